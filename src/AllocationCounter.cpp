@@ -0,0 +1,88 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef ALLOCATIONCOUNTER
+namespace {
+//Zero initialized without constructor, so it is safe to use in allocations during thread start.
+thread_local uint64_t allocations = 0;
+thread_local bool paused = false;
+}
+
+void *operator new(std::size_t size) {
+  if (!paused) allocations++;
+  void *memory = std::malloc(size == 0 ? 1 : size);
+  if (!memory) throw std::bad_alloc();
+  return memory;
+}
+
+void operator delete(void *memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+  std::free(memory);
+}
+
+AllocationCounter::Pause::Pause() {
+  _wasPaused = paused;
+  paused = true;
+}
+
+AllocationCounter::Pause::~Pause() {
+  paused = _wasPaused;
+}
+
+bool AllocationCounter::enabled() {
+  return true;
+}
+
+uint64_t AllocationCounter::threadAllocations() {
+  return allocations;
+}
+#else
+AllocationCounter::Pause::Pause() {
+}
+
+AllocationCounter::Pause::~Pause() {
+}
+
+bool AllocationCounter::enabled() {
+  return false;
+}
+
+uint64_t AllocationCounter::threadAllocations() {
+  return 0;
+}
+#endif
@@ -0,0 +1,67 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef ALLOCATIONCOUNTER_H_
+#define ALLOCATIONCOUNTER_H_
+
+#include <cstdint>
+
+/**
+ * Counts the heap allocations of each thread by replacing the global operator new. Only compiled in with
+ * "--with-allocation-counter", because every allocation pays for the counter. FrameReplay uses it to report the
+ * allocations of the gateway's receive path per forwarded frame. The packetReceived call itself (BaseLib's RPC encoder
+ * and C1Net) is excluded using Pause. For EnOcean, Z-Wave and Zigbee the count is expected to be 0 after warm-up; the
+ * culfw and CC1101 families allocate when they convert frames into strings. The report is informational, it doesn't
+ * fail.
+ */
+class AllocationCounter
+{
+public:
+	/**
+	 * Stops counting the allocations of the calling thread while it exists.
+	 */
+	class Pause
+	{
+	public:
+		Pause();
+		~Pause();
+	private:
+		bool _wasPaused = false;
+	};
+
+	static bool enabled();
+
+	/**
+	 * @return The number of allocations of the calling thread so far or 0 when the counter is not compiled in.
+	 */
+	static uint64_t threadAllocations();
+};
+
+#endif
@@ -0,0 +1,186 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "AsyncLog.h"
+#include "Gd.h"
+
+const std::array<AsyncLog::Format, 5> AsyncLog::_formats{{
+    {4, "Info: Sending packet "},
+    {4, "Info: RAW Sending packet "},
+    {5, "Debug: Packet received: "},
+    {6, "Debug: Sending: "},
+    {6, "Debug: Received: "}
+}};
+
+AsyncLog::~AsyncLog() {
+  stop();
+}
+
+void AsyncLog::start(BaseLib::SharedObjects *bl) {
+  try {
+    stop();
+    _bl = bl;
+    if (!_slots) _slots.reset(new Slot[_slotCount]);
+    for (size_t i = 0; i < _slotCount; i++) {
+      _slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    _enqueuePosition = 0;
+    _dequeuePosition = 0;
+    _stopWriter = false;
+    _async = true;
+    _bl->threadManager.start(_writerThread, true, &AsyncLog::writer, this);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void AsyncLog::stop() {
+  try {
+    if (_stopWriter) return;
+    _async = false;
+    {
+      std::lock_guard<std::mutex> writerGuard(_writerMutex);
+      _stopWriter = true;
+    }
+    _writerConditionVariable.notify_all();
+    _bl->threadManager.join(_writerThread);
+    drain();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void AsyncLog::log(LogFormat format, const uint8_t *data, size_t size) {
+  try {
+    const Format &formatInfo = _formats.at((size_t)format);
+    if (Gd::bl->debugLevel < formatInfo.level) return;
+
+    if (!_async) {
+      print(formatInfo, data, size, size);
+      return;
+    }
+
+    //Bounded MPMC queue by Dmitry Vyukov: A slot is free when its sequence equals the position.
+    uint64_t position = _enqueuePosition.load(std::memory_order_relaxed);
+    Slot *slot = nullptr;
+    while (true) {
+      slot = &_slots[position & (_slotCount - 1)];
+      int64_t difference = (int64_t)slot->sequence.load(std::memory_order_acquire) - (int64_t)position;
+      if (difference == 0) {
+        if (_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+      } else if (difference < 0) {
+        _dropped++;
+        return;
+      } else position = _enqueuePosition.load(std::memory_order_relaxed);
+    }
+
+    slot->format = (uint16_t)format;
+    slot->size = (uint16_t)std::min(size, (size_t)UINT16_MAX);
+    std::memcpy(slot->data, data, std::min(size, _payloadSize));
+    slot->sequence.store(position + 1, std::memory_order_release);
+
+    //The writer wakes up every 10 ms. Only wake it early when the ring fills up.
+    if (position - _dequeuePosition.load(std::memory_order_relaxed) == _slotCount / 2) _writerConditionVariable.notify_one();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void AsyncLog::writer() {
+  try {
+    while (!_stopWriter) {
+      {
+        std::unique_lock<std::mutex> writerLock(_writerMutex);
+        _writerConditionVariable.wait_for(writerLock, std::chrono::milliseconds(10), [&] { return (bool)_stopWriter; });
+      }
+      drain();
+    }
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void AsyncLog::drain() {
+  if (!_slots) return;
+  uint8_t data[_payloadSize];
+  while (true) {
+    uint64_t position = _dequeuePosition.load(std::memory_order_relaxed);
+    Slot &slot = _slots[position & (_slotCount - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != position + 1) break;
+
+    LogFormat format = (LogFormat)slot.format;
+    size_t size = slot.size;
+    std::memcpy(data, slot.data, std::min(size, _payloadSize));
+    slot.sequence.store(position + _slotCount, std::memory_order_release);
+    _dequeuePosition.store(position + 1, std::memory_order_relaxed);
+
+    print(_formats.at((size_t)format), data, std::min(size, _payloadSize), size);
+    _messages++;
+  }
+
+  uint64_t dropped = _dropped;
+  if (dropped != _droppedReported) {
+    Gd::out.printWarning("Warning: Log buffer full. " + std::to_string(dropped - _droppedReported) + " messages were dropped.");
+    _droppedReported = dropped;
+  }
+}
+
+void AsyncLog::print(const Format &format, const uint8_t *data, size_t size, size_t originalSize) {
+  std::string message(format.text);
+  message.append(BaseLib::HelperFunctions::getHexString(data, (uint32_t)size));
+  if (originalSize > size) message.append("... (" + std::to_string(originalSize) + " bytes)");
+  if (format.level <= 4) Gd::out.printInfo(message);
+  else Gd::out.printDebug(message, format.level);
+}
+
+size_t AsyncLog::pending() {
+  //Read the dequeue position first, so it is never ahead of the enqueue position.
+  uint64_t dequeuePosition = _dequeuePosition.load(std::memory_order_acquire);
+  uint64_t enqueuePosition = _enqueuePosition.load(std::memory_order_acquire);
+  return enqueuePosition > dequeuePosition ? (size_t)(enqueuePosition - dequeuePosition) : 0;
+}
+
+BaseLib::PVariable AsyncLog::getStatus() {
+  try {
+    auto status = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+    status->structValue->emplace("async", std::make_shared<BaseLib::Variable>((bool)_async));
+    status->structValue->emplace("messages", std::make_shared<BaseLib::Variable>((int64_t)_messages));
+    status->structValue->emplace("dropped", std::make_shared<BaseLib::Variable>((int64_t)_dropped));
+    return status;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
+}
@@ -0,0 +1,140 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef ASYNCLOG_H_
+#define ASYNCLOG_H_
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * The messages logged through AsyncLog. The text and the debug level of each are in AsyncLog::_formats.
+ */
+enum class LogFormat : uint16_t
+{
+	sendingPacket = 0,
+	rawSendingPacket = 1,
+	packetReceived = 2,
+	spiSending = 3,
+	spiReceived = 4
+};
+
+/**
+ * Logging of frames on hot paths. The debug level is checked before anything is formatted. In asynchronous mode, the
+ * caller only copies the format ID and the raw bytes into a lock-free ring buffer. A background thread formats the
+ * messages and passes them to BaseLib::Output. Without asynchronous mode, the messages are formatted and printed right
+ * away, but still only when the debug level requires it.
+ *
+ * Asynchronous messages are printed up to 10 ms later, so their time stamps and their order relative to messages printed
+ * directly through Gd::out can differ slightly. Messages are dropped when the ring is full.
+ */
+class AsyncLog
+{
+public:
+	AsyncLog() = default;
+	virtual ~AsyncLog();
+
+	/**
+	 * Starts asynchronous mode.
+	 */
+	void start(BaseLib::SharedObjects* bl);
+
+	/**
+	 * Prints all pending messages and switches back to synchronous mode.
+	 */
+	void stop();
+
+	/**
+	 * Logs a message followed by the data in hex. Thread safe and lock free.
+	 */
+	void log(LogFormat format, const uint8_t* data, size_t size);
+	void log(LogFormat format, const std::vector<uint8_t>& data) { log(format, data.data(), data.size()); }
+
+	/**
+	 * @return The number of messages waiting for the writer thread.
+	 */
+	size_t pending();
+
+	BaseLib::PVariable getStatus();
+private:
+	struct Format
+	{
+		int32_t level;
+		const char* text;
+	};
+
+	static const std::array<Format, 5> _formats;
+
+	static constexpr size_t _slotCount = 1024;
+
+	/**
+	 * The bytes stored per message. Longer data is truncated.
+	 */
+	static constexpr size_t _payloadSize = 244;
+
+	struct Slot
+	{
+		/**
+		 * The position the slot can be written at or, if one higher, the position it can be read from.
+		 */
+		std::atomic<uint64_t> sequence{0};
+		uint16_t format = 0;
+		uint16_t size = 0;
+		uint8_t data[_payloadSize];
+	};
+
+	BaseLib::SharedObjects* _bl = nullptr;
+	std::unique_ptr<Slot[]> _slots;
+	std::atomic_bool _async{false};
+	alignas(64) std::atomic<uint64_t> _enqueuePosition{0};
+	alignas(64) std::atomic<uint64_t> _dequeuePosition{0};
+	std::atomic<uint64_t> _messages{0};
+	std::atomic<uint64_t> _dropped{0};
+	std::atomic<uint64_t> _droppedReported{0};
+
+	std::mutex _writerMutex;
+	std::condition_variable _writerConditionVariable;
+	std::atomic_bool _stopWriter{true};
+	std::thread _writerThread;
+
+	void writer();
+
+	/**
+	 * Prints all complete messages in the ring. Only called by the writer thread or after it was stopped.
+	 */
+	void drain();
+
+	/**
+	 * @param size The number of bytes in data.
+	 * @param originalSize The size of the logged data before it was truncated.
+	 */
+	static void print(const Format& format, const uint8_t* data, size_t size, size_t originalSize);
+};
+
+#endif
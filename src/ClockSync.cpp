@@ -0,0 +1,258 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "ClockSync.h"
+#include "Gd.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+int64_t monotonicTime() {
+  timespec time{};
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (int64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+bool getTime(const BaseLib::PVariable &value, int64_t &time) {
+  if (!value) return false;
+  if (value->type == BaseLib::VariableType::tInteger64) time = value->integerValue64;
+  else if (value->type == BaseLib::VariableType::tInteger) time = value->integerValue;
+  else return false;
+  return true;
+}
+}
+
+ClockSync::ClockSync(BaseLib::SharedObjects *bl) {
+  _bl = bl;
+}
+
+ClockSync::~ClockSync() {
+  stop();
+}
+
+void ClockSync::start(int32_t interval) {
+  try {
+    stop();
+    if (interval <= 0) return;
+    _interval = (int64_t)interval * 1000000000;
+    _stopSyncThread = false;
+    _bl->threadManager.start(_syncThread, true, &ClockSync::syncThread, this);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void ClockSync::stop() {
+  try {
+    {
+      std::lock_guard<std::mutex> syncGuard(_syncMutex);
+      _stopSyncThread = true;
+    }
+    _syncConditionVariable.notify_all();
+    _bl->threadManager.join(_syncThread);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+bool ClockSync::wait(int64_t nanoseconds) {
+  std::unique_lock<std::mutex> syncLock(_syncMutex);
+  _syncConditionVariable.wait_for(syncLock, std::chrono::nanoseconds(nanoseconds), [&] { return (bool)_stopSyncThread; });
+  return !_stopSyncThread;
+}
+
+void ClockSync::syncThread() {
+  bool connected = false;
+  bool unsupportedLogged = false;
+  while (!_stopSyncThread) {
+    try {
+      if (!Gd::rpcServer || !Gd::rpcServer->isClientConnected()) {
+        if (connected) {
+          //The next client might run on another host.
+          std::lock_guard<std::mutex> samplesGuard(_samplesMutex);
+          _samples.clear();
+          _drift = 0;
+          _driftKnown = false;
+          _discardedBursts = 0;
+          connected = false;
+        }
+        if (!wait(1000000000)) return;
+        continue;
+      }
+      connected = true;
+
+      if (synchronize()) unsupportedLogged = false;
+      else if (!unsupportedLogged) {
+        Gd::out.printInfo("Info: Homegear doesn't answer clockSync. The clock offset is not available.");
+        unsupportedLogged = true;
+      }
+      if (!wait(_interval)) return;
+    }
+    catch (const std::exception &ex) {
+      Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+  }
+}
+
+bool ClockSync::synchronize() {
+  Sample best;
+  bool haveSample = false;
+  for (size_t i = 0; i < _burstSize && !_stopSyncThread; i++) {
+    auto parameters = std::make_shared<BaseLib::Array>();
+    int64_t t1 = monotonicTime();
+    parameters->push_back(std::make_shared<BaseLib::Variable>(t1));
+    auto result = Gd::rpcServer->invoke("clockSync", parameters);
+    int64_t t4 = monotonicTime();
+    _exchanges++;
+
+    int64_t t2 = 0;
+    int64_t t3 = 0;
+    bool valid = false;
+    if (!result->errorStruct) {
+      if (result->type == BaseLib::VariableType::tStruct) {
+        auto receiveIterator = result->structValue->find("receive");
+        auto transmitIterator = result->structValue->find("transmit");
+        valid = receiveIterator != result->structValue->end() && transmitIterator != result->structValue->end() && getTime(receiveIterator->second, t2) && getTime(transmitIterator->second, t3);
+      } else {
+        valid = getTime(result, t2);
+        t3 = t2;
+      }
+    }
+    if (!valid) {
+      _failedExchanges++;
+      if (i == 0) return false;
+      continue;
+    }
+
+    Sample sample;
+    sample.monotonic = t1 + (t4 - t1) / 2;
+    sample.delay = std::max((int64_t)0, (t4 - t1) - (t3 - t2));
+    sample.offset = ((t2 - t1) + (t3 - t4)) / 2;
+    if (!haveSample || sample.delay < best.delay) best = sample;
+    haveSample = true;
+
+    if (!wait(10000000)) break;
+  }
+
+  if (haveSample) addSample(best);
+  return true;
+}
+
+void ClockSync::addSample(const Sample &sample) {
+  std::lock_guard<std::mutex> samplesGuard(_samplesMutex);
+  if (!_samples.empty() && _discardedBursts < 3) {
+    int64_t minDelay = std::min_element(_samples.begin(), _samples.end(), [](const Sample &a, const Sample &b) { return a.delay < b.delay; })->delay;
+    //1 ms of slack, so jitter on a fast link doesn't discard everything. After three discarded bursts in a row, the
+    //path has probably changed.
+    if ((double)sample.delay > (double)minDelay * _maxDelayFactor + 1000000) {
+      _discardedBursts++;
+      _rejectedBursts++;
+      return;
+    }
+  }
+  _discardedBursts = 0;
+
+  _samples.push_back(sample);
+  while (_samples.size() > _maxSamples) _samples.pop_front();
+  updateDrift();
+}
+
+void ClockSync::updateDrift() {
+  if (_samples.size() < 4) {
+    _drift = 0;
+    _driftKnown = false;
+    return;
+  }
+
+  //Least squares fit of the offset over the monotonic time. Relative to the first sample to keep the precision.
+  double meanX = 0;
+  double meanY = 0;
+  for (auto &sample : _samples) {
+    meanX += (double)(sample.monotonic - _samples.front().monotonic);
+    meanY += (double)(sample.offset - _samples.front().offset);
+  }
+  meanX /= _samples.size();
+  meanY /= _samples.size();
+
+  double numerator = 0;
+  double denominator = 0;
+  for (auto &sample : _samples) {
+    double x = (double)(sample.monotonic - _samples.front().monotonic) - meanX;
+    double y = (double)(sample.offset - _samples.front().offset) - meanY;
+    numerator += x * y;
+    denominator += x * x;
+  }
+  if (denominator <= 0) return;
+  _drift = numerator / denominator;
+  _driftKnown = true;
+}
+
+BaseLib::PVariable ClockSync::getClockOffset(BaseLib::PArray &parameters) {
+  try {
+    auto result = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+    int64_t now = monotonicTime();
+    result->structValue->emplace("monotonic", std::make_shared<BaseLib::Variable>(now));
+
+    std::lock_guard<std::mutex> samplesGuard(_samplesMutex);
+    result->structValue->emplace("valid", std::make_shared<BaseLib::Variable>(!_samples.empty()));
+    result->structValue->emplace("samples", std::make_shared<BaseLib::Variable>((int32_t)_samples.size()));
+    if (_samples.empty()) return result;
+
+    //The sample with the shortest round trip is the least affected by asymmetry.
+    auto &best = *std::min_element(_samples.begin(), _samples.end(), [](const Sample &a, const Sample &b) { return a.delay < b.delay; });
+    int64_t age = now - best.monotonic;
+    int64_t offset = best.offset + std::llround(_drift * (double)age);
+    int64_t errorBound = best.delay / 2 + std::llround(std::abs((double)age) * (_driftKnown ? _knownDriftTolerance : _unknownDriftTolerance) / 1000000.0);
+
+    result->structValue->emplace("offset", std::make_shared<BaseLib::Variable>(offset));
+    result->structValue->emplace("errorBound", std::make_shared<BaseLib::Variable>(errorBound));
+    result->structValue->emplace("drift", std::make_shared<BaseLib::Variable>(_drift * 1000000.0));
+    result->structValue->emplace("delay", std::make_shared<BaseLib::Variable>(best.delay));
+    result->structValue->emplace("lastSync", std::make_shared<BaseLib::Variable>(_samples.back().monotonic));
+    return result;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
+}
+
+BaseLib::PVariable ClockSync::getStatus() {
+  auto parameters = std::make_shared<BaseLib::Array>();
+  auto status = getClockOffset(parameters);
+  if (status->errorStruct) return status;
+  status->structValue->emplace("exchanges", std::make_shared<BaseLib::Variable>((int64_t)_exchanges));
+  status->structValue->emplace("failedExchanges", std::make_shared<BaseLib::Variable>((int64_t)_failedExchanges));
+  status->structValue->emplace("rejectedBursts", std::make_shared<BaseLib::Variable>((int64_t)_rejectedBursts));
+  return status;
+}
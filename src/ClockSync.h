@@ -0,0 +1,121 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef CLOCKSYNC_H_
+#define CLOCKSYNC_H_
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Estimates the offset between the gateway's CLOCK_MONOTONIC and Homegear's wall clock, so Homegear can translate the
+ * receive timestamps of frames (see ReceiveTime) into its own time. The monotonic clock is used instead of the wall
+ * clock, because many gateways run without NTP and their wall clock may be stepped at any time.
+ *
+ * Works like NTP: Every interval the gateway calls "clockSync" several times in a row. Homegear answers with its wall
+ * clock time in nanoseconds, either as integer or as struct with the elements "receive" and "transmit". Queueing behind
+ * other RPC calls makes a round trip asymmetric, so only the exchange with the shortest round trip of every burst is
+ * kept, and bursts much slower than the fastest recent one are discarded. The drift is the slope of a least squares fit
+ * over the kept samples. The error bound is half the round trip plus the worst case drift since the sample was taken.
+ */
+class ClockSync
+{
+public:
+	ClockSync(BaseLib::SharedObjects* bl);
+	virtual ~ClockSync();
+
+	/**
+	 * @param interval The time in seconds between two bursts of exchanges.
+	 */
+	void start(int32_t interval);
+	void stop();
+
+	/**
+	 * Returns the current estimate: "valid", "offset" (Homegear's wall clock minus the gateway's monotonic clock in ns),
+	 * "errorBound" (ns), "drift" (ppm), "delay" (round trip of the best sample in ns), "samples", "monotonic" (the
+	 * gateway's monotonic clock the estimate is for) and "lastSync" (monotonic time of the last kept sample).
+	 */
+	BaseLib::PVariable getClockOffset(BaseLib::PArray& parameters);
+
+	BaseLib::PVariable getStatus();
+private:
+	struct Sample
+	{
+		int64_t monotonic = 0; //Middle of the exchange
+		int64_t offset = 0;
+		int64_t delay = 0;
+	};
+
+	static const size_t _burstSize = 8;
+	static const size_t _maxSamples = 8;
+
+	/**
+	 * Bursts with a delay above this factor of the best recent delay are considered asymmetric and discarded.
+	 */
+	static constexpr double _maxDelayFactor = 2.0;
+
+	/**
+	 * The drift assumed for the error bound in ppm: typical crystal tolerance before the drift is known, the remaining
+	 * uncertainty afterwards.
+	 */
+	static constexpr double _unknownDriftTolerance = 100.0;
+	static constexpr double _knownDriftTolerance = 10.0;
+
+	BaseLib::SharedObjects* _bl = nullptr;
+	int64_t _interval = 0;
+
+	std::atomic_bool _stopSyncThread{true};
+	std::mutex _syncMutex;
+	std::condition_variable _syncConditionVariable;
+	std::thread _syncThread;
+
+	std::mutex _samplesMutex;
+	std::deque<Sample> _samples;
+	double _drift = 0; //ns per ns
+	bool _driftKnown = false;
+	uint32_t _discardedBursts = 0;
+
+	std::atomic<uint64_t> _exchanges{0};
+	std::atomic<uint64_t> _failedExchanges{0};
+	std::atomic<uint64_t> _rejectedBursts{0};
+
+	bool wait(int64_t nanoseconds);
+	void syncThread();
+
+	/**
+	 * Does one burst of exchanges.
+	 *
+	 * @return Returns false when Homegear doesn't answer clockSync.
+	 */
+	bool synchronize();
+	void addSample(const Sample& sample);
+	void updateDrift();
+};
+
+#endif
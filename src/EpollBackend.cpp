@@ -0,0 +1,113 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "EpollBackend.h"
+#include "Gd.h"
+
+EpollBackend::EpollBackend(BaseLib::SharedObjects *bl) : IoBackend(bl) {
+  _epollDescriptor = std::make_shared<BaseLib::FileDescriptor>();
+}
+
+EpollBackend::~EpollBackend() {
+  _bl->fileDescriptorManager.close(_epollDescriptor);
+}
+
+bool EpollBackend::init() {
+  _epollDescriptor = _bl->fileDescriptorManager.add(epoll_create1(EPOLL_CLOEXEC));
+  if (_epollDescriptor->descriptor == -1) {
+    Gd::out.printError("Error: Could not create epoll descriptor: " + std::string(strerror(errno)));
+    return false;
+  }
+  return initWakeUp();
+}
+
+bool EpollBackend::add(int32_t fileDescriptor, uint32_t events, EventCallback callback) {
+  try {
+    if (fileDescriptor == -1) return false;
+    std::lock_guard<std::mutex> callbacksGuard(_callbacksMutex);
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = fileDescriptor;
+    if (epoll_ctl(_epollDescriptor->descriptor, EPOLL_CTL_ADD, fileDescriptor, &event) == -1) {
+      if (errno != EEXIST || epoll_ctl(_epollDescriptor->descriptor, EPOLL_CTL_MOD, fileDescriptor, &event) == -1) {
+        Gd::out.printError("Error: Could not add descriptor to epoll: " + std::string(strerror(errno)));
+        return false;
+      }
+    }
+    _callbacks[fileDescriptor] = std::make_shared<EventCallback>(std::move(callback));
+    return true;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return false;
+}
+
+bool EpollBackend::remove(int32_t fileDescriptor) {
+  try {
+    std::lock_guard<std::mutex> callbacksGuard(_callbacksMutex);
+    _callbacks.erase(fileDescriptor);
+    //Fails when the descriptor was closed already. The kernel removes closed descriptors automatically.
+    return epoll_ctl(_epollDescriptor->descriptor, EPOLL_CTL_DEL, fileDescriptor, nullptr) == 0;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return false;
+}
+
+int32_t EpollBackend::wait(int32_t timeout) {
+  try {
+    int32_t eventCount = epoll_wait(_epollDescriptor->descriptor, _events.data(), _events.size(), timeout);
+    if (eventCount == -1) {
+      if (errno == EINTR) return 0;
+      Gd::out.printError("Error: epoll_wait failed: " + std::string(strerror(errno)));
+      return -1;
+    }
+
+    int32_t dispatchedEvents = 0;
+    for (int32_t i = 0; i < eventCount; i++) {
+      std::shared_ptr<EventCallback> callback;
+      {
+        std::lock_guard<std::mutex> callbacksGuard(_callbacksMutex);
+        auto callbackIterator = _callbacks.find(_events[i].data.fd);
+        if (callbackIterator == _callbacks.end()) continue;
+        callback = callbackIterator->second;
+      }
+      (*callback)(_events[i].data.fd, _events[i].events);
+      if (_events[i].data.fd != _wakeUpDescriptor->descriptor) dispatchedEvents++;
+    }
+    return dispatchedEvents;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return -1;
+}
@@ -0,0 +1,58 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef EPOLLBACKEND_H_
+#define EPOLLBACKEND_H_
+
+#include "IoBackend.h"
+
+#include <sys/epoll.h>
+
+class EpollBackend : public IoBackend
+{
+public:
+	EpollBackend(BaseLib::SharedObjects* bl);
+	virtual ~EpollBackend();
+
+	virtual std::string name() { return "epoll"; }
+
+	virtual bool add(int32_t fileDescriptor, uint32_t events, EventCallback callback);
+	virtual bool remove(int32_t fileDescriptor);
+	virtual int32_t wait(int32_t timeout);
+protected:
+	virtual bool init();
+private:
+	BaseLib::PFileDescriptor _epollDescriptor;
+	std::mutex _callbacksMutex;
+	std::unordered_map<int32_t, std::shared_ptr<EventCallback>> _callbacks;
+	std::array<struct epoll_event, 32> _events;
+};
+
+#endif
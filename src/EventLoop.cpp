@@ -0,0 +1,182 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "EventLoop.h"
+#include "Gd.h"
+
+#include <sys/timerfd.h>
+
+EventLoop::EventLoop(BaseLib::SharedObjects *bl) {
+  _bl = bl;
+}
+
+EventLoop::~EventLoop() {
+  try {
+    stop();
+    std::lock_guard<std::mutex> timersGuard(_timersMutex);
+    for (auto &timer : _timers) {
+      _bl->fileDescriptorManager.close(timer.second);
+    }
+    _timers.clear();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+bool EventLoop::init() {
+  _backend = IoBackend::create(_bl);
+  if (!_backend) return false;
+  Gd::out.printInfo("Info: Event loop is using " + _backend->name() + ".");
+  return true;
+}
+
+void EventLoop::run() {
+  try {
+    if (!_backend) return;
+    _loopThreadId = std::this_thread::get_id();
+    while (!_stopLoop) {
+      if (_backend->wait(-1) == -1) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      _wakeUps++;
+    }
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  _loopThreadId = std::thread::id();
+}
+
+void EventLoop::stop() {
+  _stopLoop = true;
+  if (_backend) _backend->wakeUp();
+}
+
+bool EventLoop::addDescriptor(int32_t fileDescriptor, uint32_t events, IoBackend::EventCallback callback) {
+  try {
+    if (!_backend || fileDescriptor == -1) return false;
+    auto active = std::make_shared<std::atomic_bool>(true);
+    {
+      std::lock_guard<std::mutex> registrationsGuard(_registrationsMutex);
+      auto registrationIterator = _registrations.find(fileDescriptor);
+      if (registrationIterator != _registrations.end()) *registrationIterator->second = false;
+      _registrations[fileDescriptor] = active;
+    }
+    return _backend->add(fileDescriptor, events, [this, active, callback](int32_t fileDescriptor, uint32_t events) {
+      std::lock_guard<std::recursive_mutex> dispatchGuard(_dispatchMutex);
+      if (!*active) return;
+      callback(fileDescriptor, events);
+    });
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return false;
+}
+
+void EventLoop::removeDescriptor(int32_t fileDescriptor) {
+  try {
+    if (!_backend || fileDescriptor == -1) return;
+    std::lock_guard<std::recursive_mutex> dispatchGuard(_dispatchMutex);
+    {
+      std::lock_guard<std::mutex> registrationsGuard(_registrationsMutex);
+      auto registrationIterator = _registrations.find(fileDescriptor);
+      if (registrationIterator == _registrations.end()) return;
+      *registrationIterator->second = false;
+      _registrations.erase(registrationIterator);
+    }
+    _backend->remove(fileDescriptor);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+int32_t EventLoop::addTimer(int32_t delay, int32_t interval, TimerCallback callback) {
+  try {
+    auto timerDescriptor = _bl->fileDescriptorManager.add(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+    if (timerDescriptor->descriptor == -1) {
+      Gd::out.printError("Error: Could not create timer: " + std::string(strerror(errno)));
+      return -1;
+    }
+
+    if (delay <= 0) delay = 1; //A value of 0 disarms the timer.
+    struct itimerspec timerSpec{};
+    timerSpec.it_value.tv_sec = delay / 1000;
+    timerSpec.it_value.tv_nsec = (delay % 1000) * 1000000;
+    timerSpec.it_interval.tv_sec = interval / 1000;
+    timerSpec.it_interval.tv_nsec = (interval % 1000) * 1000000;
+    if (timerfd_settime(timerDescriptor->descriptor, 0, &timerSpec, nullptr) == -1) {
+      Gd::out.printError("Error: Could not set timer: " + std::string(strerror(errno)));
+      _bl->fileDescriptorManager.close(timerDescriptor);
+      return -1;
+    }
+
+    int32_t timerId = 0;
+    {
+      std::lock_guard<std::mutex> timersGuard(_timersMutex);
+      timerId = _currentTimerId++;
+      if (_currentTimerId < 0) _currentTimerId = 0;
+      _timers.emplace(timerId, timerDescriptor);
+    }
+
+    if (!addDescriptor(timerDescriptor->descriptor, POLLIN, [this, timerId, interval, callback](int32_t fileDescriptor, uint32_t events) {
+      uint64_t expirations = 0;
+      if (read(fileDescriptor, &expirations, sizeof(expirations)) != sizeof(expirations)) return;
+      if (interval == 0) removeTimer(timerId);
+      callback();
+    })) {
+      removeTimer(timerId);
+      return -1;
+    }
+    return timerId;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return -1;
+}
+
+void EventLoop::removeTimer(int32_t timerId) {
+  try {
+    BaseLib::PFileDescriptor timerDescriptor;
+    {
+      std::lock_guard<std::mutex> timersGuard(_timersMutex);
+      auto timerIterator = _timers.find(timerId);
+      if (timerIterator == _timers.end()) return;
+      timerDescriptor = timerIterator->second;
+      _timers.erase(timerIterator);
+    }
+    removeDescriptor(timerDescriptor->descriptor);
+    _bl->fileDescriptorManager.close(timerDescriptor);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
@@ -0,0 +1,99 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef EVENTLOOP_H_
+#define EVENTLOOP_H_
+
+#include "IoBackend.h"
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Single threaded reactor used when "eventLoop" is enabled in gateway.conf. Subsystems register their descriptors and
+ * timers (timerfd) here instead of running their own blocking threads. All callbacks are executed on the thread calling
+ * run(), so they must not block.
+ */
+class EventLoop
+{
+public:
+	typedef std::function<void()> TimerCallback;
+
+	EventLoop(BaseLib::SharedObjects* bl);
+	virtual ~EventLoop();
+
+	bool init();
+
+	/**
+	 * Dispatches events until stop() is called.
+	 */
+	void run();
+	void stop();
+
+	bool isLoopThread() { return std::this_thread::get_id() == _loopThreadId; }
+
+	/**
+	 * @return The number of times the loop thread woke up since start.
+	 */
+	uint64_t wakeUps() { return _wakeUps; }
+
+	bool addDescriptor(int32_t fileDescriptor, uint32_t events, IoBackend::EventCallback callback);
+
+	/**
+	 * Unregisters a descriptor. When called from another thread, it blocks until a running callback returned, so the
+	 * callback is guaranteed to not be executed anymore after this method returns.
+	 */
+	void removeDescriptor(int32_t fileDescriptor);
+
+	/**
+	 * Adds a timer.
+	 *
+	 * @param delay The time in milliseconds until the timer fires for the first time.
+	 * @param interval The interval in milliseconds. When 0 the timer fires once and is removed automatically.
+	 * @return The ID of the timer or -1 on error.
+	 */
+	int32_t addTimer(int32_t delay, int32_t interval, TimerCallback callback);
+	void removeTimer(int32_t timerId);
+private:
+	BaseLib::SharedObjects* _bl = nullptr;
+	std::unique_ptr<IoBackend> _backend;
+	std::atomic_bool _stopLoop{false};
+	std::thread::id _loopThreadId;
+	std::atomic<uint64_t> _wakeUps{0};
+
+	std::recursive_mutex _dispatchMutex;
+	std::mutex _registrationsMutex;
+	std::unordered_map<int32_t, std::shared_ptr<std::atomic_bool>> _registrations;
+
+	std::mutex _timersMutex;
+	int32_t _currentTimerId = 0;
+	std::unordered_map<int32_t, BaseLib::PFileDescriptor> _timers;
+};
+
+#endif
@@ -0,0 +1,160 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "AddressFilter.h"
+#include "../Gd.h"
+
+namespace {
+bool isInteger(const BaseLib::PVariable &value) {
+  return value->type == BaseLib::VariableType::tInteger || value->type == BaseLib::VariableType::tInteger64;
+}
+
+int64_t getInteger(const BaseLib::PVariable &value) {
+  return value->type == BaseLib::VariableType::tInteger64 ? value->integerValue64 : value->integerValue;
+}
+}
+
+AddressFilter::AddressFilter(BaseLib::SharedObjects *bl, std::string name) {
+  _bl = bl;
+  _name = std::move(name);
+  _subscriptions = std::make_shared<Subscriptions>();
+}
+
+bool AddressFilter::forward(uint32_t sender, uint32_t destination, uint8_t messageType) {
+  if (!_enabled.load(std::memory_order_acquire)) {
+    _framesForwarded++;
+    return true;
+  }
+
+  std::shared_ptr<const Subscriptions> subscriptions;
+  {
+    std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+    subscriptions = _subscriptions;
+  }
+
+  auto subscriptionIterator = subscriptions->find(sender);
+  if (subscriptionIterator == subscriptions->end() || !subscriptionIterator->second.test(messageType)) subscriptionIterator = subscriptions->find(destination);
+  if (subscriptionIterator != subscriptions->end() && subscriptionIterator->second.test(messageType)) {
+    _framesForwarded++;
+    return true;
+  }
+
+  _framesDropped++;
+  return false;
+}
+
+bool AddressFilter::forwardHexFrame(const std::string &packetHex) {
+  if (!_enabled.load(std::memory_order_acquire) || packetHex.size() < 20) {
+    _framesForwarded++;
+    return true;
+  }
+  return forward((uint32_t)BaseLib::Math::getNumber(packetHex.substr(8, 6), true), (uint32_t)BaseLib::Math::getNumber(packetHex.substr(14, 6), true), (uint8_t)BaseLib::Math::getNumber(packetHex.substr(6, 2), true));
+}
+
+BaseLib::PVariable AddressFilter::setSubscriptions(BaseLib::PArray &parameters) {
+  try {
+    if (parameters->size() != 2 || parameters->at(1)->type != BaseLib::VariableType::tArray) return BaseLib::Variable::createError(-1, "Invalid parameters.");
+
+    auto subscriptions = std::make_shared<Subscriptions>();
+    subscriptions->reserve(parameters->at(1)->arrayValue->size());
+    for (auto &element : *parameters->at(1)->arrayValue) {
+      if (isInteger(element)) {
+        (*subscriptions)[(uint32_t)getInteger(element)].set();
+        continue;
+      }
+      if (element->type != BaseLib::VariableType::tStruct) return BaseLib::Variable::createError(-1, "Subscription is neither an address nor a struct.");
+
+      auto addressIterator = element->structValue->find("address");
+      if (addressIterator == element->structValue->end() || !isInteger(addressIterator->second)) return BaseLib::Variable::createError(-1, "Subscription has no valid element \"address\".");
+      auto &messageTypes = (*subscriptions)[(uint32_t)getInteger(addressIterator->second)];
+
+      auto messageTypesIterator = element->structValue->find("messageTypes");
+      if (messageTypesIterator != element->structValue->end() && messageTypesIterator->second->type != BaseLib::VariableType::tArray) return BaseLib::Variable::createError(-1, "Element \"messageTypes\" is not an array.");
+      if (messageTypesIterator == element->structValue->end() || messageTypesIterator->second->arrayValue->empty()) {
+        messageTypes.set();
+        continue;
+      }
+      for (auto &messageType : *messageTypesIterator->second->arrayValue) {
+        if (!isInteger(messageType) || getInteger(messageType) < 0 || getInteger(messageType) > 255) return BaseLib::Variable::createError(-1, "Message types need to be integers between 0 and 255.");
+        messageTypes.set((size_t)getInteger(messageType));
+      }
+    }
+
+    size_t size = subscriptions->size();
+    {
+      std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+      _subscriptions = std::move(subscriptions);
+    }
+    _enabled.store(size > 0, std::memory_order_release);
+    Gd::out.printInfo("Info: " + _name + ": " + (size > 0 ? "Forwarding frames of " + std::to_string(size) + " subscribed addresses only." : "Address filter disabled."));
+
+    return std::make_shared<BaseLib::Variable>();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
+}
+
+BaseLib::PVariable AddressFilter::getSubscriptions(BaseLib::PArray &parameters) {
+  try {
+    std::shared_ptr<const Subscriptions> subscriptions;
+    {
+      std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+      subscriptions = _subscriptions;
+    }
+
+    auto subscriptionArray = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tArray);
+    subscriptionArray->arrayValue->reserve(subscriptions->size());
+    for (auto &subscription : *subscriptions) {
+      auto subscriptionStruct = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+      subscriptionStruct->structValue->emplace("address", std::make_shared<BaseLib::Variable>((int64_t)subscription.first));
+      if (!subscription.second.all()) {
+        auto messageTypes = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tArray);
+        for (size_t i = 0; i < subscription.second.size(); i++) {
+          if (subscription.second.test(i)) messageTypes->arrayValue->push_back(std::make_shared<BaseLib::Variable>((int32_t)i));
+        }
+        subscriptionStruct->structValue->emplace("messageTypes", messageTypes);
+      }
+      subscriptionArray->arrayValue->push_back(subscriptionStruct);
+    }
+
+    auto result = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+    result->structValue->emplace("enabled", std::make_shared<BaseLib::Variable>((bool)_enabled));
+    result->structValue->emplace("subscriptions", subscriptionArray);
+    result->structValue->emplace("framesForwarded", std::make_shared<BaseLib::Variable>((int64_t)_framesForwarded));
+    result->structValue->emplace("framesDropped", std::make_shared<BaseLib::Variable>((int64_t)_framesDropped));
+    return result;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
+}
@@ -0,0 +1,93 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_ADDRESSFILTER_H
+#define HOMEGEAR_GATEWAY_ADDRESSFILTER_H
+
+#include <homegear-base/BaseLib.h>
+
+#include <bitset>
+
+/**
+ * Drops received frames of devices Homegear is not interested in, e. g. the neighbours' devices in an apartment
+ * building. Homegear pushes the addresses it cares about with setSubscriptions(). Every address can be limited to a
+ * set of message types (RORG for EnOcean, message type for BidCoS and MAX!). While no address is subscribed, all
+ * frames are forwarded. Destinations are matched as well, so subscribing the own address (or, while pairing, the
+ * broadcast address) passes frames addressed to it.
+ *
+ * The receive path only reads an immutable snapshot of the subscriptions, so updating them doesn't block it.
+ */
+class AddressFilter
+{
+public:
+    AddressFilter(BaseLib::SharedObjects* bl, std::string name);
+    virtual ~AddressFilter() = default;
+
+    /**
+     * Checks a received frame. A frame is forwarded when its sender or its destination is subscribed for the message type.
+     *
+     * @return Returns true when the frame needs to be passed to Homegear.
+     */
+    bool forward(uint32_t sender, uint32_t destination, uint8_t messageType);
+
+    /**
+     * Like forward() for BidCoS and MAX! frames in hex, which share their layout: length, message counter, flags, message
+     * type, sender (3 bytes), destination (3 bytes), payload. Frames too short to contain the addresses are forwarded.
+     */
+    bool forwardHexFrame(const std::string& packetHex);
+
+//{{{ RPC methods
+    /**
+     * Replaces all subscriptions. Parameters: family ID, array of subscriptions. A subscription is either an address
+     * (all message types) or a struct with the elements "address" and "messageTypes" (array of integers). An empty
+     * array disables filtering.
+     */
+    BaseLib::PVariable setSubscriptions(BaseLib::PArray& parameters);
+
+    /**
+     * Returns the subscriptions and the number of forwarded and dropped frames.
+     */
+    BaseLib::PVariable getSubscriptions(BaseLib::PArray& parameters);
+//}}}
+private:
+    typedef std::unordered_map<uint32_t, std::bitset<256>> Subscriptions;
+
+    BaseLib::SharedObjects* _bl = nullptr;
+    std::string _name;
+
+    std::atomic_bool _enabled{false};
+    std::mutex _subscriptionsMutex;
+    std::shared_ptr<const Subscriptions> _subscriptions;
+
+    std::atomic<uint64_t> _framesForwarded{0};
+    std::atomic<uint64_t> _framesDropped{0};
+};
+
+#endif
@@ -29,12 +29,15 @@
 */
 
 #include "Cc110LTest.h"
+#include "FamilyModule.h"
 
 #ifdef SPISUPPORT
 #include "../Gd.h"
+#include "../IoBackend.h"
+#include "../RealTime.h"
 #include <sys/poll.h>
 
-Cc110LTest::Cc110LTest(BaseLib::SharedObjects* bl) : ICommunicationInterface(bl)
+Cc110LTest::Cc110LTest(BaseLib::SharedObjects* bl, const InterfaceSettings& settings) : ICommunicationInterface(bl, settings)
 {
     try
     {
@@ -49,13 +52,13 @@ Cc110LTest::Cc110LTest(BaseLib::SharedObjects* bl) : ICommunicationInterface(bl)
         _updateMode = false;
         _gpio.reset(new BaseLib::LowLevel::Gpio(bl, Gd::settings.gpioPath()));
 
-        _localRpcMethods.emplace("sendPacket", std::bind(&Cc110LTest::sendPacket, this, std::placeholders::_1));
-        _localRpcMethods.emplace("txTest", std::bind(&Cc110LTest::startTx, this, std::placeholders::_1));
-        _localRpcMethods.emplace("startTx", std::bind(&Cc110LTest::startTx, this, std::placeholders::_1));
-        _localRpcMethods.emplace("stopTx", std::bind(&Cc110LTest::stopTx, this, std::placeholders::_1));
+        registerRpcMethod(RpcMethod::sendPacket, std::bind(&Cc110LTest::sendPacket, this, std::placeholders::_1));
+        registerRpcMethod(RpcMethod::txTest, std::bind(&Cc110LTest::startTx, this, std::placeholders::_1));
+        registerRpcMethod(RpcMethod::startTx, std::bind(&Cc110LTest::startTx, this, std::placeholders::_1));
+        registerRpcMethod(RpcMethod::stopTx, std::bind(&Cc110LTest::stopTx, this, std::placeholders::_1));
 
-        _oscillatorFrequency = Gd::settings.oscillatorFrequency();
-        _interruptPin = Gd::settings.interruptPin();
+        _oscillatorFrequency = _settings.oscillatorFrequency;
+        _interruptPin = _settings.interruptPin;
 
         if(_oscillatorFrequency < 0) _oscillatorFrequency = 26000000;
         if(_interruptPin != 0 && _interruptPin != 2)
@@ -92,7 +95,9 @@ void Cc110LTest::start()
 {
     try
     {
-        if(Gd::settings.device().empty())
+        if(replaying()) return; //Frames are fed in by FrameReplay. Don't open the device.
+
+        if(_settings.device.empty())
         {
             Gd::out.printError("Error: No device defined for family HomeMatic BidCoS CC1101. Please specify it in \"gateway.conf\".");
             return;
@@ -103,7 +108,7 @@ void Cc110LTest::start()
         _stopped = false;
         _firstPacket = true;
         _stopCallbackThread = false;
-        Gd::bl->threadManager.start(_listenThread, true, 45, SCHED_FIFO, &Cc110LTest::mainThread, this);
+        Gd::bl->threadManager.start(_listenThread, true, &Cc110LTest::mainThread, this);
     }
     catch(const std::exception& ex)
     {
@@ -121,8 +126,8 @@ void Cc110LTest::stop()
         _stopTxThread = true;
         Gd::bl->threadManager.join(_txThread);
         _stopTxThread = false;
-        if(_fileDescriptor->descriptor != -1) closeDevice();
-        _gpio->closeDevice(Gd::settings.gpio1());
+        if(_fileDescriptor && _fileDescriptor->descriptor != -1) closeDevice();
+        _gpio->closeDevice(_settings.gpio1);
         _stopped = true;
     }
     catch(const std::exception& ex)
@@ -135,9 +140,16 @@ void Cc110LTest::mainThread()
 {
     try
     {
+        RealTime::apply(RealTime::Subsystem::cc1101);
         int32_t pollResult;
         int32_t bytesRead;
         std::vector<char> readBuffer({'0'});
+        std::unique_ptr<IoBackend> ioBackend = IoBackend::create(Gd::bl.get());
+        if(!ioBackend)
+        {
+            Gd::out.printError("Error: Could not create I/O backend.");
+            return;
+        }
 
         while(!_stopCallbackThread)
         {
@@ -148,7 +160,7 @@ void Cc110LTest::mainThread()
                     std::this_thread::sleep_for(std::chrono::milliseconds(200));
                     continue;
                 }
-                if(!_stopCallbackThread && (_fileDescriptor->descriptor == -1 || !_gpio->isOpen(Gd::settings.gpio1())))
+                if(!_stopCallbackThread && (_fileDescriptor->descriptor == -1 || !_gpio->isOpen(_settings.gpio1)))
                 {
                     Gd::out.printError("Connection to TI CC1101 closed unexpectedly... Trying to reconnect...");
                     _stopped = true; //Set to true, so that sendPacket aborts
@@ -159,19 +171,13 @@ void Cc110LTest::mainThread()
                     }
                     _txMutex.unlock(); //Make sure _txMutex is unlocked
 
-                    _gpio->closeDevice(Gd::settings.gpio1());
+                    _gpio->closeDevice(_settings.gpio1);
                     initDevice();
                     _stopped = false;
                     continue;
                 }
 
-                pollfd pollstruct {
-                        (int)_gpio->getFileDescriptor(Gd::settings.gpio1())->descriptor,
-                        (short)(POLLPRI | POLLERR),
-                        (short)0
-                };
-
-                pollResult = poll(&pollstruct, 1, 100);
+                pollResult = ioBackend->poll(_gpio->getFileDescriptor(_settings.gpio1), POLLPRI | POLLERR, 100);
                 /*if(pollstruct.revents & POLLERR)
                 {
                     _out.printWarning("Warning: Error polling GPIO. Reopening...");
@@ -181,8 +187,8 @@ void Cc110LTest::mainThread()
                 }*/
                 if(pollResult > 0)
                 {
-                    if(lseek(_gpio->getFileDescriptor(Gd::settings.gpio1())->descriptor, 0, SEEK_SET) == -1) throw BaseLib::Exception("Could not poll gpio: " + std::string(strerror(errno)));
-                    bytesRead = read(_gpio->getFileDescriptor(Gd::settings.gpio1())->descriptor, &readBuffer[0], 1);
+                    if(lseek(_gpio->getFileDescriptor(_settings.gpio1)->descriptor, 0, SEEK_SET) == -1) throw BaseLib::Exception("Could not poll gpio: " + std::string(strerror(errno)));
+                    bytesRead = read(_gpio->getFileDescriptor(_settings.gpio1)->descriptor, &readBuffer[0], 1);
                     if(!bytesRead) continue;
                     if(readBuffer.at(0) == 0x30)
                     {
@@ -262,9 +268,9 @@ void Cc110LTest::mainThread()
                 {
                     _txMutex.unlock();
                     Gd::out.printError("Error: Could not poll gpio: " + std::string(strerror(errno)) + ". Reopening...");
-                    _gpio->closeDevice(Gd::settings.gpio1());
+                    _gpio->closeDevice(_settings.gpio1);
                     std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-                    _gpio->openDevice(Gd::settings.gpio1(), true);
+                    _gpio->openDevice(_settings.gpio1, true);
                 }
                 //pollResult == 0 is timeout
             }
@@ -286,9 +292,10 @@ void Cc110LTest::txThread()
 {
     try
     {
+        RealTime::apply(RealTime::Subsystem::cc1101);
         while(!_stopTxThread)
         {
-            if(!_fileDescriptor || _fileDescriptor->descriptor == -1 || !_gpio->isOpen(Gd::settings.gpio1()) || _stopped)
+            if(!_fileDescriptor || _fileDescriptor->descriptor == -1 || !_gpio->isOpen(_settings.gpio1) || _stopped)
             {
                 Gd::out.printError("SPI device or GPIO is not open.");
                 return;
@@ -311,7 +318,7 @@ void Cc110LTest::txThread()
                 }
             }
             _sendingPending = false;
-            if(_stopCallbackThread || _fileDescriptor->descriptor == -1 || !_gpio->isOpen(Gd::settings.gpio1()) || _stopped)
+            if(_stopCallbackThread || _fileDescriptor->descriptor == -1 || !_gpio->isOpen(_settings.gpio1) || _stopped)
             {
                 _txMutex.unlock();
                 Gd::out.printError("SPI device or GPIO is not open.");
@@ -344,7 +351,7 @@ void Cc110LTest::initDevice()
 
         initChip();
         Gd::out.printDebug("Debug: CC1100: Setting GPIO direction");
-        int32_t gpioIndex = Gd::settings.gpio1();
+        int32_t gpioIndex = _settings.gpio1;
         if(gpioIndex == -1)
         {
             Gd::out.printError("Error: GPIO 1 is not defined in settings.");
@@ -356,7 +363,7 @@ void Cc110LTest::initDevice()
         _gpio->openDevice(gpioIndex, true);
         if(!_gpio->isOpen(gpioIndex))
         {
-            Gd::out.printError("Error: Couldn't listen to rf device, because the GPIO descriptor is not valid: " + Gd::settings.device());
+            Gd::out.printError("Error: Couldn't listen to rf device, because the GPIO descriptor is not valid: " + _settings.device);
             return;
         }
     }
@@ -372,7 +379,7 @@ void Cc110LTest::openDevice()
     {
         if(_fileDescriptor && _fileDescriptor->descriptor != -1) closeDevice();
 
-        _lockfile = Gd::bl->settings.lockFilePath() + "LCK.." + Gd::settings.device().substr(Gd::settings.device().find_last_of('/') + 1);
+        _lockfile = Gd::bl->settings.lockFilePath() + "LCK.." + _settings.device.substr(_settings.device.find_last_of('/') + 1);
         int lockfileDescriptor = open(_lockfile.c_str(), O_WRONLY | O_EXCL | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
         if(lockfileDescriptor == -1)
         {
@@ -387,7 +394,7 @@ void Cc110LTest::openDevice()
             lockfileStream >> processID;
             if(getpid() != processID && kill(processID, 0) == 0)
             {
-                Gd::out.printCritical("Rf device is in use: " + Gd::settings.device());
+                Gd::out.printCritical("Rf device is in use: " + _settings.device);
                 return;
             }
             unlink(_lockfile.c_str());
@@ -401,12 +408,12 @@ void Cc110LTest::openDevice()
         dprintf(lockfileDescriptor, "%10i", getpid());
         close(lockfileDescriptor);
 
-        _fileDescriptor = _bl->fileDescriptorManager.add(open(Gd::settings.device().c_str(), O_RDWR | O_NONBLOCK));
+        _fileDescriptor = _bl->fileDescriptorManager.add(open(_settings.device.c_str(), O_RDWR | O_NONBLOCK));
         usleep(1000);
 
         if(_fileDescriptor->descriptor == -1)
         {
-            Gd::out.printCritical("Couldn't open rf device \"" + Gd::settings.device() + "\": " + strerror(errno));
+            Gd::out.printCritical("Couldn't open rf device \"" + _settings.device + "\": " + strerror(errno));
             return;
         }
 
@@ -441,14 +448,14 @@ void Cc110LTest::setupDevice()
         uint8_t bits = 8;
         uint32_t speed = 4000000; //4MHz, see page 25 in datasheet
 
-        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_WR_MODE, &mode)) throw(BaseLib::Exception("Couldn't set spi mode on device " + Gd::settings.device()));
-        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_RD_MODE, &mode)) throw(BaseLib::Exception("Couldn't get spi mode off device " + Gd::settings.device()));
+        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_WR_MODE, &mode)) throw(BaseLib::Exception("Couldn't set spi mode on device " + _settings.device));
+        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_RD_MODE, &mode)) throw(BaseLib::Exception("Couldn't get spi mode off device " + _settings.device));
 
-        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_WR_BITS_PER_WORD, &bits)) throw(BaseLib::Exception("Couldn't set bits per word on device " + Gd::settings.device()));
-        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_RD_BITS_PER_WORD, &bits)) throw(BaseLib::Exception("Couldn't get bits per word off device " + Gd::settings.device()));
+        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_WR_BITS_PER_WORD, &bits)) throw(BaseLib::Exception("Couldn't set bits per word on device " + _settings.device));
+        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_RD_BITS_PER_WORD, &bits)) throw(BaseLib::Exception("Couldn't get bits per word off device " + _settings.device));
 
-        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_WR_MAX_SPEED_HZ, &speed)) throw(BaseLib::Exception("Couldn't set speed on device " + Gd::settings.device()));
-        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_RD_MAX_SPEED_HZ, &speed)) throw(BaseLib::Exception("Couldn't get speed off device " + Gd::settings.device()));
+        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_WR_MAX_SPEED_HZ, &speed)) throw(BaseLib::Exception("Couldn't set speed on device " + _settings.device));
+        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_RD_MAX_SPEED_HZ, &speed)) throw(BaseLib::Exception("Couldn't get speed off device " + _settings.device));
     }
     catch(const std::exception& ex)
     {
@@ -571,13 +578,13 @@ void Cc110LTest::readwrite(std::vector<uint8_t>& data)
         _transfer.tx_buf = (uint64_t)&data[0];
         _transfer.rx_buf = (uint64_t)&data[0];
         _transfer.len = (uint32_t)data.size();
-        if(_bl->debugLevel >= 6) Gd::out.printDebug("Debug: Sending: " + _bl->hf.getHexString(data));
+        Gd::asyncLog.log(LogFormat::spiSending, data);
         if(!ioctl(_fileDescriptor->descriptor, SPI_IOC_MESSAGE(1), &_transfer))
         {
-            Gd::out.printError("Couldn't write to device " + Gd::settings.device() + ": " + std::string(strerror(errno)));
+            Gd::out.printError("Couldn't write to device " + _settings.device + ": " + std::string(strerror(errno)));
             return;
         }
-        if(_bl->debugLevel >= 6) Gd::out.printDebug("Debug: Received: " + _bl->hf.getHexString(data));
+        Gd::asyncLog.log(LogFormat::spiReceived, data);
     }
     catch(const std::exception& ex)
     {
@@ -589,7 +596,7 @@ bool Cc110LTest::checkStatus(uint8_t statusByte, Status::Enum status)
 {
     try
     {
-        if(_fileDescriptor->descriptor == -1 || !_gpio->isOpen(Gd::settings.gpio1())) return false;
+        if(_fileDescriptor->descriptor == -1 || !_gpio->isOpen(_settings.gpio1)) return false;
         if((statusByte & (StatusBitmasks::Enum::CHIP_RDYn | StatusBitmasks::Enum::STATE)) != status) return false;
         return true;
     }
@@ -715,24 +722,6 @@ uint8_t Cc110LTest::sendCommandStrobe(CommandStrobes::Enum commandStrobe)
     return 0;
 }
 
-BaseLib::PVariable Cc110LTest::callMethod(std::string& method, BaseLib::PArray parameters)
-{
-    try
-    {
-        auto localMethodIterator = _localRpcMethods.find(method);
-        if(localMethodIterator == _localRpcMethods.end()) return BaseLib::Variable::createError(-32601, ": Requested method not found.");
-
-        if(Gd::bl->debugLevel >= 5) Gd::out.printDebug("Debug: Server is calling RPC method: " + method);
-
-        return localMethodIterator->second(parameters);
-    }
-    catch(const std::exception& ex)
-    {
-        Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
-    }
-    return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
-}
-
 //{{{ RPC methods
 BaseLib::PVariable Cc110LTest::sendPacket(BaseLib::PArray& parameters)
 {
@@ -740,7 +729,7 @@ BaseLib::PVariable Cc110LTest::sendPacket(BaseLib::PArray& parameters)
     {
         if(parameters->size() != 2 || parameters->at(1)->type != BaseLib::VariableType::tString || parameters->at(1)->stringValue.empty()) return BaseLib::Variable::createError(-1, "Invalid parameters.");
 
-        if(!_fileDescriptor || _fileDescriptor->descriptor == -1 || !_gpio->isOpen(Gd::settings.gpio1()) || _stopped) return BaseLib::Variable::createError(-1, "SPI device or GPIO is not open.");
+        if(!_fileDescriptor || _fileDescriptor->descriptor == -1 || !_gpio->isOpen(_settings.gpio1) || _stopped) return BaseLib::Variable::createError(-1, "SPI device or GPIO is not open.");
 
         std::vector<uint8_t> decodedPacket = _bl->hf.getUBinary(parameters->at(1)->stringValue);
         bool burst = decodedPacket.at(2) & 0x10;
@@ -767,7 +756,7 @@ BaseLib::PVariable Cc110LTest::sendPacket(BaseLib::PArray& parameters)
             }
         }
         _sendingPending = false;
-        if(_stopCallbackThread || _fileDescriptor->descriptor == -1 || !_gpio->isOpen(Gd::settings.gpio1()) || _stopped)
+        if(_stopCallbackThread || _fileDescriptor->descriptor == -1 || !_gpio->isOpen(_settings.gpio1) || _stopped)
         {
             _txMutex.unlock();
             return BaseLib::Variable::createError(-1, "SPI device or GPIO is not open.");
@@ -927,7 +916,7 @@ BaseLib::PVariable Cc110LTest::startTx(BaseLib::PArray& parameters)
     try
     {
         _stopTxThread = false;
-        Gd::bl->threadManager.start(_txThread, true, 45, SCHED_FIFO, &Cc110LTest::txThread, this);
+        Gd::bl->threadManager.start(_txThread, true, &Cc110LTest::txThread, this);
 
         return std::make_shared<BaseLib::Variable>();
     }
@@ -958,4 +947,6 @@ BaseLib::PVariable Cc110LTest::stopTx(BaseLib::PArray& parameters)
 }
 //}}}
 
-#endif
\ No newline at end of file
+HOMEGEAR_GATEWAY_FAMILY_MODULE(Cc110LTest)
+
+#endif
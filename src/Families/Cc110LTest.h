@@ -40,9 +40,8 @@
 class Cc110LTest : public ICommunicationInterface
 {
 public:
-    Cc110LTest(BaseLib::SharedObjects* bl);
+    Cc110LTest(BaseLib::SharedObjects* bl, const InterfaceSettings& settings);
     virtual ~Cc110LTest();
-    virtual BaseLib::PVariable callMethod(std::string& method, BaseLib::PArray parameters);
 private:
     struct CommandStrobes
     {
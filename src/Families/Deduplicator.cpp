@@ -0,0 +1,202 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "Deduplicator.h"
+#include "../Gd.h"
+
+namespace {
+int64_t steadyTime() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+Deduplicator::Deduplicator(BaseLib::SharedObjects *bl, std::string name, int32_t window, int32_t hold) {
+  _bl = bl;
+  _name = std::move(name);
+  _hold = hold < 0 ? 0 : hold;
+  //Held frames must not expire before they are forwarded.
+  _window = std::max(window, _hold + 1);
+}
+
+Deduplicator::~Deduplicator() {
+  try {
+    stop();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void Deduplicator::start() {
+  try {
+    stop();
+    if (_hold == 0) return;
+    _stopHoldThread = false;
+    _bl->threadManager.start(_holdThread, true, &Deduplicator::holdThread, this);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void Deduplicator::stop() {
+  try {
+    {
+      std::lock_guard<std::mutex> entriesGuard(_entriesMutex);
+      _stopHoldThread = true;
+    }
+    _entriesConditionVariable.notify_all();
+    _bl->threadManager.join(_holdThread);
+
+    std::lock_guard<std::mutex> entriesGuard(_entriesMutex);
+    _entries.clear();
+    _expiry.clear();
+    _held.clear();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+uint64_t Deduplicator::hash(const uint8_t *data, size_t size, uint64_t hash) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+uint64_t Deduplicator::hashHexFrame(const std::string &packetHex, uint8_t ignoredFlags) {
+  if (packetHex.size() < 8) return hash((const uint8_t *)packetHex.data(), packetHex.size());
+  uint64_t result = hash((const uint8_t *)packetHex.data(), 4);
+  uint8_t flags = (uint8_t)BaseLib::Math::getNumber(packetHex.substr(4, 2), true) & ~ignoredFlags;
+  result = hash(&flags, 1, result);
+  return hash((const uint8_t *)packetHex.data() + 6, packetHex.size() - 8, result);
+}
+
+void Deduplicator::expire(int64_t now) {
+  while (!_expiry.empty() && now - _expiry.front().first >= _window) {
+    auto entryIterator = _entries.find(_expiry.front().second);
+    if (entryIterator != _entries.end()) {
+      if (entryIterator->second.forward) break; //Still held, try again later.
+      if (entryIterator->second.firstSeen == _expiry.front().first) _entries.erase(entryIterator);
+    }
+    _expiry.pop_front();
+  }
+}
+
+bool Deduplicator::process(uint64_t hash, int32_t rssi, ForwardFunction forward) {
+  try {
+    int64_t now = steadyTime();
+    {
+      std::lock_guard<std::mutex> entriesGuard(_entriesMutex);
+      expire(now);
+
+      auto entryIterator = _entries.find(hash);
+      if (entryIterator != _entries.end()) {
+        auto &entry = entryIterator->second;
+        entry.copies.count++;
+        if (rssi != INT32_MIN && (entry.copies.bestRssi == INT32_MIN || rssi > entry.copies.bestRssi)) {
+          entry.copies.bestRssi = rssi;
+          //Forward the copy received best.
+          if (entry.forward) entry.forward = std::move(forward);
+        }
+        _framesSuppressed++;
+        return false;
+      }
+
+      Entry entry;
+      entry.firstSeen = now;
+      entry.copies.count = 1;
+      entry.copies.bestRssi = rssi;
+      if (_hold > 0 && !_stopHoldThread) entry.forward = std::move(forward);
+      bool held = (bool)entry.forward;
+      _entries.emplace(hash, std::move(entry));
+      _expiry.emplace_back(now, hash);
+      if (held) {
+        _held.emplace_back(now + _hold, hash);
+        if (_held.size() == 1) _entriesConditionVariable.notify_all();
+        return true;
+      }
+    }
+
+    _framesForwarded++;
+    Copies copies;
+    copies.count = 1;
+    copies.bestRssi = rssi;
+    forward(copies);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return true;
+}
+
+void Deduplicator::holdThread() {
+  while (!_stopHoldThread) {
+    try {
+      ForwardFunction forward;
+      Copies copies;
+      {
+        std::unique_lock<std::mutex> entriesLock(_entriesMutex);
+        if (_held.empty()) {
+          _entriesConditionVariable.wait(entriesLock, [&] { return _stopHoldThread || !_held.empty(); });
+          continue;
+        }
+        int64_t now = steadyTime();
+        if (_held.front().first > now) {
+          _entriesConditionVariable.wait_for(entriesLock, std::chrono::milliseconds(_held.front().first - now), [&] { return (bool)_stopHoldThread; });
+          continue;
+        }
+        auto entryIterator = _entries.find(_held.front().second);
+        _held.pop_front();
+        if (entryIterator == _entries.end() || !entryIterator->second.forward) continue;
+        forward = std::move(entryIterator->second.forward);
+        entryIterator->second.forward = ForwardFunction();
+        copies = entryIterator->second.copies;
+      }
+
+      _framesForwarded++;
+      forward(copies);
+    }
+    catch (const std::exception &ex) {
+      Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+  }
+}
+
+BaseLib::PVariable Deduplicator::getStatus() {
+  auto status = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+  status->structValue->emplace("window", std::make_shared<BaseLib::Variable>(_window));
+  status->structValue->emplace("hold", std::make_shared<BaseLib::Variable>(_hold));
+  status->structValue->emplace("framesForwarded", std::make_shared<BaseLib::Variable>((int64_t)_framesForwarded));
+  status->structValue->emplace("framesSuppressed", std::make_shared<BaseLib::Variable>((int64_t)_framesSuppressed));
+  return status;
+}
@@ -0,0 +1,116 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_DEDUPLICATOR_H
+#define HOMEGEAR_GATEWAY_DEDUPLICATOR_H
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Suppresses identical copies of a received frame, e. g. the ones sent by repeaters. Frames are identified by a hash,
+ * which must not include the RSSI or repeater information. Copies of a frame received within the window after the
+ * first copy are dropped and counted.
+ *
+ * Without a hold time, the first copy is forwarded right away. With a hold time, it is forwarded after the hold time by
+ * a separate thread. The copy with the best RSSI is forwarded then together with the number of copies received so far.
+ */
+class Deduplicator
+{
+public:
+    struct Copies
+    {
+        uint32_t count = 0;
+        int32_t bestRssi = INT32_MIN;
+    };
+
+    typedef std::function<void(const Copies& copies)> ForwardFunction;
+
+    /**
+     * @param window The time in milliseconds copies are suppressed for.
+     * @param hold The time in milliseconds the first copy is held back for or 0.
+     */
+    Deduplicator(BaseLib::SharedObjects* bl, std::string name, int32_t window, int32_t hold);
+    virtual ~Deduplicator();
+
+    void start();
+    void stop();
+    int32_t hold() { return _hold; }
+
+    /**
+     * Calls "forward" for the first copy of a frame (or the best copy with a hold time) and drops all other copies.
+     *
+     * @param rssi The RSSI of the copy in dBm or INT32_MIN when unknown.
+     * @return Returns false when the frame is a copy and was dropped.
+     */
+    bool process(uint64_t hash, int32_t rssi, ForwardFunction forward);
+
+    /**
+     * 64-bit FNV-1a hash. Pass the result of the previous call as "hash" to hash several ranges.
+     */
+    static uint64_t hash(const uint8_t* data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+    /**
+     * Hashes a BidCoS or MAX! frame in hex without its trailing RSSI byte.
+     *
+     * @param ignoredFlags The bits of the flags byte (the third byte) to ignore, e. g. the "repeated" flag.
+     */
+    static uint64_t hashHexFrame(const std::string& packetHex, uint8_t ignoredFlags);
+
+    BaseLib::PVariable getStatus();
+private:
+    struct Entry
+    {
+        int64_t firstSeen = 0;
+        Copies copies;
+        ForwardFunction forward; //Set while the frame is held back.
+    };
+
+    BaseLib::SharedObjects* _bl = nullptr;
+    std::string _name;
+    int64_t _window = 0;
+    int32_t _hold = 0;
+
+    std::mutex _entriesMutex;
+    std::condition_variable _entriesConditionVariable;
+    std::unordered_map<uint64_t, Entry> _entries;
+    std::deque<std::pair<int64_t, uint64_t>> _expiry; //Time of first copy and hash, oldest first.
+    std::deque<std::pair<int64_t, uint64_t>> _held; //Time to forward and hash, oldest first.
+
+    std::atomic<uint64_t> _framesForwarded{0};
+    std::atomic<uint64_t> _framesSuppressed{0};
+
+    std::atomic_bool _stopHoldThread{true};
+    std::thread _holdThread;
+
+    void expire(int64_t now);
+    void holdThread();
+};
+
+#endif
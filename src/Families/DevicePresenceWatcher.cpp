@@ -0,0 +1,210 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "DevicePresenceWatcher.h"
+#include "../Gd.h"
+
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <sys/poll.h>
+#include <climits>
+
+DevicePresenceWatcher::DevicePresenceWatcher(BaseLib::SharedObjects *bl, std::string device) {
+  _bl = bl;
+  _device = std::move(device);
+  _inotifyDescriptor = std::make_shared<BaseLib::FileDescriptor>();
+  _stopEventDescriptor = std::make_shared<BaseLib::FileDescriptor>();
+}
+
+DevicePresenceWatcher::~DevicePresenceWatcher() {
+  try {
+    stop();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void DevicePresenceWatcher::start() {
+  try {
+    stop();
+    {
+      std::lock_guard<std::mutex> presenceGuard(_presenceMutex);
+      _stopped = false;
+    }
+    if (_device.empty()) return;
+
+    _inotifyDescriptor = _bl->fileDescriptorManager.add(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+    if (_inotifyDescriptor->descriptor == -1) {
+      Gd::out.printWarning("Warning: Could not initialize inotify. Device hotplug detection is disabled: " + std::string(strerror(errno)));
+      return;
+    }
+    _stopEventDescriptor = _bl->fileDescriptorManager.add(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    if (_stopEventDescriptor->descriptor == -1) {
+      Gd::out.printWarning("Warning: Could not create event descriptor. Device hotplug detection is disabled: " + std::string(strerror(errno)));
+      _bl->fileDescriptorManager.close(_inotifyDescriptor);
+      return;
+    }
+
+    _watchedDirectories.clear();
+    addWatches();
+    _present = checkPresence();
+    _arrived = false;
+
+    _stopWatcherThread = false;
+    _bl->threadManager.start(_watcherThread, true, &DevicePresenceWatcher::watch, this);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void DevicePresenceWatcher::stop() {
+  try {
+    {
+      std::lock_guard<std::mutex> presenceGuard(_presenceMutex);
+      _stopWatcherThread = true;
+      _stopped = true;
+    }
+    _presenceConditionVariable.notify_all();
+    if (_stopEventDescriptor->descriptor != -1) {
+      uint64_t value = 1;
+      if (write(_stopEventDescriptor->descriptor, &value, sizeof(value)) == -1) Gd::out.printDebug("Debug: Could not signal presence watcher to stop: " + std::string(strerror(errno)));
+    }
+    _bl->threadManager.join(_watcherThread);
+    _bl->fileDescriptorManager.close(_inotifyDescriptor);
+    _bl->fileDescriptorManager.close(_stopEventDescriptor);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+bool DevicePresenceWatcher::waitForDevice(int32_t timeout) {
+  try {
+    std::unique_lock<std::mutex> presenceLock(_presenceMutex);
+    if (_stopped) return false;
+    if (_stopWatcherThread) {
+      //Hotplug detection is not available. Behave like a plain sleep, which stop() interrupts.
+      _presenceConditionVariable.wait_for(presenceLock, std::chrono::milliseconds(timeout), [&] { return _stopped; });
+      return false;
+    }
+    bool arrived = _presenceConditionVariable.wait_for(presenceLock, std::chrono::milliseconds(timeout), [&] { return _arrived || _stopped; });
+    arrived = arrived && _arrived;
+    _arrived = false;
+    return arrived;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return false;
+}
+
+void DevicePresenceWatcher::addWatches() {
+  try {
+    std::vector<std::string> directories{"/dev", "/dev/serial", "/dev/serial/by-id"};
+    directories.push_back(BaseLib::HelperFunctions::splitLast(_device, '/').first);
+
+    char path[PATH_MAX];
+    if (realpath(_device.c_str(), path)) directories.push_back(BaseLib::HelperFunctions::splitLast(std::string(path), '/').first);
+
+    for (auto &directory : directories) {
+      if (directory.empty() || _watchedDirectories.find(directory) != _watchedDirectories.end()) continue;
+      if (!BaseLib::Io::directoryExists(directory)) continue;
+      if (inotify_add_watch(_inotifyDescriptor->descriptor, directory.c_str(), IN_CREATE | IN_DELETE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF) == -1) {
+        Gd::out.printDebug("Debug: Could not watch directory " + directory + ": " + std::string(strerror(errno)));
+        continue;
+      }
+      _watchedDirectories.emplace(directory);
+    }
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+bool DevicePresenceWatcher::checkPresence() {
+  return access(_device.c_str(), R_OK | W_OK) == 0;
+}
+
+void DevicePresenceWatcher::watch() {
+  std::array<char, 4096> buffer{};
+  while (!_stopWatcherThread) {
+    try {
+      pollfd pollStructs[2]{
+          {(int)_inotifyDescriptor->descriptor, (short)POLLIN, (short)0},
+          {(int)_stopEventDescriptor->descriptor, (short)POLLIN, (short)0}
+      };
+      int32_t pollResult = poll(pollStructs, 2, -1);
+      if (pollResult == -1) {
+        if (errno == EINTR) continue;
+        Gd::out.printError("Error: Could not poll inotify descriptor: " + std::string(strerror(errno)));
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+        continue;
+      }
+      if (_stopWatcherThread || pollStructs[1].revents) break;
+
+      bool directoryRemoved = false;
+      ssize_t bytesRead = 0;
+      while ((bytesRead = read(_inotifyDescriptor->descriptor, buffer.data(), buffer.size())) > 0) {
+        for (ssize_t i = 0; i < bytesRead;) {
+          auto event = (inotify_event *)(buffer.data() + i);
+          if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) directoryRemoved = true;
+          i += sizeof(inotify_event) + event->len;
+        }
+      }
+
+      //Directories like /dev/serial/by-id are removed when the last device is unplugged and recreated later.
+      if (directoryRemoved) _watchedDirectories.clear();
+      addWatches();
+
+      bool present = checkPresence();
+      if (present == _present) continue;
+
+      if (present) {
+        Gd::out.printInfo("Info: Device " + _device + " is present.");
+        {
+          std::lock_guard<std::mutex> presenceGuard(_presenceMutex);
+          _present = true;
+          _arrived = true;
+        }
+        _presenceConditionVariable.notify_all();
+      } else {
+        Gd::out.printWarning("Warning: Device " + _device + " was removed.");
+        Gd::flightRecorder.record(FlightRecorder::Event::state, -1, "Device removed: " + _device);
+        _present = false;
+        if (_removedCallback) _removedCallback();
+      }
+    }
+    catch (const std::exception &ex) {
+      Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+  }
+}
@@ -0,0 +1,95 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_DEVICEPRESENCEWATCHER_H
+#define HOMEGEAR_GATEWAY_DEVICEPRESENCEWATCHER_H
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Watches /dev, /dev/serial/by-id and the directory of the configured device using inotify. This allows the families to
+ * reopen a USB device as soon as it reappears instead of retrying blindly and to close it as soon as it is removed.
+ */
+class DevicePresenceWatcher
+{
+public:
+    DevicePresenceWatcher(BaseLib::SharedObjects* bl, std::string device);
+    virtual ~DevicePresenceWatcher();
+
+    void start();
+    void stop();
+
+    /**
+     * @return Returns true when the device node exists and is accessible.
+     */
+    bool isPresent() { return _present; }
+
+    /**
+     * Waits until the device (re)appears. Returns immediately when the device reappeared since the last call or when the
+     * watcher was stopped.
+     *
+     * @param timeout The maximum time to wait in milliseconds.
+     * @return Returns true when the device reappeared and false on timeout or when the watcher was stopped.
+     */
+    bool waitForDevice(int32_t timeout);
+
+    /**
+     * Sets a callback that is called from the watcher thread when the device is removed.
+     */
+    void setRemovedCallback(std::function<void()> value) { _removedCallback.swap(value); }
+private:
+    BaseLib::SharedObjects* _bl = nullptr;
+    std::string _device;
+    std::function<void()> _removedCallback;
+
+    BaseLib::PFileDescriptor _inotifyDescriptor;
+    BaseLib::PFileDescriptor _stopEventDescriptor;
+    std::set<std::string> _watchedDirectories;
+
+    std::atomic_bool _stopWatcherThread{true};
+    std::thread _watcherThread;
+
+    std::mutex _presenceMutex;
+    std::condition_variable _presenceConditionVariable;
+    std::atomic_bool _present{false};
+    bool _arrived = false;
+
+    /**
+     * Set by stop(), so waitForDevice() returns right away. Unlike _stopWatcherThread, it is not set when hotplug
+     * detection is unavailable.
+     */
+    bool _stopped = false;
+
+    void addWatches();
+    bool checkPresence();
+    void watch();
+};
+
+#endif
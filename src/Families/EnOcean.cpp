@@ -29,18 +29,32 @@
 */
 
 #include "EnOcean.h"
+#include "FamilyModule.h"
 #include "../Gd.h"
+#include "SerialLowLatency.h"
+#include "../RealTime.h"
 
-EnOcean::EnOcean(BaseLib::SharedObjects *bl) : ICommunicationInterface(bl) {
+EnOcean::EnOcean(BaseLib::SharedObjects* bl, const InterfaceSettings& settings) : ICommunicationInterface(bl, settings) {
   try {
     _familyId = ENOCEAN_FAMILY_ID;
+    _captureLinkType = FrameCapture::LinkType::enOceanEsp3;
 
     _initComplete = false;
     _stopped = true;
 
-    _localRpcMethods.emplace("sendPacket", std::bind(&EnOcean::sendPacket, this, std::placeholders::_1));
-    _localRpcMethods.emplace("getBaseAddress", std::bind(&EnOcean::getBaseAddress, this, std::placeholders::_1));
-    _localRpcMethods.emplace("setBaseAddress", std::bind(&EnOcean::setBaseAddress, this, std::placeholders::_1));
+    _addressFilter.reset(new AddressFilter(bl, "EnOcean"));
+    registerRpcMethod(RpcMethod::sendPacket, std::bind(&EnOcean::sendPacket, this, std::placeholders::_1));
+    registerRpcMethod(RpcMethod::getSubscriptions, std::bind(&AddressFilter::getSubscriptions, _addressFilter.get(), std::placeholders::_1));
+    registerRpcMethod(RpcMethod::setSubscriptions, std::bind(&AddressFilter::setSubscriptions, _addressFilter.get(), std::placeholders::_1));
+    registerRpcMethod(RpcMethod::getBaseAddress, std::bind(&EnOcean::getBaseAddress, this, std::placeholders::_1));
+    registerRpcMethod(RpcMethod::setBaseAddress, std::bind(&EnOcean::setBaseAddress, this, std::placeholders::_1));
+
+    _txQueue.reset(new SerialTxQueue(bl, [this]() { return _serial ? _serial->fileDescriptor() : BaseLib::PFileDescriptor(); }));
+    _presenceWatcher.reset(new DevicePresenceWatcher(bl, _settings.device));
+    _serialReader.reset(new SerialReader(bl));
+    _linkHealth.reset(new LinkHealth(57600, 100000));
+    _requestEngine.reset(new RequestEngine(bl, "EnOcean"));
+    _presenceWatcher->setRemovedCallback([this]() { _stopped = true; });
 
     start();
   }
@@ -61,17 +75,22 @@ EnOcean::~EnOcean() {
 
 void EnOcean::start() {
   try {
-    if (Gd::settings.device().empty()) {
+    if (replaying()) return; //Frames are fed in by FrameReplay. Don't open the device.
+
+    if (_settings.device.empty()) {
       Gd::out.printError("Error: No device defined for family EnOcean. Please specify it in \"gateway.conf\".");
       return;
     }
 
-    _serial.reset(new BaseLib::SerialReaderWriter(_bl, Gd::settings.device(), 57600, 0, true, -1));
+    _presenceWatcher->start();
+
+    _serial.reset(new BaseLib::SerialReaderWriter(_bl, _settings.device, 57600, 0, true, -1));
     _serial->openDevice(false, false, false);
     if (!_serial->isOpen()) {
       Gd::out.printError("Error: Could not open device.");
       return;
     }
+    if (Gd::settings.serialLowLatency()) SerialLowLatency::apply(_settings.device, _serial->fileDescriptor()->descriptor);
 
     _stopped = false;
     _stopCallbackThread = false;
@@ -79,7 +98,19 @@ void EnOcean::start() {
     char byte = 0;
     while (result == 0) {
       //Clear buffer, otherwise the address response cannot be sent by the module if the buffer is full.
-      result = _serial->readChar(byte, 100000);
+      result = _serialReader->readChar(_serial->fileDescriptor(), byte, 100000);
+    }
+    _txQueue->start();
+    _requestEngine->start();
+    if (Gd::eventLoop) {
+      //init() waits for responses processed by the event loop, so it must not run on the loop thread.
+      registerWithEventLoop();
+      _reconnectTimer = Gd::eventLoop->addTimer(1000, 1000, [this]() { checkConnection(); });
+      _bl->threadManager.join(_initThread);
+      //Set before the thread starts, so checkConnection() can't call reconnect() before init() is running.
+      _initRunning = true;
+      _bl->threadManager.start(_initThread, true, &EnOcean::init, this);
+      return;
     }
     _bl->threadManager.start(_listenThread, true, &EnOcean::listen, this);
 
@@ -93,9 +124,17 @@ void EnOcean::start() {
 void EnOcean::stop() {
   try {
     _stopCallbackThread = true;
+    _presenceWatcher->stop();
+    _requestEngine->stop();
+    if (Gd::eventLoop) {
+      Gd::eventLoop->removeTimer(_reconnectTimer);
+      _reconnectTimer = -1;
+      unregisterFromEventLoop();
+    }
     _bl->threadManager.join(_listenThread);
     _initComplete = false;
     _stopped = true;
+    _txQueue->stop();
     if (_serial) _serial->closeDevice();
   }
   catch (const std::exception &ex) {
@@ -105,34 +144,25 @@ void EnOcean::stop() {
 
 void EnOcean::getResponse(uint8_t packetType, std::vector<uint8_t> &requestPacket, std::vector<uint8_t> &responsePacket) {
   try {
-    if (_stopped) return;
     responsePacket.clear();
+    if (_stopped) return;
 
-    std::lock_guard<std::mutex> sendPacketGuard(_sendPacketMutex);
-    std::lock_guard<std::mutex> getResponseGuard(_getResponseMutex);
-    std::shared_ptr<Request> request(new Request());
-    std::unique_lock<std::mutex> requestsGuard(_requestsMutex);
-    _requests[packetType] = request;
-    requestsGuard.unlock();
-    std::unique_lock<std::mutex> lock(request->mutex);
-
-    try {
-      Gd::out.printInfo("Info: Sending packet " + BaseLib::HelperFunctions::getHexString(requestPacket));
-      rawSend(requestPacket);
-    }
-    catch (const C1Net::Exception &ex) {
-      Gd::out.printError("Error sending packet: " + std::string(ex.what()));
-      return;
-    }
+    //Only this caller waits. Other requests can be sent and the listen thread keeps processing packets in the meantime.
+    auto result = _requestEngine->sendAndWait(packetType, 10000, [&]() {
+      try {
+        Gd::asyncLog.log(LogFormat::sendingPacket, requestPacket);
+        rawSend(requestPacket);
+        return true;
+      }
+      catch (const C1Net::Exception &ex) {
+        Gd::out.printError("Error sending packet: " + std::string(ex.what()));
+      }
+      return false;
+    }, responsePacket);
 
-    if (!request->conditionVariable.wait_for(lock, std::chrono::milliseconds(10000), [&] { return request->mutexReady; })) {
+    if (result == RequestEngine::Result::timeout) {
       Gd::out.printError("Error: No response received to packet: " + BaseLib::HelperFunctions::getHexString(requestPacket));
     }
-    responsePacket = request->response;
-
-    requestsGuard.lock();
-    _requests.erase(packetType);
-    requestsGuard.unlock();
   }
   catch (const std::exception &ex) {
     Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
@@ -162,6 +192,8 @@ void EnOcean::addCrc8(std::vector<uint8_t> &packet) {
 
 void EnOcean::reconnect() {
   try {
+    Gd::flightRecorder.record(FlightRecorder::Event::reconnect, _familyId, _settings.device);
+    Metrics::add(Counter::reconnects, _familyId);
     _serial->closeDevice();
     _initComplete = false;
     _serial->openDevice(false, false, false);
@@ -169,9 +201,11 @@ void EnOcean::reconnect() {
       Gd::out.printError("Error: Could not open device.");
       return;
     }
+    if (Gd::settings.serialLowLatency()) SerialLowLatency::apply(_settings.device, _serial->fileDescriptor()->descriptor);
     _stopped = false;
 
     Gd::bl->threadManager.join(_initThread);
+    _initRunning = true;
     _bl->threadManager.start(_initThread, true, &EnOcean::init, this);
   }
   catch (const std::exception &ex) {
@@ -185,14 +219,18 @@ void EnOcean::init() {
     for (int32_t i = 0; i < 10; i++) {
       std::vector<uint8_t> data{0x55, 0x00, 0x01, 0x00, 0x05, 0x00, 0x08, 0x00};
       addCrc8(data);
+      int64_t startTime = BaseLib::HelperFunctions::getTimeMicroseconds();
       getResponse(0x02, data, response);
+      int64_t roundTripTime = BaseLib::HelperFunctions::getTimeMicroseconds() - startTime;
       if (response.size() != 13 || response[1] != 0 || response[2] != 5 || response[3] != 1 || response[6] != 0) {
         if (i < 9) continue;
         Gd::out.printError("Error reading address from device: " + BaseLib::HelperFunctions::getHexString(data));
         _stopped = true;
+        _initRunning = false;
         return;
       }
       _baseAddress = ((int32_t) (uint8_t) response[7] << 24) | ((int32_t) (uint8_t) response[8] << 16) | ((int32_t) (uint8_t) response[9] << 8) | (uint8_t) response[10];
+      Gd::out.printInfo("Info: CO_RD_IDBASE round trip time: " + std::to_string(roundTripTime) + " µs (low latency profile is " + (Gd::settings.serialLowLatency() ? "enabled" : "disabled") + ").");
       break;
     }
 
@@ -203,81 +241,47 @@ void EnOcean::init() {
   catch (const std::exception &ex) {
     Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
   }
+  _initRunning = false;
 }
 
 void EnOcean::listen() {
   try {
-    std::vector<uint8_t> data;
-    data.reserve(100);
+    RealTime::apply(RealTime::Subsystem::serial);
+    FlightRecorder::Watch watch(_settings.family + " " + _settings.device);
     char byte = 0;
     int32_t result = 0;
-    uint32_t size = 0;
-    uint8_t crc8 = 0;
 
     while (!_stopCallbackThread) {
+      watch.beat();
       try {
         if (_stopped || !_serial->isOpen()) {
           if (_stopCallbackThread) return;
           if (_stopped) Gd::out.printWarning("Warning: Connection to device closed. Trying to reconnect...");
           _serial->closeDevice();
-          std::this_thread::sleep_for(std::chrono::milliseconds(10000));
+          if (_presenceWatcher->waitForDevice(10000)) Gd::out.printInfo("Info: Device reappeared. Reconnecting...");
+          if (_stopCallbackThread) return;
           reconnect();
           continue;
         }
 
-        result = _serial->readChar(byte, 100000);
+        result = _serialReader->readChar(_serial->fileDescriptor(), byte, _packet.empty() ? 100000 : _linkHealth->partialFrameTimeout());
         if (result == -1) {
           Gd::out.printError("Error reading from serial device.");
+          _linkHealth->readFailed();
           _stopped = true;
-          size = 0;
-          data.clear();
+          resetParser();
           continue;
         } else if (result == 1) {
-          size = 0;
-          data.clear();
+          if (!_packet.empty()) _linkHealth->frameIncomplete();
+          resetParser();
+          _linkHealth->pollUartErrors(_serial->fileDescriptor());
           continue;
         }
 
-        if (data.empty() && byte != 0x55) continue;
-        data.push_back((uint8_t) byte);
-
-        if (size == 0 && data.size() == 6) {
-          crc8 = 0;
-          for (int32_t i = 1; i < 5; i++) {
-            crc8 = _crc8Table[crc8 ^ (uint8_t) data[i]];
-          }
-          if (crc8 != data[5]) {
-            Gd::out.printError("Error: CRC (0x" + BaseLib::HelperFunctions::getHexString(crc8, 2) + ") failed for header: " + BaseLib::HelperFunctions::getHexString(data));
-            size = 0;
-            data.clear();
-            continue;
-          }
-          size = ((data[1] << 8) | data[2]) + data[3];
-          if (size == 0) {
-            Gd::out.printError("Error: Header has invalid size information: " + BaseLib::HelperFunctions::getHexString(data));
-            size = 0;
-            data.clear();
-            continue;
-          }
-          size += 7;
-        }
-        if (size > 0 && data.size() == size) {
-          crc8 = 0;
-          for (uint32_t i = 6; i < data.size() - 1; i++) {
-            crc8 = _crc8Table[crc8 ^ (uint8_t) data[i]];
-          }
-          if (crc8 != data.back()) {
-            Gd::out.printError("Error: CRC failed for packet: " + BaseLib::HelperFunctions::getHexString(data));
-            size = 0;
-            data.clear();
-            continue;
-          }
-
-          processPacket(data);
-
-          size = 0;
-          data.clear();
-        }
+        _linkHealth->readSucceeded();
+        _receiveTime = _serialReader->readTime();
+        _linkHealth->byteReceived(_receiveTime, !_packet.empty());
+        processByte((uint8_t)byte);
       }
       catch (const std::exception &ex) {
         Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
@@ -289,38 +293,110 @@ void EnOcean::listen() {
   }
 }
 
-void EnOcean::processPacket(std::vector<uint8_t> &data) {
-  try {
-    if (data.size() < 5) {
-      Gd::out.printError("Error: Too small packet received: " + BaseLib::HelperFunctions::getHexString(data));
+void EnOcean::resetParser() {
+  _packetSize = 0;
+  _packet.clear();
+}
+
+void EnOcean::processByte(uint8_t byte) {
+  if (_packet.empty() && byte != 0x55) {
+    _linkHealth->byteDiscarded();
+    return;
+  }
+  _packet.push_back(byte);
+
+  uint8_t crc8 = 0;
+  if (_packetSize == 0 && _packet.size() == 6) {
+    for (int32_t i = 1; i < 5; i++) {
+      crc8 = _crc8Table[crc8 ^ (uint8_t) _packet[i]];
+    }
+    if (crc8 != _packet[5]) {
+      Gd::out.printError("Error: CRC (0x" + BaseLib::HelperFunctions::getHexString(crc8, 2) + ") failed for header: " + BaseLib::HelperFunctions::getHexString(_packet));
+      _rfStatistics->crcError();
+      _linkHealth->frameCorrupted();
+      Metrics::add(Counter::crcErrors, _familyId);
+      resetParser();
+      return;
+    }
+    _packetSize = ((_packet[1] << 8) | _packet[2]) + _packet[3];
+    if (_packetSize == 0) {
+      Gd::out.printError("Error: Header has invalid size information: " + BaseLib::HelperFunctions::getHexString(_packet));
+      _linkHealth->frameCorrupted();
+      resetParser();
+      return;
+    }
+    _packetSize += 7;
+  }
+  if (_packetSize > 0 && _packet.size() == _packetSize) {
+    crc8 = 0;
+    for (uint32_t i = 6; i < _packet.size() - 1; i++) {
+      crc8 = _crc8Table[crc8 ^ (uint8_t) _packet[i]];
+    }
+    if (crc8 != _packet.back()) {
+      Gd::out.printError("Error: CRC failed for packet: " + BaseLib::HelperFunctions::getHexString(_packet));
+      uint32_t dataSize = (_packet[1] << 8) | _packet[2];
+      if (_packet[4] == 0x01 && dataSize >= 6) {
+        //ERP1: The sender ID precedes the status byte at the end of the data.
+        uint32_t senderOffset = 6 + dataSize - 5;
+        _rfStatistics->crcError(((uint32_t)_packet[senderOffset] << 24) | ((uint32_t)_packet[senderOffset + 1] << 16) | ((uint32_t)_packet[senderOffset + 2] << 8) | _packet[senderOffset + 3]);
+      } else _rfStatistics->crcError();
+      _linkHealth->frameCorrupted();
+      Metrics::add(Counter::crcErrors, _familyId);
+      resetParser();
       return;
     }
 
-    if (Gd::bl->debugLevel >= 5) Gd::out.printDebug("Debug: Packet received: " + BaseLib::HelperFunctions::getHexString(data));
+    _linkHealth->frameCompleted(_packet.size());
+    processPacket(_packet);
+    resetParser();
+    if (_serial) _linkHealth->pollUartErrors(_serial->fileDescriptor());
+  }
+}
 
-    uint8_t packetType = data[4];
-    std::unique_lock<std::mutex> requestsGuard(_requestsMutex);
-    std::map<uint8_t, std::shared_ptr<Request>>::iterator requestIterator = _requests.find(packetType);
-    if (requestIterator != _requests.end()) {
-      std::shared_ptr<Request> request = requestIterator->second;
-      requestsGuard.unlock();
-      request->response = data;
-      {
-        std::lock_guard<std::mutex> lock(request->mutex);
-        request->mutexReady = true;
-      }
-      request->conditionVariable.notify_one();
+void EnOcean::registerWithEventLoop() {
+  try {
+    _eventLoopDescriptor = _serial->fileDescriptor()->descriptor;
+    Gd::eventLoop->addDescriptor(_eventLoopDescriptor, POLLIN, [this](int32_t fileDescriptor, uint32_t events) { processSerialEvent(fileDescriptor, events); });
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void EnOcean::unregisterFromEventLoop() {
+  if (_eventLoopDescriptor == -1) return;
+  Gd::eventLoop->removeDescriptor(_eventLoopDescriptor);
+  _eventLoopDescriptor = -1;
+}
+
+void EnOcean::processSerialEvent(int32_t fileDescriptor, uint32_t events) {
+  try {
+    if (!(events & POLLIN)) {
+      Gd::out.printError("Error reading from serial device.");
+      _stopped = true;
+      unregisterFromEventLoop();
       return;
-    } else requestsGuard.unlock();
+    }
 
-    BaseLib::PArray parameters = std::make_shared<BaseLib::Array>();
-    parameters->reserve(2);
-    parameters->push_back(std::make_shared<BaseLib::Variable>(ENOCEAN_FAMILY_ID));
-    parameters->push_back(std::make_shared<BaseLib::Variable>(data));
+    std::array<uint8_t, 256> buffer{};
+    ssize_t bytesRead = read(fileDescriptor, buffer.data(), buffer.size());
+    if (bytesRead <= 0) {
+      if (bytesRead == -1 && (errno == EAGAIN || errno == EINTR)) return;
+      Gd::out.printError("Error reading from serial device.");
+      _stopped = true;
+      unregisterFromEventLoop();
+      return;
+    }
+    ReceiveTime readTime = ReceiveTime::now();
 
-    auto result = _invoke("packetReceived", parameters);
-    if (result->errorStruct && result->structValue->at("faultCode")->integerValue != -1) {
-      Gd::out.printError("Error calling packetReceived(): " + result->structValue->at("faultString")->stringValue);
+    for (ssize_t i = 0; i < bytesRead; i++) {
+      //Same as the read timeout of the listen thread: Discard incomplete packets after a pause.
+      if (!_linkHealth->byteReceived(readTime, !_packet.empty())) {
+        _linkHealth->frameIncomplete();
+        resetParser();
+      }
+      _receiveTime = readTime;
+      processByte(buffer[i]);
     }
   }
   catch (const std::exception &ex) {
@@ -328,29 +404,84 @@ void EnOcean::processPacket(std::vector<uint8_t> &data) {
   }
 }
 
-void EnOcean::rawSend(std::vector<uint8_t> &packet) {
+void EnOcean::checkConnection() {
   try {
-    if (!_serial || !_serial->isOpen()) return;
-    _serial->writeData(packet);
+    if (!_stopped && _serial->isOpen()) {
+      _linkHealth->pollUartErrors(_serial->fileDescriptor());
+      return;
+    }
+
+    int64_t time = BaseLib::HelperFunctions::getTime();
+    if (_eventLoopDescriptor != -1 || _serial->isOpen()) {
+      Gd::out.printWarning("Warning: Connection to device closed. Trying to reconnect...");
+      unregisterFromEventLoop();
+      _serial->closeDevice();
+      _lastReconnect = time;
+      return;
+    }
+
+    if (_initRunning) return; //reconnect() joins the init thread which waits for the event loop.
+    bool deviceArrived = _presenceWatcher->waitForDevice(0);
+    if (!deviceArrived && time - _lastReconnect < 10000) return;
+    if (deviceArrived) Gd::out.printInfo("Info: Device reappeared. Reconnecting...");
+    _lastReconnect = time;
+    resetParser();
+    reconnect();
+    if (_serial->isOpen()) registerWithEventLoop();
   }
   catch (const std::exception &ex) {
     Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
   }
 }
 
-BaseLib::PVariable EnOcean::callMethod(std::string &method, BaseLib::PArray parameters) {
+void EnOcean::processPacket(std::vector<uint8_t> &data) {
   try {
-    auto localMethodIterator = _localRpcMethods.find(method);
-    if (localMethodIterator == _localRpcMethods.end()) return BaseLib::Variable::createError(-32601, ": Requested method not found.");
+    if (data.size() < 5) {
+      Gd::out.printError("Error: Too small packet received: " + BaseLib::HelperFunctions::getHexString(data));
+      return;
+    }
 
-    if (Gd::bl->debugLevel >= 5) Gd::out.printDebug("Debug: Server is calling RPC method: " + method);
+    Gd::asyncLog.log(LogFormat::packetReceived, data);
 
-    return localMethodIterator->second(parameters);
+    uint8_t packetType = data[4];
+    int32_t rssi = FrameCapture::noRssi;
+    uint32_t dataSize = (data[1] << 8) | data[2];
+    //ERP1 optional data: sub telegram count, destination ID (4 bytes), dBm, security level
+    if (packetType == 0x01 && data[3] >= 6 && data.size() >= 6 + dataSize + 6) rssi = -(int32_t)data[6 + dataSize + 5];
+    captureFrame(FrameCapture::Direction::inbound, data, rssi);
+
+    if (_requestEngine->complete(packetType, data)) return;
+
+    if (packetType == 0x01 && dataSize >= 6 && data.size() >= 6 + dataSize) {
+      //ERP1 data: RORG, payload, sender ID (4 bytes), status. The optional data contains the destination ID.
+      uint32_t senderOffset = 6 + dataSize - 5;
+      uint32_t sender = ((uint32_t)data[senderOffset] << 24) | ((uint32_t)data[senderOffset + 1] << 16) | ((uint32_t)data[senderOffset + 2] << 8) | data[senderOffset + 3];
+      uint32_t destination = 0xFFFFFFFF;
+      if (data[3] >= 5 && data.size() >= 6 + dataSize + 5) destination = ((uint32_t)data[6 + dataSize + 1] << 24) | ((uint32_t)data[6 + dataSize + 2] << 16) | ((uint32_t)data[6 + dataSize + 3] << 8) | data[6 + dataSize + 4];
+      if (!_addressFilter->forward(sender, destination, data[6])) return;
+
+      //Hash RORG, payload and sender ID. The status byte contains the repeater count, the optional data the RSSI.
+      uint64_t dedupeHash = _deduplicator ? Deduplicator::hash(data.data() + 6, dataSize - 1) : 0;
+      forwardPacket(sender, dedupeHash, rssi, _receivePool->packet(data));
+      return;
+    }
+
+    forwardPacket(_receivePool->packet(data));
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void EnOcean::rawSend(std::vector<uint8_t> &packet) {
+  try {
+    if (!_serial || !_serial->isOpen()) return;
+    captureFrame(FrameCapture::Direction::outbound, packet);
+    if (!_txQueue->enqueue(packet)) Gd::out.printError("Error: Could not queue packet " + BaseLib::HelperFunctions::getHexString(packet) + ". Transmit queue is full.");
   }
   catch (const std::exception &ex) {
     Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
   }
-  return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
 }
 
 //{{{ RPC methods
@@ -454,4 +585,6 @@ BaseLib::PVariable EnOcean::setBaseAddress(BaseLib::PArray &parameters) {
   }
   return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
 }
-//}}}
\ No newline at end of file
+//}}}
+
+HOMEGEAR_GATEWAY_FAMILY_MODULE(EnOcean)
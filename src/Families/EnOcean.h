@@ -32,29 +32,23 @@
 #define HOMEGEAR_GATEWAY_ENOCEAN_H
 
 #include "ICommunicationInterface.h"
+#include "AddressFilter.h"
+#include "SerialTxQueue.h"
+#include "DevicePresenceWatcher.h"
+#include "SerialReader.h"
+#include "RequestEngine.h"
 
 #define ENOCEAN_FAMILY_ID 15
 
 class EnOcean : public ICommunicationInterface
 {
 public:
-    EnOcean(BaseLib::SharedObjects* bl);
+    EnOcean(BaseLib::SharedObjects* bl, const InterfaceSettings& settings);
     virtual ~EnOcean();
-    virtual BaseLib::PVariable callMethod(std::string& method, BaseLib::PArray parameters);
+    virtual size_t txQueueDepth() { return _txQueue ? _txQueue->depth() : 0; }
+    virtual size_t pendingRequests() { return _requestEngine ? _requestEngine->pending() : 0; }
+    virtual bool replayFrame(std::vector<uint8_t>& frame) { processPacket(frame); return true; }
 private:
-    class Request
-    {
-    public:
-        std::mutex mutex;
-        std::condition_variable conditionVariable;
-        bool mutexReady = false;
-        std::vector<uint8_t> response;
-
-        Request() {}
-        virtual ~Request() {}
-    private:
-    };
-
     const uint8_t _crc8Table[256] = {
             0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15,
             0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d,
@@ -94,23 +88,39 @@ private:
     std::thread _listenThread;
 
     std::unique_ptr<BaseLib::SerialReaderWriter> _serial;
+    std::unique_ptr<SerialTxQueue> _txQueue;
+    std::unique_ptr<DevicePresenceWatcher> _presenceWatcher;
+    std::unique_ptr<SerialReader> _serialReader;
     std::atomic_bool _stopped;
     std::atomic_bool _initComplete;
+    std::atomic_bool _initRunning{false};
     std::thread _initThread;
 
-    std::mutex _sendPacketMutex;
-    std::mutex _getResponseMutex;
-
-    std::mutex _requestsMutex;
-    std::map<uint8_t, std::shared_ptr<Request>> _requests;
+    std::unique_ptr<RequestEngine> _requestEngine;
+    std::unique_ptr<AddressFilter> _addressFilter;
 
     uint32_t _baseAddress = 0;
 
+    std::vector<uint8_t> _packet;
+    uint32_t _packetSize = 0;
+
+    //{{{ Event loop mode
+    int32_t _eventLoopDescriptor = -1;
+    int32_t _reconnectTimer = -1;
+    int64_t _lastReconnect = 0;
+    //}}}
+
     void start();
     void stop();
     void init();
     void reconnect();
     void listen();
+    void resetParser();
+    void processByte(uint8_t byte);
+    void registerWithEventLoop();
+    void unregisterFromEventLoop();
+    void processSerialEvent(int32_t fileDescriptor, uint32_t events);
+    void checkConnection();
     void getResponse(uint8_t packetType, std::vector<uint8_t>& requestPacket, std::vector<uint8_t>& responsePacket);
     void addCrc8(std::vector<uint8_t>& packet);
     void rawSend(std::vector<uint8_t>& packet);
@@ -0,0 +1,67 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_FAMILYMODULE_H
+#define HOMEGEAR_GATEWAY_FAMILYMODULE_H
+
+#include "ICommunicationInterface.h"
+
+/**
+ * Version of the interface between homegear-gateway and the family modules. Increment it whenever ICommunicationInterface,
+ * InterfaceSettings or any other class shared with the modules changes in an incompatible way.
+ */
+#define HOMEGEAR_GATEWAY_MODULE_API_VERSION 1
+
+extern "C"
+{
+typedef int32_t (*ModuleApiVersionFunction)();
+typedef ICommunicationInterface* (*CreateInterfaceFunction)(BaseLib::SharedObjects* bl, const InterfaceSettings& settings);
+}
+
+/**
+ * Exports the factory functions of a family. Each family implementation calls this once at the end of its source file.
+ * The modules are loaded by ModuleLoader as "mod_<family>.so". Without FAMILYMODULES all families are linked into the
+ * executable and this macro expands to nothing.
+ */
+#ifdef FAMILYMODULES
+#define HOMEGEAR_GATEWAY_FAMILY_MODULE(className) \
+    extern "C" __attribute__((visibility("default"))) int32_t homegearGatewayModuleApiVersion() \
+    { \
+        return HOMEGEAR_GATEWAY_MODULE_API_VERSION; \
+    } \
+    extern "C" __attribute__((visibility("default"))) ICommunicationInterface* homegearGatewayCreateInterface(BaseLib::SharedObjects* bl, const InterfaceSettings& settings) \
+    { \
+        return new className(bl, settings); \
+    }
+#else
+#define HOMEGEAR_GATEWAY_FAMILY_MODULE(className)
+#endif
+
+#endif
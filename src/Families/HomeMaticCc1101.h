@@ -34,15 +34,17 @@
 #ifdef SPISUPPORT
 
 #include "ICommunicationInterface.h"
+#include "AddressFilter.h"
 
 #define HOMEMATIC_CC1101_FAMILY_ID 0
 
 class HomeMaticCc1101 : public ICommunicationInterface
 {
 public:
-    HomeMaticCc1101(BaseLib::SharedObjects* bl);
+    HomeMaticCc1101(BaseLib::SharedObjects* bl, const InterfaceSettings& settings);
     virtual ~HomeMaticCc1101();
-    virtual BaseLib::PVariable callMethod(std::string& method, BaseLib::PArray parameters);
+
+    virtual bool replayFrame(std::vector<uint8_t>& frame) { processPacket(BaseLib::HelperFunctions::getHexString(frame)); return true; }
 private:
     struct CommandStrobes
     {
@@ -189,6 +191,7 @@ private:
     std::atomic_bool _sendingPending;
     std::atomic_bool _firstPacket;
     std::thread _listenThread;
+    std::unique_ptr<AddressFilter> _addressFilter;
     std::atomic_bool _stopped;
     std::atomic_bool _stopCallbackThread;
 
@@ -196,6 +199,7 @@ private:
     void stop();
 
     void mainThread();
+    void processPacket(const std::string& packet);
 
     void setConfig();
     void setupDevice();
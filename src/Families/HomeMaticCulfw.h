@@ -32,20 +32,23 @@
 #define HOMEGEAR_GATEWAY_HOMEMATIC_COC_H
 
 #include "ICommunicationInterface.h"
+#include "AddressFilter.h"
 
 #define HOMEMATIC_COC_FAMILY_ID 0
 
 class HomeMaticCulfw : public ICommunicationInterface, public BaseLib::SerialReaderWriter::ISerialReaderWriterEventSink
 {
 public:
-    HomeMaticCulfw(BaseLib::SharedObjects* bl);
+    HomeMaticCulfw(BaseLib::SharedObjects* bl, const InterfaceSettings& settings);
     virtual ~HomeMaticCulfw();
-    virtual BaseLib::PVariable callMethod(std::string& method, BaseLib::PArray parameters);
+
+    virtual bool replayFrame(std::vector<uint8_t>& frame) { lineReceived(std::string(frame.begin(), frame.end())); return true; }
 private:
     std::atomic_bool _updateMode;
 
     std::unique_ptr<BaseLib::LowLevel::Gpio> _gpio;
     std::unique_ptr<BaseLib::SerialReaderWriter> _serial;
+    std::unique_ptr<AddressFilter> _addressFilter;
 
     void start();
     void stop();
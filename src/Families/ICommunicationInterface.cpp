@@ -30,15 +30,246 @@
 
 #include "ICommunicationInterface.h"
 #include "../Gd.h"
+#include "../AllocationCounter.h"
 
-ICommunicationInterface::ICommunicationInterface(BaseLib::SharedObjects* bl)
+ICommunicationInterface::ICommunicationInterface(BaseLib::SharedObjects* bl, const InterfaceSettings& settings)
 {
     try
     {
         _bl = bl;
+        _settings = settings;
+
+        _receivePool.reset(new ReceivePool());
+        _rfStatistics.reset(new RfStatistics());
+        registerRpcMethod(RpcMethod::getRfStatistics, std::bind(&RfStatistics::getRfStatistics, _rfStatistics.get(), std::placeholders::_1));
+
+        if(_settings.dedupeWindow > 0)
+        {
+            _deduplicator.reset(new Deduplicator(bl, _settings.family, _settings.dedupeWindow, _settings.dedupeHold));
+            _deduplicator->start();
+        }
+
+        if(_settings.rateLimit > 0 || _settings.receiveBudget > 0) _rateLimiter.reset(new RateLimiter(_settings.rateLimit, _settings.rateLimitBurst, _settings.receiveBudget));
+    }
+    catch(const std::exception& ex)
+    {
+        Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+}
+
+ICommunicationInterface::~ICommunicationInterface()
+{
+    try
+    {
+        //Held frames are forwarded by the deduplicator's thread, which must not outlive the interface.
+        if(_deduplicator) _deduplicator->stop();
+    }
+    catch(const std::exception& ex)
+    {
+        Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+}
+
+BaseLib::PVariable ICommunicationInterface::callMethod(RpcMethod method, BaseLib::PArray parameters)
+{
+    try
+    {
+        if(method <= RpcMethod::unknown || method >= RpcMethod::count || !_localRpcMethods[(size_t)method]) return BaseLib::Variable::createError(-32601, ": Requested method not found.");
+
+        if(_bl->debugLevel >= 5) Gd::out.printDebug("Debug: Server is calling RPC method: " + std::string(RpcMethods::getName(method)));
+
+        return _localRpcMethods[(size_t)method](parameters);
+    }
+    catch(const std::exception& ex)
+    {
+        Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
+}
+
+void ICommunicationInterface::captureFrame(FrameCapture::Direction direction, const uint8_t* data, size_t size, int32_t rssi)
+{
+    Gd::flightRecorder.record(direction == FrameCapture::Direction::inbound ? FlightRecorder::Event::frameReceived : FlightRecorder::Event::frameSent, _familyId, data, size, rssi == FrameCapture::noRssi ? 0 : rssi);
+    Metrics::add(direction == FrameCapture::Direction::inbound ? Counter::framesReceived : Counter::framesSent, _familyId);
+    if(!Gd::frameCapture || !Gd::frameCapture->enabled()) return;
+
+    int64_t captureInterface = _captureInterface.load(std::memory_order_relaxed);
+    if(captureInterface == -1)
+    {
+        //registerInterface() returns the same index for the same parameters, so racing threads agree on the index.
+        captureInterface = Gd::frameCapture->registerInterface(_captureLinkType, _settings.family + " " + _settings.device);
+        _captureInterface = captureInterface;
+    }
+    Gd::frameCapture->capture((uint32_t)captureInterface, direction, data, size, rssi);
+}
+
+bool ICommunicationInterface::replaying()
+{
+    return (bool)Gd::frameReplay;
+}
+
+ReceiveTime ICommunicationInterface::takeReceiveTime()
+{
+    ReceiveTime receiveTime = _receiveTime.empty() ? ReceiveTime::now() : _receiveTime;
+    _receiveTime = ReceiveTime();
+    return receiveTime;
+}
+
+void ICommunicationInterface::limitAndForward(int64_t source, const ReceiveTime& receiveTime, const BaseLib::PVariable& packet, BaseLib::PVariable metadata, bool limit)
+{
+    try
+    {
+        if(!_invoke) return;
+
+        if(_rateLimiter && limit)
+        {
+            auto result = _rateLimiter->admit(source);
+            if(result.sourceLimitReached || result.budgetExceeded) raiseRateLimitWarning(source, result);
+            if(!result.forward) return;
+            if(result.dropped > 0)
+            {
+                //Lets Homegear distinguish dropped frames from lost ones.
+                if(!metadata) metadata = _receivePool->metadata();
+                ReceivePool::setInteger(metadata, "dropped", result.dropped);
+            }
+        }
+
+        if(Gd::settings.receiveTimestamps())
+        {
+            //The delay is the time the frame spent in the gateway so far. Homegear can subtract it to get the air time.
+            if(!metadata) metadata = _receivePool->metadata();
+            BaseLib::PVariable received;
+            auto receivedIterator = metadata->structValue->find("received");
+            if(receivedIterator != metadata->structValue->end()) received = receivedIterator->second;
+            else
+            {
+                received = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+                metadata->structValue->emplace("received", received);
+            }
+            ReceivePool::setInteger(received, "monotonic", receiveTime.monotonic);
+            ReceivePool::setInteger(received, "realtime", receiveTime.realtime);
+            ReceivePool::setInteger(received, "delay", (ReceiveTime::now().monotonic - receiveTime.monotonic) / 1000);
+        }
+
+        BaseLib::PArray parameters = _receivePool->parameters(_familyId, packet, metadata);
+        auto invokeTime = std::chrono::steady_clock::now();
+        BaseLib::PVariable result;
+        {
+            //The allocations of BaseLib's RPC encoder and C1Net are not part of the receive path reported by FrameReplay.
+            AllocationCounter::Pause pauseAllocationCounter;
+            result = _invoke("packetReceived", parameters);
+        }
+        parameters->clear(); //Releases packet and metadata, so they can be recycled.
+        if(!result->errorStruct) Metrics::observe(Histogram::packetReceivedLatency, _familyId, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - invokeTime).count());
+        else if(result->structValue->at("faultCode")->integerValue == invokeTimeoutFaultCode) Metrics::add(Counter::packetReceivedTimeouts, _familyId);
+        if(result->errorStruct && result->structValue->at("faultCode")->integerValue != -1)
+        {
+            Gd::out.printError("Error calling packetReceived(): " + result->structValue->at("faultString")->stringValue);
+        }
+    }
+    catch(const std::exception& ex)
+    {
+        Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+}
+
+void ICommunicationInterface::raiseRateLimitWarning(int64_t source, const RateLimiter::Result& result)
+{
+    try
+    {
+        auto warning = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+        if(result.sourceLimitReached)
+        {
+            Gd::out.printWarning("Warning: Source " + BaseLib::HelperFunctions::getHexString((int32_t)source) + " exceeds the rate limit of " + std::to_string(_rateLimiter->rate()) + " frames per second on interface " + _settings.family + ". Dropping frames.");
+            warning->structValue->emplace("type", std::make_shared<BaseLib::Variable>(std::string("source")));
+            warning->structValue->emplace("source", std::make_shared<BaseLib::Variable>(source));
+            warning->structValue->emplace("limit", std::make_shared<BaseLib::Variable>(_rateLimiter->rate()));
+        }
+        else
+        {
+            Gd::out.printWarning("Warning: Interface " + _settings.family + " exceeds the receive budget of " + std::to_string(_rateLimiter->budget()) + " frames per second. Dropping frames.");
+            warning->structValue->emplace("type", std::make_shared<BaseLib::Variable>(std::string("budget")));
+            warning->structValue->emplace("limit", std::make_shared<BaseLib::Variable>(_rateLimiter->budget()));
+        }
+
+        BaseLib::PArray parameters = std::make_shared<BaseLib::Array>();
+        parameters->reserve(2);
+        parameters->push_back(std::make_shared<BaseLib::Variable>(_familyId));
+        parameters->push_back(warning);
+
+        auto result = _invoke("rateLimitExceeded", parameters);
+        if(result->errorStruct && result->structValue->at("faultCode")->integerValue != -1)
+        {
+            Gd::out.printError("Error calling rateLimitExceeded(): " + result->structValue->at("faultString")->stringValue);
+        }
+    }
+    catch(const std::exception& ex)
+    {
+        Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+}
+
+void ICommunicationInterface::forwardPacket(const BaseLib::PVariable& packet)
+{
+    limitAndForward(RateLimiter::noSource, takeReceiveTime(), packet, BaseLib::PVariable());
+}
+
+void ICommunicationInterface::forwardControlPacket(const BaseLib::PVariable& packet)
+{
+    limitAndForward(RateLimiter::noSource, takeReceiveTime(), packet, BaseLib::PVariable(), false);
+}
+
+void ICommunicationInterface::forwardPacket(uint32_t source, uint64_t dedupeHash, int32_t rssi, const BaseLib::PVariable& packet)
+{
+    ReceiveTime receiveTime = takeReceiveTime();
+    if(!_deduplicator)
+    {
+        _rfStatistics->frameReceived(source, rssi, false, receiveTime);
+        limitAndForward(source, receiveTime, packet, BaseLib::PVariable());
+        return;
+    }
+
+    //Deduplicate first, so copies from repeaters don't use up the tokens of the source.
+    bool firstCopy = _deduplicator->process(dedupeHash, rssi, [this, source, receiveTime, packet](const Deduplicator::Copies& copies)
+    {
+        //Without a hold time only the first copy was seen, so there is nothing to report.
+        if(_deduplicator->hold() == 0)
+        {
+            limitAndForward(source, receiveTime, packet, BaseLib::PVariable());
+            return;
+        }
+        auto metadata = _receivePool->metadata();
+        ReceivePool::setInteger(metadata, "copies", copies.count);
+        if(copies.bestRssi != FrameCapture::noRssi) ReceivePool::setInteger(metadata, "rssi", copies.bestRssi);
+        limitAndForward(source, receiveTime, packet, metadata);
+    });
+    _rfStatistics->frameReceived(source, rssi, !firstCopy, receiveTime);
+}
+
+void ICommunicationInterface::forwardHexFrame(const std::string& packetHex, uint8_t ignoredFlags, int32_t rssi, const BaseLib::PVariable& packet)
+{
+    try
+    {
+        if(packetHex.size() < 14)
+        {
+            forwardPacket(packet);
+            return;
+        }
+        uint32_t sender = (uint32_t)BaseLib::Math::getNumber(packetHex.substr(8, 6), true);
+        forwardPacket(sender, _deduplicator ? Deduplicator::hashHexFrame(packetHex, ignoredFlags) : 0, rssi, packet);
     }
     catch(const std::exception& ex)
     {
         Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
     }
-}
\ No newline at end of file
+}
+
+BaseLib::PVariable ICommunicationInterface::getReceiveStatus()
+{
+    auto status = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+    if(_deduplicator) status->structValue->emplace("dedupe", _deduplicator->getStatus());
+    if(_rateLimiter) status->structValue->emplace("rateLimit", _rateLimiter->getStatus());
+    status->structValue->emplace("pool", _receivePool->getStatus());
+    if(_linkHealth) status->structValue->emplace("link", _linkHealth->getStatus());
+    return status;
+}
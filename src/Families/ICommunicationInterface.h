@@ -31,23 +31,159 @@
 #ifndef HOMEGEAR_GATEWAY_ICOMMUNICATIONINTERFACE_H
 #define HOMEGEAR_GATEWAY_ICOMMUNICATIONINTERFACE_H
 
+#include "../Settings.h"
+#include "../FrameCapture.h"
+#include "RpcMethods.h"
+#include "Deduplicator.h"
+#include "LinkHealth.h"
+#include "RateLimiter.h"
+#include "ReceivePool.h"
+#include "ReceiveTime.h"
+#include "RfStatistics.h"
+
 #include <homegear-base/BaseLib.h>
 
 class ICommunicationInterface
 {
 public:
-    ICommunicationInterface(BaseLib::SharedObjects* bl);
-    virtual ~ICommunicationInterface() = default;
+    /**
+     * The fault code of the error the invoke function returns when Homegear doesn't respond in time.
+     */
+    static constexpr int32_t invokeTimeoutFaultCode = -32501;
+
+    ICommunicationInterface(BaseLib::SharedObjects* bl, const InterfaceSettings& settings);
+    virtual ~ICommunicationInterface();
 
     int32_t familyId() { return _familyId; }
+    const InterfaceSettings& settings() { return _settings; }
+
+    /**
+     * @return The number of frames waiting to be written to the device or 0 if the interface has no transmit queue.
+     */
+    virtual size_t txQueueDepth() { return 0; }
 
-    virtual BaseLib::PVariable callMethod(std::string& method, BaseLib::PArray parameters) = 0;
+    /**
+     * @return The number of requests waiting for a response from the device.
+     */
+    virtual size_t pendingRequests() { return 0; }
+
+    /**
+     * Calls a local RPC method by ID. This is the fast path used by RpcServer.
+     */
+    BaseLib::PVariable callMethod(RpcMethod method, BaseLib::PArray parameters);
+
+    /**
+     * Calls a local RPC method by name.
+     */
+    BaseLib::PVariable callMethod(const std::string& method, BaseLib::PArray parameters) { return callMethod(RpcMethods::getId(method), parameters); }
     void setInvoke(std::function<BaseLib::PVariable(std::string, BaseLib::PArray&)> value) { _invoke.swap(value); }
+
+    FrameCapture::LinkType captureLinkType() { return _captureLinkType; }
+
+    /**
+     * Feeds a recorded inbound frame into the receive path as if it had been received from the device. Used by FrameReplay.
+     * The frame is moved into the receive path, so its content is undefined afterwards.
+     *
+     * @return Returns false when the interface does not support replaying frames.
+     */
+    virtual bool replayFrame(std::vector<uint8_t>& frame) { return false; }
+
+    /**
+     * @return Counters of the receive path.
+     */
+    BaseLib::PVariable getReceiveStatus();
 protected:
     BaseLib::SharedObjects* _bl = nullptr;
     int32_t _familyId = -1;
-    std::map<std::string, std::function<BaseLib::PVariable(BaseLib::PArray& parameters)>> _localRpcMethods;
+    InterfaceSettings _settings;
+    std::array<std::function<BaseLib::PVariable(BaseLib::PArray& parameters)>, RpcMethods::size> _localRpcMethods;
+
+    void registerRpcMethod(RpcMethod method, std::function<BaseLib::PVariable(BaseLib::PArray& parameters)> function) { _localRpcMethods.at((size_t)method) = std::move(function); }
     std::function<BaseLib::PVariable(std::string, BaseLib::PArray&)> _invoke;
+    std::unique_ptr<Deduplicator> _deduplicator;
+    std::unique_ptr<RateLimiter> _rateLimiter;
+    std::unique_ptr<RfStatistics> _rfStatistics;
+
+    /**
+     * Set by families reading from a serial device themselves.
+     */
+    std::unique_ptr<LinkHealth> _linkHealth;
+
+    /**
+     * Provides the Variables passed to forwardPacket(), so they aren't allocated for every received frame.
+     */
+    std::unique_ptr<ReceivePool> _receivePool;
+
+    /**
+     * Set by the receive thread when a frame is complete and taken by the next call to forwardPacket(). Frames
+     * forwarded without it get the time forwardPacket() is called.
+     */
+    ReceiveTime _receiveTime;
+
+    /**
+     * Passes a received frame to Homegear by calling packetReceived. Frames exceeding the receive budget are dropped.
+     */
+    void forwardPacket(const BaseLib::PVariable& packet);
+
+    /**
+     * Like forwardPacket(), but exempt from the receive budget. For protocol control frames (e. g. ACK, NACK and
+     * responses to host requests), which Homegear needs to complete its own exchanges with the device. Only frames the
+     * device sends in reply to the host may be passed here, so their rate is bounded by Homegear's requests.
+     */
+    void forwardControlPacket(const BaseLib::PVariable& packet);
+
+    /**
+     * Like forwardPacket(), but also drops frames of sources exceeding their rate limit and copies of frames forwarded
+     * within the dedupe window of the interface. All frames including the dropped ones are counted in the RF statistics.
+     *
+     * @param source The sender address of the frame.
+     * @param dedupeHash The hash of the frame without RSSI and repeater information, see Deduplicator::hash().
+     * @param rssi The RSSI of the frame in dBm or FrameCapture::noRssi.
+     */
+    void forwardPacket(uint32_t source, uint64_t dedupeHash, int32_t rssi, const BaseLib::PVariable& packet);
+
+    /**
+     * forwardPacket() for BidCoS and MAX! frames in hex. See AddressFilter::forwardHexFrame() for the layout.
+     *
+     * @param ignoredFlags The bits of the flags byte, which repeaters change, see Deduplicator::hashHexFrame().
+     */
+    void forwardHexFrame(const std::string& packetHex, uint8_t ignoredFlags, int32_t rssi, const BaseLib::PVariable& packet);
+
+    /**
+     * @return Returns true when the gateway replays a trace. The device must not be opened then.
+     */
+    bool replaying();
+
+    //{{{ Frame capture
+    /**
+     * The format of the frames passed to captureFrame(). Set by the family's constructor.
+     */
+    FrameCapture::LinkType _captureLinkType = FrameCapture::LinkType::enOceanEsp3;
+
+    /**
+     * Records a frame in the flight recorder and, when capturing is enabled, in the capture. Frames are captured as they
+     * are on the wire, before any filtering.
+     */
+    void captureFrame(FrameCapture::Direction direction, const uint8_t* data, size_t size, int32_t rssi = FrameCapture::noRssi);
+    void captureFrame(FrameCapture::Direction direction, const std::vector<uint8_t>& data, int32_t rssi = FrameCapture::noRssi) { captureFrame(direction, data.data(), data.size(), rssi); }
+    void captureFrame(FrameCapture::Direction direction, const std::string& data, int32_t rssi = FrameCapture::noRssi) { captureFrame(direction, (const uint8_t*)data.data(), data.size(), rssi); }
+    //}}}
+private:
+    std::atomic<int64_t> _captureInterface{-1};
+
+    /**
+     * Applies the rate limits and calls packetReceived. The metadata is passed as third parameter when set.
+     *
+     * @param limit Set to false to skip the rate limits.
+     */
+    void limitAndForward(int64_t source, const ReceiveTime& receiveTime, const BaseLib::PVariable& packet, BaseLib::PVariable metadata, bool limit = true);
+
+    ReceiveTime takeReceiveTime();
+
+    /**
+     * Tells Homegear about a source or the interface exceeding its limit by calling rateLimitExceeded.
+     */
+    void raiseRateLimitWarning(int64_t source, const RateLimiter::Result& result);
 };
 
 
@@ -0,0 +1,193 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "LinkHealth.h"
+#include "../Gd.h"
+
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+
+LinkHealth::LinkHealth(int32_t baudRate, uint32_t maxPartialFrameTimeout) {
+  _baudRate = baudRate > 0 ? baudRate : 9600;
+  _byteTime = 10000000 / _baudRate; //Start bit, 8 data bits and stop bit.
+  _maxPartialFrameTimeout = maxPartialFrameTimeout;
+  _partialFrameTimeout = maxPartialFrameTimeout;
+}
+
+bool LinkHealth::byteReceived(const ReceiveTime &readTime, bool inFrame) {
+  try {
+    int64_t time = readTime.monotonic / 1000;
+    bool inTime = true;
+    if (inFrame && time != _lastReadTime && _lastReadTime != 0) {
+      int64_t gap = time - _lastReadTime;
+      if (gap > _partialFrameTimeout) inTime = false;
+      else addGap(gap);
+    }
+    if (!inFrame || !inTime) _frameStartTime = time;
+    _lastReadTime = time;
+    return inTime;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return true;
+}
+
+void LinkHealth::addGap(int64_t gap) {
+  if (_gapSamples == 0) {
+    _gap = gap;
+    _gapDeviation = gap / 2.0;
+  } else {
+    double error = gap - _gap;
+    _gap += error / 8;
+    _gapDeviation += (std::abs(error) - _gapDeviation) / 4;
+  }
+  _gapSamples++;
+  _interByteGap = (int64_t)_gap;
+  if (_gapSamples < _minGapSamples) return;
+
+  //Never go below a few byte times plus the scheduling jitter of the reading thread.
+  double minimum = 2000 + 4 * std::max((double)_byteTime, _observedByteTime.load());
+  double timeout = std::max(minimum, _gap + 4 * _gapDeviation);
+  _partialFrameTimeout = (uint32_t)std::min((double)_maxPartialFrameTimeout, timeout);
+}
+
+void LinkHealth::frameCompleted(size_t size) {
+  try {
+    _frames++;
+    if (size > 1 && _lastReadTime > _frameStartTime) {
+      double byteTime = (double)(_lastReadTime - _frameStartTime) / (size - 1);
+      double observedByteTime = _observedByteTime;
+      _observedByteTime = observedByteTime == 0 ? byteTime : observedByteTime + (byteTime - observedByteTime) / 8;
+    }
+    if (_lastFrameTime != 0) {
+      int64_t gap = _lastReadTime - _lastFrameTime;
+      int64_t interFrameGap = _interFrameGap;
+      _interFrameGap = interFrameGap == 0 ? gap : interFrameGap + (gap - interFrameGap) / 8;
+    }
+    _lastFrameTime = _lastReadTime;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void LinkHealth::frameIncomplete() {
+  _incompleteFrames++;
+  //The missing byte might just have been late. Back off like after a lost gap measurement of twice the timeout, so a
+  //slower adapter doesn't lose frame after frame.
+  if (_gapSamples >= _minGapSamples) addGap(2 * (int64_t)_partialFrameTimeout);
+}
+
+uint32_t LinkHealth::readFailed() {
+  _readErrors++;
+  return ++_consecutiveReadErrors;
+}
+
+void LinkHealth::pollUartErrors(const BaseLib::PFileDescriptor &fileDescriptor) {
+  try {
+#ifdef TIOCGICOUNT
+    if (!fileDescriptor || fileDescriptor->descriptor == -1) return;
+    int64_t time = BaseLib::HelperFunctions::getTime();
+    std::lock_guard<std::mutex> uartGuard(_uartMutex);
+    bool reopened = fileDescriptor->id != _fileDescriptorId;
+    if (!reopened && (!_uartCountersSupported || time - _lastUartPoll < 1000)) return;
+    _lastUartPoll = time;
+    _fileDescriptorId = fileDescriptor->id;
+
+    struct serial_icounter_struct icount{};
+    if (ioctl(fileDescriptor->descriptor, TIOCGICOUNT, &icount) == -1) {
+      if (_uartCountersSupported) Gd::out.printDebug("Debug: The serial driver doesn't provide UART error counters.");
+      _uartCountersSupported = false;
+      return;
+    }
+    _uartCountersSupported = true;
+
+    UartCounters counters;
+    counters.frame = icount.frame;
+    counters.overrun = icount.overrun;
+    counters.parity = icount.parity;
+    counters.brk = icount.brk;
+    counters.bufferOverrun = icount.buf_overrun;
+    if (reopened) {
+      //The counters are those of the port, not of this descriptor.
+      _uartBase = counters;
+      return;
+    }
+
+    int64_t overruns = (counters.overrun - _uartBase.overrun) + (counters.bufferOverrun - _uartBase.bufferOverrun);
+    int64_t framingErrors = (counters.frame - _uartBase.frame) + (counters.parity - _uartBase.parity);
+    _uartErrors.frame += counters.frame - _uartBase.frame;
+    _uartErrors.overrun += counters.overrun - _uartBase.overrun;
+    _uartErrors.parity += counters.parity - _uartBase.parity;
+    _uartErrors.brk += counters.brk - _uartBase.brk;
+    _uartErrors.bufferOverrun += counters.bufferOverrun - _uartBase.bufferOverrun;
+    _uartBase = counters;
+
+    if (overruns > 0) Gd::out.printWarning("Warning: " + std::to_string(overruns) + " UART overrun(s) on serial device. Received bytes were lost.");
+    if (framingErrors > 0) Gd::out.printWarning("Warning: " + std::to_string(framingErrors) + " UART framing or parity error(s) on serial device. Please check the baud rate and the connection.");
+#endif
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+BaseLib::PVariable LinkHealth::getStatus() {
+  try {
+    auto status = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+    status->structValue->emplace("baudRate", std::make_shared<BaseLib::Variable>(_baudRate));
+    status->structValue->emplace("partialFrameTimeout", std::make_shared<BaseLib::Variable>((int64_t)_partialFrameTimeout));
+    status->structValue->emplace("interByteGap", std::make_shared<BaseLib::Variable>(_interByteGap.load()));
+    status->structValue->emplace("interFrameGap", std::make_shared<BaseLib::Variable>(_interFrameGap.load()));
+    status->structValue->emplace("byteTime", std::make_shared<BaseLib::Variable>(std::max(_byteTime, (int64_t)_observedByteTime.load())));
+    status->structValue->emplace("frames", std::make_shared<BaseLib::Variable>((int64_t)_frames));
+    status->structValue->emplace("incompleteFrames", std::make_shared<BaseLib::Variable>((int64_t)_incompleteFrames));
+    status->structValue->emplace("corruptedFrames", std::make_shared<BaseLib::Variable>((int64_t)_corruptedFrames));
+    status->structValue->emplace("discardedBytes", std::make_shared<BaseLib::Variable>((int64_t)_discardedBytes));
+    status->structValue->emplace("readErrors", std::make_shared<BaseLib::Variable>((int64_t)_readErrors));
+
+    std::lock_guard<std::mutex> uartGuard(_uartMutex);
+    if (_uartCountersSupported && _fileDescriptorId != -1) {
+      auto uartErrors = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+      uartErrors->structValue->emplace("frame", std::make_shared<BaseLib::Variable>(_uartErrors.frame));
+      uartErrors->structValue->emplace("overrun", std::make_shared<BaseLib::Variable>(_uartErrors.overrun));
+      uartErrors->structValue->emplace("parity", std::make_shared<BaseLib::Variable>(_uartErrors.parity));
+      uartErrors->structValue->emplace("break", std::make_shared<BaseLib::Variable>(_uartErrors.brk));
+      uartErrors->structValue->emplace("bufferOverrun", std::make_shared<BaseLib::Variable>(_uartErrors.bufferOverrun));
+      status->structValue->emplace("uartErrors", uartErrors);
+    }
+    return status;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
+}
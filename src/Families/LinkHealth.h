@@ -0,0 +1,178 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_LINKHEALTH_H
+#define HOMEGEAR_GATEWAY_LINKHEALTH_H
+
+#include "ReceiveTime.h"
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Watches the serial link to a module. It measures the gaps between the reads within a frame and derives the partial
+ * frame timeout from them, so a corrupted frame (e. g. one with a lost byte) is discarded milliseconds after the last
+ * byte instead of after a fixed worst case. It also counts frames, incomplete and corrupted frames and the UART errors
+ * the driver reports through TIOCGICOUNT.
+ *
+ * All methods but getStatus() must only be called from the thread reading from the device.
+ */
+class LinkHealth
+{
+public:
+    /**
+     * The number of consecutive read errors after which the device should be reopened.
+     */
+    static constexpr uint32_t maxConsecutiveReadErrors = 5;
+
+    /**
+     * @param baudRate The baud rate of the device. 8N1 framing is assumed.
+     * @param maxPartialFrameTimeout The partial frame timeout in microseconds used until enough gaps were measured. It is
+     * also the upper bound of the adaptive timeout.
+     */
+    LinkHealth(int32_t baudRate, uint32_t maxPartialFrameTimeout);
+    virtual ~LinkHealth() = default;
+
+    /**
+     * @return The time in microseconds to wait for the next byte of a partial frame.
+     */
+    uint32_t partialFrameTimeout() { return _partialFrameTimeout; }
+
+    /**
+     * Call for every received byte.
+     *
+     * @param readTime The time the read returning the byte completed.
+     * @param inFrame True when the byte continues a partial frame.
+     * @return Returns false when the gap since the previous read exceeds the partial frame timeout. The partial frame
+     * must be discarded then. This only happens in event loop mode, where there is no read timeout.
+     */
+    bool byteReceived(const ReceiveTime& readTime, bool inFrame);
+
+    /**
+     * Call when a byte is discarded because it doesn't start a frame.
+     */
+    void byteDiscarded() { _discardedBytes++; }
+
+    /**
+     * Call when a frame with a valid checksum is complete.
+     *
+     * @param size The size of the frame in bytes.
+     */
+    void frameCompleted(size_t size);
+
+    /**
+     * Call when a frame is discarded because of a checksum error or an invalid header.
+     */
+    void frameCorrupted() { _corruptedFrames++; }
+
+    /**
+     * Call when a partial frame is discarded because the partial frame timeout expired.
+     */
+    void frameIncomplete();
+
+    /**
+     * Call when reading from the device fails.
+     *
+     * @return The number of consecutive read errors.
+     */
+    uint32_t readFailed();
+
+    /**
+     * Call when reading from the device succeeds again.
+     */
+    void readSucceeded() { _consecutiveReadErrors = 0; }
+
+    /**
+     * Fetches the UART error counters of the device at most once per second and logs new overruns and framing
+     * errors. Call it regularly, e. g. on read timeouts and after completed frames.
+     */
+    void pollUartErrors(const BaseLib::PFileDescriptor& fileDescriptor);
+
+    BaseLib::PVariable getStatus();
+private:
+    struct UartCounters
+    {
+        int64_t frame = 0;
+        int64_t overrun = 0;
+        int64_t parity = 0;
+        int64_t brk = 0;
+        int64_t bufferOverrun = 0;
+    };
+
+    /**
+     * The number of gaps measured before the adaptive timeout replaces the maximum.
+     */
+    static constexpr uint32_t _minGapSamples = 16;
+
+    int32_t _baudRate = 0;
+    int64_t _byteTime = 0;
+    int64_t _maxPartialFrameTimeout = 0;
+    std::atomic<uint32_t> _partialFrameTimeout{0};
+
+    //{{{ Timing, only used by the reading thread
+    int64_t _lastReadTime = 0;
+    int64_t _frameStartTime = 0;
+    int64_t _lastFrameTime = 0;
+    uint32_t _gapSamples = 0;
+    double _gap = 0;
+    double _gapDeviation = 0;
+    //}}}
+
+    /**
+     * The smoothed time per byte within frames spanning several reads in microseconds. It is larger than the nominal
+     * byte time when the adapter forwards the data in chunks.
+     */
+    std::atomic<double> _observedByteTime{0};
+
+    //{{{ UART counters
+    std::mutex _uartMutex;
+    int32_t _fileDescriptorId = -1;
+    bool _uartCountersSupported = true;
+    int64_t _lastUartPoll = 0;
+    UartCounters _uartBase;
+    UartCounters _uartErrors;
+    //}}}
+
+    std::atomic<uint64_t> _frames{0};
+    std::atomic<uint64_t> _incompleteFrames{0};
+    std::atomic<uint64_t> _corruptedFrames{0};
+    std::atomic<uint64_t> _discardedBytes{0};
+    std::atomic<uint64_t> _readErrors{0};
+    std::atomic<uint32_t> _consecutiveReadErrors{0};
+    std::atomic<int64_t> _interByteGap{0};
+    std::atomic<int64_t> _interFrameGap{0};
+
+    /**
+     * Adds a gap to the smoothed gap and its deviation like TCP's retransmission timer does and recalculates the partial
+     * frame timeout.
+     */
+    void addGap(int64_t gap);
+};
+
+#endif
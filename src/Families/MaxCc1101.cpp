@@ -29,15 +29,19 @@
 */
 
 #include "MaxCc1101.h"
+#include "FamilyModule.h"
 #ifdef SPISUPPORT
 #include "../Gd.h"
+#include "../IoBackend.h"
+#include "../RealTime.h"
 #include <sys/poll.h>
 
-MaxCc1101::MaxCc1101(BaseLib::SharedObjects* bl) : ICommunicationInterface(bl)
+MaxCc1101::MaxCc1101(BaseLib::SharedObjects* bl, const InterfaceSettings& settings) : ICommunicationInterface(bl, settings)
 {
     try
     {
         _familyId = MAX_CC1101_FAMILY_ID;
+        _captureLinkType = FrameCapture::LinkType::maxCc1101;
 
         _stopCallbackThread = true;
         _stopped = true;
@@ -47,10 +51,13 @@ MaxCc1101::MaxCc1101(BaseLib::SharedObjects* bl) : ICommunicationInterface(bl)
         _updateMode = false;
         _gpio.reset(new BaseLib::LowLevel::Gpio(bl, Gd::settings.gpioPath()));
 
-        _localRpcMethods.emplace("sendPacket", std::bind(&MaxCc1101::sendPacket, this, std::placeholders::_1));
+        _addressFilter.reset(new AddressFilter(bl, "MAX! CC1101"));
+        registerRpcMethod(RpcMethod::sendPacket, std::bind(&MaxCc1101::sendPacket, this, std::placeholders::_1));
+        registerRpcMethod(RpcMethod::getSubscriptions, std::bind(&AddressFilter::getSubscriptions, _addressFilter.get(), std::placeholders::_1));
+        registerRpcMethod(RpcMethod::setSubscriptions, std::bind(&AddressFilter::setSubscriptions, _addressFilter.get(), std::placeholders::_1));
 
-        _oscillatorFrequency = Gd::settings.oscillatorFrequency();
-        _interruptPin = Gd::settings.interruptPin();
+        _oscillatorFrequency = _settings.oscillatorFrequency;
+        _interruptPin = _settings.interruptPin;
 
         if(_oscillatorFrequency < 0) _oscillatorFrequency = 26000000;
         if(_interruptPin != 0 && _interruptPin != 2)
@@ -87,7 +94,14 @@ void MaxCc1101::start()
 {
     try
     {
-        if(Gd::settings.device().empty())
+        if(replaying())
+        {
+            //Frames are fed in by FrameReplay. Don't open the device. _stopped stays set, so nothing is sent.
+            _fileDescriptor = std::make_shared<BaseLib::FileDescriptor>();
+            return;
+        }
+
+        if(_settings.device.empty())
         {
             Gd::out.printError("Error: No device defined for family MAX! CC1101. Please specify it in \"gateway.conf\".");
             return;
@@ -98,7 +112,7 @@ void MaxCc1101::start()
         _stopped = false;
         _firstPacket = true;
         _stopCallbackThread = false;
-        Gd::bl->threadManager.start(_listenThread, true, 45, SCHED_FIFO, &MaxCc1101::mainThread, this);
+        Gd::bl->threadManager.start(_listenThread, true, &MaxCc1101::mainThread, this);
     }
     catch(const std::exception& ex)
     {
@@ -113,8 +127,8 @@ void MaxCc1101::stop()
         _stopCallbackThread = true;
         Gd::bl->threadManager.join(_listenThread);
         _stopCallbackThread = false;
-        if(_fileDescriptor->descriptor != -1) closeDevice();
-        _gpio->closeDevice(Gd::settings.gpio1());
+        if(_fileDescriptor && _fileDescriptor->descriptor != -1) closeDevice();
+        _gpio->closeDevice(_settings.gpio1);
         _stopped = true;
     }
     catch(const std::exception& ex)
@@ -127,9 +141,16 @@ void MaxCc1101::mainThread()
 {
     try
     {
+        RealTime::apply(RealTime::Subsystem::cc1101);
         int32_t pollResult;
         int32_t bytesRead;
         std::vector<char> readBuffer({'0'});
+        std::unique_ptr<IoBackend> ioBackend = IoBackend::create(Gd::bl.get());
+        if(!ioBackend)
+        {
+            Gd::out.printError("Error: Could not create I/O backend.");
+            return;
+        }
 
         while(!_stopCallbackThread)
         {
@@ -140,7 +161,7 @@ void MaxCc1101::mainThread()
                     std::this_thread::sleep_for(std::chrono::milliseconds(200));
                     continue;
                 }
-                if(!_stopCallbackThread && (_fileDescriptor->descriptor == -1 || !_gpio->isOpen(Gd::settings.gpio1())))
+                if(!_stopCallbackThread && (_fileDescriptor->descriptor == -1 || !_gpio->isOpen(_settings.gpio1)))
                 {
                     Gd::out.printError("Connection to TI CC1101 closed unexpectedly... Trying to reconnect...");
                     _stopped = true; //Set to true, so that sendPacket aborts
@@ -151,19 +172,13 @@ void MaxCc1101::mainThread()
                     }
                     _txMutex.unlock(); //Make sure _txMutex is unlocked
 
-                    _gpio->closeDevice(Gd::settings.gpio1());
+                    _gpio->closeDevice(_settings.gpio1);
                     initDevice();
                     _stopped = false;
                     continue;
                 }
 
-                pollfd pollstruct {
-                        (int)_gpio->getFileDescriptor(Gd::settings.gpio1())->descriptor,
-                        (short)(POLLPRI | POLLERR),
-                        (short)0
-                };
-
-                pollResult = poll(&pollstruct, 1, 100);
+                pollResult = ioBackend->poll(_gpio->getFileDescriptor(_settings.gpio1), POLLPRI | POLLERR, 100);
                 /*if(pollstruct.revents & POLLERR)
                 {
                     _out.printWarning("Warning: Error polling GPIO. Reopening...");
@@ -173,8 +188,9 @@ void MaxCc1101::mainThread()
                 }*/
                 if(pollResult > 0)
                 {
-                    if(lseek(_gpio->getFileDescriptor(Gd::settings.gpio1())->descriptor, 0, SEEK_SET) == -1) throw BaseLib::Exception("Could not poll gpio: " + std::string(strerror(errno)));
-                    bytesRead = read(_gpio->getFileDescriptor(Gd::settings.gpio1())->descriptor, &readBuffer[0], 1);
+                    _receiveTime = ReceiveTime::now(); //As close to the GDO0 edge signalling the end of the frame as possible.
+                    if(lseek(_gpio->getFileDescriptor(_settings.gpio1)->descriptor, 0, SEEK_SET) == -1) throw BaseLib::Exception("Could not poll gpio: " + std::string(strerror(errno)));
+                    bytesRead = read(_gpio->getFileDescriptor(_settings.gpio1)->descriptor, &readBuffer[0], 1);
                     if(!bytesRead) continue;
                     if(readBuffer.at(0) == 0x30)
                     {
@@ -205,10 +221,18 @@ void MaxCc1101::mainThread()
                                     continue;
                                 }
                             }
-                            else if(packetBytes.size() >= 9) packet = BaseLib::HelperFunctions::getHexString(packetBytes);
+                            else if(packetBytes.size() >= 9)
+                            {
+                                captureFrame(FrameCapture::Direction::inbound, packetBytes, FrameCapture::cc1101Rssi(packetBytes.back()));
+                                packet = BaseLib::HelperFunctions::getHexString(packetBytes);
+                            }
                             else Gd::out.printWarning("Warning: Too small packet received: " + BaseLib::HelperFunctions::getHexString(packetBytes));
                         }
-                        else Gd::out.printDebug("Debug: MAX! packet received, but CRC failed.");
+                        else
+                        {
+                            Gd::out.printDebug("Debug: MAX! packet received, but CRC failed.");
+                            _rfStatistics->crcError(); //The CC1101 flushes the frame, so the sender is unknown.
+                        }
                         if(!_sendingPending)
                         {
                             sendCommandStrobe(CommandStrobes::Enum::SFRX);
@@ -218,22 +242,7 @@ void MaxCc1101::mainThread()
                         if(!packet.empty())
                         {
                             if(_firstPacket) _firstPacket = false;
-                            else
-                            {
-                                BaseLib::PArray parameters = std::make_shared<BaseLib::Array>();
-                                parameters->reserve(2);
-                                parameters->push_back(std::make_shared<BaseLib::Variable>(MAX_CC1101_FAMILY_ID));
-                                parameters->push_back(std::make_shared<BaseLib::Variable>(packet));
-
-                                if(_invoke)
-                                {
-                                    auto result = _invoke("packetReceived", parameters);
-                                    if(result->errorStruct && result->structValue->at("faultCode")->integerValue != -1)
-                                    {
-                                        Gd::out.printError("Error calling packetReceived(): " + result->structValue->at("faultString")->stringValue);
-                                    }
-                                }
-                            }
+                            else processPacket(packet);
                         }
                     }
                 }
@@ -241,9 +250,9 @@ void MaxCc1101::mainThread()
                 {
                     _txMutex.unlock();
                     Gd::out.printError("Error: Could not poll gpio: " + std::string(strerror(errno)) + ". Reopening...");
-                    _gpio->closeDevice(Gd::settings.gpio1());
+                    _gpio->closeDevice(_settings.gpio1);
                     std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-                    _gpio->openDevice(Gd::settings.gpio1(), true);
+                    _gpio->openDevice(_settings.gpio1, true);
                 }
                 //pollResult == 0 is timeout
             }
@@ -261,6 +270,21 @@ void MaxCc1101::mainThread()
     _txMutex.unlock();
 }
 
+void MaxCc1101::processPacket(const std::string& packet)
+{
+    try
+    {
+        if(!_addressFilter->forwardHexFrame(packet)) return;
+
+        int32_t rssi = packet.size() >= 2 ? FrameCapture::cc1101Rssi((uint8_t)BaseLib::Math::getNumber(packet.substr(packet.size() - 2), true)) : FrameCapture::noRssi;
+        forwardHexFrame(packet, 0, rssi, _receivePool->packet(packet));
+    }
+    catch(const std::exception& ex)
+    {
+        Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+}
+
 void MaxCc1101::initDevice()
 {
     try
@@ -270,7 +294,7 @@ void MaxCc1101::initDevice()
 
         initChip();
         Gd::out.printDebug("Debug: CC1100: Setting GPIO direction");
-        int32_t gpioIndex = Gd::settings.gpio1();
+        int32_t gpioIndex = _settings.gpio1;
         if(gpioIndex == -1)
         {
             Gd::out.printError("Error: GPIO 1 is not defined in settings.");
@@ -282,7 +306,7 @@ void MaxCc1101::initDevice()
         _gpio->openDevice(gpioIndex, true);
         if(!_gpio->isOpen(gpioIndex))
         {
-            Gd::out.printError("Error: Couldn't listen to rf device, because the GPIO descriptor is not valid: " + Gd::settings.device());
+            Gd::out.printError("Error: Couldn't listen to rf device, because the GPIO descriptor is not valid: " + _settings.device);
             return;
         }
     }
@@ -298,7 +322,7 @@ void MaxCc1101::openDevice()
     {
         if(_fileDescriptor && _fileDescriptor->descriptor != -1) closeDevice();
 
-        _lockfile = Gd::bl->settings.lockFilePath() + "LCK.." + Gd::settings.device().substr(Gd::settings.device().find_last_of('/') + 1);
+        _lockfile = Gd::bl->settings.lockFilePath() + "LCK.." + _settings.device.substr(_settings.device.find_last_of('/') + 1);
         int lockfileDescriptor = open(_lockfile.c_str(), O_WRONLY | O_EXCL | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
         if(lockfileDescriptor == -1)
         {
@@ -313,7 +337,7 @@ void MaxCc1101::openDevice()
             lockfileStream >> processID;
             if(getpid() != processID && kill(processID, 0) == 0)
             {
-                Gd::out.printCritical("Rf device is in use: " + Gd::settings.device());
+                Gd::out.printCritical("Rf device is in use: " + _settings.device);
                 return;
             }
             unlink(_lockfile.c_str());
@@ -327,12 +351,12 @@ void MaxCc1101::openDevice()
         dprintf(lockfileDescriptor, "%10i", getpid());
         close(lockfileDescriptor);
 
-        _fileDescriptor = _bl->fileDescriptorManager.add(open(Gd::settings.device().c_str(), O_RDWR | O_NONBLOCK));
+        _fileDescriptor = _bl->fileDescriptorManager.add(open(_settings.device.c_str(), O_RDWR | O_NONBLOCK));
         usleep(1000);
 
         if(_fileDescriptor->descriptor == -1)
         {
-            Gd::out.printCritical("Couldn't open rf device \"" + Gd::settings.device() + "\": " + strerror(errno));
+            Gd::out.printCritical("Couldn't open rf device \"" + _settings.device + "\": " + strerror(errno));
             return;
         }
 
@@ -367,14 +391,14 @@ void MaxCc1101::setupDevice()
         uint8_t bits = 8;
         uint32_t speed = 4000000; //4MHz, see page 25 in datasheet
 
-        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_WR_MODE, &mode)) throw(BaseLib::Exception("Couldn't set spi mode on device " + Gd::settings.device()));
-        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_RD_MODE, &mode)) throw(BaseLib::Exception("Couldn't get spi mode off device " + Gd::settings.device()));
+        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_WR_MODE, &mode)) throw(BaseLib::Exception("Couldn't set spi mode on device " + _settings.device));
+        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_RD_MODE, &mode)) throw(BaseLib::Exception("Couldn't get spi mode off device " + _settings.device));
 
-        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_WR_BITS_PER_WORD, &bits)) throw(BaseLib::Exception("Couldn't set bits per word on device " + Gd::settings.device()));
-        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_RD_BITS_PER_WORD, &bits)) throw(BaseLib::Exception("Couldn't get bits per word off device " + Gd::settings.device()));
+        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_WR_BITS_PER_WORD, &bits)) throw(BaseLib::Exception("Couldn't set bits per word on device " + _settings.device));
+        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_RD_BITS_PER_WORD, &bits)) throw(BaseLib::Exception("Couldn't get bits per word off device " + _settings.device));
 
-        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_WR_MAX_SPEED_HZ, &speed)) throw(BaseLib::Exception("Couldn't set speed on device " + Gd::settings.device()));
-        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_RD_MAX_SPEED_HZ, &speed)) throw(BaseLib::Exception("Couldn't get speed off device " + Gd::settings.device()));
+        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_WR_MAX_SPEED_HZ, &speed)) throw(BaseLib::Exception("Couldn't set speed on device " + _settings.device));
+        if(ioctl(_fileDescriptor->descriptor, SPI_IOC_RD_MAX_SPEED_HZ, &speed)) throw(BaseLib::Exception("Couldn't get speed off device " + _settings.device));
     }
     catch(const std::exception& ex)
     {
@@ -502,13 +526,13 @@ void MaxCc1101::readwrite(std::vector<uint8_t>& data)
         _transfer.tx_buf = (uint64_t)&data[0];
         _transfer.rx_buf = (uint64_t)&data[0];
         _transfer.len = (uint32_t)data.size();
-        if(_bl->debugLevel >= 6) Gd::out.printDebug("Debug: Sending: " + _bl->hf.getHexString(data));
+        Gd::asyncLog.log(LogFormat::spiSending, data);
         if(!ioctl(_fileDescriptor->descriptor, SPI_IOC_MESSAGE(1), &_transfer))
         {
-            Gd::out.printError("Couldn't write to device " + Gd::settings.device() + ": " + std::string(strerror(errno)));
+            Gd::out.printError("Couldn't write to device " + _settings.device + ": " + std::string(strerror(errno)));
             return;
         }
-        if(_bl->debugLevel >= 6) Gd::out.printDebug("Debug: Received: " + _bl->hf.getHexString(data));
+        Gd::asyncLog.log(LogFormat::spiReceived, data);
     }
     catch(const std::exception& ex)
     {
@@ -520,7 +544,7 @@ bool MaxCc1101::checkStatus(uint8_t statusByte, Status::Enum status)
 {
     try
     {
-        if(_fileDescriptor->descriptor == -1 || !_gpio->isOpen(Gd::settings.gpio1())) return false;
+        if(_fileDescriptor->descriptor == -1 || !_gpio->isOpen(_settings.gpio1)) return false;
         if((statusByte & (StatusBitmasks::Enum::CHIP_RDYn | StatusBitmasks::Enum::STATE)) != status) return false;
         return true;
     }
@@ -646,24 +670,6 @@ uint8_t MaxCc1101::sendCommandStrobe(CommandStrobes::Enum commandStrobe)
     return 0;
 }
 
-BaseLib::PVariable MaxCc1101::callMethod(std::string& method, BaseLib::PArray parameters)
-{
-    try
-    {
-        auto localMethodIterator = _localRpcMethods.find(method);
-        if(localMethodIterator == _localRpcMethods.end()) return BaseLib::Variable::createError(-32601, ": Requested method not found.");
-
-        if(Gd::bl->debugLevel >= 5) Gd::out.printDebug("Debug: Server is calling RPC method: " + method);
-
-        return localMethodIterator->second(parameters);
-    }
-    catch(const std::exception& ex)
-    {
-        Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
-    }
-    return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
-}
-
 //{{{ RPC methods
 BaseLib::PVariable MaxCc1101::sendPacket(BaseLib::PArray& parameters)
 {
@@ -671,14 +677,15 @@ BaseLib::PVariable MaxCc1101::sendPacket(BaseLib::PArray& parameters)
     {
         if(parameters->size() != 3 || parameters->at(1)->type != BaseLib::VariableType::tString || parameters->at(1)->stringValue.empty() || parameters->at(2)->type != BaseLib::VariableType::tBoolean) return BaseLib::Variable::createError(-1, "Invalid parameters.");
 
-        if(!_fileDescriptor || _fileDescriptor->descriptor == -1 || !_gpio->isOpen(Gd::settings.gpio1()) || _stopped) return BaseLib::Variable::createError(-1, "SPI device or GPIO is not open.");
+        if(!_fileDescriptor || _fileDescriptor->descriptor == -1 || !_gpio->isOpen(_settings.gpio1) || _stopped) return BaseLib::Variable::createError(-1, "SPI device or GPIO is not open.");
 
         std::vector<uint8_t> packetBytes = _bl->hf.getUBinary(parameters->at(1)->stringValue);
+        captureFrame(FrameCapture::Direction::outbound, packetBytes);
 
         _sendingPending = true;
         _txMutex.lock();
         _sendingPending = false;
-        if(_stopCallbackThread || _fileDescriptor->descriptor == -1 || !_gpio->isOpen(Gd::settings.gpio1()) || _stopped)
+        if(_stopCallbackThread || _fileDescriptor->descriptor == -1 || !_gpio->isOpen(_settings.gpio1) || _stopped)
         {
             _txMutex.unlock();
             return BaseLib::Variable::createError(-1, "SPI device or GPIO is not open.");
@@ -805,4 +812,6 @@ void MaxCc1101::setConfig()
 }
 //}}}
 
+HOMEGEAR_GATEWAY_FAMILY_MODULE(MaxCc1101)
+
 #endif
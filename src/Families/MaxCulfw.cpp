@@ -29,17 +29,23 @@
 */
 
 #include "MaxCulfw.h"
+#include "FamilyModule.h"
 #include "../Gd.h"
+#include "SerialLowLatency.h"
 
-MaxCulfw::MaxCulfw(BaseLib::SharedObjects* bl) : ICommunicationInterface(bl)
+MaxCulfw::MaxCulfw(BaseLib::SharedObjects* bl, const InterfaceSettings& settings) : ICommunicationInterface(bl, settings)
 {
     try
     {
         _familyId = MAX_COC_FAMILY_ID;
+        _captureLinkType = FrameCapture::LinkType::maxCulfw;
 
         _updateMode = false;
 
-        _localRpcMethods.emplace("sendPacket", std::bind(&MaxCulfw::sendPacket, this, std::placeholders::_1));
+        _addressFilter.reset(new AddressFilter(bl, "MAX! CUL"));
+        registerRpcMethod(RpcMethod::sendPacket, std::bind(&MaxCulfw::sendPacket, this, std::placeholders::_1));
+        registerRpcMethod(RpcMethod::getSubscriptions, std::bind(&AddressFilter::getSubscriptions, _addressFilter.get(), std::placeholders::_1));
+        registerRpcMethod(RpcMethod::setSubscriptions, std::bind(&AddressFilter::setSubscriptions, _addressFilter.get(), std::placeholders::_1));
 
         _gpio.reset(new BaseLib::LowLevel::Gpio(bl, Gd::settings.gpioPath()));
 
@@ -67,13 +73,15 @@ void MaxCulfw::start()
 {
     try
     {
-        if(Gd::settings.device().empty())
+        if(replaying()) return; //Frames are fed in by FrameReplay. Don't open the device.
+
+        if(_settings.device.empty())
         {
             Gd::out.printError("Error: No device defined for family MAX! CUL. Please specify it in \"gateway.conf\".");
             return;
         }
 
-        _serial.reset(new BaseLib::SerialReaderWriter(_bl, Gd::settings.device(), 38400, 0, true, 45));
+        _serial.reset(new BaseLib::SerialReaderWriter(_bl, _settings.device, 38400, 0, true, 45));
         _eventHandlerSelf = _serial->addEventHandler(this);
         _serial->openDevice(false, false, true);
         if(!_serial->isOpen())
@@ -81,21 +89,22 @@ void MaxCulfw::start()
             Gd::out.printError("Error: Could not open device.");
             return;
         }
+        if(Gd::settings.serialLowLatency()) SerialLowLatency::apply(_settings.device, _serial->fileDescriptor()->descriptor);
 
-        if(Gd::settings.gpio2() != -1)
+        if(_settings.gpio2 != -1)
         {
-            _gpio->openDevice(Gd::settings.gpio2(), false);
-            if(!_gpio->get(Gd::settings.gpio2())) _gpio->set(Gd::settings.gpio2(), true);
-            _gpio->closeDevice(Gd::settings.gpio2());
+            _gpio->openDevice(_settings.gpio2, false);
+            if(!_gpio->get(_settings.gpio2)) _gpio->set(_settings.gpio2, true);
+            _gpio->closeDevice(_settings.gpio2);
         }
-        if(Gd::settings.gpio1() != -1)
+        if(_settings.gpio1 != -1)
         {
-            _gpio->openDevice(Gd::settings.gpio1(), false);
-            _gpio->set(Gd::settings.gpio1(), false);
+            _gpio->openDevice(_settings.gpio1, false);
+            _gpio->set(_settings.gpio1, false);
             std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-            _gpio->set(Gd::settings.gpio1(), true);
+            _gpio->set(_settings.gpio1, true);
             std::this_thread::sleep_for(std::chrono::milliseconds(2000));
-            _gpio->closeDevice(Gd::settings.gpio1());
+            _gpio->closeDevice(_settings.gpio1);
         }
 
         std::string packet = "X21\nZr\n";
@@ -127,23 +136,16 @@ void MaxCulfw::lineReceived(const std::string& data)
 {
     try
     {
+        //SerialReaderWriter doesn't tell when the line was read, so this is as close as it gets.
+        _receiveTime = ReceiveTime::now();
         if(data.size() > 21) //21 is minimal packet length (=10 Byte + COC "Z" + "\n")
         {
             std::string packetHex = data.substr(1);
             BaseLib::HelperFunctions::trim(packetHex);
-            BaseLib::PArray parameters = std::make_shared<BaseLib::Array>();
-            parameters->reserve(2);
-            parameters->push_back(std::make_shared<BaseLib::Variable>(MAX_COC_FAMILY_ID));
-            parameters->push_back(std::make_shared<BaseLib::Variable>(data));
-
-            if(_invoke)
-            {
-                auto result = _invoke("packetReceived", parameters);
-                if(result->errorStruct && result->structValue->at("faultCode")->integerValue != -1)
-                {
-                    Gd::out.printError("Error calling packetReceived(): " + result->structValue->at("faultString")->stringValue);
-                }
-            }
+            int32_t rssi = FrameCapture::cc1101Rssi((uint8_t)BaseLib::Math::getNumber(packetHex.substr(packetHex.size() - 2), true));
+            captureFrame(FrameCapture::Direction::inbound, data, rssi);
+            if(!_addressFilter->forwardHexFrame(packetHex)) return;
+            forwardHexFrame(packetHex, 0, rssi, _receivePool->packet(data));
         }
         else if(!data.empty())
         {
@@ -158,24 +160,6 @@ void MaxCulfw::lineReceived(const std::string& data)
     }
 }
 
-BaseLib::PVariable MaxCulfw::callMethod(std::string& method, BaseLib::PArray parameters)
-{
-    try
-    {
-        auto localMethodIterator = _localRpcMethods.find(method);
-        if(localMethodIterator == _localRpcMethods.end()) return BaseLib::Variable::createError(-32601, ": Requested method not found.");
-
-        if(Gd::bl->debugLevel >= 5) Gd::out.printDebug("Debug: Server is calling RPC method: " + method);
-
-        return localMethodIterator->second(parameters);
-    }
-    catch(const std::exception& ex)
-    {
-        Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
-    }
-    return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
-}
-
 //{{{ RPC methods
 BaseLib::PVariable MaxCulfw::sendPacket(BaseLib::PArray& parameters)
 {
@@ -185,10 +169,11 @@ BaseLib::PVariable MaxCulfw::sendPacket(BaseLib::PArray& parameters)
 
         if(!_serial)
         {
-            Gd::out.printError("Error: Couldn't write to device, because the device descriptor is not valid: " + Gd::settings.device());
+            Gd::out.printError("Error: Couldn't write to device, because the device descriptor is not valid: " + _settings.device);
             return BaseLib::Variable::createError(-1, "Serial device is not open.");
         }
 
+        captureFrame(FrameCapture::Direction::outbound, "Zs" + parameters->at(1)->stringValue);
         std::string packet = "Zs" + parameters->at(1)->stringValue + "\n" + (_updateMode ? "" : "Zr\n");
         _serial->writeLine(packet);
 
@@ -203,4 +188,6 @@ BaseLib::PVariable MaxCulfw::sendPacket(BaseLib::PArray& parameters)
     }
     return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
 }
-//}}}
\ No newline at end of file
+//}}}
+
+HOMEGEAR_GATEWAY_FAMILY_MODULE(MaxCulfw)
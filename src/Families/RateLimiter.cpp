@@ -0,0 +1,143 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "RateLimiter.h"
+#include "../Gd.h"
+
+namespace {
+int64_t steadyTime() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+RateLimiter::RateLimiter(int32_t rate, int32_t burst, int32_t budget) {
+  _rate = rate < 0 ? 0 : rate;
+  _burst = burst < 1 ? 1 : burst;
+  _budget = budget < 0 ? 0 : budget;
+  _budgetBucket.tokens = _budget;
+  _budgetBucket.lastRefill = steadyTime();
+}
+
+bool RateLimiter::refill(Bucket &bucket, double rate, double size, int64_t now) {
+  int64_t elapsed = now - bucket.lastRefill;
+  if (elapsed > 0) {
+    bucket.tokens = std::min(size, bucket.tokens + (elapsed * rate) / 1000.0);
+    bucket.lastRefill = now;
+  }
+  return bucket.tokens >= size;
+}
+
+void RateLimiter::prune(int64_t now) {
+  if (now - _lastPrune < 1000) return;
+  _lastPrune = now;
+  for (auto sourceIterator = _sources.begin(); sourceIterator != _sources.end();) {
+    //Full buckets behave like new ones, so they can be removed unless there are drops left to report.
+    if (refill(sourceIterator->second, _rate, _burst, now) && sourceIterator->second.dropped == 0) sourceIterator = _sources.erase(sourceIterator);
+    else sourceIterator++;
+  }
+}
+
+RateLimiter::Result RateLimiter::admit(int64_t source) {
+  Result result;
+  try {
+    int64_t now = steadyTime();
+    std::lock_guard<std::mutex> bucketsGuard(_bucketsMutex);
+
+    Bucket *sourceBucket = nullptr;
+    if (_rate > 0 && source != noSource) {
+      auto sourceIterator = _sources.find((uint32_t)source);
+      if (sourceIterator == _sources.end()) {
+        if (_sources.size() >= _maxSources) prune(now);
+        if (_sources.size() < _maxSources) {
+          Bucket bucket;
+          bucket.tokens = _burst;
+          bucket.lastRefill = now;
+          sourceIterator = _sources.emplace((uint32_t)source, bucket).first;
+        }
+      }
+      if (sourceIterator != _sources.end()) sourceBucket = &sourceIterator->second;
+    }
+
+    if (sourceBucket) {
+      if (refill(*sourceBucket, _rate, _burst, now)) sourceBucket->limited = false;
+      if (sourceBucket->tokens < 1) {
+        result.forward = false;
+        if (!sourceBucket->limited) {
+          sourceBucket->limited = true;
+          result.sourceLimitReached = true;
+          _sourceLimits++;
+        }
+      }
+    }
+
+    if (result.forward && _budget > 0) {
+      if (refill(_budgetBucket, _budget, _budget, now)) _budgetBucket.limited = false;
+      if (_budgetBucket.tokens < 1) {
+        result.forward = false;
+        if (!_budgetBucket.limited) {
+          _budgetBucket.limited = true;
+          result.budgetExceeded = true;
+          _budgetLimits++;
+        }
+      }
+    }
+
+    uint32_t &dropped = sourceBucket ? sourceBucket->dropped : _droppedWithoutSource;
+    if (!result.forward) {
+      dropped++;
+      _framesDropped++;
+      return result;
+    }
+
+    if (sourceBucket) sourceBucket->tokens -= 1;
+    if (_budget > 0) _budgetBucket.tokens -= 1;
+    result.dropped = dropped;
+    dropped = 0;
+    _framesForwarded++;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return result;
+}
+
+BaseLib::PVariable RateLimiter::getStatus() {
+  auto status = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+  status->structValue->emplace("rate", std::make_shared<BaseLib::Variable>(_rate));
+  status->structValue->emplace("burst", std::make_shared<BaseLib::Variable>((int32_t)_burst));
+  status->structValue->emplace("budget", std::make_shared<BaseLib::Variable>(_budget));
+  status->structValue->emplace("framesForwarded", std::make_shared<BaseLib::Variable>((int64_t)_framesForwarded));
+  status->structValue->emplace("framesDropped", std::make_shared<BaseLib::Variable>((int64_t)_framesDropped));
+  status->structValue->emplace("sourceLimits", std::make_shared<BaseLib::Variable>((int64_t)_sourceLimits));
+  status->structValue->emplace("budgetLimits", std::make_shared<BaseLib::Variable>((int64_t)_budgetLimits));
+  std::lock_guard<std::mutex> bucketsGuard(_bucketsMutex);
+  status->structValue->emplace("sources", std::make_shared<BaseLib::Variable>((int32_t)_sources.size()));
+  return status;
+}
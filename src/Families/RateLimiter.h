@@ -0,0 +1,123 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_RATELIMITER_H
+#define HOMEGEAR_GATEWAY_RATELIMITER_H
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Protects Homegear and the uplink from RF storms, e. g. a sensor stuck in a send loop or a jammer producing frames
+ * with valid checksums. Every source address has a token bucket and all frames of the interface share a receive
+ * budget, which is a token bucket as well. Frames exceeding either are dropped. The number of dropped frames is
+ * reported with the next forwarded frame of the same source, so Homegear knows about the gap.
+ *
+ * Limits are reported once per episode: An episode starts with the first dropped frame and ends when the bucket has
+ * filled up again.
+ */
+class RateLimiter
+{
+public:
+    static constexpr int64_t noSource = -1;
+
+    struct Result
+    {
+        bool forward = true;
+
+        /**
+         * Frames of the same source (or, without source, of the interface) dropped since the last forwarded one.
+         */
+        uint32_t dropped = 0;
+
+        bool sourceLimitReached = false;
+        bool budgetExceeded = false;
+    };
+
+    /**
+     * @param rate The frames per second allowed per source address or 0.
+     * @param burst The number of frames a source may send at once.
+     * @param budget The frames per second allowed for the whole interface or 0. The interface may receive one
+     * second's worth of frames at once.
+     */
+    RateLimiter(int32_t rate, int32_t burst, int32_t budget);
+    virtual ~RateLimiter() = default;
+
+    int32_t rate() { return _rate; }
+    int32_t budget() { return _budget; }
+
+    /**
+     * Takes a token from the bucket of the source and from the receive budget.
+     *
+     * @param source The sender address of the frame or noSource, when the family doesn't provide it. Frames without
+     * source are only limited by the receive budget.
+     */
+    Result admit(int64_t source);
+
+    BaseLib::PVariable getStatus();
+private:
+    struct Bucket
+    {
+        double tokens = 0;
+        int64_t lastRefill = 0;
+        uint32_t dropped = 0;
+        bool limited = false;
+    };
+
+    /**
+     * The maximum number of source buckets. Random source addresses of a jammer would let the table grow without bound
+     * otherwise. Sources without a bucket are only limited by the receive budget.
+     */
+    static constexpr size_t _maxSources = 1024;
+
+    int32_t _rate = 0;
+    double _burst = 0;
+    int32_t _budget = 0;
+
+    std::mutex _bucketsMutex;
+    std::unordered_map<uint32_t, Bucket> _sources;
+    Bucket _budgetBucket;
+    uint32_t _droppedWithoutSource = 0;
+    int64_t _lastPrune = 0;
+
+    std::atomic<uint64_t> _framesForwarded{0};
+    std::atomic<uint64_t> _framesDropped{0};
+    std::atomic<uint64_t> _sourceLimits{0};
+    std::atomic<uint64_t> _budgetLimits{0};
+
+    /**
+     * Adds the tokens accumulated since the last call.
+     *
+     * @return Returns true when the bucket is full.
+     */
+    static bool refill(Bucket& bucket, double rate, double size, int64_t now);
+    void prune(int64_t now);
+};
+
+#endif
@@ -0,0 +1,136 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "ReceivePool.h"
+#include "../Gd.h"
+
+template<typename T>
+int32_t ReceivePool::findUnused(std::array<std::shared_ptr<T>, _size> &pool, size_t &next) {
+  for (size_t i = 0; i < _size; i++) {
+    size_t index = (next + i) % _size;
+    //The pool holds the only reference, so no other thread can access the object.
+    if (!pool[index] || pool[index].use_count() == 1) {
+      next = (index + 1) % _size;
+      return (int32_t)index;
+    }
+  }
+  return -1;
+}
+
+BaseLib::PVariable ReceivePool::packet(std::vector<uint8_t> &data) {
+  int32_t index = findUnused(_packets, _nextPacket);
+  if (index == -1) {
+    _misses++;
+    auto variable = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tBinary);
+    variable->binaryValue.swap(data);
+    data.clear();
+    return variable;
+  }
+
+  auto &variable = _packets[index];
+  if (!variable) variable = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tBinary);
+  variable->type = BaseLib::VariableType::tBinary;
+  variable->binaryValue.swap(data);
+  data.clear();
+  return variable;
+}
+
+BaseLib::PVariable ReceivePool::packet(const std::string &data) {
+  int32_t index = findUnused(_packets, _nextPacket);
+  if (index == -1) {
+    _misses++;
+    return std::make_shared<BaseLib::Variable>(data);
+  }
+
+  auto &variable = _packets[index];
+  if (!variable) variable = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tString);
+  variable->type = BaseLib::VariableType::tString;
+  variable->stringValue.assign(data);
+  return variable;
+}
+
+BaseLib::PVariable ReceivePool::metadata() {
+  std::lock_guard<std::mutex> parametersGuard(_parametersMutex);
+  int32_t index = findUnused(_metadata, _nextMetadata);
+  if (index == -1) {
+    _misses++;
+    return std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+  }
+
+  auto &variable = _metadata[index];
+  if (!variable) variable = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+  for (auto elementIterator = variable->structValue->begin(); elementIterator != variable->structValue->end();) {
+    if (elementIterator->first == "received") elementIterator++;
+    else elementIterator = variable->structValue->erase(elementIterator);
+  }
+  return variable;
+}
+
+BaseLib::PArray ReceivePool::parameters(int32_t familyId, const BaseLib::PVariable &packet, const BaseLib::PVariable &metadata) {
+  BaseLib::PArray parameters;
+  BaseLib::PVariable familyIdVariable;
+  {
+    std::lock_guard<std::mutex> parametersGuard(_parametersMutex);
+    if (!_familyId || _familyId->integerValue != familyId) _familyId = std::make_shared<BaseLib::Variable>(familyId);
+    familyIdVariable = _familyId;
+    int32_t index = findUnused(_parameters, _nextParameters);
+    if (index == -1) _misses++;
+    else {
+      if (!_parameters[index]) _parameters[index] = std::make_shared<BaseLib::Array>();
+      parameters = _parameters[index];
+    }
+  }
+  if (!parameters) parameters = std::make_shared<BaseLib::Array>();
+
+  parameters->clear();
+  parameters->reserve(3);
+  parameters->push_back(familyIdVariable);
+  parameters->push_back(packet);
+  if (metadata) parameters->push_back(metadata);
+  return parameters;
+}
+
+void ReceivePool::setInteger(const BaseLib::PVariable &structVariable, const std::string &key, int64_t value) {
+  auto elementIterator = structVariable->structValue->find(key);
+  if (elementIterator == structVariable->structValue->end()) {
+    structVariable->structValue->emplace(key, std::make_shared<BaseLib::Variable>(value));
+    return;
+  }
+  //Only the pool references elements of pooled structs, so they can be modified.
+  elementIterator->second->type = BaseLib::VariableType::tInteger64;
+  elementIterator->second->integerValue64 = value;
+}
+
+BaseLib::PVariable ReceivePool::getStatus() {
+  auto status = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+  status->structValue->emplace("size", std::make_shared<BaseLib::Variable>((int32_t)_size));
+  status->structValue->emplace("misses", std::make_shared<BaseLib::Variable>((int64_t)_misses));
+  return status;
+}
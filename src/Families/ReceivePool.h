@@ -0,0 +1,103 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_RECEIVEPOOL_H
+#define HOMEGEAR_GATEWAY_RECEIVEPOOL_H
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Recycles the Variables and the parameter array passed to packetReceived, so the gateway doesn't allocate them for
+ * every frame. This is not an allocation free receive path: BaseLib's RPC encoder and C1Net's send path still allocate
+ * per frame, and the culfw and CC1101 families allocate when they convert frames into strings. An object is reused once
+ * all other references to it are gone, i. e. after the RPC call returned or the deduplicator released a held frame.
+ * Buffers keep their capacity, so a recycled packet Variable only allocates when a frame is larger than all frames
+ * before.
+ *
+ * When all pooled objects are in use, a new one is allocated and not pooled.
+ */
+class ReceivePool
+{
+public:
+    ReceivePool() = default;
+    virtual ~ReceivePool() = default;
+
+    /**
+     * Returns a binary Variable holding the frame. The frame is moved, "data" is empty afterwards but gets the buffer
+     * of a previous frame, so the caller's buffer is recycled as well. Only call it from the receive thread.
+     */
+    BaseLib::PVariable packet(std::vector<uint8_t>& data);
+
+    /**
+     * Returns a string Variable holding a copy of the frame. Only call it from the receive thread.
+     */
+    BaseLib::PVariable packet(const std::string& data);
+
+    /**
+     * Returns an empty struct for the third parameter of packetReceived. The element "received" of the previous use is
+     * kept, so it can be updated in place with setInteger().
+     */
+    BaseLib::PVariable metadata();
+
+    /**
+     * Returns the parameters of packetReceived: family ID, packet and, when set, metadata. Clear the array after the
+     * call, so the packet and the metadata can be recycled.
+     */
+    BaseLib::PArray parameters(int32_t familyId, const BaseLib::PVariable& packet, const BaseLib::PVariable& metadata);
+
+    /**
+     * Sets the element "key" of a struct to an integer. Existing elements are updated in place.
+     */
+    static void setInteger(const BaseLib::PVariable& structVariable, const std::string& key, int64_t value);
+
+    BaseLib::PVariable getStatus();
+private:
+    static const size_t _size = 16;
+
+    size_t _nextPacket = 0;
+    std::array<BaseLib::PVariable, _size> _packets;
+
+    std::mutex _parametersMutex;
+    BaseLib::PVariable _familyId; //Never modified, so all calls can share it.
+    size_t _nextParameters = 0;
+    std::array<BaseLib::PArray, _size> _parameters;
+    size_t _nextMetadata = 0;
+    std::array<BaseLib::PVariable, _size> _metadata;
+
+    std::atomic<uint64_t> _misses{0};
+
+    /**
+     * @return The index of an unused object starting at "next" or -1.
+     */
+    template<typename T>
+    static int32_t findUnused(std::array<std::shared_ptr<T>, _size>& pool, size_t& next);
+};
+
+#endif
@@ -0,0 +1,60 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_RECEIVETIME_H
+#define HOMEGEAR_GATEWAY_RECEIVETIME_H
+
+#include <cstdint>
+#include <ctime>
+
+/**
+ * The time a frame was received in nanoseconds since the epoch of CLOCK_MONOTONIC and CLOCK_REALTIME. It is taken as
+ * close to the hardware as possible, e. g. right after the read() returning the last byte of the frame.
+ */
+struct ReceiveTime
+{
+    int64_t monotonic = 0;
+    int64_t realtime = 0;
+
+    bool empty() const { return monotonic == 0; }
+
+    static ReceiveTime now()
+    {
+        ReceiveTime receiveTime;
+        timespec time{};
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        receiveTime.monotonic = (int64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+        clock_gettime(CLOCK_REALTIME, &time);
+        receiveTime.realtime = (int64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+        return receiveTime;
+    }
+};
+
+#endif
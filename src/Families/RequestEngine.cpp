@@ -0,0 +1,272 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "RequestEngine.h"
+#include "../Gd.h"
+
+#include <future>
+
+namespace {
+int64_t steadyTime() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+RequestEngine::RequestEngine(BaseLib::SharedObjects *bl, std::string name) {
+  _bl = bl;
+  _name = std::move(name);
+}
+
+RequestEngine::~RequestEngine() {
+  try {
+    stop();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void RequestEngine::start() {
+  try {
+    stop();
+    _stopTimeoutThread = false;
+    _bl->threadManager.start(_timeoutThread, true, &RequestEngine::timeoutThread, this);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void RequestEngine::stop() {
+  try {
+    std::vector<Continuation> cancelled;
+    {
+      std::lock_guard<std::mutex> exchangesGuard(_exchangesMutex);
+      _stopTimeoutThread = true;
+      cancelled.reserve(_exchanges.size());
+      for (auto &exchange : _exchanges) {
+        cancelled.emplace_back(std::move(exchange.second.continuation));
+      }
+      _exchanges.clear();
+      _keys.clear();
+      _deadlines.clear();
+    }
+    _exchangesConditionVariable.notify_all();
+    _keysConditionVariable.notify_all();
+    _bl->threadManager.join(_timeoutThread);
+
+    if (!cancelled.empty()) Gd::out.printInfo("Info: " + _name + ": Cancelling " + std::to_string(cancelled.size()) + " pending requests.");
+    std::vector<uint8_t> empty;
+    for (auto &continuation : cancelled) {
+      if (continuation) continuation(Result::cancelled, empty);
+    }
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+uint64_t RequestEngine::send(uint32_t key, int32_t timeout, const std::function<bool()> &sendFunction, Continuation continuation) {
+  try {
+    int64_t deadline = steadyTime() + timeout;
+    uint64_t id = 0;
+    Result result = Result::cancelled;
+    {
+      std::unique_lock<std::mutex> exchangesLock(_exchangesMutex);
+      while (!_stopTimeoutThread) {
+        int64_t now = steadyTime();
+        auto keyIterator = _keys.find(key);
+        if (keyIterator == _keys.end() || (keyIterator->second.exchange == 0 && keyIterator->second.retiredUntil <= now)) {
+          id = ++_currentId;
+          auto &exchange = _exchanges[id];
+          exchange.key = key;
+          exchange.deadline = deadline;
+          exchange.continuation = std::move(continuation);
+          _keys[key] = Key{id, 0};
+          _deadlines.emplace(deadline, id);
+          break;
+        }
+        if (now >= deadline) {
+          result = Result::timeout;
+          break;
+        }
+        int64_t waitUntil = keyIterator->second.exchange == 0 ? std::min(deadline, keyIterator->second.retiredUntil) : deadline;
+        _keysConditionVariable.wait_for(exchangesLock, std::chrono::milliseconds(waitUntil - now));
+      }
+    }
+
+    if (id == 0) {
+      if (result == Result::timeout) _timeouts++;
+      std::vector<uint8_t> empty;
+      if (continuation) continuation(result, empty);
+      return 0;
+    }
+
+    _exchangesConditionVariable.notify_one();
+
+    if (!sendFunction()) {
+      cancel(id);
+      return 0;
+    }
+    return id;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return 0;
+}
+
+RequestEngine::Result RequestEngine::sendAndWait(uint32_t key, int32_t timeout, const std::function<bool()> &sendFunction, std::vector<uint8_t> &response) {
+  try {
+    auto promise = std::make_shared<std::promise<std::pair<Result, std::vector<uint8_t>>>>();
+    auto future = promise->get_future();
+    send(key, timeout, sendFunction, [promise](Result result, std::vector<uint8_t> &data) {
+      promise->set_value(std::make_pair(result, data));
+    });
+    auto result = future.get();
+    response = std::move(result.second);
+    return result.first;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return Result::cancelled;
+}
+
+bool RequestEngine::complete(uint32_t key, std::vector<uint8_t> &response) {
+  try {
+    Continuation continuation;
+    {
+      std::lock_guard<std::mutex> exchangesGuard(_exchangesMutex);
+      auto keyIterator = _keys.find(key);
+      if (keyIterator == _keys.end()) return false;
+      if (keyIterator->second.exchange == 0) {
+        if (keyIterator->second.retiredUntil <= steadyTime()) {
+          _keys.erase(keyIterator);
+          return false;
+        }
+        //The late response of the timed out exchange. The key can be used again right away.
+        _keys.erase(keyIterator);
+        _lateResponses++;
+        _keysConditionVariable.notify_all();
+        Gd::out.printInfo("Info: " + _name + ": Dropping late response: " + BaseLib::HelperFunctions::getHexString(response));
+        return true;
+      }
+      continuation = remove(keyIterator->second.exchange);
+    }
+    if (continuation) continuation(Result::success, response);
+    return true;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return false;
+}
+
+bool RequestEngine::cancel(uint64_t id) {
+  try {
+    Continuation continuation;
+    {
+      std::lock_guard<std::mutex> exchangesGuard(_exchangesMutex);
+      if (_exchanges.find(id) == _exchanges.end()) return false;
+      continuation = remove(id);
+    }
+    std::vector<uint8_t> empty;
+    if (continuation) continuation(Result::cancelled, empty);
+    return true;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return false;
+}
+
+size_t RequestEngine::pending() {
+  std::lock_guard<std::mutex> exchangesGuard(_exchangesMutex);
+  return _exchanges.size();
+}
+
+RequestEngine::Continuation RequestEngine::remove(uint64_t id, bool retire) {
+  auto exchangeIterator = _exchanges.find(id);
+  if (exchangeIterator == _exchanges.end()) return Continuation();
+  Continuation continuation = std::move(exchangeIterator->second.continuation);
+
+  auto keyIterator = _keys.find(exchangeIterator->second.key);
+  if (keyIterator != _keys.end() && keyIterator->second.exchange == id) {
+    if (retire) keyIterator->second = Key{0, steadyTime() + _retireTime};
+    else _keys.erase(keyIterator);
+    _keysConditionVariable.notify_all();
+  }
+
+  auto deadlines = _deadlines.equal_range(exchangeIterator->second.deadline);
+  for (auto deadlineIterator = deadlines.first; deadlineIterator != deadlines.second; ++deadlineIterator) {
+    if (deadlineIterator->second == id) {
+      _deadlines.erase(deadlineIterator);
+      break;
+    }
+  }
+
+  _exchanges.erase(exchangeIterator);
+  return continuation;
+}
+
+void RequestEngine::timeoutThread() {
+  std::vector<Continuation> expired;
+  std::vector<uint8_t> empty;
+  while (!_stopTimeoutThread) {
+    try {
+      {
+        std::unique_lock<std::mutex> exchangesLock(_exchangesMutex);
+        if (_deadlines.empty()) {
+          _exchangesConditionVariable.wait_for(exchangesLock, std::chrono::milliseconds(1000));
+        } else {
+          int64_t waitTime = _deadlines.begin()->first - steadyTime();
+          if (waitTime > 0) _exchangesConditionVariable.wait_for(exchangesLock, std::chrono::milliseconds(waitTime));
+        }
+        if (_stopTimeoutThread) return;
+
+        int64_t now = steadyTime();
+        while (!_deadlines.empty() && _deadlines.begin()->first <= now) {
+          expired.emplace_back(remove(_deadlines.begin()->second, true));
+        }
+      }
+
+      _timeouts += expired.size();
+      for (auto &continuation : expired) {
+        if (continuation) continuation(Result::timeout, empty);
+      }
+      expired.clear();
+    }
+    catch (const std::exception &ex) {
+      expired.clear();
+      Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+  }
+}
@@ -0,0 +1,152 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_REQUESTENGINE_H
+#define HOMEGEAR_GATEWAY_REQUESTENGINE_H
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Tracks request/response exchanges with a device without blocking the thread that sent the request. Every exchange
+ * has a key (e. g. the expected response packet type), a timeout and a continuation. The continuation is called exactly
+ * once: by complete() on the thread that received the response, by the timeout thread or by cancel()/stop().
+ *
+ * Responses carry nothing that identifies their request, so only one exchange per key is in flight at a time. Exchanges
+ * with different keys don't wait for each other. After an exchange timed out, its key is retired for _retireTime
+ * milliseconds: a late response arriving in that time is dropped instead of being handed to the next exchange.
+ *
+ * Continuations are called without any engine lock held, but they should return quickly, because they usually run on a
+ * listen thread or on the event loop.
+ */
+class RequestEngine
+{
+public:
+    enum class Result : int32_t
+    {
+        success = 0,
+        timeout = 1,
+        cancelled = 2
+    };
+
+    typedef std::function<void(Result result, std::vector<uint8_t>& response)> Continuation;
+
+    RequestEngine(BaseLib::SharedObjects* bl, std::string name);
+    virtual ~RequestEngine();
+
+    void start();
+
+    /**
+     * Cancels all pending exchanges and stops the timeout thread. Exchanges started while the engine is stopped are
+     * cancelled immediately.
+     */
+    void stop();
+
+    /**
+     * Registers an exchange and sends the request. Blocks while another exchange with the same key is in flight or the
+     * key is retired. The time spent waiting counts towards the timeout.
+     *
+     * @param key The key the response is expected with.
+     * @param timeout The timeout in milliseconds.
+     * @param sendFunction Sends the request. Called on the calling thread. Returning false cancels the exchange.
+     * @param continuation Called with the result.
+     * @return Returns the ID of the exchange or 0 when the exchange finished before the request was sent.
+     */
+    uint64_t send(uint32_t key, int32_t timeout, const std::function<bool()>& sendFunction, Continuation continuation);
+
+    /**
+     * Like send(), but blocks the calling thread until the exchange finished. Only the caller waits, other exchanges
+     * can still be started and completed in the meantime.
+     */
+    Result sendAndWait(uint32_t key, int32_t timeout, const std::function<bool()>& sendFunction, std::vector<uint8_t>& response);
+
+    /**
+     * Completes the pending exchange with the given key.
+     *
+     * @return Returns true when the response was consumed by an exchange or dropped as a late response.
+     */
+    bool complete(uint32_t key, std::vector<uint8_t>& response);
+
+    bool cancel(uint64_t id);
+
+    size_t pending();
+    uint64_t timeouts() { return _timeouts; }
+    uint64_t lateResponses() { return _lateResponses; }
+private:
+    /**
+     * The time in milliseconds a key stays retired after an exchange timed out.
+     */
+    static constexpr int64_t _retireTime = 1000;
+
+    struct Exchange
+    {
+        uint32_t key = 0;
+        int64_t deadline = 0;
+        Continuation continuation;
+    };
+
+    struct Key
+    {
+        /**
+         * The exchange in flight or 0.
+         */
+        uint64_t exchange = 0;
+
+        /**
+         * Until then, responses belong to a timed out exchange.
+         */
+        int64_t retiredUntil = 0;
+    };
+
+    BaseLib::SharedObjects* _bl = nullptr;
+    std::string _name;
+
+    std::mutex _exchangesMutex;
+    std::condition_variable _exchangesConditionVariable;
+    std::condition_variable _keysConditionVariable;
+    uint64_t _currentId = 0;
+    std::unordered_map<uint64_t, Exchange> _exchanges;
+    std::unordered_map<uint32_t, Key> _keys;
+    std::multimap<int64_t, uint64_t> _deadlines;
+    std::atomic<uint64_t> _timeouts{0};
+    std::atomic<uint64_t> _lateResponses{0};
+
+    std::atomic_bool _stopTimeoutThread{true};
+    std::thread _timeoutThread;
+
+    /**
+     * Removes an exchange from all indexes and frees its key. _exchangesMutex must be locked.
+     *
+     * @param retire Retires the key, because a response to the exchange might still arrive.
+     */
+    Continuation remove(uint64_t id, bool retire = false);
+    void timeoutThread();
+};
+
+#endif
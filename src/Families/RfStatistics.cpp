@@ -0,0 +1,186 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "RfStatistics.h"
+#include "../FrameCapture.h"
+#include "../Gd.h"
+
+RfStatistics::RfStatistics() {
+  _instance = (uint64_t)BaseLib::HelperFunctions::getRandomNumber(1, 0x7FFFFF) << 40;
+}
+
+size_t RfStatistics::slot(uint32_t address, size_t capacity) {
+  //Final mix of MurmurHash3. Sequential addresses would otherwise form long probe chains.
+  address ^= address >> 16;
+  address *= 0x85EBCA6B;
+  address ^= address >> 13;
+  address *= 0xC2B2AE35;
+  address ^= address >> 16;
+  return address & (capacity - 1);
+}
+
+void RfStatistics::grow() {
+  std::vector<Entry> entries(_entries.empty() ? _initialCapacity : _entries.size() * 2);
+  for (auto &entry : _entries) {
+    if (!entry.used) continue;
+    size_t index = slot(entry.address, entries.size());
+    while (entries[index].used) index = (index + 1) & (entries.size() - 1);
+    entries[index] = entry;
+  }
+  _entries.swap(entries);
+}
+
+RfStatistics::Entry *RfStatistics::find(uint32_t address, bool create) {
+  if (!_entries.empty()) {
+    size_t index = slot(address, _entries.size());
+    while (_entries[index].used) {
+      if (_entries[index].address == address) return &_entries[index];
+      index = (index + 1) & (_entries.size() - 1);
+    }
+  }
+  if (!create) return nullptr;
+
+  //Keep the load factor at or below 75 %, so probe chains stay short and there always is a free slot.
+  if ((_size + 1) * 4 > _entries.size() * 3) {
+    if (_entries.size() >= _maxCapacity) return nullptr;
+    grow();
+  }
+
+  size_t index = slot(address, _entries.size());
+  while (_entries[index].used) index = (index + 1) & (_entries.size() - 1);
+  auto &entry = _entries[index];
+  entry.used = true;
+  entry.address = address;
+  _size++;
+  return &entry;
+}
+
+void RfStatistics::frameReceived(uint32_t address, int32_t rssi, bool duplicate, const ReceiveTime &receiveTime) {
+  try {
+    std::lock_guard<std::mutex> entriesGuard(_entriesMutex);
+    auto entry = find(address, true);
+    if (!entry) {
+      _untracked++;
+      return;
+    }
+
+    entry->sequence = ++_sequence;
+    entry->frames++;
+    if (duplicate) entry->duplicates++;
+    entry->lastSeen = receiveTime.realtime;
+    entry->lastSeenMonotonic = receiveTime.monotonic;
+    if (rssi != FrameCapture::noRssi) {
+      if (entry->rssiCount == 0) {
+        entry->rssiMin = rssi;
+        entry->rssiMax = rssi;
+        entry->rssiEwma = rssi;
+      } else {
+        if (rssi < entry->rssiMin) entry->rssiMin = rssi;
+        if (rssi > entry->rssiMax) entry->rssiMax = rssi;
+        entry->rssiEwma += _ewmaWeight * ((double)rssi - entry->rssiEwma);
+      }
+      entry->rssiSum += rssi;
+      entry->rssiCount++;
+    }
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void RfStatistics::crcError(uint32_t address) {
+  try {
+    std::lock_guard<std::mutex> entriesGuard(_entriesMutex);
+    auto entry = find(address, false);
+    if (!entry) {
+      _crcErrors++;
+      return;
+    }
+    entry->sequence = ++_sequence;
+    entry->crcErrors++;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void RfStatistics::crcError() {
+  std::lock_guard<std::mutex> entriesGuard(_entriesMutex);
+  _crcErrors++;
+}
+
+BaseLib::PVariable RfStatistics::getRfStatistics(BaseLib::PArray &parameters) {
+  try {
+    if (parameters->empty() || parameters->size() > 2) return BaseLib::Variable::createError(-1, "Invalid parameters.");
+    uint64_t cursor = 0;
+    if (parameters->size() == 2) {
+      auto &cursorParameter = parameters->at(1);
+      if (cursorParameter->type == BaseLib::VariableType::tInteger64) cursor = (uint64_t)cursorParameter->integerValue64;
+      else if (cursorParameter->type == BaseLib::VariableType::tInteger) cursor = (uint64_t)cursorParameter->integerValue;
+      else return BaseLib::Variable::createError(-1, "Cursor is not an integer.");
+    }
+
+    auto result = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+    auto entries = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tArray);
+
+    if ((cursor & ~0xFFFFFFFFFFull) != _instance) cursor = 0;
+    else cursor &= 0xFFFFFFFFFFull;
+
+    std::lock_guard<std::mutex> entriesGuard(_entriesMutex);
+    entries->arrayValue->reserve(cursor == 0 ? _size : 16);
+    for (auto &entry : _entries) {
+      if (!entry.used || entry.sequence <= cursor) continue;
+      auto element = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+      element->structValue->emplace("address", std::make_shared<BaseLib::Variable>((int64_t)entry.address));
+      element->structValue->emplace("frames", std::make_shared<BaseLib::Variable>((int64_t)entry.frames));
+      element->structValue->emplace("duplicates", std::make_shared<BaseLib::Variable>((int64_t)entry.duplicates));
+      element->structValue->emplace("crcErrors", std::make_shared<BaseLib::Variable>((int64_t)entry.crcErrors));
+      element->structValue->emplace("lastSeen", std::make_shared<BaseLib::Variable>(entry.lastSeen));
+      element->structValue->emplace("lastSeenMonotonic", std::make_shared<BaseLib::Variable>(entry.lastSeenMonotonic));
+      if (entry.rssiCount > 0) {
+        element->structValue->emplace("rssiMin", std::make_shared<BaseLib::Variable>(entry.rssiMin));
+        element->structValue->emplace("rssiMax", std::make_shared<BaseLib::Variable>(entry.rssiMax));
+        element->structValue->emplace("rssiAvg", std::make_shared<BaseLib::Variable>((double)entry.rssiSum / entry.rssiCount));
+        element->structValue->emplace("rssiEwma", std::make_shared<BaseLib::Variable>(entry.rssiEwma));
+      }
+      entries->arrayValue->push_back(element);
+    }
+
+    result->structValue->emplace("cursor", std::make_shared<BaseLib::Variable>((int64_t)(_instance | _sequence)));
+    result->structValue->emplace("entries", entries);
+    result->structValue->emplace("crcErrors", std::make_shared<BaseLib::Variable>((int64_t)_crcErrors));
+    result->structValue->emplace("untracked", std::make_shared<BaseLib::Variable>((int64_t)_untracked));
+    return result;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
+}
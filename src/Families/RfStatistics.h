@@ -0,0 +1,124 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_RFSTATISTICS_H
+#define HOMEGEAR_GATEWAY_RFSTATISTICS_H
+
+#include "ReceiveTime.h"
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Link quality statistics per sender address, so Homegear can query them with one call instead of computing them from
+ * every forwarded frame. The statistics survive restarts of Homegear.
+ *
+ * Entries are stored in a flat array with open addressing (linear probing), which doesn't allocate per entry and keeps
+ * lookups within a few cache lines. Every update stamps the entry with an increasing sequence number, so a client can
+ * fetch only the entries changed since its last query. Entries are never removed. When the table is full, frames of new
+ * addresses are only counted as untracked.
+ */
+class RfStatistics
+{
+public:
+    RfStatistics();
+    virtual ~RfStatistics() = default;
+
+    /**
+     * Counts a frame of the address.
+     *
+     * @param rssi The RSSI in dBm or FrameCapture::noRssi.
+     * @param duplicate True when the frame is a copy suppressed by the deduplicator.
+     */
+    void frameReceived(uint32_t address, int32_t rssi, bool duplicate, const ReceiveTime& receiveTime);
+
+    /**
+     * Counts a frame with checksum error. The address is read from the broken frame, so it is only used when the
+     * address is known already. Otherwise, and without address, the error is counted for the interface.
+     */
+    void crcError(uint32_t address);
+    void crcError();
+
+//{{{ RPC methods
+    /**
+     * Parameters: family ID, optional cursor. Returns a struct with the elements "cursor", "entries", "crcErrors" and
+     * "untracked". Without cursor or with cursor 0 all entries are returned, otherwise only the ones changed since the
+     * query which returned the cursor.
+     */
+    BaseLib::PVariable getRfStatistics(BaseLib::PArray& parameters);
+//}}}
+private:
+    struct Entry
+    {
+        uint32_t address = 0;
+        bool used = false;
+        uint64_t sequence = 0;
+        uint32_t frames = 0;
+        uint32_t duplicates = 0;
+        uint32_t crcErrors = 0;
+        int64_t lastSeen = 0; //CLOCK_REALTIME in ns
+        int64_t lastSeenMonotonic = 0;
+        int32_t rssiMin = 0;
+        int32_t rssiMax = 0;
+        int64_t rssiSum = 0;
+        uint32_t rssiCount = 0;
+        double rssiEwma = 0;
+    };
+
+    static const size_t _initialCapacity = 256;
+    static const size_t _maxCapacity = 16384;
+
+    /**
+     * The weight of a new RSSI value in the moving average.
+     */
+    static constexpr double _ewmaWeight = 0.125;
+
+    /**
+     * Random ID in the upper bits of the cursor. Cursors of another instance, e. g. from before a restart of the
+     * gateway, return all entries.
+     */
+    uint64_t _instance = 0;
+
+    std::mutex _entriesMutex;
+    std::vector<Entry> _entries;
+    size_t _size = 0;
+    uint64_t _sequence = 0;
+    uint64_t _crcErrors = 0;
+    uint64_t _untracked = 0;
+
+    /**
+     * @param create When false, returns nullptr for unknown addresses.
+     * @return The entry of the address or nullptr, when it is unknown or the table is full.
+     */
+    Entry* find(uint32_t address, bool create);
+    void grow();
+    static size_t slot(uint32_t address, size_t capacity);
+};
+
+#endif
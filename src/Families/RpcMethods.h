@@ -0,0 +1,128 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_RPCMETHODS_H
+#define HOMEGEAR_GATEWAY_RPCMETHODS_H
+
+#include <array>
+#include <string_view>
+#include <utility>
+
+/**
+ * IDs of all RPC methods known to the gateway. The order must match RpcMethods::table, which is sorted by name.
+ */
+enum class RpcMethod : int32_t
+{
+    unknown = -1,
+    disableUpdateMode,
+    dumpFlightRecorder,
+    emptyReadBuffers,
+    enableUpdateMode,
+    getBaseAddress,
+    getClockOffset,
+    getRfStatistics,
+    getRuntimeStats,
+    getSubscriptions,
+    sendPacket,
+    setBaseAddress,
+    setSubscriptions,
+    startCapture,
+    startTx,
+    stopCapture,
+    stopTx,
+    txTest,
+    count
+};
+
+/**
+ * Compile-time table mapping method names to RpcMethod IDs. Names are resolved by binary search, so no allocation or
+ * hashing is necessary.
+ */
+class RpcMethods
+{
+public:
+    static constexpr size_t size = (size_t)RpcMethod::count;
+
+    static constexpr std::array<std::pair<std::string_view, RpcMethod>, size> table{{
+            {"disableUpdateMode", RpcMethod::disableUpdateMode},
+            {"dumpFlightRecorder", RpcMethod::dumpFlightRecorder},
+            {"emptyReadBuffers", RpcMethod::emptyReadBuffers},
+            {"enableUpdateMode", RpcMethod::enableUpdateMode},
+            {"getBaseAddress", RpcMethod::getBaseAddress},
+            {"getClockOffset", RpcMethod::getClockOffset},
+            {"getRfStatistics", RpcMethod::getRfStatistics},
+            {"getRuntimeStats", RpcMethod::getRuntimeStats},
+            {"getSubscriptions", RpcMethod::getSubscriptions},
+            {"sendPacket", RpcMethod::sendPacket},
+            {"setBaseAddress", RpcMethod::setBaseAddress},
+            {"setSubscriptions", RpcMethod::setSubscriptions},
+            {"startCapture", RpcMethod::startCapture},
+            {"startTx", RpcMethod::startTx},
+            {"stopCapture", RpcMethod::stopCapture},
+            {"stopTx", RpcMethod::stopTx},
+            {"txTest", RpcMethod::txTest}
+    }};
+
+    static constexpr RpcMethod getId(std::string_view name)
+    {
+        size_t begin = 0;
+        size_t end = size;
+        while(begin < end)
+        {
+            size_t middle = begin + (end - begin) / 2;
+            int32_t result = table[middle].first.compare(name);
+            if(result == 0) return table[middle].second;
+            else if(result < 0) begin = middle + 1;
+            else end = middle;
+        }
+        return RpcMethod::unknown;
+    }
+
+    static constexpr std::string_view getName(RpcMethod id)
+    {
+        if(id <= RpcMethod::unknown || id >= RpcMethod::count) return std::string_view();
+        return table[(size_t)id].first;
+    }
+
+    static constexpr bool isValid()
+    {
+        for(size_t i = 0; i < size; i++)
+        {
+            if(table[i].second != (RpcMethod)i) return false;
+            if(i > 0 && !(table[i - 1].first < table[i].first)) return false;
+        }
+        return true;
+    }
+};
+
+static_assert(RpcMethods::isValid(), "RpcMethods::table needs to be sorted by name and in the same order as RpcMethod.");
+static_assert(RpcMethods::getId("sendPacket") == RpcMethod::sendPacket, "RpcMethods::getId() is broken.");
+
+#endif
@@ -0,0 +1,120 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "SerialLowLatency.h"
+#include "../Gd.h"
+
+#include <linux/serial.h>
+#include <termios.h>
+#include <climits>
+
+bool SerialLowLatency::apply(const std::string &device, int32_t fileDescriptor) {
+  try {
+    if (fileDescriptor == -1) return false;
+    bool result = true;
+
+    serial_struct serialInfo{};
+    if (ioctl(fileDescriptor, TIOCGSERIAL, &serialInfo) == -1) {
+      Gd::out.printInfo("Info: " + device + " does not support TIOCGSERIAL. Not setting ASYNC_LOW_LATENCY: " + std::string(strerror(errno)));
+      result = false;
+    } else {
+      serialInfo.flags |= ASYNC_LOW_LATENCY;
+      if (ioctl(fileDescriptor, TIOCSSERIAL, &serialInfo) == -1) {
+        Gd::out.printWarning("Warning: Could not set ASYNC_LOW_LATENCY on " + device + ": " + std::string(strerror(errno)));
+        result = false;
+      }
+    }
+
+    termios termiosSettings{};
+    if (tcgetattr(fileDescriptor, &termiosSettings) == -1) {
+      Gd::out.printWarning("Warning: Could not get terminal settings of " + device + ": " + std::string(strerror(errno)));
+      return false;
+    }
+    termiosSettings.c_cc[VMIN] = 1;
+    termiosSettings.c_cc[VTIME] = 0;
+    if (tcsetattr(fileDescriptor, TCSANOW, &termiosSettings) == -1) {
+      Gd::out.printWarning("Warning: Could not set VMIN and VTIME on " + device + ": " + std::string(strerror(errno)));
+      return false;
+    }
+
+    //The latency timer is reset when an adapter is plugged in again. Set it here, too, if we have the permission to do so.
+    std::string latencyTimerPath = getLatencyTimerPath(device);
+    if (!latencyTimerPath.empty() && access(latencyTimerPath.c_str(), W_OK) == 0) setLatencyTimer(device);
+
+    if (result) Gd::out.printInfo("Info: Low latency profile applied to " + device + ".");
+    return result;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return false;
+}
+
+std::string SerialLowLatency::getLatencyTimerPath(const std::string &device) {
+  char path[PATH_MAX];
+  if (!realpath(device.c_str(), path)) return "";
+  std::string name = BaseLib::HelperFunctions::splitLast(std::string(path), '/').second;
+  if (name.empty()) return "";
+
+  std::string latencyTimerPath = "/sys/class/tty/" + name + "/device/latency_timer";
+  if (BaseLib::Io::fileExists(latencyTimerPath)) return latencyTimerPath;
+  latencyTimerPath = "/sys/bus/usb-serial/devices/" + name + "/latency_timer";
+  if (BaseLib::Io::fileExists(latencyTimerPath)) return latencyTimerPath;
+  return "";
+}
+
+bool SerialLowLatency::setLatencyTimer(const std::string &device) {
+  try {
+    std::string latencyTimerPath = getLatencyTimerPath(device);
+    if (latencyTimerPath.empty()) {
+      Gd::out.printDebug("Debug: " + device + " has no latency timer.");
+      return false;
+    }
+
+    std::string oldValue = BaseLib::Io::getFileContent(latencyTimerPath);
+    BaseLib::HelperFunctions::trim(oldValue);
+    if (oldValue == "1") return true;
+
+    std::ofstream latencyTimerStream(latencyTimerPath);
+    latencyTimerStream << "1";
+    latencyTimerStream.close();
+    if (!latencyTimerStream) {
+      Gd::out.printWarning("Warning: Could not set latency timer of " + device + " (" + latencyTimerPath + ").");
+      return false;
+    }
+
+    Gd::out.printInfo("Info: Latency timer of " + device + " changed from " + oldValue + " ms to 1 ms.");
+    return true;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return false;
+}
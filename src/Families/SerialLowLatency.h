@@ -0,0 +1,65 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_SERIALLOWLATENCY_H
+#define HOMEGEAR_GATEWAY_SERIALLOWLATENCY_H
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Low latency tuning for USB serial adapters. FTDI adapters buffer received data for up to 16 ms by default, which
+ * directly adds to every request/response round trip.
+ */
+class SerialLowLatency
+{
+public:
+    /**
+     * Sets ASYNC_LOW_LATENCY and makes read() return as soon as one byte is available (VMIN = 1, VTIME = 0).
+     *
+     * @param device The device path. Only used for log output.
+     * @param fileDescriptor The descriptor of the opened device.
+     * @return Returns true when all settings could be applied.
+     */
+    static bool apply(const std::string& device, int32_t fileDescriptor);
+
+    /**
+     * Lowers the latency timer of FTDI adapters to 1 ms through sysfs. Needs write access to sysfs, so this needs to be
+     * called before dropping privileges.
+     *
+     * @return Returns true when the latency timer was set and false when the device has no latency timer or it could not be set.
+     */
+    static bool setLatencyTimer(const std::string& device);
+private:
+    SerialLowLatency() = default;
+
+    static std::string getLatencyTimerPath(const std::string& device);
+};
+
+#endif
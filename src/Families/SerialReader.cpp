@@ -0,0 +1,77 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "SerialReader.h"
+#include "../Gd.h"
+
+SerialReader::SerialReader(BaseLib::SharedObjects *bl) {
+  _ioBackend = IoBackend::create(bl);
+}
+
+void SerialReader::clear() {
+  _bufferPosition = 0;
+  _bufferSize = 0;
+}
+
+int32_t SerialReader::readChar(const BaseLib::PFileDescriptor &fileDescriptor, char &data, uint32_t timeout) {
+  try {
+    if (!fileDescriptor || fileDescriptor->descriptor == -1 || !_ioBackend) return -1;
+    if (fileDescriptor->id != _fileDescriptorId) {
+      clear();
+      _fileDescriptorId = fileDescriptor->id;
+    }
+
+    if (_bufferPosition < _bufferSize) {
+      data = _buffer[_bufferPosition++];
+      return 0;
+    }
+
+    int32_t result = _ioBackend->poll(fileDescriptor, POLLIN, timeout / 1000);
+    if (result == 0) return 1;
+    else if (result < 0) return -1;
+    if (!(_ioBackend->polledEvents() & POLLIN)) return -1;
+
+    ssize_t bytesRead = read(fileDescriptor->descriptor, _buffer.data(), _buffer.size());
+    if (bytesRead == -1) {
+      if (errno == EAGAIN || errno == EINTR) return 1;
+      return -1;
+    } else if (bytesRead == 0) return -1; //Device was removed.
+    _readTime = ReceiveTime::now();
+
+    _bufferSize = (size_t)bytesRead;
+    _bufferPosition = 1;
+    data = _buffer[0];
+    return 0;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return -1;
+}
@@ -0,0 +1,78 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_SERIALREADER_H
+#define HOMEGEAR_GATEWAY_SERIALREADER_H
+
+#include "../IoBackend.h"
+#include "ReceiveTime.h"
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Buffered replacement for SerialReaderWriter::readChar(). Instead of one poll and one read system call per byte, it
+ * waits using an IoBackend and reads everything available (up to 256 bytes) at once. Not thread safe - only call it
+ * from the thread reading from the device.
+ */
+class SerialReader
+{
+public:
+    SerialReader(BaseLib::SharedObjects* bl);
+    virtual ~SerialReader() = default;
+
+    /**
+     * Reads one byte. The buffer is discarded automatically when the device is reopened.
+     *
+     * @param fileDescriptor The descriptor of the serial device.
+     * @param data The variable to store the byte in.
+     * @param timeout The timeout in microseconds.
+     * @return Returns 0 on success, 1 on timeout and -1 on error.
+     */
+    int32_t readChar(const BaseLib::PFileDescriptor& fileDescriptor, char& data, uint32_t timeout);
+
+    /**
+     * @return The time the read() returning the last byte passed by readChar() completed.
+     */
+    const ReceiveTime& readTime() { return _readTime; }
+
+    /**
+     * Discards all buffered bytes.
+     */
+    void clear();
+private:
+    std::unique_ptr<IoBackend> _ioBackend;
+    int32_t _fileDescriptorId = -1;
+    std::array<char, 256> _buffer;
+    size_t _bufferPosition = 0;
+    size_t _bufferSize = 0;
+    ReceiveTime _readTime;
+};
+
+#endif
@@ -0,0 +1,170 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "SerialTxQueue.h"
+#include "../Gd.h"
+
+#include <sys/uio.h>
+#include <sys/poll.h>
+#include <climits>
+
+SerialTxQueue::SerialTxQueue(BaseLib::SharedObjects *bl, std::function<BaseLib::PFileDescriptor()> getFileDescriptor) {
+  _bl = bl;
+  _getFileDescriptor.swap(getFileDescriptor);
+}
+
+SerialTxQueue::~SerialTxQueue() {
+  try {
+    stop();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void SerialTxQueue::start() {
+  try {
+    stop();
+    _stopWriterThread = false;
+    _bl->threadManager.start(_writerThread, true, &SerialTxQueue::writer, this);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void SerialTxQueue::stop() {
+  try {
+    {
+      std::lock_guard<std::mutex> queueGuard(_queueMutex);
+      _stopWriterThread = true;
+    }
+    _queueConditionVariable.notify_all();
+    _bl->threadManager.join(_writerThread);
+
+    std::lock_guard<std::mutex> queueGuard(_queueMutex);
+    if (!_queue.empty()) Gd::out.printInfo("Info: Discarding " + std::to_string(_queue.size()) + " unsent frames.");
+    _queue.clear();
+    _depth = 0;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+bool SerialTxQueue::enqueue(std::vector<uint8_t> data) {
+  try {
+    if (data.empty()) return true;
+    {
+      std::lock_guard<std::mutex> queueGuard(_queueMutex);
+      if (_stopWriterThread || _queue.size() >= _maxDepth) return false;
+      _queue.emplace_back(std::move(data));
+      _depth = _queue.size();
+    }
+    _queueConditionVariable.notify_one();
+    return true;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return false;
+}
+
+void SerialTxQueue::writer() {
+  std::vector<std::vector<uint8_t>> batch;
+  batch.reserve(IOV_MAX);
+  while (!_stopWriterThread) {
+    try {
+      {
+        std::unique_lock<std::mutex> queueLock(_queueMutex);
+        if (!_queueConditionVariable.wait_for(queueLock, std::chrono::milliseconds(1000), [&] { return !_queue.empty() || _stopWriterThread; })) continue;
+        if (_stopWriterThread) return;
+
+        //Take everything that is pending, so it can be written with one system call. Order is preserved.
+        while (!_queue.empty() && batch.size() < IOV_MAX) {
+          batch.emplace_back(std::move(_queue.front()));
+          _queue.pop_front();
+        }
+      }
+
+      auto fileDescriptor = _getFileDescriptor();
+      if (!fileDescriptor || fileDescriptor->descriptor == -1) {
+        Gd::out.printWarning("Warning: Dropping " + std::to_string(batch.size()) + " frames, because the device is not open.");
+      } else if (writeBatch(fileDescriptor->descriptor, batch)) {
+        _framesWritten += batch.size();
+      }
+
+      batch.clear();
+      std::lock_guard<std::mutex> queueGuard(_queueMutex);
+      _depth = _queue.size();
+    }
+    catch (const std::exception &ex) {
+      batch.clear();
+      Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+  }
+}
+
+bool SerialTxQueue::writeBatch(int32_t fileDescriptor, std::vector<std::vector<uint8_t>> &batch) {
+  std::vector<iovec> iov;
+  iov.reserve(batch.size());
+  for (auto &element : batch) {
+    iov.push_back(iovec{element.data(), element.size()});
+  }
+
+  size_t index = 0;
+  while (index < iov.size()) {
+    ssize_t bytesWritten = writev(fileDescriptor, iov.data() + index, (int)(iov.size() - index));
+    _writeCalls++;
+    if (bytesWritten == -1) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        //The UART's buffer is full. Wait until it is writable again.
+        pollfd pollStruct{fileDescriptor, (short)POLLOUT, (short)0};
+        if (poll(&pollStruct, 1, 1000) <= 0 && _stopWriterThread) return false;
+        continue;
+      }
+      Gd::out.printError("Error writing to serial device: " + std::string(strerror(errno)));
+      return false;
+    }
+
+    //Skip completely written buffers and adjust a partially written one.
+    while (index < iov.size() && (size_t)bytesWritten >= iov[index].iov_len) {
+      bytesWritten -= iov[index].iov_len;
+      index++;
+    }
+    if (index < iov.size() && bytesWritten > 0) {
+      iov[index].iov_base = (uint8_t *)iov[index].iov_base + bytesWritten;
+      iov[index].iov_len -= bytesWritten;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,84 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_SERIALTXQUEUE_H
+#define HOMEGEAR_GATEWAY_SERIALTXQUEUE_H
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Per-device transmit queue. Frames are queued by the RPC and listen threads and written by a dedicated writer thread.
+ * All frames pending at the time the writer wakes up are written with a single writev() call, so e. g. a Z-Wave ACK
+ * and a following frame end up in one system call. Frames are always written in the order they were queued.
+ */
+class SerialTxQueue
+{
+public:
+    SerialTxQueue(BaseLib::SharedObjects* bl, std::function<BaseLib::PFileDescriptor()> getFileDescriptor);
+    virtual ~SerialTxQueue();
+
+    void start();
+    void stop();
+
+    /**
+     * Queues a frame for sending.
+     *
+     * @return Returns false when the writer is not running or the queue is full.
+     */
+    bool enqueue(std::vector<uint8_t> data);
+
+    /**
+     * @return The number of frames waiting to be written.
+     */
+    size_t depth() { return _depth; }
+
+    uint64_t framesWritten() { return _framesWritten; }
+    uint64_t writeCalls() { return _writeCalls; }
+private:
+    static const size_t _maxDepth = 1000;
+
+    BaseLib::SharedObjects* _bl = nullptr;
+    std::function<BaseLib::PFileDescriptor()> _getFileDescriptor;
+
+    std::mutex _queueMutex;
+    std::condition_variable _queueConditionVariable;
+    std::deque<std::vector<uint8_t>> _queue;
+    std::atomic<size_t> _depth{0};
+    std::atomic<uint64_t> _framesWritten{0};
+    std::atomic<uint64_t> _writeCalls{0};
+
+    std::atomic_bool _stopWriterThread{true};
+    std::thread _writerThread;
+
+    void writer();
+    bool writeBatch(int32_t fileDescriptor, std::vector<std::vector<uint8_t>>& batch);
+};
+
+#endif
@@ -30,16 +30,26 @@
 
 #include "../Gd.h"
 #include "ZWave.h"
+#include "FamilyModule.h"
+#include "../RealTime.h"
 
 
-ZWave::ZWave(BaseLib::SharedObjects* bl) : ICommunicationInterface(bl), _stopCallbackThread(false), _stopped(true), _tryCount(30), _emptyReadBuffers(true), lastSOFtime(0)
+ZWave::ZWave(BaseLib::SharedObjects* bl, const InterfaceSettings& settings) : ICommunicationInterface(bl, settings), _stopCallbackThread(false), _stopped(true), _tryCount(30), _emptyReadBuffers(true)
 {
     try
     {
         _familyId = ZWAVE_FAMILY_ID;
+        _captureLinkType = FrameCapture::LinkType::zWaveSerialApi;
 
-        _localRpcMethods.emplace("emptyReadBuffers", std::bind(&ZWave::emptyReadBuffers, this, std::placeholders::_1));
-        _localRpcMethods.emplace("sendPacket", std::bind(&ZWave::sendPacket, this, std::placeholders::_1));
+        registerRpcMethod(RpcMethod::emptyReadBuffers, std::bind(&ZWave::emptyReadBuffers, this, std::placeholders::_1));
+        registerRpcMethod(RpcMethod::sendPacket, std::bind(&ZWave::sendPacket, this, std::placeholders::_1));
+
+        _txQueue.reset(new SerialTxQueue(bl, [this]() { return _serial ? _serial->fileDescriptor() : BaseLib::PFileDescriptor(); }));
+        _presenceWatcher.reset(new DevicePresenceWatcher(bl, _settings.device));
+        _serialReader.reset(new SerialReader(bl));
+        _linkHealth.reset(new LinkHealth(115200, 1500000));
+        _requestEngine.reset(new RequestEngine(bl, "ZWave"));
+        _presenceWatcher->setRemovedCallback([this]() { SetStopped(); });
 
         start();
     }
@@ -65,17 +75,23 @@ void ZWave::start()
 {
     try
     {
-        if(Gd::settings.device().empty())
+        if(replaying()) return; //Frames are fed in by FrameReplay. Don't open the device.
+
+        if(_settings.device.empty())
         {
             Gd::out.printError("Error: No device defined for family ZWave. Please specify it in \"gateway.conf\".");
             return;
         }
 
+        _presenceWatcher->start();
+
         Reset();
         if(!Open()) return;
 
         _stopCallbackThread = false;
 
+        _txQueue->start();
+        _requestEngine->start();
         _bl->threadManager.start(_listenThread, true, &ZWave::listen, this);
 
         //sendReconnect();
@@ -93,8 +109,11 @@ void ZWave::stop()
         if(!_serial) return;
 
         _stopCallbackThread = true;
+        _presenceWatcher->stop();
+        _requestEngine->stop();
         _bl->threadManager.join(_listenThread);
         SetStopped();
+        _txQueue->stop();
         if(_serial) _serial->closeDevice();
     }
     catch(const std::exception& ex)
@@ -119,8 +138,9 @@ void ZWave::rawSend(const std::vector<uint8_t>& packet)
     {
         if(!_serial || !_serial->isOpen())
             return;
-        Gd::out.printInfo("Info: RAW Sending packet " + BaseLib::HelperFunctions::getHexString(packet));
-        _serial->writeData(packet);
+        captureFrame(FrameCapture::Direction::outbound, packet);
+        Gd::asyncLog.log(LogFormat::rawSendingPacket, packet);
+        if(!_txQueue->enqueue(packet)) Gd::out.printError("Error: Could not queue packet " + BaseLib::HelperFunctions::getHexString(packet) + ". Transmit queue is full.");
     }
     catch(const std::exception& ex)
     {
@@ -181,7 +201,7 @@ void ZWave::EmptyReadBuffers(int tryCount)
     do
     {
         //Clear buffer, otherwise the address response cannot be sent by the module if the buffer is full.
-        result = _serial->readChar(byte, 100000);
+        result = _serialReader->readChar(_serial->fileDescriptor(), byte, 100000);
         ++cnt;
     }
     while(0 == result && cnt < tryCount && !_stopCallbackThread);
@@ -191,6 +211,8 @@ void ZWave::listen()
 {
     try
     {
+        RealTime::apply(RealTime::Subsystem::serial);
+        FlightRecorder::Watch watch(_settings.family + " " + _settings.device);
         Gd::out.printInfo("Listen thread starting");
 
         std::vector<uint8_t> data;
@@ -204,6 +226,7 @@ void ZWave::listen()
 
         while(!_stopCallbackThread)
         {
+            watch.beat();
             try
             {
                 if(!IsOpen())
@@ -218,7 +241,7 @@ void ZWave::listen()
                         Gd::out.printWarning("Warning: Connection to device closed. Trying to reconnect...");
                     _serial->closeDevice();
 
-                    std::this_thread::sleep_for(std::chrono::seconds(5));
+                    if(_presenceWatcher->waitForDevice(5000)) Gd::out.printInfo("Info: Device reappeared. Reconnecting...");
 
                     if(!_stopCallbackThread)
                         reconnect();
@@ -234,20 +257,20 @@ void ZWave::listen()
                 else if (_emptyReadBuffers)
                 {
                     EmptyReadBuffers(_tryCount);
-
-                    std::unique_lock<std::mutex> lock(_mutex);
                     _emptyReadBuffers = false;
-                    lock.unlock();
-                    _cv.notify_all();
+
+                    std::vector<uint8_t> empty;
+                    _requestEngine->complete(0, empty);
 
                     continue;
                 }
 
                 byte = 0;
-                result = _serial->readChar(byte, 100000);
+                result = _serialReader->readChar(_serial->fileDescriptor(), byte, data.empty() ? 100000 : _linkHealth->partialFrameTimeout());
                 if(-1 == result)
                 {
                     Gd::out.printError("Error reading from serial device.");
+                    _linkHealth->readFailed();
                     SetStopped();
                     packetSize = 0;
                     data.clear();
@@ -255,32 +278,35 @@ void ZWave::listen()
                 }
                 else if(1 == result)
                 {
-                    const int64_t curTime = BaseLib::HelperFunctions::getTime();
-                    if (curTime - lastSOFtime < 1500) continue;
+                    _linkHealth->pollUartErrors(_serial->fileDescriptor());
 
                     packetSize = 0;
 
                     if(!data.empty())
                     {
                         Gd::out.printWarning("Warning: Incomplete packet received: " + BaseLib::HelperFunctions::getHexString(data));
+                        _linkHealth->frameIncomplete();
                         //sendNack();
                         data.clear();
 
-                        data.push_back((uint8_t)ZWaveResponseCodes::NACK);
-                        _processRawPacket(data);
-                        data.clear();
+                        forwardGeneratedNack(data);
                     }
 
                     continue;
                 }
 
+                _linkHealth->readSucceeded();
+                _receiveTime = _serialReader->readTime();
+                _linkHealth->byteReceived(_receiveTime, !data.empty());
                 if(data.empty())
                 {
                     if(static_cast<uint8_t>(byte) == (uint8_t)ZWaveResponseCodes::ACK || static_cast<uint8_t>(byte) == (uint8_t)ZWaveResponseCodes::NACK || static_cast<uint8_t>(byte) == (uint8_t)ZWaveResponseCodes::CAN)
                     {
                         data.push_back(byte);
+                        _linkHealth->frameCompleted(data.size());
 
-                        _processRawPacket(data);
+                        captureFrame(FrameCapture::Direction::inbound, data);
+                        processRawPacket(data);
 
                         data.clear();
                         continue;
@@ -288,15 +314,13 @@ void ZWave::listen()
                     else if(static_cast<uint8_t>(byte) != (uint8_t)ZWaveResponseCodes::SOF)
                     {
                         Gd::out.printWarning("Warning: Unknown start byte received: " + BaseLib::HelperFunctions::getHexString(byte));
+                        _linkHealth->byteDiscarded();
 
                         //sendNack();
-                        data.push_back((uint8_t)ZWaveResponseCodes::NACK);
-                        _processRawPacket(data);
-                        data.clear();
+                        forwardGeneratedNack(data);
 
                         continue;
                     }
-                    lastSOFtime = BaseLib::HelperFunctions::getTime();
                 }
                 data.push_back(byte);
 
@@ -306,14 +330,13 @@ void ZWave::listen()
                     if(0 == packetSize)
                     {
                         Gd::out.printError("Error: Header has invalid size information: " + BaseLib::HelperFunctions::getHexString(data));
+                        _linkHealth->frameCorrupted();
 
                         data.clear();
 
                         //sendNack();
 
-                        data.push_back((uint8_t)ZWaveResponseCodes::NACK);
-                        _processRawPacket(data);
-                        data.clear();
+                        forwardGeneratedNack(data);
 
                         continue;
                     }
@@ -326,13 +349,13 @@ void ZWave::listen()
                     if(crc8 != data.back())
                     {
                         Gd::out.printError("Error: CRC failed for packet: " + BaseLib::HelperFunctions::getHexString(data));
+                        _linkHealth->frameCorrupted();
+                        Metrics::add(Counter::crcErrors, _familyId);
                         packetSize = 0;
                         data.clear();
                         sendNack();
 
-                        data.push_back((uint8_t)ZWaveResponseCodes::NACK);
-                        _processRawPacket(data);
-                        data.clear();
+                        forwardGeneratedNack(data);
 
                         continue;
                     }
@@ -341,9 +364,12 @@ void ZWave::listen()
 
                     packetSize = 0;
 
-                    _processRawPacket(data);
+                    _linkHealth->frameCompleted(data.size());
+                    captureFrame(FrameCapture::Direction::inbound, data);
+                    processRawPacket(data);
 
                     data.clear();
+                    _linkHealth->pollUartErrors(_serial->fileDescriptor());
                 }
             }
             catch(const std::exception& ex)
@@ -360,24 +386,24 @@ void ZWave::listen()
     Gd::out.printInfo("Listen thread stopped");
 }
 
-void ZWave::_processRawPacket(std::vector<uint8_t> data)
+
+void ZWave::processRawPacket(std::vector<uint8_t>& data)
 {
-    processRawPacket(data);
+    //ACK, NACK and CAN read from the device and responses (type 0x01) to the host's requests must reach Homegear even
+    //when the receive budget is exhausted, otherwise Homegear can't finish its own sends.
+    if(data.size() == 1 || (data.size() > 2 && data[2] == 0x01)) forwardControlPacket(_receivePool->packet(data));
+    else forwardPacket(_receivePool->packet(data));
 }
 
 
-void ZWave::processRawPacket(std::vector<uint8_t>& data)
+void ZWave::forwardGeneratedNack(std::vector<uint8_t>& data)
 {
-    BaseLib::PArray parameters = std::make_shared<BaseLib::Array>();
-    parameters->reserve(2);
-    parameters->push_back(std::make_shared<BaseLib::Variable>(ZWAVE_FAMILY_ID));
-    parameters->push_back(std::make_shared<BaseLib::Variable>(data));
-
-    auto result = _invoke("packetReceived", parameters);
-    if(result->errorStruct && result->structValue->at("faultCode")->integerValue != -1)
-    {
-        Gd::out.printError("Error calling packetReceived(): " + result->structValue->at("faultString")->stringValue);
-    }
+    //The NACK wasn't sent by the device, so a noisy serial link could produce any number of them. Unlike the control
+    //frames read from the device it therefore counts against the receive budget.
+    data.clear();
+    data.push_back((uint8_t)ZWaveResponseCodes::NACK);
+    forwardPacket(_receivePool->packet(data));
+    data.clear();
 }
 
 
@@ -401,16 +427,12 @@ void ZWave::reconnect()
     try
     {
         Gd::out.printInfo("Trying to reconnect");
+        Gd::flightRecorder.record(FlightRecorder::Event::reconnect, _familyId, _settings.device);
+        Metrics::add(Counter::reconnects, _familyId);
 
         _serial->closeDevice();
         _stopped = true;
-        _serial->openDevice(false, false, false);
-        if(!_serial->isOpen())
-        {
-            Gd::out.printError("Error: Could not open device.");
-            return;
-        }
-        _stopped = false;
+        if(!Open()) return;
 
         sendReconnect();
     }
@@ -420,24 +442,6 @@ void ZWave::reconnect()
     }
 }
 
-BaseLib::PVariable ZWave::callMethod(std::string& method, BaseLib::PArray parameters)
-{
-    try
-    {
-        auto localMethodIterator = _localRpcMethods.find(method);
-        if(localMethodIterator == _localRpcMethods.end()) return BaseLib::Variable::createError(-32601, ": Requested method not found.");
-
-        if(_bl->debugLevel >= 5) Gd::out.printDebug("Debug: Server is calling RPC method: " + method);
-
-        return localMethodIterator->second(parameters);
-    }
-    catch(const std::exception& ex)
-    {
-        Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
-    }
-    return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
-}
-
 
 //{{{ RPC methods
 BaseLib::PVariable ZWave::sendPacket(BaseLib::PArray& parameters)
@@ -448,7 +452,7 @@ BaseLib::PVariable ZWave::sendPacket(BaseLib::PArray& parameters)
 
         if(!_serial)
         {
-            Gd::out.printError("Error: Couldn't write to device, because the device descriptor is not valid: " + Gd::settings.device());
+            Gd::out.printError("Error: Couldn't write to device, because the device descriptor is not valid: " + _settings.device);
             return BaseLib::Variable::createError(-1, "Serial device is not open.");
         }
 
@@ -471,15 +475,17 @@ BaseLib::PVariable ZWave::emptyReadBuffers(BaseLib::PArray& parameters)
 
         if(!_serial)
         {
-            Gd::out.printError("Error: Couldn't write to device, because the device descriptor is not valid: " + Gd::settings.device());
+            Gd::out.printError("Error: Couldn't write to device, because the device descriptor is not valid: " + _settings.device);
             return BaseLib::Variable::createError(-1, "Serial device is not open.");
         }
 
         _tryCount = parameters->at(1)->integerValue64;
 
-        std::unique_lock<std::mutex> lock(_mutex);
-        _emptyReadBuffers = true;
-        _cv.wait_for(lock, std::chrono::milliseconds(_tryCount * 200), [&] { return !_emptyReadBuffers; });
+        //The listen thread drains the buffers and completes the request. A timeout is not an error, the buffers are
+        //drained anyway.
+        std::vector<uint8_t> response;
+        auto result = _requestEngine->sendAndWait(0, _tryCount * 200, [&]() { _emptyReadBuffers = true; return true; }, response);
+        if(result == RequestEngine::Result::cancelled) return BaseLib::Variable::createError(-1, "Interface was stopped.");
 
         return std::make_shared<BaseLib::Variable>();
     }
@@ -491,3 +497,5 @@ BaseLib::PVariable ZWave::emptyReadBuffers(BaseLib::PArray& parameters)
 }
 
 //}}}
+
+HOMEGEAR_GATEWAY_FAMILY_MODULE(ZWave)
@@ -32,6 +32,11 @@
 #define HOMEGEAR_GATEWAY_ZIGBEE_H
 
 #include "ICommunicationInterface.h"
+#include "SerialTxQueue.h"
+#include "DevicePresenceWatcher.h"
+#include "SerialReader.h"
+#include "RequestEngine.h"
+#include "SerialLowLatency.h"
 
 
 #define ZIGBEE_FAMILY_ID 26
@@ -39,9 +44,11 @@
 class Zigbee : public ICommunicationInterface
 {
 public:
-    Zigbee(BaseLib::SharedObjects* bl);
+    Zigbee(BaseLib::SharedObjects* bl, const InterfaceSettings& settings);
     virtual ~Zigbee();
-    virtual BaseLib::PVariable callMethod(std::string& method, BaseLib::PArray parameters);
+    virtual size_t txQueueDepth() { return _txQueue ? _txQueue->depth() : 0; }
+    virtual size_t pendingRequests() { return _requestEngine ? _requestEngine->pending() : 0; }
+    virtual bool replayFrame(std::vector<uint8_t>& frame) { processRawPacket(frame); return true; }
 private:
 
     bool IsOpen() const
@@ -58,6 +65,7 @@ private:
             SetStopped(); // to be sure
             return false;
         }
+        if(Gd::settings.serialLowLatency()) SerialLowLatency::apply(_settings.device, _serial->fileDescriptor()->descriptor);
         SetStopped(false);
 
         return true;
@@ -65,7 +73,7 @@ private:
 
     void Reset()
     {
-        _serial.reset(new BaseLib::SerialReaderWriter(_bl, Gd::settings.device(), 115200, 0, true, -1));
+        _serial.reset(new BaseLib::SerialReaderWriter(_bl, _settings.device, 115200, 0, true, -1));
     }
 
     void Close()
@@ -88,15 +96,15 @@ private:
     std::thread _listenThread;
 
     std::unique_ptr<BaseLib::SerialReaderWriter> _serial;
+    std::unique_ptr<SerialTxQueue> _txQueue;
+    std::unique_ptr<DevicePresenceWatcher> _presenceWatcher;
+    std::unique_ptr<SerialReader> _serialReader;
+    std::unique_ptr<RequestEngine> _requestEngine;
 
     std::atomic_bool _stopped;
     std::atomic_int _tryCount;
 
     std::atomic_bool _emptyReadBuffers;
-    std::mutex _mutex;
-    std::condition_variable _cv;
-
-    int64_t lastSOFtime;
 
     void start();
     void stop();
@@ -108,7 +116,6 @@ private:
     void listen();
 
     void processRawPacket(std::vector<uint8_t>& data);
-    void _processRawPacket(std::vector<uint8_t> data);
 
     static uint8_t getCrc8(const std::vector<uint8_t>& packet);
 
@@ -0,0 +1,383 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "FlightRecorder.h"
+#include "Gd.h"
+
+#include <fcntl.h>
+
+namespace {
+
+/**
+ * Formats text without allocating, so it can be used in signal handlers.
+ */
+class LineBuffer {
+ public:
+  void append(const char *text) {
+    while (*text && _size < sizeof(_buffer)) _buffer[_size++] = *text++;
+  }
+
+  void append(char c) {
+    if (_size < sizeof(_buffer)) _buffer[_size++] = c;
+  }
+
+  void appendNumber(int64_t number, size_t width = 0) {
+    char digits[24];
+    size_t count = 0;
+    uint64_t value = number < 0 ? (uint64_t)0 - (uint64_t)number : (uint64_t)number;
+    do {
+      digits[count++] = (char)('0' + (value % 10));
+      value /= 10;
+    } while (value > 0);
+    if (number < 0) append('-');
+    for (size_t i = count; i < width; i++) append('0');
+    while (count > 0) append(digits[--count]);
+  }
+
+  void appendTime(const timespec &time) {
+    appendNumber(time.tv_sec);
+    append('.');
+    appendNumber(time.tv_nsec, 9);
+  }
+
+  void appendHex(const uint8_t *data, size_t size) {
+    static const char hex[] = "0123456789ABCDEF";
+    for (size_t i = 0; i < size; i++) {
+      append(hex[data[i] >> 4]);
+      append(hex[data[i] & 0x0F]);
+    }
+  }
+
+  void appendText(const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i++) append(data[i] >= 0x20 && data[i] < 0x7F ? (char)data[i] : '.');
+  }
+
+  bool write(int fileDescriptor) {
+    size_t written = 0;
+    while (written < _size) {
+      ssize_t result = ::write(fileDescriptor, _buffer + written, _size - written);
+      if (result == -1) {
+        if (errno == EINTR) continue;
+        return false;
+      }
+      written += (size_t)result;
+    }
+    _size = 0;
+    return true;
+  }
+
+  const char *c_str() {
+    _buffer[_size < sizeof(_buffer) ? _size : sizeof(_buffer) - 1] = 0;
+    return _buffer;
+  }
+ private:
+  char _buffer[1200];
+  size_t _size = 0;
+};
+
+const char *eventName(FlightRecorder::Event event) {
+  switch (event) {
+    case FlightRecorder::Event::frameReceived: return "frameReceived";
+    case FlightRecorder::Event::frameSent: return "frameSent";
+    case FlightRecorder::Event::rpcCall: return "rpcCall";
+    case FlightRecorder::Event::rpcInvoke: return "rpcInvoke";
+    case FlightRecorder::Event::rpcError: return "rpcError";
+    case FlightRecorder::Event::reconnect: return "reconnect";
+    case FlightRecorder::Event::state: return "state";
+    case FlightRecorder::Event::watchdog: return "watchdog";
+  }
+  return "unknown";
+}
+
+int64_t steadyMilliseconds() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+FlightRecorder::Watch::Watch(const std::string &name) {
+  try {
+    auto &watches = Gd::flightRecorder._watches;
+    for (size_t i = 0; i < watches.size(); i++) {
+      bool expected = false;
+      if (!watches[i].used.compare_exchange_strong(expected, true)) continue;
+      strncpy(watches[i].name, name.c_str(), sizeof(watches[i].name) - 1);
+      watches[i].name[sizeof(watches[i].name) - 1] = 0;
+      watches[i].tripped = false;
+      watches[i].lastBeat.store(steadyMilliseconds(), std::memory_order_release);
+      _index = (int32_t)i;
+      return;
+    }
+    Gd::out.printWarning("Warning: Too many watched threads. \"" + name + "\" is not watched.");
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+FlightRecorder::Watch::~Watch() {
+  if (_index == -1) return;
+  auto &watch = Gd::flightRecorder._watches[_index];
+  watch.lastBeat.store(0, std::memory_order_release);
+  watch.used.store(false, std::memory_order_release);
+}
+
+void FlightRecorder::Watch::beat() {
+  if (_index != -1) Gd::flightRecorder._watches[_index].lastBeat.store(steadyMilliseconds(), std::memory_order_release);
+}
+
+FlightRecorder::~FlightRecorder() {
+  stopWatchdog();
+}
+
+void FlightRecorder::init(const std::string &dataPath) {
+  try {
+    snprintf(_pathPrefix, sizeof(_pathPrefix), "%sflightrecorder-", dataPath.c_str());
+
+    struct sigaction action{};
+    action.sa_handler = &FlightRecorder::signalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESETHAND; //The default action is restored before the handler runs, so raising the signal again writes the core dump.
+    for (int signalNumber : {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT}) {
+      if (sigaction(signalNumber, &action, nullptr) == -1) Gd::out.printWarning("Warning: Could not install handler for signal " + std::to_string(signalNumber) + ": " + std::string(strerror(errno)));
+    }
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void FlightRecorder::startWatchdog(BaseLib::SharedObjects *bl, uint32_t timeout) {
+  try {
+    stopWatchdog();
+    if (timeout == 0) return;
+    _bl = bl;
+    _watchdogTimeout = timeout;
+    _stopWatchdog = false;
+    _bl->threadManager.start(_watchdogThread, true, &FlightRecorder::watchdog, this);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void FlightRecorder::stopWatchdog() {
+  try {
+    {
+      std::lock_guard<std::mutex> watchdogGuard(_watchdogMutex);
+      if (_stopWatchdog) return;
+      _stopWatchdog = true;
+    }
+    _watchdogConditionVariable.notify_all();
+    _bl->threadManager.join(_watchdogThread);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void FlightRecorder::watchdog() {
+  while (true) {
+    try {
+      {
+        std::unique_lock<std::mutex> watchdogLock(_watchdogMutex);
+        if (_watchdogConditionVariable.wait_for(watchdogLock, std::chrono::seconds(1), [&] { return _stopWatchdog; })) return;
+      }
+
+      int64_t now = steadyMilliseconds();
+      for (auto &watch : _watches) {
+        int64_t lastBeat = watch.lastBeat.load(std::memory_order_acquire);
+        if (lastBeat == 0) continue;
+        int64_t stalled = now - lastBeat;
+        if (stalled <= (int64_t)_watchdogTimeout * 1000) {
+          watch.tripped = false;
+          continue;
+        }
+        if (watch.tripped) continue; //Only one dump per stall.
+        watch.tripped = true;
+
+        std::string name(watch.name);
+        record(Event::watchdog, -1, name, (int32_t)(stalled / 1000));
+        std::string path = dump("Watchdog: \"" + name + "\" stalled.");
+        Gd::out.printCritical("Critical: Thread \"" + name + "\" did not respond for " + std::to_string(stalled / 1000) + " seconds." + (path.empty() ? std::string() : " Flight recorder written to " + path + "."));
+      }
+    }
+    catch (const std::exception &ex) {
+      Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+  }
+}
+
+void FlightRecorder::record(Event event, int32_t familyId, const uint8_t *data, size_t size, int32_t value) {
+  uint64_t position = _position.fetch_add(1, std::memory_order_relaxed);
+  auto &record = _records[position % _recordCount];
+
+  //The sequence identifies the position, so a reader detects records that were overwritten by a later lap.
+  record.sequence.store(position * 2 + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  record.time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  record.value = value;
+  record.familyId = (int16_t)familyId;
+  record.size = (uint16_t)std::min(size, (size_t)UINT16_MAX);
+  record.event = event;
+  if (data && size > 0) memcpy(record.data, data, std::min(size, sizeof(record.data)));
+  record.sequence.store(position * 2 + 2, std::memory_order_release);
+}
+
+std::string FlightRecorder::dump(const std::string &reason) {
+  try {
+    char path[sizeof(_pathPrefix) + 64];
+    if (!write(reason.c_str(), path, sizeof(path))) {
+      Gd::out.printError("Error: Could not write flight recorder to " + std::string(_pathPrefix) + "*: " + std::string(strerror(errno)));
+      return "";
+    }
+    Gd::out.printInfo("Info: Flight recorder written to " + std::string(path) + ".");
+    return path;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return "";
+}
+
+BaseLib::PVariable FlightRecorder::dump(BaseLib::PArray &parameters) {
+  try {
+    std::string reason = "RPC request";
+    if (!parameters->empty() && parameters->at(0)->type == BaseLib::VariableType::tString && !parameters->at(0)->stringValue.empty()) reason += ": " + parameters->at(0)->stringValue;
+
+    std::string path = dump(reason);
+    if (path.empty()) return BaseLib::Variable::createError(-1, "Could not write flight recorder. See log for more details.");
+    return std::make_shared<BaseLib::Variable>(path);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
+}
+
+bool FlightRecorder::write(const char *reason, char *path, size_t pathSize) {
+  if (_pathPrefix[0] == 0) return false;
+
+  timespec realTime{};
+  timespec steadyTime{};
+  clock_gettime(CLOCK_REALTIME, &realTime);
+  clock_gettime(CLOCK_MONOTONIC, &steadyTime);
+
+  LineBuffer line;
+  line.append(_pathPrefix);
+  line.appendNumber(realTime.tv_sec);
+  line.append('-');
+  line.appendNumber(_dumpCounter.fetch_add(1, std::memory_order_relaxed));
+  line.append(".txt");
+  const char *filename = line.c_str();
+  int fileDescriptor = open(filename, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0640);
+  if (fileDescriptor == -1) return false;
+  if (path && pathSize > 0) {
+    size_t i = 0;
+    for (; filename[i] && i < pathSize - 1; i++) path[i] = filename[i];
+    path[i] = 0;
+  }
+
+  uint64_t end = _position.load(std::memory_order_acquire);
+  uint64_t start = end > _recordCount ? end - _recordCount : 0;
+
+  line = LineBuffer();
+  line.append("Homegear Gateway flight recorder\nReason: ");
+  line.append(reason);
+  line.append("\nProcess: ");
+  line.appendNumber(getpid());
+  line.append("\nRealtime clock: ");
+  line.appendTime(realTime);
+  line.append("\nSteady clock: ");
+  line.appendTime(steadyTime);
+  line.append("\nRecords: ");
+  line.appendNumber((int64_t)(end - start));
+  line.append(" of ");
+  line.appendNumber((int64_t)end);
+  line.append("\nColumns: steady time, event, family, value, size, data\n\n");
+  bool success = line.write(fileDescriptor);
+
+  for (uint64_t position = start; success && position < end; position++) {
+    const auto &record = _records[position % _recordCount];
+    uint64_t sequence = record.sequence.load(std::memory_order_acquire);
+    if (sequence != position * 2 + 2) continue; //Still being written or already overwritten.
+    Record copy;
+    copy.time = record.time;
+    copy.value = record.value;
+    copy.familyId = record.familyId;
+    copy.size = record.size;
+    copy.event = record.event;
+    memcpy(copy.data, record.data, sizeof(copy.data));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (record.sequence.load(std::memory_order_relaxed) != sequence) continue;
+
+    timespec time{(time_t)(copy.time / 1000000000), (long)(copy.time % 1000000000)};
+    line.appendTime(time);
+    line.append(' ');
+    line.append(eventName(copy.event));
+    line.append(' ');
+    line.appendNumber(copy.familyId);
+    line.append(' ');
+    line.appendNumber(copy.value);
+    line.append(' ');
+    line.appendNumber(copy.size);
+    line.append(' ');
+    size_t size = std::min((size_t)copy.size, sizeof(copy.data));
+    if (copy.event == Event::frameReceived || copy.event == Event::frameSent) line.appendHex(copy.data, size);
+    else line.appendText(copy.data, size);
+    if (size < copy.size) line.append("...");
+    line.append('\n');
+    success = line.write(fileDescriptor);
+  }
+
+  close(fileDescriptor);
+  return success;
+}
+
+void FlightRecorder::signalHandler(int signalNumber) {
+  const char *reason = "Fatal signal";
+  switch (signalNumber) {
+    case SIGSEGV: reason = "SIGSEGV";
+      break;
+    case SIGBUS: reason = "SIGBUS";
+      break;
+    case SIGILL: reason = "SIGILL";
+      break;
+    case SIGFPE: reason = "SIGFPE";
+      break;
+    case SIGABRT: reason = "SIGABRT";
+      break;
+    default: break;
+  }
+  int error = errno;
+  Gd::flightRecorder.write(reason, nullptr, 0);
+  errno = error;
+  raise(signalNumber);
+}
@@ -0,0 +1,190 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef FLIGHTRECORDER_H_
+#define FLIGHTRECORDER_H_
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Always-on record of the most recent frames, RPC calls, reconnects and state changes. Recording only copies a few
+ * bytes into a fixed-size ring, so it stays enabled in production. The ring is written to a text file in the data
+ * directory when the process crashes (SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT), when a watched thread stalls for longer
+ * than "watchdogTimeout" seconds or when "dumpFlightRecorder" is called.
+ *
+ * Writers never wait. A record that is overwritten while it is dumped is skipped.
+ */
+class FlightRecorder
+{
+public:
+	enum class Event : uint8_t
+	{
+		frameReceived = 0,
+		frameSent = 1,
+
+		/**
+		 * A method called by Homegear. The data is the method name.
+		 */
+		rpcCall = 2,
+
+		/**
+		 * A method call to Homegear that returned. The data is the method name, the value the duration in microseconds.
+		 */
+		rpcInvoke = 3,
+
+		/**
+		 * A method call to Homegear that failed. The data is the method name, the value the error code.
+		 */
+		rpcError = 4,
+
+		/**
+		 * The data is the device.
+		 */
+		reconnect = 5,
+
+		/**
+		 * The data describes the new state.
+		 */
+		state = 6,
+
+		/**
+		 * The data is the name of the stalled thread, the value the number of seconds since it last reported.
+		 */
+		watchdog = 7
+	};
+
+	/**
+	 * Puts the calling thread under the watchdog for the lifetime of the object. The thread needs to call beat() more
+	 * often than every "watchdogTimeout" seconds. Watches are not thread safe, create one per thread.
+	 */
+	class Watch
+	{
+	public:
+		explicit Watch(const std::string& name);
+		~Watch();
+
+		void beat();
+	private:
+		int32_t _index = -1;
+	};
+
+	FlightRecorder() = default;
+	virtual ~FlightRecorder();
+
+	/**
+	 * Sets the directory dumps are written to and installs the handlers for fatal signals. The signals must not be
+	 * blocked.
+	 */
+	void init(const std::string& dataPath);
+
+	/**
+	 * @param timeout The number of seconds a watched thread may stall. 0 disables the watchdog.
+	 */
+	void startWatchdog(BaseLib::SharedObjects* bl, uint32_t timeout);
+	void stopWatchdog();
+
+	/**
+	 * Adds a record. Thread safe and lock free. Data longer than 39 bytes is truncated, the original size is kept.
+	 *
+	 * @param familyId The family the record belongs to or -1.
+	 */
+	void record(Event event, int32_t familyId, const uint8_t* data, size_t size, int32_t value = 0);
+	void record(Event event, int32_t familyId, const std::string& text, int32_t value = 0) { record(event, familyId, (const uint8_t*)text.data(), text.size(), value); }
+
+	/**
+	 * Writes the ring to a new file in the data directory.
+	 *
+	 * @return The path of the file or an empty string on error.
+	 */
+	std::string dump(const std::string& reason);
+
+	BaseLib::PVariable dump(BaseLib::PArray& parameters);
+private:
+	static constexpr size_t _recordCount = 4096;
+	static constexpr size_t _watchCount = 32;
+
+	struct alignas(64) Record
+	{
+		/**
+		 * Odd while the record is written. Readers compare it before and after copying the record.
+		 */
+		std::atomic<uint64_t> sequence{0};
+		int64_t time = 0;
+		int32_t value = 0;
+		int16_t familyId = -1;
+		uint16_t size = 0;
+		Event event = Event::state;
+		uint8_t data[39];
+	};
+	static_assert(sizeof(Record) == 64, "Records need to fit into one cache line.");
+
+	struct WatchSlot
+	{
+		std::atomic_bool used{false};
+
+		/**
+		 * Milliseconds on the steady clock. 0 while the slot is being set up.
+		 */
+		std::atomic<int64_t> lastBeat{0};
+		std::atomic_bool tripped{false};
+		char name[32]{};
+	};
+
+	std::array<Record, _recordCount> _records;
+	alignas(64) std::atomic<uint64_t> _position{0};
+	std::atomic<uint32_t> _dumpCounter{0};
+
+	/**
+	 * Prefix of the dump file names. Written once by init() so the signal handlers don't allocate.
+	 */
+	char _pathPrefix[1024]{};
+
+	std::array<WatchSlot, _watchCount> _watches;
+	BaseLib::SharedObjects* _bl = nullptr;
+	uint32_t _watchdogTimeout = 0;
+	std::mutex _watchdogMutex;
+	std::condition_variable _watchdogConditionVariable;
+	bool _stopWatchdog = true;
+	std::thread _watchdogThread;
+
+	void watchdog();
+
+	/**
+	 * Async signal safe.
+	 *
+	 * @param[out] path The path of the written file. Can be nullptr.
+	 * @return true on success.
+	 */
+	bool write(const char* reason, char* path, size_t pathSize);
+
+	static void signalHandler(int signalNumber);
+};
+
+#endif
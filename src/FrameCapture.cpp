@@ -0,0 +1,385 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "FrameCapture.h"
+#include "Gd.h"
+#include "../config.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+int64_t clockTime(clockid_t clock) {
+  timespec time{};
+  clock_gettime(clock, &time);
+  return (int64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+void copyToRing(std::vector<uint8_t> &ring, uint64_t position, const void *data, size_t size) {
+  size_t offset = position % ring.size();
+  size_t firstPart = std::min(size, ring.size() - offset);
+  memcpy(ring.data() + offset, data, firstPart);
+  if (firstPart < size) memcpy(ring.data(), (const uint8_t *)data + firstPart, size - firstPart);
+}
+
+void copyFromRing(const std::vector<uint8_t> &ring, uint64_t position, void *data, size_t size) {
+  size_t offset = position % ring.size();
+  size_t firstPart = std::min(size, ring.size() - offset);
+  memcpy(data, ring.data() + offset, firstPart);
+  if (firstPart < size) memcpy((uint8_t *)data + firstPart, ring.data(), size - firstPart);
+}
+
+template<typename T>
+void append(std::vector<uint8_t> &buffer, T value) {
+  size_t offset = buffer.size();
+  buffer.resize(offset + sizeof(T));
+  memcpy(buffer.data() + offset, &value, sizeof(T));
+}
+
+void pad(std::vector<uint8_t> &buffer) {
+  while (buffer.size() % 4 != 0) buffer.push_back(0);
+}
+
+/**
+ * Writes the total length of the block starting at blockStart into its header and trailer.
+ */
+void finishBlock(std::vector<uint8_t> &buffer, size_t blockStart) {
+  pad(buffer);
+  uint32_t length = (uint32_t)(buffer.size() - blockStart + 4);
+  memcpy(buffer.data() + blockStart + 4, &length, 4);
+  append<uint32_t>(buffer, length);
+}
+}
+
+FrameCapture::FrameCapture(BaseLib::SharedObjects *bl) {
+  _bl = bl;
+}
+
+FrameCapture::~FrameCapture() {
+  try {
+    stop();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+bool FrameCapture::start(const std::string &filename) {
+  try {
+    stop();
+
+    {
+      //Discard frames recorded by producers racing with the last stop().
+      std::vector<Record> records;
+      drain(records);
+    }
+
+    {
+      std::lock_guard<std::mutex> fileGuard(_fileMutex);
+      _filename = filename.empty() ? Gd::settings.captureFile() : filename;
+      if (BaseLib::Io::fileExists(_filename)) rotate();
+      else if (!openFile()) return false;
+      if (_fileDescriptor == -1) return false;
+    }
+
+    _stopWriterThread = false;
+    _bl->threadManager.start(_writerThread, true, &FrameCapture::writer, this);
+    _enabled = true;
+    Gd::out.printInfo("Info: Capturing frames to " + _filename + ".");
+    return true;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return false;
+}
+
+void FrameCapture::stop() {
+  try {
+    if (!_enabled && _stopWriterThread) return;
+    _enabled = false;
+    {
+      std::lock_guard<std::mutex> writerGuard(_writerMutex);
+      _stopWriterThread = true;
+    }
+    _writerConditionVariable.notify_all();
+    _bl->threadManager.join(_writerThread);
+
+    std::lock_guard<std::mutex> fileGuard(_fileMutex);
+    if (_fileDescriptor != -1) Gd::out.printInfo("Info: Stopped capturing frames to " + _filename + ".");
+    closeFile();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+uint32_t FrameCapture::registerInterface(LinkType linkType, const std::string &name) {
+  std::lock_guard<std::mutex> interfacesGuard(_interfacesMutex);
+  for (uint32_t i = 0; i < _interfaces.size(); i++) {
+    if (_interfaces[i].linkType == linkType && _interfaces[i].name == name) return i;
+  }
+  Interface interface;
+  interface.linkType = linkType;
+  interface.name = name;
+  _interfaces.push_back(interface);
+  return (uint32_t)_interfaces.size() - 1;
+}
+
+FrameCapture::ThreadBuffer &FrameCapture::threadBuffer() {
+  //There is only one FrameCapture object per process, so the buffer can be bound to the thread.
+  struct Holder {
+    std::shared_ptr<ThreadBuffer> buffer;
+    ~Holder() { if (buffer) buffer->abandoned = true; }
+  };
+  thread_local Holder holder;
+  if (!holder.buffer) {
+    holder.buffer = std::make_shared<ThreadBuffer>();
+    std::lock_guard<std::mutex> buffersGuard(_buffersMutex);
+    _buffers.push_back(holder.buffer);
+  }
+  return *holder.buffer;
+}
+
+void FrameCapture::capture(uint32_t interfaceIndex, Direction direction, const uint8_t *data, size_t size, int32_t rssi) {
+  if (!enabled() || size == 0 || size > 65535) return;
+
+  RecordHeader header;
+  header.size = (uint32_t)size;
+  header.interfaceIndex = interfaceIndex;
+  header.rssi = rssi;
+  header.direction = direction;
+  header.monotonicTime = clockTime(CLOCK_MONOTONIC);
+  header.realTime = clockTime(CLOCK_REALTIME);
+
+  ThreadBuffer &buffer = threadBuffer();
+  uint64_t head = buffer.head.load(std::memory_order_relaxed);
+  uint64_t tail = buffer.tail.load(std::memory_order_acquire);
+  if (ThreadBuffer::size - (head - tail) < sizeof(RecordHeader) + size) {
+    _framesDropped++;
+    return;
+  }
+  copyToRing(buffer.data, head, &header, sizeof(RecordHeader));
+  copyToRing(buffer.data, head + sizeof(RecordHeader), data, size);
+  buffer.head.store(head + sizeof(RecordHeader) + size, std::memory_order_release);
+}
+
+void FrameCapture::drain(std::vector<Record> &records) {
+  std::lock_guard<std::mutex> buffersGuard(_buffersMutex);
+  for (auto bufferIterator = _buffers.begin(); bufferIterator != _buffers.end();) {
+    ThreadBuffer &buffer = **bufferIterator;
+    //Read "abandoned" first. If it is set, the owning thread does not write anymore after the head read below.
+    bool abandoned = buffer.abandoned;
+    uint64_t head = buffer.head.load(std::memory_order_acquire);
+    uint64_t tail = buffer.tail.load(std::memory_order_relaxed);
+    while (tail < head) {
+      Record record;
+      copyFromRing(buffer.data, tail, &record.header, sizeof(RecordHeader));
+      record.data.resize(record.header.size);
+      copyFromRing(buffer.data, tail + sizeof(RecordHeader), record.data.data(), record.header.size);
+      tail += sizeof(RecordHeader) + record.header.size;
+      records.push_back(std::move(record));
+    }
+    buffer.tail.store(tail, std::memory_order_release);
+
+    if (abandoned) bufferIterator = _buffers.erase(bufferIterator);
+    else ++bufferIterator;
+  }
+}
+
+void FrameCapture::writer() {
+  std::vector<Record> records;
+  while (true) {
+    try {
+      bool stopping = false;
+      {
+        std::unique_lock<std::mutex> writerLock(_writerMutex);
+        _writerConditionVariable.wait_for(writerLock, std::chrono::milliseconds(200), [&] { return (bool)_stopWriterThread; });
+        stopping = _stopWriterThread;
+      }
+
+      drain(records);
+      if (!records.empty()) {
+        //Every thread's buffer is ordered, but frames of different threads need to be merged.
+        std::stable_sort(records.begin(), records.end(), [](const Record &a, const Record &b) { return a.header.monotonicTime < b.header.monotonicTime; });
+        _framesCaptured += records.size();
+        std::lock_guard<std::mutex> fileGuard(_fileMutex);
+        writeRecords(records);
+        records.clear();
+      }
+
+      if (stopping) return;
+    }
+    catch (const std::exception &ex) {
+      records.clear();
+      Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+  }
+}
+
+bool FrameCapture::openFile() {
+  closeFile();
+  _fileDescriptor = open(_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP);
+  if (_fileDescriptor == -1) {
+    Gd::out.printError("Error: Could not open capture file " + _filename + ": " + std::string(strerror(errno)));
+    return false;
+  }
+  _fileSize = 0;
+  _interfacesInFile = 0;
+  _writeBuffer.clear();
+  appendSectionHeader();
+  flush();
+  return true;
+}
+
+void FrameCapture::closeFile() {
+  if (_fileDescriptor == -1) return;
+  flush();
+  close(_fileDescriptor);
+  _fileDescriptor = -1;
+}
+
+void FrameCapture::rotate() {
+  closeFile();
+  int32_t fileCount = Gd::settings.captureFiles();
+  for (int32_t i = fileCount - 1; i > 0; i--) {
+    std::string source = i == 1 ? _filename : _filename + "." + std::to_string(i - 1);
+    std::string target = _filename + "." + std::to_string(i);
+    if (BaseLib::Io::fileExists(source)) rename(source.c_str(), target.c_str());
+  }
+  openFile();
+}
+
+void FrameCapture::writeRecords(std::vector<Record> &records) {
+  if (_fileDescriptor == -1) return;
+
+  for (auto &record : records) {
+    if (record.header.interfaceIndex >= _interfacesInFile) {
+      std::lock_guard<std::mutex> interfacesGuard(_interfacesMutex);
+      while (_interfacesInFile <= record.header.interfaceIndex && _interfacesInFile < _interfaces.size()) {
+        appendInterfaceDescription(_interfaces[_interfacesInFile]);
+        _interfacesInFile++;
+      }
+    }
+    appendPacket(record);
+    if (_writeBuffer.size() >= 65536) flush();
+  }
+  flush();
+
+  if (_fileSize >= (uint64_t)Gd::settings.captureFileSize() * 1024 * 1024) rotate();
+}
+
+void FrameCapture::appendSectionHeader() {
+  size_t blockStart = _writeBuffer.size();
+  append<uint32_t>(_writeBuffer, 0x0A0D0D0A);
+  append<uint32_t>(_writeBuffer, 0); //Total length, set by finishBlock()
+  append<uint32_t>(_writeBuffer, 0x1A2B3C4D); //Byte order magic. Everything is written in host byte order.
+  append<uint16_t>(_writeBuffer, 1); //Major version
+  append<uint16_t>(_writeBuffer, 0); //Minor version
+  append<int64_t>(_writeBuffer, -1); //Section length not specified
+  std::string application = "homegear-gateway " + std::string(VERSION);
+  appendOption(4, application.data(), (uint16_t)application.size()); //shb_userappl
+  appendOption(0, nullptr, 0);
+  finishBlock(_writeBuffer, blockStart);
+}
+
+void FrameCapture::appendInterfaceDescription(const Interface &interface) {
+  size_t blockStart = _writeBuffer.size();
+  append<uint32_t>(_writeBuffer, 1);
+  append<uint32_t>(_writeBuffer, 0);
+  append<uint16_t>(_writeBuffer, (uint16_t)interface.linkType);
+  append<uint16_t>(_writeBuffer, 0); //Reserved
+  append<uint32_t>(_writeBuffer, 0); //No snap length
+  appendOption(2, interface.name.data(), (uint16_t)interface.name.size()); //if_name
+  uint8_t timestampResolution = 9; //Nanoseconds
+  appendOption(9, &timestampResolution, 1); //if_tsresol
+  appendOption(0, nullptr, 0);
+  finishBlock(_writeBuffer, blockStart);
+}
+
+void FrameCapture::appendPacket(const Record &record) {
+  size_t blockStart = _writeBuffer.size();
+  append<uint32_t>(_writeBuffer, 6);
+  append<uint32_t>(_writeBuffer, 0);
+  append<uint32_t>(_writeBuffer, record.header.interfaceIndex);
+  append<uint32_t>(_writeBuffer, (uint32_t)((uint64_t)record.header.realTime >> 32));
+  append<uint32_t>(_writeBuffer, (uint32_t)((uint64_t)record.header.realTime & 0xFFFFFFFF));
+  append<uint32_t>(_writeBuffer, (uint32_t)record.data.size()); //Captured length
+  append<uint32_t>(_writeBuffer, (uint32_t)record.data.size()); //Original length
+  _writeBuffer.insert(_writeBuffer.end(), record.data.begin(), record.data.end());
+  pad(_writeBuffer);
+
+  uint32_t flags = (uint32_t)record.header.direction;
+  appendOption(2, &flags, 4); //epb_flags
+  //The monotonic time is not affected by NTP adjustments, so it can be used to measure intervals between frames.
+  std::string comment = "monotonic=" + std::to_string(record.header.monotonicTime);
+  if (record.header.rssi != noRssi) comment += " rssi=" + std::to_string(record.header.rssi) + "dBm";
+  appendOption(1, comment.data(), (uint16_t)comment.size()); //opt_comment
+  appendOption(0, nullptr, 0);
+  finishBlock(_writeBuffer, blockStart);
+}
+
+void FrameCapture::appendOption(uint16_t code, const void *data, uint16_t size) {
+  append<uint16_t>(_writeBuffer, code);
+  append<uint16_t>(_writeBuffer, size);
+  if (size > 0) _writeBuffer.insert(_writeBuffer.end(), (const uint8_t *)data, (const uint8_t *)data + size);
+  pad(_writeBuffer);
+}
+
+void FrameCapture::flush() {
+  if (_fileDescriptor == -1 || _writeBuffer.empty()) return;
+  size_t written = 0;
+  while (written < _writeBuffer.size()) {
+    ssize_t result = write(_fileDescriptor, _writeBuffer.data() + written, _writeBuffer.size() - written);
+    if (result == -1) {
+      if (errno == EINTR) continue;
+      Gd::out.printError("Error: Could not write to capture file " + _filename + ": " + std::string(strerror(errno)));
+      break;
+    }
+    written += result;
+  }
+  _fileSize += written;
+  _bytesWritten += written;
+  _writeBuffer.clear();
+}
+
+BaseLib::PVariable FrameCapture::getStatus() {
+  auto status = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+  status->structValue->emplace("enabled", std::make_shared<BaseLib::Variable>(enabled()));
+  {
+    std::lock_guard<std::mutex> fileGuard(_fileMutex);
+    status->structValue->emplace("file", std::make_shared<BaseLib::Variable>(_filename));
+  }
+  status->structValue->emplace("framesCaptured", std::make_shared<BaseLib::Variable>((int64_t)_framesCaptured));
+  status->structValue->emplace("framesDropped", std::make_shared<BaseLib::Variable>((int64_t)_framesDropped));
+  status->structValue->emplace("bytesWritten", std::make_shared<BaseLib::Variable>((int64_t)_bytesWritten));
+  return status;
+}
@@ -0,0 +1,174 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef FRAMECAPTURE_H_
+#define FRAMECAPTURE_H_
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Records radio frames crossing the gateway into rotating pcapng files. Each interface gets its own pcapng interface
+ * with a link type identifying the frame format.
+ *
+ * Recording threads append to a lock-free single producer, single consumer ring buffer owned by the calling thread.
+ * A background thread drains all buffers, orders the records by time and writes them. When capturing is disabled,
+ * capture() returns after checking one atomic flag. When a buffer is full, frames are dropped and counted.
+ */
+class FrameCapture
+{
+public:
+	/**
+	 * pcapng link types. There are no registered link types for the serial protocols, so the user defined ones
+	 * (LINKTYPE_USER0 to LINKTYPE_USER15) are used.
+	 */
+	enum class LinkType : uint16_t
+	{
+		enOceanEsp3 = 147,
+		zWaveSerialApi = 148,
+		zigbeeZnp = 149,
+		homeMaticCc1101 = 150,
+		homeMaticCulfw = 151,
+		maxCc1101 = 152,
+		maxCulfw = 153
+	};
+
+	enum class Direction : uint8_t
+	{
+		inbound = 1,
+		outbound = 2
+	};
+
+	static constexpr int32_t noRssi = INT32_MIN;
+
+	FrameCapture(BaseLib::SharedObjects* bl);
+	virtual ~FrameCapture();
+
+	/**
+	 * Starts capturing.
+	 *
+	 * @param filename The file to write to. When empty, the file from gateway.conf is used.
+	 * @return Returns false when the file could not be opened.
+	 */
+	bool start(const std::string& filename = "");
+	void stop();
+	bool enabled() { return _enabled.load(std::memory_order_relaxed); }
+
+	/**
+	 * Returns the index of the pcapng interface for the given link type and name. Calling it again with the same
+	 * parameters returns the same index.
+	 */
+	uint32_t registerInterface(LinkType linkType, const std::string& name);
+
+	void capture(uint32_t interfaceIndex, Direction direction, const uint8_t* data, size_t size, int32_t rssi = noRssi);
+
+	/**
+	 * Converts the RSSI byte of a CC1101 (also reported by culfw) to dBm.
+	 */
+	static int32_t cc1101Rssi(uint8_t rssi) { return rssi >= 128 ? ((int32_t)rssi - 256) / 2 - 74 : rssi / 2 - 74; }
+
+	BaseLib::PVariable getStatus();
+private:
+	struct RecordHeader
+	{
+		uint32_t size = 0;
+		uint32_t interfaceIndex = 0;
+		int32_t rssi = noRssi;
+		Direction direction = Direction::inbound;
+		int64_t monotonicTime = 0;
+		int64_t realTime = 0;
+	};
+
+	/**
+	 * Ring buffer of one recording thread. Only the owning thread writes "head", only the writer thread writes "tail".
+	 */
+	struct ThreadBuffer
+	{
+		static const size_t size = 262144;
+
+		std::vector<uint8_t> data;
+		std::atomic<uint64_t> head{0};
+		std::atomic<uint64_t> tail{0};
+		std::atomic_bool abandoned{false};
+
+		ThreadBuffer() : data(size) {}
+	};
+
+	struct Interface
+	{
+		LinkType linkType = LinkType::enOceanEsp3;
+		std::string name;
+	};
+
+	struct Record
+	{
+		RecordHeader header;
+		std::vector<uint8_t> data;
+	};
+
+	BaseLib::SharedObjects* _bl = nullptr;
+	std::atomic_bool _enabled{false};
+
+	std::mutex _buffersMutex;
+	std::vector<std::shared_ptr<ThreadBuffer>> _buffers;
+
+	std::mutex _interfacesMutex;
+	std::vector<Interface> _interfaces;
+
+	std::mutex _fileMutex;
+	std::string _filename;
+	int32_t _fileDescriptor = -1;
+	uint64_t _fileSize = 0;
+	size_t _interfacesInFile = 0;
+	std::vector<uint8_t> _writeBuffer;
+
+	std::atomic<uint64_t> _framesCaptured{0};
+	std::atomic<uint64_t> _framesDropped{0};
+	std::atomic<uint64_t> _bytesWritten{0};
+
+	std::atomic_bool _stopWriterThread{true};
+	std::mutex _writerMutex;
+	std::condition_variable _writerConditionVariable;
+	std::thread _writerThread;
+
+	ThreadBuffer& threadBuffer();
+	void writer();
+	void drain(std::vector<Record>& records);
+	bool openFile();
+	void closeFile();
+	void rotate();
+	void writeRecords(std::vector<Record>& records);
+	void appendSectionHeader();
+	void appendInterfaceDescription(const Interface& interface);
+	void appendPacket(const Record& record);
+	void appendOption(uint16_t code, const void* data, uint16_t size);
+	void flush();
+};
+
+#endif
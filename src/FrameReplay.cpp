@@ -0,0 +1,354 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "FrameReplay.h"
+#include "Gd.h"
+#include "AllocationCounter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+int64_t steadyTime() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint16_t read16(const uint8_t *data, bool swap) {
+  uint16_t value = 0;
+  memcpy(&value, data, 2);
+  return swap ? __builtin_bswap16(value) : value;
+}
+
+uint32_t read32(const uint8_t *data, bool swap) {
+  uint32_t value = 0;
+  memcpy(&value, data, 4);
+  return swap ? __builtin_bswap32(value) : value;
+}
+
+int64_t percentile(const std::vector<int64_t> &sortedValues, double percent) {
+  if (sortedValues.empty()) return 0;
+  size_t index = (size_t)((percent / 100.0) * (double)(sortedValues.size() - 1) + 0.5);
+  return sortedValues.at(std::min(index, sortedValues.size() - 1));
+}
+}
+
+FrameReplay::FrameReplay(BaseLib::SharedObjects *bl) {
+  _bl = bl;
+}
+
+FrameReplay::~FrameReplay() {
+  try {
+    stop();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+bool FrameReplay::load(const std::string &filename) {
+  try {
+    _filename = filename;
+    _interfaces.clear();
+    _frames.clear();
+    if (!BaseLib::Io::fileExists(filename)) {
+      Gd::out.printError("Error: Trace file " + filename + " does not exist.");
+      return false;
+    }
+    std::vector<char> file = BaseLib::Io::getBinaryFileContent(filename);
+    if (!parse(std::vector<uint8_t>(file.begin(), file.end()))) return false;
+    if (_frames.empty()) {
+      Gd::out.printError("Error: Trace file " + filename + " contains no frames.");
+      return false;
+    }
+    Gd::out.printInfo("Info: Loaded " + std::to_string(_frames.size()) + " frames on " + std::to_string(_interfaces.size()) + " interfaces from " + filename + ".");
+    return true;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return false;
+}
+
+bool FrameReplay::parse(const std::vector<uint8_t> &file) {
+  bool swap = false;
+  size_t sectionInterfaceOffset = 0; //Interface IDs are counted per section.
+  size_t position = 0;
+  while (position + 12 <= file.size()) {
+    const uint8_t *block = file.data() + position;
+    uint32_t blockType = read32(block, swap);
+    if (blockType == 0x0A0D0D0A) {
+      //The byte order of a section is defined by its section header, so read the magic before the length.
+      uint32_t byteOrderMagic = 0;
+      memcpy(&byteOrderMagic, block + 8, 4);
+      if (byteOrderMagic == 0x1A2B3C4D) swap = false;
+      else if (byteOrderMagic == 0x4D3C2B1A) swap = true;
+      else {
+        Gd::out.printError("Error: " + _filename + " is not a pcapng file.");
+        return false;
+      }
+      sectionInterfaceOffset = _interfaces.size();
+    } else if (position == 0) {
+      Gd::out.printError("Error: " + _filename + " is not a pcapng file.");
+      return false;
+    }
+
+    uint32_t blockLength = read32(block + 4, swap);
+    if (blockLength < 12 || blockLength % 4 != 0 || position + blockLength > file.size()) {
+      //A file that is still being written or was cut off. Use what was read so far.
+      Gd::out.printWarning("Warning: " + _filename + " is truncated at offset " + std::to_string(position) + ".");
+      break;
+    }
+    const uint8_t *body = block + 8;
+    size_t bodyLength = blockLength - 12;
+
+    if (blockType == 1 && bodyLength >= 8) {
+      //Interface description block
+      Interface interface;
+      interface.linkType = (FrameCapture::LinkType)read16(body, swap);
+      interface.timestampResolution = 1000; //Default is microseconds
+      size_t optionPosition = 8;
+      while (optionPosition + 4 <= bodyLength) {
+        uint16_t code = read16(body + optionPosition, swap);
+        uint16_t length = read16(body + optionPosition + 2, swap);
+        if (code == 0 || optionPosition + 4 + length > bodyLength) break;
+        const uint8_t *value = body + optionPosition + 4;
+        if (code == 2) interface.name = std::string((const char *)value, length); //if_name
+        else if (code == 9 && length >= 1) {
+          //if_tsresol: Negative power of 10 or, when the most significant bit is set, of 2.
+          uint8_t resolution = value[0];
+          double unitsPerSecond = (resolution & 0x80) ? std::pow(2.0, resolution & 0x7F) : std::pow(10.0, resolution);
+          interface.timestampResolution = std::max((int64_t)1, (int64_t)(1000000000.0 / unitsPerSecond));
+        }
+        optionPosition += 4 + ((length + 3) & ~3);
+      }
+      _interfaces.push_back(interface);
+    } else if (blockType == 6 && bodyLength >= 20) {
+      //Enhanced packet block
+      size_t interfaceIndex = sectionInterfaceOffset + read32(body, swap);
+      uint32_t capturedLength = read32(body + 12, swap);
+      if (interfaceIndex >= _interfaces.size() || 20 + (size_t)capturedLength > bodyLength) {
+        Gd::out.printWarning("Warning: Skipping invalid packet block at offset " + std::to_string(position) + ".");
+      } else {
+        Frame frame;
+        frame.interfaceIndex = (uint32_t)interfaceIndex;
+        uint64_t timestamp = ((uint64_t)read32(body + 4, swap) << 32) | read32(body + 8, swap);
+        frame.time = (int64_t)timestamp * _interfaces[interfaceIndex].timestampResolution;
+        frame.data.assign(body + 20, body + 20 + capturedLength);
+
+        bool outbound = false;
+        int64_t monotonicTime = -1;
+        size_t optionPosition = 20 + ((capturedLength + 3) & ~3);
+        while (optionPosition + 4 <= bodyLength) {
+          uint16_t code = read16(body + optionPosition, swap);
+          uint16_t length = read16(body + optionPosition + 2, swap);
+          if (code == 0 || optionPosition + 4 + length > bodyLength) break;
+          const uint8_t *value = body + optionPosition + 4;
+          if (code == 2 && length == 4) outbound = (read32(value, swap) & 3) == 2; //epb_flags
+          else if (code == 1) {
+            //opt_comment written by FrameCapture. The monotonic time is preferred as it isn't affected by clock adjustments.
+            std::string comment((const char *)value, length);
+            if (comment.compare(0, 10, "monotonic=") == 0) monotonicTime = BaseLib::Math::getNumber64(comment.substr(10, comment.find(' ') - 10));
+          }
+          optionPosition += 4 + ((length + 3) & ~3);
+        }
+        if (monotonicTime != -1) frame.time = monotonicTime;
+
+        if (outbound) _framesSkipped++;
+        else _frames.push_back(std::move(frame));
+      }
+    }
+
+    position += blockLength;
+  }
+  return true;
+}
+
+void FrameReplay::start(double speed, std::function<void()> finishedCallback) {
+  try {
+    stop();
+    _speed = speed < 0 ? 0 : speed;
+    _finishedCallback = std::move(finishedCallback);
+    _stopReplayThread = false;
+    _bl->threadManager.start(_replayThread, true, &FrameReplay::replay, this);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void FrameReplay::stop() {
+  try {
+    {
+      std::lock_guard<std::mutex> replayGuard(_replayMutex);
+      _stopReplayThread = true;
+    }
+    _replayConditionVariable.notify_all();
+    _bl->threadManager.join(_replayThread);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+bool FrameReplay::wait(int64_t nanoseconds) {
+  std::unique_lock<std::mutex> replayLock(_replayMutex);
+  _replayConditionVariable.wait_for(replayLock, std::chrono::nanoseconds(nanoseconds), [&] { return (bool)_stopReplayThread; });
+  return !_stopReplayThread;
+}
+
+void FrameReplay::replay() {
+  try {
+    //Without a client every packetReceived call fails immediately, which would not measure anything.
+    Gd::out.printInfo("Info: Waiting for a client to connect before replaying " + _filename + "...");
+    while (!Gd::rpcServer || !Gd::rpcServer->isClientConnected()) {
+      if (!wait(100000000)) return;
+    }
+
+    std::vector<ICommunicationInterface *> targets;
+    targets.reserve(_interfaces.size());
+    for (auto &interface : _interfaces) {
+      auto target = Gd::rpcServer->getInterface(interface.linkType);
+      if (!target) Gd::out.printWarning("Warning: No interface configured for frames of " + interface.name + " (link type " + std::to_string((int32_t)interface.linkType) + "). Skipping them.");
+      targets.push_back(target);
+    }
+
+    {
+      std::lock_guard<std::mutex> statusGuard(_statusMutex);
+      _latencies.clear();
+      _latencies.reserve(_frames.size());
+    }
+    _running = true;
+    Gd::out.printMessage("Replaying " + std::to_string(_frames.size()) + " frames from " + _filename + (_speed > 0 ? " at " + std::to_string(_speed) + "x speed." : " at maximum speed."));
+
+    //The first frames fill the pools of the receive path. Allocations are only counted afterwards.
+    size_t warmUpFrames = std::min(_frames.size() / 10, (size_t)100);
+    std::vector<uint8_t> replayBuffer;
+    int64_t firstFrameTime = _frames.front().time;
+    int64_t previousFrameTime = firstFrameTime;
+    int64_t startTime = steadyTime();
+    for (auto &frame : _frames) {
+      if (_stopReplayThread) break;
+      auto target = targets.at(frame.interfaceIndex);
+      if (!target) {
+        _framesSkipped++;
+        continue;
+      }
+
+      if (_speed > 0) {
+        //Never go back in time, frames of different threads can be slightly out of order.
+        previousFrameTime = std::max(previousFrameTime, frame.time);
+        int64_t dueTime = startTime + (int64_t)((double)(previousFrameTime - firstFrameTime) / _speed);
+        int64_t now = steadyTime();
+        if (dueTime > now && !wait(dueTime - now)) break;
+        int64_t lag = steadyTime() - dueTime;
+        if (lag > _maxLag) _maxLag = lag;
+      }
+
+      //replayFrame() consumes the frame. Assigning reuses the buffer the receive path hands back.
+      replayBuffer.assign(frame.data.begin(), frame.data.end());
+
+      //replayFrame() returns after packetReceived was answered, so this is the full receive-to-RPC latency.
+      uint64_t allocationsBefore = AllocationCounter::threadAllocations();
+      int64_t frameStartTime = steadyTime();
+      if (!target->replayFrame(replayBuffer)) {
+        _framesSkipped++;
+        continue;
+      }
+      int64_t latency = steadyTime() - frameStartTime;
+      if (_framesReplayed >= warmUpFrames) {
+        uint64_t allocations = AllocationCounter::threadAllocations() - allocationsBefore;
+        _allocations += allocations;
+        if (allocations > 0) _framesWithAllocations++;
+      }
+      _framesReplayed++;
+      std::lock_guard<std::mutex> statusGuard(_statusMutex);
+      _latencies.push_back(latency);
+    }
+
+    {
+      std::lock_guard<std::mutex> statusGuard(_statusMutex);
+      _duration = (double)(steadyTime() - startTime) / 1000000000.0;
+    }
+    _running = false;
+    if (_stopReplayThread) return;
+    _finished = true;
+    printResults();
+    if (_finishedCallback) _finishedCallback();
+  }
+  catch (const std::exception &ex) {
+    _running = false;
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void FrameReplay::printResults() {
+  std::vector<int64_t> latencies;
+  double duration = 0;
+  {
+    std::lock_guard<std::mutex> statusGuard(_statusMutex);
+    latencies = _latencies;
+    duration = _duration;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  Gd::out.printMessage("Replay finished: " + std::to_string(_framesReplayed) + " frames replayed, " + std::to_string(_framesSkipped) + " skipped in " + std::to_string(duration) + " s (" +
+      std::to_string(duration > 0 ? (double)_framesReplayed / duration : 0) + " frames/s).");
+  Gd::out.printMessage("Replay latency (µs): p50 " + std::to_string(percentile(latencies, 50) / 1000) + ", p90 " + std::to_string(percentile(latencies, 90) / 1000) + ", p99 " + std::to_string(percentile(latencies, 99) / 1000) +
+      ", max " + std::to_string(latencies.empty() ? 0 : latencies.back() / 1000) + ". Maximum lag behind schedule: " + std::to_string(_maxLag / 1000) + " µs.");
+  if (AllocationCounter::enabled()) {
+    Gd::out.printMessage("Replay allocations of the receive path after warm-up (without the packetReceived call into BaseLib and C1Net): " + std::to_string(_allocations) + " in " + std::to_string(_framesWithAllocations) + " frames.");
+  }
+}
+
+BaseLib::PVariable FrameReplay::getStatus() {
+  auto status = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+  status->structValue->emplace("file", std::make_shared<BaseLib::Variable>(_filename));
+  status->structValue->emplace("speed", std::make_shared<BaseLib::Variable>(_speed));
+  status->structValue->emplace("running", std::make_shared<BaseLib::Variable>((bool)_running));
+  status->structValue->emplace("finished", std::make_shared<BaseLib::Variable>((bool)_finished));
+  status->structValue->emplace("frames", std::make_shared<BaseLib::Variable>((int64_t)_frames.size()));
+  status->structValue->emplace("framesReplayed", std::make_shared<BaseLib::Variable>((int64_t)_framesReplayed));
+  status->structValue->emplace("framesSkipped", std::make_shared<BaseLib::Variable>((int64_t)_framesSkipped));
+  status->structValue->emplace("maxLagUs", std::make_shared<BaseLib::Variable>((int64_t)(_maxLag / 1000)));
+  if (AllocationCounter::enabled()) {
+    status->structValue->emplace("allocations", std::make_shared<BaseLib::Variable>((int64_t)_allocations));
+    status->structValue->emplace("framesWithAllocations", std::make_shared<BaseLib::Variable>((int64_t)_framesWithAllocations));
+  }
+
+  std::vector<int64_t> latencies;
+  {
+    std::lock_guard<std::mutex> statusGuard(_statusMutex);
+    latencies = _latencies;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  status->structValue->emplace("latencyP50Us", std::make_shared<BaseLib::Variable>(percentile(latencies, 50) / 1000));
+  status->structValue->emplace("latencyP99Us", std::make_shared<BaseLib::Variable>(percentile(latencies, 99) / 1000));
+  status->structValue->emplace("latencyMaxUs", std::make_shared<BaseLib::Variable>(latencies.empty() ? (int64_t)0 : latencies.back() / 1000));
+  return status;
+}
@@ -0,0 +1,115 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef FRAMEREPLAY_H_
+#define FRAMEREPLAY_H_
+
+#include "FrameCapture.h"
+
+#include <homegear-base/BaseLib.h>
+
+class ICommunicationInterface;
+
+/**
+ * Feeds the inbound frames of a pcapng trace written by FrameCapture back into the receive path of the matching
+ * interfaces, as if they had been received from the device. Used to benchmark the receive-to-RPC pipeline with real
+ * traffic without hardware.
+ *
+ * Frames are replayed in file order from a single thread, so a replay is deterministic. Outbound frames are skipped,
+ * as they are generated by the client.
+ */
+class FrameReplay
+{
+public:
+	FrameReplay(BaseLib::SharedObjects* bl);
+	virtual ~FrameReplay();
+
+	/**
+	 * Reads the trace into memory.
+	 *
+	 * @return Returns false when the file could not be read or contains no frames.
+	 */
+	bool load(const std::string& filename);
+
+	/**
+	 * Starts replaying once a client is connected.
+	 *
+	 * @param speed 1 replays in real time, 10 ten times as fast. 0 replays as fast as possible.
+	 * @param finishedCallback Called from the replay thread after the last frame was replayed.
+	 */
+	void start(double speed, std::function<void()> finishedCallback);
+	void stop();
+
+	BaseLib::PVariable getStatus();
+private:
+	struct Interface
+	{
+		FrameCapture::LinkType linkType = FrameCapture::LinkType::enOceanEsp3;
+		std::string name;
+		int64_t timestampResolution = 1000; //Nanoseconds per timestamp unit
+	};
+
+	struct Frame
+	{
+		uint32_t interfaceIndex = 0;
+		int64_t time = 0; //Nanoseconds
+		std::vector<uint8_t> data;
+	};
+
+	BaseLib::SharedObjects* _bl = nullptr;
+	std::string _filename;
+	std::vector<Interface> _interfaces;
+	std::vector<Frame> _frames;
+	double _speed = 1;
+	std::function<void()> _finishedCallback;
+
+	std::atomic_bool _stopReplayThread{true};
+	std::mutex _replayMutex;
+	std::condition_variable _replayConditionVariable;
+	std::thread _replayThread;
+
+	std::mutex _statusMutex;
+	std::atomic_bool _running{false};
+	std::atomic_bool _finished{false};
+	std::atomic<uint64_t> _framesReplayed{0};
+	std::atomic<uint64_t> _framesSkipped{0};
+	std::atomic<int64_t> _maxLag{0};
+	std::atomic<uint64_t> _allocations{0}; //Heap allocations of the receive path after warm-up, see AllocationCounter
+	std::atomic<uint64_t> _framesWithAllocations{0};
+	double _duration = 0;
+	std::vector<int64_t> _latencies;
+
+	bool parse(const std::vector<uint8_t>& file);
+	bool wait(int64_t nanoseconds);
+	void replay();
+	void printResults();
+};
+
+#endif
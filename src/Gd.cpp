@@ -42,4 +42,11 @@ std::string Gd::executableFile = "";
 int64_t Gd::startingTime = BaseLib::HelperFunctions::getTime();
 Settings Gd::settings;
 std::unique_ptr<RpcServer> Gd::rpcServer;
-std::unique_ptr<UPnP> Gd::upnp;
\ No newline at end of file
+std::unique_ptr<UPnP> Gd::upnp;
+std::unique_ptr<EventLoop> Gd::eventLoop;
+std::unique_ptr<FrameCapture> Gd::frameCapture;
+std::unique_ptr<FrameReplay> Gd::frameReplay;
+std::unique_ptr<ClockSync> Gd::clockSync;
+std::unique_ptr<MetricsServer> Gd::metricsServer;
+AsyncLog Gd::asyncLog;
+FlightRecorder Gd::flightRecorder;
\ No newline at end of file
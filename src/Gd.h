@@ -36,6 +36,13 @@
 #include <homegear-base/BaseLib.h>
 #include "RpcServer.h"
 #include "UPnP.h"
+#include "EventLoop.h"
+#include "FrameCapture.h"
+#include "FrameReplay.h"
+#include "ClockSync.h"
+#include "AsyncLog.h"
+#include "FlightRecorder.h"
+#include "MetricsServer.h"
 
 class Gd
 {
@@ -53,6 +60,13 @@ public:
 	static Settings settings;
     static std::unique_ptr<RpcServer> rpcServer;
 	static std::unique_ptr<UPnP> upnp;
+	static std::unique_ptr<EventLoop> eventLoop;
+	static std::unique_ptr<FrameCapture> frameCapture;
+	static std::unique_ptr<FrameReplay> frameReplay;
+	static std::unique_ptr<ClockSync> clockSync;
+	static std::unique_ptr<MetricsServer> metricsServer;
+	static AsyncLog asyncLog;
+	static FlightRecorder flightRecorder;
 
 	virtual ~Gd() = default;
 private:
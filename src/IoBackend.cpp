@@ -0,0 +1,100 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "IoBackend.h"
+#include "EpollBackend.h"
+#include "Gd.h"
+
+#include <sys/eventfd.h>
+
+IoBackend::IoBackend(BaseLib::SharedObjects *bl) {
+  _bl = bl;
+  _wakeUpDescriptor = std::make_shared<BaseLib::FileDescriptor>();
+}
+
+IoBackend::~IoBackend() {
+  _bl->fileDescriptorManager.close(_wakeUpDescriptor);
+}
+
+std::unique_ptr<IoBackend> IoBackend::create(BaseLib::SharedObjects *bl) {
+  try {
+    std::unique_ptr<IoBackend> backend(new EpollBackend(bl));
+    if (backend->init()) return backend;
+    Gd::out.printError("Error: Could not initialize epoll.");
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return std::unique_ptr<IoBackend>();
+}
+
+bool IoBackend::initWakeUp() {
+  _wakeUpDescriptor = _bl->fileDescriptorManager.add(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+  if (_wakeUpDescriptor->descriptor == -1) {
+    Gd::out.printError("Error: Could not create event descriptor: " + std::string(strerror(errno)));
+    return false;
+  }
+  return add(_wakeUpDescriptor->descriptor, POLLIN, [](int32_t fileDescriptor, uint32_t events) {
+    uint64_t value = 0;
+    if (read(fileDescriptor, &value, sizeof(value)) == -1 && errno != EAGAIN) Gd::out.printDebug("Debug: Could not read from event descriptor: " + std::string(strerror(errno)));
+  });
+}
+
+void IoBackend::wakeUp() {
+  if (_wakeUpDescriptor->descriptor == -1) return;
+  uint64_t value = 1;
+  if (write(_wakeUpDescriptor->descriptor, &value, sizeof(value)) == -1) Gd::out.printDebug("Debug: Could not write to event descriptor: " + std::string(strerror(errno)));
+}
+
+int32_t IoBackend::poll(const BaseLib::PFileDescriptor &fileDescriptor, uint32_t events, int32_t timeout) {
+  if (!fileDescriptor || fileDescriptor->descriptor == -1) {
+    errno = EBADF;
+    return -1;
+  }
+
+  if (fileDescriptor->descriptor != _polledDescriptor || fileDescriptor->id != _polledDescriptorId) {
+    //The descriptor was reopened. The kernel already removed the old one if it was closed, so errors are expected here.
+    if (_polledDescriptor != -1) remove(_polledDescriptor);
+    _polledDescriptor = -1;
+    if (!add(fileDescriptor->descriptor, events, [this](int32_t, uint32_t events) { _polledEvents |= events; })) return -1;
+    _polledDescriptor = fileDescriptor->descriptor;
+    _polledDescriptorId = fileDescriptor->id;
+  }
+
+  _polledEvents = 0;
+  int32_t result = wait(timeout);
+  if (result < 0) return result;
+  if (_polledEvents & POLLNVAL) {
+    //Force reregistration on the next call.
+    remove(_polledDescriptor);
+    _polledDescriptor = -1;
+  }
+  return _polledEvents ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef IOBACKEND_H_
+#define IOBACKEND_H_
+
+#include <homegear-base/BaseLib.h>
+
+#include <sys/poll.h>
+
+/**
+ * Abstraction of the mechanism used to wait for I/O events. Events are poll() event masks (POLLIN, POLLPRI, ...).
+ * The implementation is epoll (see EpollBackend).
+ */
+class IoBackend
+{
+public:
+	typedef std::function<void(int32_t fileDescriptor, uint32_t events)> EventCallback;
+
+	/**
+	 * Creates a backend.
+	 *
+	 * @return The initialized backend or nullptr on error.
+	 */
+	static std::unique_ptr<IoBackend> create(BaseLib::SharedObjects* bl);
+
+	virtual ~IoBackend();
+
+	virtual std::string name() = 0;
+
+	/**
+	 * Registers a file descriptor. The callback is called from the thread calling wait(). add() and remove() may be
+	 * called from any thread.
+	 */
+	virtual bool add(int32_t fileDescriptor, uint32_t events, EventCallback callback) = 0;
+	virtual bool remove(int32_t fileDescriptor) = 0;
+
+	/**
+	 * Waits for events and calls the callbacks of all descriptors that are ready.
+	 *
+	 * @param timeout The timeout in milliseconds. -1 waits forever.
+	 * @return The number of dispatched events, 0 on timeout and -1 on error.
+	 */
+	virtual int32_t wait(int32_t timeout) = 0;
+
+	/**
+	 * Interrupts a running wait().
+	 */
+	void wakeUp();
+
+	/**
+	 * Convenience method for loops waiting on a single descriptor. It is a drop-in replacement for poll(): The descriptor
+	 * is registered on first use and reregistered when it changes.
+	 *
+	 * @return Returns a value > 0 when an event occurred, 0 on timeout and -1 on error.
+	 */
+	int32_t poll(const BaseLib::PFileDescriptor& fileDescriptor, uint32_t events, int32_t timeout);
+
+	/**
+	 * @return The events returned by the last call to poll().
+	 */
+	uint32_t polledEvents() { return _polledEvents; }
+protected:
+	BaseLib::SharedObjects* _bl = nullptr;
+	BaseLib::PFileDescriptor _wakeUpDescriptor;
+
+	IoBackend(BaseLib::SharedObjects* bl);
+
+	virtual bool init() = 0;
+	bool initWakeUp();
+private:
+	int32_t _polledDescriptor = -1;
+	int32_t _polledDescriptorId = -1;
+	uint32_t _polledEvents = 0;
+};
+
+#endif
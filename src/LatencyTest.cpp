@@ -0,0 +1,250 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "LatencyTest.h"
+#include "Gd.h"
+#include "RealTime.h"
+#include "Families/SerialReader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+
+namespace {
+int64_t majorPageFaults() {
+  struct rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) == -1) return 0;
+  return usage.ru_majflt;
+}
+}
+
+LatencyTest::LatencyTest(BaseLib::SharedObjects *bl) {
+  _bl = bl;
+}
+
+LatencyTest::~LatencyTest() {
+  stopThreads();
+}
+
+void LatencyTest::run(int32_t duration) {
+  try {
+    auto status = RealTime::getStatus();
+    std::cout << "Receive path latency test, " << duration << " s per phase, " << std::thread::hardware_concurrency() << " CPUs." << std::endl;
+    std::cout << "Profile of serial threads: " << status->structValue->at("profiles")->structValue->at("serial")->stringValue << ", memory " << (status->structValue->at("memoryLocked")->booleanValue ? "locked" : "not locked") << "." << std::endl << std::endl;
+    std::cout << std::left << std::setw(8) << "Phase" << std::right << std::setw(9) << "Samples" << std::setw(9) << "Min" << std::setw(9) << "Median" << std::setw(9) << "99 %" << std::setw(9) << "99.9 %" << std::setw(9) << "Max" << std::setw(9) << "Jitter" << std::setw(14) << "Major faults" << std::endl;
+
+    runPhase("idle", duration, false, false);
+    runPhase("cpu", duration, true, false);
+    runPhase("io", duration, false, true);
+    runPhase("cpu+io", duration, true, true);
+
+    std::cout << std::endl << "Latencies and jitter (standard deviation) in microseconds." << std::endl;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void LatencyTest::runPhase(const std::string &name, int32_t duration, bool cpuLoad, bool ioLoad) {
+  try {
+    int pipeDescriptors[2];
+    if (pipe2(pipeDescriptors, O_NONBLOCK | O_CLOEXEC) == -1) {
+      std::cout << "Could not create pipe: " << strerror(errno) << std::endl;
+      return;
+    }
+    auto readDescriptor = _bl->fileDescriptorManager.add(pipeDescriptors[0]);
+    auto writeDescriptor = _bl->fileDescriptorManager.add(pipeDescriptors[1]);
+
+    _latencies.clear();
+    _latencies.reserve((size_t)duration * 1000 + 1000);
+    _stopReader = false;
+    _stopWriter = false;
+    _stopLoad = false;
+
+    _loadThreads.reserve(std::thread::hardware_concurrency() + 2); //The threads must not move while they are started.
+    if (cpuLoad) {
+      for (uint32_t i = 0; i < std::max(1u, std::thread::hardware_concurrency()); i++) {
+        _loadThreads.emplace_back();
+        _bl->threadManager.start(_loadThreads.back(), true, &LatencyTest::cpuLoad, this);
+      }
+    }
+    if (ioLoad) {
+      _loadThreads.emplace_back();
+      _bl->threadManager.start(_loadThreads.back(), true, &LatencyTest::ioLoad, this, Gd::settings.workingDirectory() + "latencytest.tmp");
+    }
+
+    int64_t majorPageFaultsBefore = majorPageFaults();
+    _bl->threadManager.start(_readerThread, true, &LatencyTest::reader, this, readDescriptor);
+    _bl->threadManager.start(_writerThread, true, &LatencyTest::writer, this, pipeDescriptors[1]);
+    std::this_thread::sleep_for(std::chrono::seconds(duration));
+    stopThreads();
+    int64_t pageFaults = majorPageFaults() - majorPageFaultsBefore;
+
+    _bl->fileDescriptorManager.close(readDescriptor);
+    _bl->fileDescriptorManager.close(writeDescriptor);
+
+    printResult(name, pageFaults);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void LatencyTest::stopThreads() {
+  _stopWriter = true;
+  _bl->threadManager.join(_writerThread);
+  _stopReader = true;
+  _bl->threadManager.join(_readerThread);
+  _stopLoad = true;
+  for (auto &thread : _loadThreads) {
+    _bl->threadManager.join(thread);
+  }
+  _loadThreads.clear();
+}
+
+void LatencyTest::reader(BaseLib::PFileDescriptor fileDescriptor) {
+  try {
+    RealTime::apply(RealTime::Subsystem::serial);
+
+    SerialReader serialReader(_bl);
+    std::array<uint8_t, sizeof(int64_t)> frame{};
+    size_t position = 0;
+    while (!_stopReader) {
+      char byte = 0;
+      int32_t result = serialReader.readChar(fileDescriptor, byte, 100000);
+      if (result == -1) break;
+      else if (result == 1) {
+        position = 0;
+        continue;
+      }
+
+      frame[position++] = (uint8_t)byte;
+      if (position < frame.size()) continue;
+      position = 0;
+
+      int64_t sendTime = 0;
+      std::memcpy(&sendTime, frame.data(), frame.size());
+      if (_latencies.size() < _latencies.capacity()) _latencies.push_back(ReceiveTime::now().monotonic - sendTime);
+    }
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void LatencyTest::writer(int32_t fileDescriptor) {
+  try {
+    auto nextWrite = std::chrono::steady_clock::now();
+    while (!_stopWriter) {
+      nextWrite += std::chrono::milliseconds(1);
+      std::this_thread::sleep_until(nextWrite);
+
+      int64_t sendTime = ReceiveTime::now().monotonic;
+      //Writes of up to PIPE_BUF bytes are atomic. A full pipe means the reader stalls, which shows in the results.
+      if (write(fileDescriptor, &sendTime, sizeof(sendTime)) == -1 && errno != EAGAIN) {
+        std::cout << "Could not write to pipe: " << strerror(errno) << std::endl;
+        return;
+      }
+    }
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void LatencyTest::cpuLoad() {
+  volatile double value = 1;
+  while (!_stopLoad) {
+    for (int32_t i = 0; i < 100000; i++) {
+      value = value * 1.000001 + 0.5;
+    }
+  }
+}
+
+void LatencyTest::ioLoad(std::string filename) {
+  int fileDescriptor = -1;
+  try {
+    fileDescriptor = open(filename.c_str(), O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC, 0600);
+    if (fileDescriptor == -1) {
+      std::cout << "Could not create " << filename << ": " << strerror(errno) << std::endl;
+      return;
+    }
+
+    std::vector<char> buffer(1024 * 1024, 'x');
+    size_t fileSize = 0;
+    while (!_stopLoad) {
+      if (write(fileDescriptor, buffer.data(), buffer.size()) == -1) break;
+      fileSize += buffer.size();
+      if (fileSize % (8 * buffer.size()) == 0) fdatasync(fileDescriptor);
+      if (fileSize >= 64 * buffer.size()) {
+        //Drop the file from the page cache and read it back, so the reads hit the disk, too.
+        posix_fadvise(fileDescriptor, 0, 0, POSIX_FADV_DONTNEED);
+        lseek(fileDescriptor, 0, SEEK_SET);
+        while (!_stopLoad && read(fileDescriptor, buffer.data(), buffer.size()) > 0);
+        if (ftruncate(fileDescriptor, 0) == -1) break;
+        lseek(fileDescriptor, 0, SEEK_SET);
+        fileSize = 0;
+      }
+    }
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  if (fileDescriptor != -1) close(fileDescriptor);
+  unlink(filename.c_str());
+}
+
+void LatencyTest::printResult(const std::string &name, int64_t majorPageFaults) {
+  std::cout << std::left << std::setw(8) << name << std::right << std::setw(9) << _latencies.size();
+  if (_latencies.empty()) {
+    std::cout << std::endl;
+    return;
+  }
+
+  std::sort(_latencies.begin(), _latencies.end());
+  double sum = 0;
+  for (auto latency : _latencies) {
+    sum += latency;
+  }
+  double mean = sum / _latencies.size();
+  double squaredDeviations = 0;
+  for (auto latency : _latencies) {
+    squaredDeviations += (latency - mean) * (latency - mean);
+  }
+  auto percentile = [&](double fraction) { return _latencies.at(std::min(_latencies.size() - 1, (size_t)(fraction * _latencies.size()))) / 1000; };
+
+  std::cout << std::setw(9) << _latencies.front() / 1000 << std::setw(9) << percentile(0.5) << std::setw(9) << percentile(0.99) << std::setw(9) << percentile(0.999) << std::setw(9) << _latencies.back() / 1000;
+  std::cout << std::setw(9) << std::fixed << std::setprecision(1) << std::sqrt(squaredDeviations / _latencies.size()) / 1000 << std::setw(14) << majorPageFaults << std::endl;
+}
@@ -0,0 +1,81 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef LATENCYTEST_H_
+#define LATENCYTEST_H_
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Measures the jitter of the receive path. A writer thread sends its CLOCK_MONOTONIC time through a pipe every
+ * millisecond and a reader thread with the real-time profile of the serial interfaces reads it byte by byte through
+ * SerialReader, like the listen threads do. The latency is the time from the write until the reader has the complete
+ * timestamp. The test runs without load and with synthetic CPU load (one busy thread per CPU), IO load (writing and
+ * syncing a file in the working directory) and both, to show how well the profiles set in gateway.conf shield the
+ * receive path.
+ */
+class LatencyTest
+{
+public:
+	LatencyTest(BaseLib::SharedObjects* bl);
+	virtual ~LatencyTest();
+
+	/**
+	 * Runs all phases and prints the results.
+	 *
+	 * @param duration The duration of each phase in seconds.
+	 */
+	void run(int32_t duration);
+private:
+	BaseLib::SharedObjects* _bl = nullptr;
+
+	std::atomic_bool _stopReader{false};
+	std::atomic_bool _stopWriter{false};
+	std::atomic_bool _stopLoad{false};
+	std::thread _readerThread;
+	std::thread _writerThread;
+	std::vector<std::thread> _loadThreads;
+
+	/**
+	 * The latencies of the current phase in nanoseconds. Reserved before the phase starts, so the reader doesn't
+	 * allocate.
+	 */
+	std::vector<int64_t> _latencies;
+
+	void runPhase(const std::string& name, int32_t duration, bool cpuLoad, bool ioLoad);
+	void reader(BaseLib::PFileDescriptor fileDescriptor);
+	void writer(int32_t fileDescriptor);
+	void cpuLoad();
+	void ioLoad(std::string filename);
+	void stopThreads();
+	void printResult(const std::string& name, int64_t majorPageFaults);
+};
+
+#endif
@@ -0,0 +1,249 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "Metrics.h"
+#include "Gd.h"
+
+namespace {
+
+struct Description {
+  const char *name;
+  const char *help;
+};
+
+const std::array<Description, Metrics::counterCount> counterDescriptions{{
+    {"homegear_gateway_frames_received_total", "Frames received from the devices."},
+    {"homegear_gateway_frames_sent_total", "Frames sent to the devices."},
+    {"homegear_gateway_crc_errors_total", "Frames dropped by the serial listening threads because of CRC errors."},
+    {"homegear_gateway_reconnects_total", "Reconnects to the devices."},
+    {"homegear_gateway_packet_received_timeouts_total", "packetReceived calls Homegear did not respond to."},
+    {"homegear_gateway_upnp_responses_total", "UPnP discovery requests answered."}
+}};
+
+const std::array<Description, Metrics::histogramCount> histogramDescriptions{{
+    {"homegear_gateway_packet_received_duration_seconds", "Round trip time of packetReceived calls to Homegear."},
+    {"homegear_gateway_tx_lock_wait_seconds", "Time CC1101 senders waited for the transmit lock."}
+}};
+
+void appendSeconds(std::string &output, uint64_t microseconds) {
+  output.append(std::to_string(microseconds / 1000000));
+  std::string fraction = std::to_string(microseconds % 1000000);
+  output.push_back('.');
+  output.append(6 - fraction.size(), '0');
+  output.append(fraction);
+}
+
+void appendLabels(std::string &output, int32_t familyId, const char *le = nullptr) {
+  if (familyId == -1 && !le) return;
+  output.push_back('{');
+  if (familyId != -1) output.append("family=\"" + std::to_string(familyId) + "\"");
+  if (le) {
+    if (familyId != -1) output.push_back(',');
+    output.append("le=\"");
+    output.append(le);
+    output.push_back('"');
+  }
+  output.push_back('}');
+}
+
+}
+
+constexpr std::array<int64_t, 14> Metrics::bucketBounds;
+
+struct Metrics::ShardHandle {
+  Shard *shard = nullptr;
+
+  ~ShardHandle() {
+    if (shard) Metrics::retire(shard);
+  }
+};
+
+std::mutex &Metrics::shardsMutex() {
+  //Never destroyed, so threads finishing after the end of main() can still retire their shards.
+  static auto *mutex = new std::mutex();
+  return *mutex;
+}
+
+std::vector<Metrics::Shard *> &Metrics::shards() {
+  static auto *shards = new std::vector<Shard *>();
+  return *shards;
+}
+
+Metrics::Shard &Metrics::retired() {
+  static auto *retired = new Shard();
+  return *retired;
+}
+
+Metrics::Shard &Metrics::shard() {
+  static thread_local ShardHandle handle;
+  if (!handle.shard) {
+    auto shard = new Shard();
+    std::lock_guard<std::mutex> shardsGuard(shardsMutex());
+    shards().push_back(shard);
+    handle.shard = shard;
+  }
+  return *handle.shard;
+}
+
+void Metrics::retire(Shard *shard) {
+  {
+    std::lock_guard<std::mutex> shardsGuard(shardsMutex());
+    addTo(retired(), *shard);
+    auto &allShards = shards();
+    allShards.erase(std::remove(allShards.begin(), allShards.end(), shard), allShards.end());
+  }
+  delete shard;
+}
+
+void Metrics::addTo(Shard &target, const Shard &source) {
+  for (size_t i = 0; i < counterCount; i++) {
+    for (size_t j = 0; j < familySlots; j++) {
+      increment(target.counters[i][j], source.counters[i][j].load(std::memory_order_relaxed));
+    }
+  }
+  for (size_t i = 0; i < histogramCount; i++) {
+    for (size_t j = 0; j < familySlots; j++) {
+      auto &targetHistogram = target.histograms[i][j];
+      auto &sourceHistogram = source.histograms[i][j];
+      if (sourceHistogram.count.load(std::memory_order_relaxed) == 0) continue;
+      for (size_t k = 0; k < bucketCount; k++) {
+        increment(targetHistogram.buckets[k], sourceHistogram.buckets[k].load(std::memory_order_relaxed));
+      }
+      increment(targetHistogram.count, sourceHistogram.count.load(std::memory_order_relaxed));
+      increment(targetHistogram.sum, sourceHistogram.sum.load(std::memory_order_relaxed));
+    }
+  }
+}
+
+void Metrics::add(Counter counter, int32_t familyId, uint64_t value) {
+  increment(shard().counters[(size_t)counter][slot(familyId)], value);
+}
+
+void Metrics::observe(Histogram histogram, int32_t familyId, int64_t microseconds) {
+  if (microseconds < 0) microseconds = 0;
+  auto &data = shard().histograms[(size_t)histogram][slot(familyId)];
+  size_t bucket = std::lower_bound(bucketBounds.begin(), bucketBounds.end(), microseconds) - bucketBounds.begin();
+  increment(data.buckets[bucket], 1);
+  increment(data.sum, (uint64_t)microseconds);
+  increment(data.count, 1);
+}
+
+std::string Metrics::collect() {
+  try {
+    std::unique_ptr<Shard> total(new Shard());
+    {
+      std::lock_guard<std::mutex> shardsGuard(shardsMutex());
+      addTo(*total, retired());
+      for (auto shard : shards()) {
+        addTo(*total, *shard);
+      }
+    }
+
+    std::vector<int32_t> familyIds;
+    std::vector<QueueDepths> queueDepths;
+    if (Gd::rpcServer) {
+      familyIds = Gd::rpcServer->familyIds();
+      queueDepths = Gd::rpcServer->getQueueDepths();
+    }
+
+    std::string output;
+    output.reserve(8192);
+
+    for (size_t i = 0; i < counterCount; i++) {
+      output.append("# HELP ").append(counterDescriptions[i].name).append(" ").append(counterDescriptions[i].help).append("\n");
+      output.append("# TYPE ").append(counterDescriptions[i].name).append(" counter\n");
+      for (size_t j = 0; j < familySlots; j++) {
+        int32_t familyId = (int32_t)j - 1;
+        uint64_t value = total->counters[i][j].load(std::memory_order_relaxed);
+        //Series of configured families are always exported, so rate() works from the first scrape on.
+        if (value == 0 && std::find(familyIds.begin(), familyIds.end(), familyId) == familyIds.end()) continue;
+        output.append(counterDescriptions[i].name);
+        appendLabels(output, familyId);
+        output.append(" " + std::to_string(value) + "\n");
+      }
+    }
+
+    for (size_t i = 0; i < histogramCount; i++) {
+      output.append("# HELP ").append(histogramDescriptions[i].name).append(" ").append(histogramDescriptions[i].help).append("\n");
+      output.append("# TYPE ").append(histogramDescriptions[i].name).append(" histogram\n");
+      std::string bucketName = std::string(histogramDescriptions[i].name) + "_bucket";
+      for (size_t j = 0; j < familySlots; j++) {
+        auto &data = total->histograms[i][j];
+        uint64_t count = data.count.load(std::memory_order_relaxed);
+        if (count == 0) continue;
+        int32_t familyId = (int32_t)j - 1;
+        uint64_t cumulative = 0;
+        for (size_t k = 0; k < bucketCount; k++) {
+          cumulative += data.buckets[k].load(std::memory_order_relaxed);
+          std::string le;
+          if (k < bucketBounds.size()) appendSeconds(le, (uint64_t)bucketBounds[k]);
+          else le = "+Inf";
+          output.append(bucketName);
+          appendLabels(output, familyId, le.c_str());
+          output.append(" " + std::to_string(cumulative) + "\n");
+        }
+        output.append(histogramDescriptions[i].name).append("_sum");
+        appendLabels(output, familyId);
+        output.push_back(' ');
+        appendSeconds(output, data.sum.load(std::memory_order_relaxed));
+        output.append("\n");
+        output.append(histogramDescriptions[i].name).append("_count");
+        appendLabels(output, familyId);
+        output.append(" " + std::to_string(count) + "\n");
+      }
+    }
+
+    output.append("# HELP homegear_gateway_tx_queue_depth Frames waiting to be written to the device.\n");
+    output.append("# TYPE homegear_gateway_tx_queue_depth gauge\n");
+    for (auto &depths : queueDepths) {
+      output.append("homegear_gateway_tx_queue_depth");
+      appendLabels(output, depths.familyId);
+      output.append(" " + std::to_string(depths.tx) + "\n");
+    }
+    output.append("# HELP homegear_gateway_pending_requests Requests waiting for a response from the device.\n");
+    output.append("# TYPE homegear_gateway_pending_requests gauge\n");
+    for (auto &depths : queueDepths) {
+      output.append("homegear_gateway_pending_requests");
+      appendLabels(output, depths.familyId);
+      output.append(" " + std::to_string(depths.requests) + "\n");
+    }
+    output.append("# HELP homegear_gateway_async_log_pending Log messages waiting to be written.\n");
+    output.append("# TYPE homegear_gateway_async_log_pending gauge\n");
+    output.append("homegear_gateway_async_log_pending " + std::to_string(Gd::asyncLog.pending()) + "\n");
+    output.append("# HELP homegear_gateway_rpc_client_connected 1 when Homegear is connected.\n");
+    output.append("# TYPE homegear_gateway_rpc_client_connected gauge\n");
+    output.append(std::string("homegear_gateway_rpc_client_connected ") + (Gd::rpcServer && Gd::rpcServer->isClientConnected() ? "1" : "0") + "\n");
+    return output;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return "";
+}
@@ -0,0 +1,127 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Event counters. Counters without a family are recorded with family ID -1.
+ */
+enum class Counter : uint8_t
+{
+	framesReceived = 0,
+	framesSent = 1,
+	crcErrors = 2,
+	reconnects = 3,
+	packetReceivedTimeouts = 4,
+	upnpResponses = 5
+};
+
+/**
+ * Durations in microseconds.
+ */
+enum class Histogram : uint8_t
+{
+	packetReceivedLatency = 0,
+	txLockWait = 1
+};
+
+/**
+ * Counters and histograms in Prometheus text format. Every thread writes to its own shard, so recording is a load and a
+ * store without lock prefix or cache line sharing. Shards are summed up on scrape. The shard of a finished thread is
+ * added to a common total, so counters never decrease.
+ */
+class Metrics
+{
+public:
+	struct QueueDepths
+	{
+		int32_t familyId = -1;
+		size_t tx = 0;
+		size_t requests = 0;
+	};
+
+	/**
+	 * The number of family IDs that are labeled. Events of other families are recorded without label.
+	 */
+	static constexpr size_t familySlots = 32;
+	static constexpr size_t counterCount = 6;
+	static constexpr size_t histogramCount = 2;
+
+	/**
+	 * Upper bounds of the histogram buckets in microseconds. The last bucket is +Inf.
+	 */
+	static constexpr std::array<int64_t, 14> bucketBounds{{100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000, 5000000, 10000000}};
+	static constexpr size_t bucketCount = bucketBounds.size() + 1;
+
+	static void add(Counter counter, int32_t familyId, uint64_t value = 1);
+	static void observe(Histogram histogram, int32_t familyId, int64_t microseconds);
+
+	/**
+	 * @return All metrics in Prometheus text exposition format.
+	 */
+	static std::string collect();
+private:
+	struct HistogramData
+	{
+		std::array<std::atomic<uint64_t>, bucketCount> buckets{};
+		std::atomic<uint64_t> count{0};
+		std::atomic<uint64_t> sum{0};
+	};
+
+	struct Shard
+	{
+		std::array<std::array<std::atomic<uint64_t>, familySlots>, counterCount> counters{};
+		std::array<std::array<HistogramData, familySlots>, histogramCount> histograms{};
+	};
+
+	/**
+	 * Owns the shard of a thread and retires it when the thread finishes.
+	 */
+	struct ShardHandle;
+
+	static std::mutex& shardsMutex();
+	static std::vector<Shard*>& shards();
+
+	/**
+	 * The sum of all shards of finished threads.
+	 */
+	static Shard& retired();
+
+	static Shard& shard();
+	static void retire(Shard* shard);
+	static void addTo(Shard& target, const Shard& source);
+	static size_t slot(int32_t familyId) { return familyId >= -1 && familyId < (int32_t)familySlots - 1 ? (size_t)(familyId + 1) : 0; }
+	static void increment(std::atomic<uint64_t>& value, uint64_t amount) { value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed); }
+};
+
+#endif
@@ -0,0 +1,117 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "MetricsServer.h"
+#include "Metrics.h"
+#include "Gd.h"
+
+MetricsServer::~MetricsServer() {
+  stop();
+}
+
+bool MetricsServer::start(int32_t port) {
+  try {
+    stop();
+
+    C1Net::TcpServer::TcpServerInfo serverInfo;
+    serverInfo.listen_address = "127.0.0.1";
+    serverInfo.port = port;
+    serverInfo.max_connections = _maxConnections;
+    serverInfo.tls = false;
+    serverInfo.log_callback = std::bind(&MetricsServer::log, this, std::placeholders::_1, std::placeholders::_2);
+    serverInfo.packet_received_callback = std::bind(&MetricsServer::packetReceived, this, std::placeholders::_1, std::placeholders::_2);
+
+    _tcpServer = std::make_shared<C1Net::TcpServer>(serverInfo);
+    _tcpServer->Start();
+    Gd::out.printInfo("Info: Metrics are available on http://127.0.0.1:" + std::to_string(port) + "/metrics.");
+    return true;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  _tcpServer.reset();
+  return false;
+}
+
+void MetricsServer::stop() {
+  try {
+    if (!_tcpServer) return;
+    _tcpServer->Stop();
+    _tcpServer->WaitForServerStopped();
+    _tcpServer.reset();
+    std::lock_guard<std::mutex> requestsGuard(_requestsMutex);
+    _requests.clear();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void MetricsServer::log(uint32_t log_level, const std::string &message) {
+  Gd::out.printMessage("Metrics server: " + message, log_level, log_level < 3);
+}
+
+void MetricsServer::packetReceived(const C1Net::TcpServer::PTcpClientData &client_data, const C1Net::TcpPacket &packet) {
+  try {
+    std::string request;
+    {
+      std::lock_guard<std::mutex> requestsGuard(_requestsMutex);
+      if (_requests.size() >= _maxConnections && _requests.find(client_data->GetId()) == _requests.end()) {
+        //Only _maxConnections clients can be connected, so at least one entry belongs to a client that disconnected
+        //without completing its request. Dropping the oldest one keeps the map bounded.
+        _requests.erase(_requests.begin());
+      }
+      auto &buffer = _requests[client_data->GetId()];
+      buffer.append((const char *)packet.data(), packet.size());
+      if (buffer.size() > _maxRequestSize) {
+        _requests.erase(client_data->GetId());
+        send(client_data, "413 Payload Too Large", "text/plain", "Request too large.\n");
+        return;
+      }
+      if (buffer.find("\r\n\r\n") == std::string::npos) return;
+      request = std::move(buffer);
+      _requests.erase(client_data->GetId());
+    }
+
+    auto requestLine = BaseLib::HelperFunctions::splitAll(request.substr(0, request.find("\r\n")), ' ');
+    if (requestLine.size() < 3) send(client_data, "400 Bad Request", "text/plain", "Bad request.\n");
+    else if (requestLine.at(0) != "GET") send(client_data, "405 Method Not Allowed", "text/plain", "Only GET is supported.\n");
+    else if (requestLine.at(1) != "/metrics" && requestLine.at(1).compare(0, 9, "/metrics?") != 0) send(client_data, "404 Not Found", "text/plain", "Metrics are available on /metrics.\n");
+    else send(client_data, "200 OK", "text/plain; version=0.0.4; charset=utf-8", Metrics::collect());
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void MetricsServer::send(const C1Net::TcpServer::PTcpClientData &client_data, const std::string &status, const std::string &contentType, const std::string &content) {
+  std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: " + contentType + "\r\nContent-Length: " + std::to_string(content.size()) + "\r\nConnection: close\r\n\r\n" + content;
+  _tcpServer->Send(client_data, C1Net::TcpPacket(response.begin(), response.end()), true);
+}
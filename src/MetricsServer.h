@@ -0,0 +1,65 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef METRICSSERVER_H_
+#define METRICSSERVER_H_
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Minimal HTTP server answering "GET /metrics" with Metrics::collect(). Every request is answered on its own connection,
+ * which is closed afterwards. The server only listens on 127.0.0.1.
+ */
+class MetricsServer
+{
+public:
+	MetricsServer() = default;
+	virtual ~MetricsServer();
+
+	bool start(int32_t port);
+	void stop();
+private:
+	/**
+	 * Requests larger than this are rejected.
+	 */
+	static constexpr size_t _maxRequestSize = 8192;
+	static constexpr uint32_t _maxConnections = 10;
+
+	std::shared_ptr<C1Net::TcpServer> _tcpServer;
+	std::mutex _requestsMutex;
+	//Incomplete requests by client ID. Client IDs only grow, so the first entry is the oldest.
+	std::map<int32_t, std::string> _requests;
+
+	void log(uint32_t log_level, const std::string& message);
+	void packetReceived(const C1Net::TcpServer::PTcpClientData& client_data, const C1Net::TcpPacket& packet);
+	void send(const C1Net::TcpServer::PTcpClientData& client_data, const std::string& status, const std::string& contentType, const std::string& content);
+};
+
+#endif
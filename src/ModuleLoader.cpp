@@ -0,0 +1,114 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "ModuleLoader.h"
+#include "Families/FamilyModule.h"
+#include "Gd.h"
+
+#include <dlfcn.h>
+
+ModuleLoader::ModuleLoader(BaseLib::SharedObjects *bl) {
+  _bl = bl;
+}
+
+ModuleLoader::~ModuleLoader() {
+  try {
+    std::lock_guard<std::mutex> modulesGuard(_modulesMutex);
+    for (auto &module : _modules) {
+      dlclose(module.second);
+    }
+    _modules.clear();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void *ModuleLoader::getModule(const std::string &family) {
+  try {
+    std::lock_guard<std::mutex> modulesGuard(_modulesMutex);
+    auto moduleIterator = _modules.find(family);
+    if (moduleIterator != _modules.end()) return moduleIterator->second;
+
+    for (auto character : family) {
+      if (!std::isalnum(character)) {
+        Gd::out.printError("Error: Invalid family name: " + family);
+        return nullptr;
+      }
+    }
+
+    std::string path = Gd::settings.modulePath() + "mod_" + family + ".so";
+    if (!BaseLib::Io::fileExists(path)) {
+      Gd::out.printError("Error: Module for family " + family + " not found (" + path + ").");
+      return nullptr;
+    }
+
+    int64_t startTime = BaseLib::HelperFunctions::getTimeMicroseconds();
+    void *module = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!module) {
+      Gd::out.printError("Error: Could not load module " + path + ": " + std::string(dlerror()));
+      return nullptr;
+    }
+
+    auto moduleApiVersion = (ModuleApiVersionFunction)dlsym(module, "homegearGatewayModuleApiVersion");
+    if (!moduleApiVersion || moduleApiVersion() != HOMEGEAR_GATEWAY_MODULE_API_VERSION) {
+      Gd::out.printError("Error: Module " + path + " is not compatible with this version of Homegear Gateway.");
+      dlclose(module);
+      return nullptr;
+    }
+
+    Gd::out.printInfo("Info: Loaded module " + path + " in " + std::to_string(BaseLib::HelperFunctions::getTimeMicroseconds() - startTime) + " µs.");
+    _modules.emplace(family, module);
+    return module;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return nullptr;
+}
+
+std::unique_ptr<ICommunicationInterface> ModuleLoader::createInterface(const InterfaceSettings &settings) {
+  try {
+    void *module = getModule(settings.family);
+    if (!module) return std::unique_ptr<ICommunicationInterface>();
+
+    auto createInterface = (CreateInterfaceFunction)dlsym(module, "homegearGatewayCreateInterface");
+    if (!createInterface) {
+      Gd::out.printError("Error: Module for family " + settings.family + " does not export homegearGatewayCreateInterface.");
+      return std::unique_ptr<ICommunicationInterface>();
+    }
+
+    return std::unique_ptr<ICommunicationInterface>(createInterface(_bl, settings));
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return std::unique_ptr<ICommunicationInterface>();
+}
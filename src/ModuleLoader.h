@@ -0,0 +1,57 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef MODULELOADER_H_
+#define MODULELOADER_H_
+
+#include "Families/ICommunicationInterface.h"
+
+#include <homegear-base/BaseLib.h>
+
+/**
+ * Loads family modules ("mod_<family>.so") from the module path on demand. Only the modules of configured families are
+ * loaded. Modules stay loaded until the loader is destroyed, so all interfaces need to be destroyed before.
+ */
+class ModuleLoader
+{
+public:
+	ModuleLoader(BaseLib::SharedObjects* bl);
+	virtual ~ModuleLoader();
+
+	std::unique_ptr<ICommunicationInterface> createInterface(const InterfaceSettings& settings);
+private:
+	BaseLib::SharedObjects* _bl = nullptr;
+	std::mutex _modulesMutex;
+	std::map<std::string, void*> _modules;
+
+	void* getModule(const std::string& family);
+};
+
+#endif
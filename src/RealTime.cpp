@@ -0,0 +1,230 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "RealTime.h"
+#include "Gd.h"
+
+#include <alloca.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+std::array<RealTime::Profile, 4> RealTime::_profiles{};
+std::atomic_bool RealTime::_memoryLocked{false};
+
+namespace {
+const std::array<const char *, 4> subsystemNames{"serial", "cc1101", "rpc", "signal"};
+
+//Not inlined, so the memory is taken from below the stack frame of the caller.
+__attribute__((noinline)) void prefaultStack(size_t size) {
+  volatile uint8_t *stack = (volatile uint8_t *)alloca(size);
+  for (size_t i = 0; i < size; i += 4096) {
+    stack[i] = 0;
+  }
+}
+}
+
+void RealTime::init() {
+  try {
+    const std::array<std::string, 4> profiles{Gd::settings.realTimeSerial(), Gd::settings.realTimeCc1101(), Gd::settings.realTimeRpc(), Gd::settings.realTimeSignal()};
+    int32_t maxPriority = 0;
+    for (size_t i = 0; i < profiles.size(); i++) {
+      Profile profile;
+      if (!profiles[i].empty() && !parseProfile(profiles[i], profile)) {
+        Gd::out.printError("Error: Invalid real-time profile for " + std::string(subsystemNames[i]) + ": \"" + profiles[i] + "\". Using the default scheduling policy.");
+        profile = Profile();
+      }
+      _profiles[i] = profile;
+      if (profile.priority > maxPriority) maxPriority = profile.priority;
+      if (profile.policy != SCHED_OTHER || !profile.cpus.empty()) Gd::out.printInfo("Info: Real-time profile of " + std::string(subsystemNames[i]) + " threads is " + toString(profile) + ".");
+    }
+
+    //Privileges are dropped later, so allow the unprivileged user to use the configured priorities and to lock memory.
+    struct rlimit limits{};
+    if (getuid() == 0 && maxPriority > 0 && getrlimit(RLIMIT_RTPRIO, &limits) == 0 && limits.rlim_max < (rlim_t)maxPriority) {
+      limits.rlim_cur = maxPriority;
+      limits.rlim_max = maxPriority;
+      if (setrlimit(RLIMIT_RTPRIO, &limits) == -1) Gd::out.printWarning("Warning: Could not raise RLIMIT_RTPRIO: " + std::string(strerror(errno)));
+    }
+    if (getrlimit(RLIMIT_RTPRIO, &limits) == 0 && limits.rlim_cur < (rlim_t)maxPriority) {
+      limits.rlim_cur = std::min(limits.rlim_max, (rlim_t)maxPriority);
+      setrlimit(RLIMIT_RTPRIO, &limits);
+    }
+
+    if (Gd::settings.threadStackSize() > 0) {
+      pthread_attr_t attributes;
+      if (pthread_getattr_default_np(&attributes) == 0) {
+        int result = pthread_attr_setstacksize(&attributes, (size_t)Gd::settings.threadStackSize() * 1024);
+        if (result == 0) result = pthread_setattr_default_np(&attributes);
+        if (result == 0) Gd::out.printInfo("Info: Stack size of new threads set to " + std::to_string(Gd::settings.threadStackSize()) + " KiB.");
+        else Gd::out.printError("Error: Could not set stack size of new threads to " + std::to_string(Gd::settings.threadStackSize()) + " KiB: " + std::string(strerror(result)));
+        pthread_attr_destroy(&attributes);
+      }
+    }
+
+    if (Gd::settings.lockMemory()) {
+      if (getuid() == 0) {
+        limits.rlim_cur = RLIM_INFINITY;
+        limits.rlim_max = RLIM_INFINITY;
+        if (setrlimit(RLIMIT_MEMLOCK, &limits) == -1) Gd::out.printWarning("Warning: Could not raise RLIMIT_MEMLOCK: " + std::string(strerror(errno)));
+      }
+
+      //Keep freed memory in the heap instead of returning it to the system, so it doesn't need to be faulted in again.
+      mallopt(M_TRIM_THRESHOLD, -1);
+      mallopt(M_MMAP_MAX, 0);
+      if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1) Gd::out.printError("Error: Could not lock memory: " + std::string(strerror(errno)));
+      else {
+        _memoryLocked = true;
+        Gd::out.printInfo("Info: Memory locked.");
+      }
+    }
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void RealTime::apply(Subsystem subsystem) {
+  try {
+    const Profile &profile = _profiles.at((size_t)subsystem);
+
+    //Always set the policy. Threads inherit it from the thread starting them otherwise.
+    sched_param parameters{};
+    parameters.sched_priority = profile.priority;
+    int result = pthread_setschedparam(pthread_self(), profile.policy, &parameters);
+    if (result != 0) Gd::out.printWarning("Warning: Could not set scheduling policy " + toString(profile) + " for " + subsystemNames[(size_t)subsystem] + " thread: " + std::string(strerror(result)));
+
+    if (!profile.cpus.empty()) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      for (auto cpu : profile.cpus) {
+        CPU_SET(cpu, &cpus);
+      }
+      result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+      if (result != 0) Gd::out.printWarning("Warning: Could not set CPU affinity " + toString(profile) + " for " + subsystemNames[(size_t)subsystem] + " thread: " + std::string(strerror(result)));
+    }
+
+    if (_memoryLocked || profile.policy == SCHED_FIFO || profile.policy == SCHED_RR) prefaultStack(_prefaultSize);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void RealTime::applyOnce(Subsystem subsystem) {
+  thread_local bool applied = false;
+  if (applied) return;
+  applied = true;
+  apply(subsystem);
+}
+
+bool RealTime::parseProfile(const std::string &value, Profile &profile) {
+  try {
+    auto policyAndCpus = BaseLib::HelperFunctions::splitFirst(value, '@');
+    auto policyAndPriority = BaseLib::HelperFunctions::splitFirst(policyAndCpus.first, ':');
+    std::string policy = BaseLib::HelperFunctions::trim(policyAndPriority.first);
+    BaseLib::HelperFunctions::toLower(policy);
+    if (policy == "other") profile.policy = SCHED_OTHER;
+    else if (policy == "batch") profile.policy = SCHED_BATCH;
+    else if (policy == "idle") profile.policy = SCHED_IDLE;
+    else if (policy == "fifo") profile.policy = SCHED_FIFO;
+    else if (policy == "rr") profile.policy = SCHED_RR;
+    else return false;
+
+    std::string priority = BaseLib::HelperFunctions::trim(policyAndPriority.second);
+    profile.priority = priority.empty() ? sched_get_priority_min(profile.policy) : BaseLib::Math::getNumber(priority);
+    if ((!priority.empty() && !BaseLib::Math::isNumber(priority)) || profile.priority < sched_get_priority_min(profile.policy) || profile.priority > sched_get_priority_max(profile.policy)) return false;
+
+    profile.cpus.clear();
+    std::string cpus = BaseLib::HelperFunctions::trim(policyAndCpus.second);
+    if (cpus.empty()) return true;
+    for (auto &element : BaseLib::HelperFunctions::splitAll(cpus, ',')) {
+      auto range = BaseLib::HelperFunctions::splitFirst(element, '-');
+      BaseLib::HelperFunctions::trim(range.first);
+      BaseLib::HelperFunctions::trim(range.second);
+      if (range.second.empty()) range.second = range.first;
+      if (!BaseLib::Math::isNumber(range.first) || !BaseLib::Math::isNumber(range.second)) return false;
+      int32_t first = BaseLib::Math::getNumber(range.first);
+      int32_t last = BaseLib::Math::getNumber(range.second);
+      if (first < 0 || last < first || last >= CPU_SETSIZE) return false;
+      for (int32_t cpu = first; cpu <= last; cpu++) {
+        profile.cpus.push_back(cpu);
+      }
+    }
+    return true;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return false;
+}
+
+std::string RealTime::toString(const Profile &profile) {
+  std::string result;
+  switch (profile.policy) {
+    case SCHED_BATCH: result = "batch";
+      break;
+    case SCHED_IDLE: result = "idle";
+      break;
+    case SCHED_FIFO: result = "fifo";
+      break;
+    case SCHED_RR: result = "rr";
+      break;
+    default: result = "other";
+  }
+  result.append(":" + std::to_string(profile.priority));
+  for (size_t i = 0; i < profile.cpus.size(); i++) {
+    result.append((i == 0 ? "@" : ",") + std::to_string(profile.cpus[i]));
+  }
+  return result;
+}
+
+BaseLib::PVariable RealTime::getStatus() {
+  try {
+    auto status = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+    status->structValue->emplace("memoryLocked", std::make_shared<BaseLib::Variable>((bool)_memoryLocked));
+    struct rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+      status->structValue->emplace("majorPageFaults", std::make_shared<BaseLib::Variable>((int64_t)usage.ru_majflt));
+      status->structValue->emplace("minorPageFaults", std::make_shared<BaseLib::Variable>((int64_t)usage.ru_minflt));
+    }
+    auto profiles = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+    for (size_t i = 0; i < _profiles.size(); i++) {
+      profiles->structValue->emplace(subsystemNames[i], std::make_shared<BaseLib::Variable>(toString(_profiles[i])));
+    }
+    status->structValue->emplace("profiles", profiles);
+    return status;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
+}
@@ -0,0 +1,106 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef REALTIME_H_
+#define REALTIME_H_
+
+#include <homegear-base/BaseLib.h>
+
+#include <sched.h>
+
+/**
+ * Real-time profiles of the gateway's threads. Every subsystem has a profile consisting of the scheduling policy, the
+ * priority and the CPUs its threads may run on. The threads apply the profile of their subsystem themselves when they
+ * start. On top of that, the whole process can be locked into memory, so page faults (e. g. on a loaded SD card) don't
+ * stall reception, and the stack size of new threads can be set, which limits the memory locked per thread.
+ */
+class RealTime
+{
+public:
+	enum class Subsystem
+	{
+		serial = 0, //The listen threads of serial interfaces and the event loop.
+		cc1101 = 1, //The main threads of the CC1101 interfaces.
+		rpc = 2, //The threads of the RPC server.
+		signal = 3 //The signal handler.
+	};
+
+	struct Profile
+	{
+		int32_t policy = SCHED_OTHER;
+		int32_t priority = 0;
+		std::vector<int32_t> cpus;
+	};
+
+	/**
+	 * Parses the profiles, sets the stack size of threads created afterwards and locks the memory when enabled in
+	 * gateway.conf. Raising the limits for real-time priorities and locked memory needs root, so this needs to be called
+	 * before dropping privileges.
+	 */
+	static void init();
+
+	/**
+	 * Applies the profile of the subsystem to the calling thread. The stack of real-time threads and of all threads when
+	 * memory is locked is pre-faulted.
+	 */
+	static void apply(Subsystem subsystem);
+
+	/**
+	 * Like apply(), but only once per thread. For threads not started by the gateway like those of the RPC server.
+	 */
+	static void applyOnce(Subsystem subsystem);
+
+	/**
+	 * Parses a profile in the form "<policy>[:<priority>][@<CPU>[,<CPU>...]]", e. g. "fifo:45@1". The policy is one of
+	 * "other", "batch", "idle", "fifo" or "rr".
+	 *
+	 * @return Returns false when the profile is invalid.
+	 */
+	static bool parseProfile(const std::string& value, Profile& profile);
+
+	/**
+	 * @return Whether the memory is locked and the page faults of the process.
+	 */
+	static BaseLib::PVariable getStatus();
+private:
+	/**
+	 * The stack pre-faulted by apply(). Thread stacks are mapped lazily, so the first deep call would fault otherwise.
+	 */
+	static constexpr size_t _prefaultSize = 64 * 1024;
+
+	static std::array<Profile, 4> _profiles;
+	static std::atomic_bool _memoryLocked;
+
+	RealTime() = default;
+
+	static std::string toString(const Profile& profile);
+};
+
+#endif
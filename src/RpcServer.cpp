@@ -30,6 +30,10 @@
 
 #include "RpcServer.h"
 #include "Gd.h"
+#include "RealTime.h"
+#ifdef FAMILYMODULES
+#include "ModuleLoader.h"
+#else
 #include "Families/EnOcean.h"
 #include "Families/HomeMaticCulfw.h"
 #include "Families/MaxCulfw.h"
@@ -40,6 +44,7 @@
 #endif
 #include "Families/ZWave.h"
 #include "Families/Zigbee.h"
+#endif
 
 RpcServer::RpcServer(BaseLib::SharedObjects *bl) {
   signal(SIGPIPE, SIG_IGN);
@@ -61,37 +66,103 @@ RpcServer::~RpcServer() {
 }
 
 int32_t RpcServer::familyId() {
-  if (_interface) return _interface->familyId();
+  std::lock_guard<std::mutex> interfacesGuard(_interfacesMutex);
+  if (!_interfaces.empty()) return _interfaces.begin()->first;
 
   return -1;
 }
 
+std::vector<int32_t> RpcServer::familyIds() {
+  std::vector<int32_t> familyIds;
+  std::lock_guard<std::mutex> interfacesGuard(_interfacesMutex);
+  familyIds.reserve(_interfaces.size());
+  for (auto &interface : _interfaces) {
+    familyIds.push_back(interface.first);
+  }
+  return familyIds;
+}
+
+std::vector<Metrics::QueueDepths> RpcServer::getQueueDepths() {
+  std::vector<Metrics::QueueDepths> queueDepths;
+  std::lock_guard<std::mutex> interfacesGuard(_interfacesMutex);
+  queueDepths.reserve(_interfaces.size());
+  for (auto &interface : _interfaces) {
+    Metrics::QueueDepths depths;
+    depths.familyId = interface.first;
+    depths.tx = interface.second->txQueueDepth();
+    depths.requests = interface.second->pendingRequests();
+    queueDepths.push_back(depths);
+  }
+  return queueDepths;
+}
+
+ICommunicationInterface *RpcServer::getInterface(FrameCapture::LinkType linkType) {
+  std::lock_guard<std::mutex> interfacesGuard(_interfacesMutex);
+  for (auto &interface : _interfaces) {
+    if (interface.second->captureLinkType() == linkType) return interface.second.get();
+  }
+  return nullptr;
+}
+
+void RpcServer::clearInterfaces() {
+  std::map<int32_t, std::unique_ptr<ICommunicationInterface>> interfaces;
+  {
+    std::lock_guard<std::mutex> interfacesGuard(_interfacesMutex);
+    interfaces.swap(_interfaces);
+  }
+  //The interfaces are destroyed here without holding the lock, as stopping them can take a while.
+}
+
+std::unique_ptr<ICommunicationInterface> RpcServer::createInterface(const InterfaceSettings &settings) {
+#ifdef FAMILYMODULES
+  if (!_moduleLoader) _moduleLoader.reset(new ModuleLoader(_bl));
+  return _moduleLoader->createInterface(settings);
+#else
+  if (settings.family == "enocean") return std::unique_ptr<EnOcean>(new EnOcean(_bl, settings));
+  else if (settings.family == "homematicculfw") return std::unique_ptr<HomeMaticCulfw>(new HomeMaticCulfw(_bl, settings));
+  else if (settings.family == "maxculfw") return std::unique_ptr<MaxCulfw>(new MaxCulfw(_bl, settings));
+  else if (settings.family == "zwave") return std::unique_ptr<ZWave>(new ZWave(_bl, settings));
+  else if (settings.family == "zigbee") return std::unique_ptr<Zigbee>(new Zigbee(_bl, settings));
+#ifdef SPISUPPORT
+  else if (settings.family == "cc110ltest") return std::unique_ptr<Cc110LTest>(new Cc110LTest(_bl, settings));
+  else if (settings.family == "homematiccc1101") return std::unique_ptr<HomeMaticCc1101>(new HomeMaticCc1101(_bl, settings));
+  else if (settings.family == "maxcc1101") return std::unique_ptr<MaxCc1101>(new MaxCc1101(_bl, settings));
+#endif
+
+  return std::unique_ptr<ICommunicationInterface>();
+#endif
+}
+
 bool RpcServer::start() {
   try {
     _unconfigured = false;
 
-    if (Gd::settings.family().empty()) {
-      Gd::out.printError("Error: Setting family in gateway.conf is empty.");
-      return false;
-    }
+    for (auto &interfaceSettings : Gd::settings.interfaces()) {
+      if (interfaceSettings.family.empty()) {
+        Gd::out.printError("Error: Setting family in gateway.conf is empty.");
+        continue;
+      }
 
-    if (Gd::settings.family() == "enocean") _interface = std::unique_ptr<EnOcean>(new EnOcean(_bl));
-    else if (Gd::settings.family() == "homematicculfw") _interface = std::unique_ptr<HomeMaticCulfw>(new HomeMaticCulfw(_bl));
-    else if (Gd::settings.family() == "maxculfw") _interface = std::unique_ptr<MaxCulfw>(new MaxCulfw(_bl));
-    else if (Gd::settings.family() == "zwave") _interface = std::unique_ptr<ZWave>(new ZWave(_bl));
-    else if (Gd::settings.family() == "zigbee") _interface = std::unique_ptr<Zigbee>(new Zigbee(_bl));
-#ifdef SPISUPPORT
-    else if (Gd::settings.family() == "cc110ltest") _interface = std::unique_ptr<Cc110LTest>(new Cc110LTest(_bl));
-    else if (Gd::settings.family() == "homematiccc1101") _interface = std::unique_ptr<HomeMaticCc1101>(new HomeMaticCc1101(_bl));
-    else if (Gd::settings.family() == "maxcc1101") _interface = std::unique_ptr<MaxCc1101>(new MaxCc1101(_bl));
-#endif
+      auto interface = createInterface(interfaceSettings);
+      if (!interface) {
+        Gd::out.printError("Error: Unknown family: " + interfaceSettings.family + ". Please correct it in gateway.conf.");
+        continue;
+      }
 
-    if (!_interface) {
-      Gd::out.printError("Error: Unknown family: " + Gd::settings.family() + ". Please correct it in gateway.conf.");
-      return false;
+      std::lock_guard<std::mutex> interfacesGuard(_interfacesMutex);
+      if (_interfaces.find(interface->familyId()) != _interfaces.end()) {
+        Gd::out.printError("Error: Only one interface per family ID is supported. Ignoring interface with family " + interfaceSettings.family + " and device " + interfaceSettings.device + ".");
+        continue;
+      }
+
+      interface->setInvoke(std::function<BaseLib::PVariable(std::string, BaseLib::PArray &)>(std::bind(&RpcServer::invoke, this, std::placeholders::_1, std::placeholders::_2)));
+      _interfaces.emplace(interface->familyId(), std::move(interface));
     }
 
-    _interface->setInvoke(std::function<BaseLib::PVariable(std::string, BaseLib::PArray &)>(std::bind(&RpcServer::invoke, this, std::placeholders::_1, std::placeholders::_2)));
+    if (familyIds().empty()) {
+      Gd::out.printError("Error: No valid interface is configured in gateway.conf.");
+      return false;
+    }
 
     C1Net::TcpServer::TcpServerInfo serverInfo;
     serverInfo.listen_address = Gd::settings.listenAddress();
@@ -128,7 +199,7 @@ bool RpcServer::start() {
     certificateInfo->key_file = keyFile;
 
     if (_unconfigured && Gd::settings.configurationPassword().empty()) {
-      _interface.reset();
+      clearInterfaces();
       Gd::out.printError("Error: Gateway is unconfigured but configurationPassword is not set in gateway.conf.");
       return false;
     }
@@ -160,7 +231,7 @@ void RpcServer::stop() {
       _tcpServer->Stop();
       _tcpServer->WaitForServerStopped();
     }
-    _interface.reset();
+    clearInterfaces();
   }
   catch (const std::exception &ex) {
     Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
@@ -244,6 +315,107 @@ BaseLib::PVariable RpcServer::configure(BaseLib::PArray &parameters) {
   return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
 }
 
+BaseLib::PVariable RpcServer::callMethod(RpcMethod method, BaseLib::PArray &parameters) {
+  try {
+    //All family methods take the family ID as first parameter.
+    if (_interfaces.size() == 1) return _interfaces.begin()->second->callMethod(method, parameters);
+    if (parameters->empty() || (parameters->at(0)->type != BaseLib::VariableType::tInteger && parameters->at(0)->type != BaseLib::VariableType::tInteger64)) {
+      return BaseLib::Variable::createError(-1, "First parameter needs to be the family ID.");
+    }
+    int32_t familyId = parameters->at(0)->type == BaseLib::VariableType::tInteger64 ? (int32_t)parameters->at(0)->integerValue64 : parameters->at(0)->integerValue;
+    auto interfaceIterator = _interfaces.find(familyId);
+    if (interfaceIterator == _interfaces.end()) return BaseLib::Variable::createError(-1, "Unknown family ID.");
+    return interfaceIterator->second->callMethod(method, parameters);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
+}
+
+BaseLib::PVariable RpcServer::getRuntimeStats(BaseLib::PArray &parameters) {
+  try {
+    auto stats = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+    stats->structValue->emplace("time", std::make_shared<BaseLib::Variable>(BaseLib::HelperFunctions::getTime()));
+    stats->structValue->emplace("eventLoop", std::make_shared<BaseLib::Variable>((bool)Gd::eventLoop));
+    if (Gd::eventLoop) stats->structValue->emplace("eventLoopWakeUps", std::make_shared<BaseLib::Variable>((int64_t)Gd::eventLoop->wakeUps()));
+
+    std::string status = BaseLib::Io::getFileContent("/proc/self/status");
+    for (auto &line : BaseLib::HelperFunctions::splitAll(status, '\n')) {
+      auto pair = BaseLib::HelperFunctions::splitFirst(line, ':');
+      BaseLib::HelperFunctions::trim(pair.second);
+      if (pair.first == "Threads") stats->structValue->emplace("threads", std::make_shared<BaseLib::Variable>(BaseLib::Math::getNumber(pair.second)));
+      else if (pair.first == "VmRSS") stats->structValue->emplace("rssKb", std::make_shared<BaseLib::Variable>(BaseLib::Math::getNumber(pair.second.substr(0, pair.second.find(' ')))));
+    }
+
+    //Context switches are accounted per thread. Voluntary switches are the wakeups of sleeping threads.
+    int64_t voluntaryContextSwitches = 0;
+    int64_t nonvoluntaryContextSwitches = 0;
+    for (auto &task : BaseLib::Io::getDirectories("/proc/self/task/")) {
+      std::string taskStatus;
+      try {
+        taskStatus = BaseLib::Io::getFileContent("/proc/self/task/" + task + "status");
+      }
+      catch (const BaseLib::Exception &ex) {
+        continue; //Thread exited in the meantime.
+      }
+      for (auto &line : BaseLib::HelperFunctions::splitAll(taskStatus, '\n')) {
+        auto pair = BaseLib::HelperFunctions::splitFirst(line, ':');
+        BaseLib::HelperFunctions::trim(pair.second);
+        if (pair.first == "voluntary_ctxt_switches") voluntaryContextSwitches += BaseLib::Math::getNumber64(pair.second);
+        else if (pair.first == "nonvoluntary_ctxt_switches") nonvoluntaryContextSwitches += BaseLib::Math::getNumber64(pair.second);
+      }
+    }
+    stats->structValue->emplace("voluntaryContextSwitches", std::make_shared<BaseLib::Variable>(voluntaryContextSwitches));
+    stats->structValue->emplace("nonvoluntaryContextSwitches", std::make_shared<BaseLib::Variable>(nonvoluntaryContextSwitches));
+    if (Gd::frameCapture) stats->structValue->emplace("capture", Gd::frameCapture->getStatus());
+    if (Gd::frameReplay) stats->structValue->emplace("replay", Gd::frameReplay->getStatus());
+    if (Gd::clockSync) stats->structValue->emplace("clockSync", Gd::clockSync->getStatus());
+    stats->structValue->emplace("realTime", RealTime::getStatus());
+    stats->structValue->emplace("log", Gd::asyncLog.getStatus());
+
+    auto interfaces = std::make_shared<BaseLib::Variable>(BaseLib::VariableType::tStruct);
+    std::lock_guard<std::mutex> interfacesGuard(_interfacesMutex);
+    for (auto &interface : _interfaces) {
+      interfaces->structValue->emplace(std::to_string(interface.first), interface.second->getReceiveStatus());
+    }
+    stats->structValue->emplace("interfaces", interfaces);
+
+    return stats;
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
+}
+
+BaseLib::PVariable RpcServer::startCapture(BaseLib::PArray &parameters) {
+  try {
+    //The file is taken from gateway.conf only. Allowing clients to pass a path would let them overwrite any file.
+    if (!parameters->empty()) return BaseLib::Variable::createError(-1, "Wrong parameter count.");
+    if (!Gd::frameCapture) return BaseLib::Variable::createError(-32500, "Capturing is not available.");
+    if (!Gd::frameCapture->start()) return BaseLib::Variable::createError(-2, "Could not open capture file. See log for more details.");
+    return Gd::frameCapture->getStatus();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
+}
+
+BaseLib::PVariable RpcServer::stopCapture(BaseLib::PArray &parameters) {
+  try {
+    if (!parameters->empty()) return BaseLib::Variable::createError(-1, "Wrong parameter count.");
+    if (!Gd::frameCapture) return BaseLib::Variable::createError(-32500, "Capturing is not available.");
+    Gd::frameCapture->stop();
+    return Gd::frameCapture->getStatus();
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+  return BaseLib::Variable::createError(-32500, "Unknown application error. See log for more details.");
+}
+
 void RpcServer::log(uint32_t log_level, const std::string &message) {
   Gd::out.printMessage(message, log_level, log_level < 3);
 }
@@ -253,6 +425,7 @@ void RpcServer::newConnection(const C1Net::TcpServer::PTcpClientData &client_dat
     Gd::out.printInfo("Info: New connection from " + client_data->GetIpAddress() + " on port " + std::to_string(client_data->GetPort()) + ".");
     _clientId = client_data->GetId();
     _clientConnected = true;
+    Gd::flightRecorder.record(FlightRecorder::Event::state, -1, "Client connected: " + client_data->GetIpAddress());
   }
   catch (const std::exception &ex) {
     Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
@@ -261,6 +434,7 @@ void RpcServer::newConnection(const C1Net::TcpServer::PTcpClientData &client_dat
 
 void RpcServer::packetReceived(const C1Net::TcpServer::PTcpClientData &client_data, const C1Net::TcpPacket &packet) {
   try {
+    RealTime::applyOnce(RealTime::Subsystem::rpc); //The threads are started by C1Net.
     int32_t processedBytes = 0;
     while (processedBytes < (signed)packet.size()) {
       processedBytes += _binaryRpc->process((char *)packet.data() + processedBytes, packet.size() - processedBytes);
@@ -292,7 +466,29 @@ void RpcServer::packetReceived(const C1Net::TcpServer::PTcpClientData &client_da
               _tcpServer->Send(client_data, data, true);
             }
           } else {
-            response = _interface->callMethod(method, parameters);
+            //Resolve the name once. Everything below dispatches on the method ID.
+            RpcMethod methodId = RpcMethods::getId(method);
+            Gd::flightRecorder.record(FlightRecorder::Event::rpcCall, -1, method);
+            switch (methodId) {
+              case RpcMethod::dumpFlightRecorder:
+                response = Gd::flightRecorder.dump(parameters);
+                break;
+              case RpcMethod::getClockOffset:
+                response = Gd::clockSync ? Gd::clockSync->getClockOffset(parameters) : BaseLib::Variable::createError(-1, "Clock synchronization is not available.");
+                break;
+              case RpcMethod::getRuntimeStats:
+                response = getRuntimeStats(parameters);
+                break;
+              case RpcMethod::startCapture:
+                response = startCapture(parameters);
+                break;
+              case RpcMethod::stopCapture:
+                response = stopCapture(parameters);
+                break;
+              default:
+                response = callMethod(methodId, parameters);
+                break;
+            }
             std::vector<uint8_t> data;
             _rpcEncoder->encodeResponse(response, data);
             _tcpServer->Send(client_data, data);
@@ -325,10 +521,11 @@ BaseLib::PVariable RpcServer::invoke(std::string methodName, BaseLib::PArray &pa
     _rpcResponse.reset();
     _waitForResponse = true;
 
-    std::vector<uint8_t> encodedPacket;
-    _rpcEncoder->encodeRequest(methodName, parameters, encodedPacket);
+    _invokeBuffer.clear();
+    _rpcEncoder->encodeRequest(methodName, parameters, _invokeBuffer);
 
-    _tcpServer->Send(_clientId, encodedPacket);
+    auto startTime = std::chrono::steady_clock::now();
+    _tcpServer->Send(_clientId, _invokeBuffer);
 
     int32_t i = 0;
     while (!_requestConditionVariable.wait_for(requestLock, std::chrono::milliseconds(1000), [&] {
@@ -336,8 +533,12 @@ BaseLib::PVariable RpcServer::invoke(std::string methodName, BaseLib::PArray &pa
       return _rpcResponse || _stopped || i == 10;
     }));
     _waitForResponse = false;
-    if (i == 10 || !_rpcResponse) return BaseLib::Variable::createError(-32500, "No RPC response received.");
+    if (i == 10 || !_rpcResponse) {
+      Gd::flightRecorder.record(FlightRecorder::Event::rpcError, -1, methodName, ICommunicationInterface::invokeTimeoutFaultCode);
+      return BaseLib::Variable::createError(ICommunicationInterface::invokeTimeoutFaultCode, "No RPC response received.");
+    }
 
+    Gd::flightRecorder.record(FlightRecorder::Event::rpcInvoke, -1, methodName, (int32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count());
     return _rpcResponse;
   }
   catch (const std::exception &ex) {
@@ -348,9 +549,11 @@ BaseLib::PVariable RpcServer::invoke(std::string methodName, BaseLib::PArray &pa
 
 void RpcServer::txTest() {
   try {
-    std::string method = "txTest";
-    auto parameters = std::make_shared<BaseLib::Array>();
-    _interface->callMethod(method, parameters);
+    std::lock_guard<std::mutex> interfacesGuard(_interfacesMutex);
+    for (auto &interface : _interfaces) {
+      auto parameters = std::make_shared<BaseLib::Array>();
+      interface.second->callMethod(RpcMethod::txTest, parameters);
+    }
   }
   catch (const std::exception &ex) {
     Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
@@ -33,6 +33,10 @@
 
 #include <homegear-base/BaseLib.h>
 #include "Families/ICommunicationInterface.h"
+#include "Metrics.h"
+#ifdef FAMILYMODULES
+#include "ModuleLoader.h"
+#endif
 
 #include <sys/stat.h>
 
@@ -42,8 +46,19 @@ public:
 	RpcServer(BaseLib::SharedObjects* bl);
 	virtual ~RpcServer();
 
+	/**
+	 * @return The family ID of the first configured interface or -1.
+	 */
 	int32_t familyId();
+	std::vector<int32_t> familyIds();
+	std::vector<Metrics::QueueDepths> getQueueDepths();
 	bool isUnconfigured() { return _unconfigured; }
+	bool isClientConnected() { return !_unconfigured && _tcpServer && _tcpServer->GetClientCount() > 0; }
+
+	/**
+	 * @return The interface receiving frames of the given link type or nullptr. The pointer is only valid until the next stop() or restart().
+	 */
+	ICommunicationInterface* getInterface(FrameCapture::LinkType linkType);
 
 	bool start();
 	void stop();
@@ -67,14 +82,28 @@ private:
     int32_t _clientId = 0;
 
     std::mutex _invokeMutex;
+    std::vector<uint8_t> _invokeBuffer; //Protected by _invokeMutex. Keeps its capacity, so invoke() doesn't allocate it every call.
     std::mutex _requestMutex;
     std::atomic_bool _waitForResponse;
     std::condition_variable _requestConditionVariable;
     BaseLib::PVariable _rpcResponse;
 
-    std::unique_ptr<ICommunicationInterface> _interface;
-
+#ifdef FAMILYMODULES
+    //Needs to be declared before _interfaces, so the modules are unloaded after the interfaces are destroyed.
+    std::unique_ptr<ModuleLoader> _moduleLoader;
+#endif
+    //Protects _interfaces against start() and stop() for the threads outside of the RPC server (metrics, UPnP, event loop). The RPC server's own threads
+    //don't need it, because the TCP server is stopped before the map changes.
+    std::mutex _interfacesMutex;
+    std::map<int32_t, std::unique_ptr<ICommunicationInterface>> _interfaces;
+
+	std::unique_ptr<ICommunicationInterface> createInterface(const InterfaceSettings& settings);
+	void clearInterfaces();
+	BaseLib::PVariable callMethod(RpcMethod method, BaseLib::PArray& parameters);
 	BaseLib::PVariable configure(BaseLib::PArray& parameters);
+	BaseLib::PVariable getRuntimeStats(BaseLib::PArray& parameters);
+	BaseLib::PVariable startCapture(BaseLib::PArray& parameters);
+	BaseLib::PVariable stopCapture(BaseLib::PArray& parameters);
 
 	void restart();
 
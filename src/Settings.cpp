@@ -31,6 +31,10 @@
 #include "Settings.h"
 #include "Gd.h"
 
+#ifndef DEFAULTMODULEPATH
+#define DEFAULTMODULEPATH "/usr/lib/homegear-gateway/"
+#endif
+
 Settings::Settings()
 {
 }
@@ -44,6 +48,8 @@ void Settings::reset()
 	_runAsGroup = "";
 	_debugLevel = 3;
 	_memoryDebugging = false;
+	_asyncLogging = false;
+	_watchdogTimeout = 60;
 	_enableCoreDumps = true;
     _waitForIp4OnInterface = "";
     _waitForIp6OnInterface = "";
@@ -53,6 +59,8 @@ void Settings::reset()
     _dataPath = "/var/lib/homegear-gateway/";
 	_lockFilePath = "/var/lock/";
 	_gpioPath = "/sys/class/gpio/";
+	_modulePath = DEFAULTMODULEPATH;
+	_eventLoop = false;
 	_secureMemorySize = 65536;
 	_caFile = "";
 	_certPath = "";
@@ -65,12 +73,28 @@ void Settings::reset()
     _upnpIpAddress = "";
     _upnpUdn = "";
 
-    _family = "";
-    _device = "";
-	_gpio1 = -1;
-	_gpio2 = -1;
-    _oscillatorFrequency = -1;
-    _interruptPin = -1;
+    _metricsPort = 0;
+
+    _serialLowLatency = false;
+    _receiveTimestamps = false;
+    _clockSyncInterval = 0;
+    _realTimeSerial = "";
+    _realTimeCc1101 = "fifo:45";
+    _realTimeRpc = "";
+    _realTimeSignal = "";
+    _lockMemory = false;
+    _threadStackSize = 0;
+    _capture = false;
+    _captureFile = "";
+    _captureFileSize = 10;
+    _captureFiles = 5;
+    _interfaces.clear();
+}
+
+InterfaceSettings& Settings::currentInterface()
+{
+    if(_interfaces.empty()) _interfaces.emplace_back();
+    return _interfaces.back();
 }
 
 bool Settings::changed()
@@ -106,6 +130,14 @@ void Settings::load(std::string filename, std::string executablePath)
 			len = strlen(input);
 			if (len < 2) continue;
 			if (input[len-1] == '\n') input[len-1] = '\0';
+			std::string line(input);
+			BaseLib::HelperFunctions::trim(line);
+			if(BaseLib::HelperFunctions::toLower(line) == "[interface]")
+			{
+				_interfaces.emplace_back();
+				Gd::bl->out.printDebug("Debug: Interface " + std::to_string(_interfaces.size()) + " started");
+				continue;
+			}
 			ptr = 0;
 			found = false;
 			while(ptr < len)
@@ -165,6 +197,17 @@ void Settings::load(std::string filename, std::string executablePath)
 					if(BaseLib::HelperFunctions::toLower(value) == "true") _memoryDebugging = true;
 					Gd::bl->out.printDebug("Debug: memoryDebugging set to " + std::to_string(_memoryDebugging));
 				}
+				else if(name == "asynclogging")
+				{
+					_asyncLogging = (BaseLib::HelperFunctions::toLower(value) == "true");
+					Gd::bl->out.printDebug("Debug: asyncLogging set to " + std::to_string(_asyncLogging));
+				}
+				else if(name == "watchdogtimeout")
+				{
+					int32_t watchdogTimeout = BaseLib::Math::getNumber(value);
+					_watchdogTimeout = watchdogTimeout < 0 ? 0 : (uint32_t)watchdogTimeout;
+					Gd::bl->out.printDebug("Debug: watchdogTimeout set to " + std::to_string(_watchdogTimeout));
+				}
 				else if(name == "enablecoredumps")
 				{
 					if(BaseLib::HelperFunctions::toLower(value) == "false") _enableCoreDumps = false;
@@ -220,6 +263,18 @@ void Settings::load(std::string filename, std::string executablePath)
                     if(_gpioPath.empty()) _gpioPath = "/sys/class/gpio/";
                     if(_gpioPath.back() != '/') _gpioPath.push_back('/');
                     Gd::bl->out.printDebug("Debug: gpioPath set to " + _gpioPath);
+                }
+                else if(name == "modulepath")
+                {
+                    _modulePath = value;
+                    if(_modulePath.empty()) _modulePath = DEFAULTMODULEPATH;
+                    if(_modulePath.back() != '/') _modulePath.push_back('/');
+                    Gd::bl->out.printDebug("Debug: modulePath set to " + _modulePath);
+                }
+                else if(name == "eventloop")
+                {
+                    _eventLoop = (BaseLib::HelperFunctions::toLower(value) == "true");
+                    Gd::bl->out.printDebug("Debug: eventLoop set to " + std::to_string(_eventLoop));
                 }
 				else if(name == "securememorysize")
 				{
@@ -267,41 +322,146 @@ void Settings::load(std::string filename, std::string executablePath)
                     _upnpUdn = value;
                     Gd::out.printDebug("Debug: uPnPUDN set to " + _upnpUdn);
                 }
+                else if(name == "metricsport")
+                {
+                    _metricsPort = BaseLib::Math::getNumber(value);
+                    if(_metricsPort < 0 || _metricsPort > 65535) _metricsPort = 0;
+                    Gd::out.printDebug("Debug: metricsPort set to " + std::to_string(_metricsPort));
+                }
                 else if(name == "family")
                 {
-                    _family = BaseLib::HelperFunctions::toLower(value);
-                    Gd::bl->out.printDebug("Debug: family set to " + _family);
+                    currentInterface().family = BaseLib::HelperFunctions::toLower(value);
+                    Gd::bl->out.printDebug("Debug: family set to " + currentInterface().family);
                 }
                 else if(name == "device")
                 {
-                    _device = value;
-                    Gd::bl->out.printDebug("Debug: device set to " + _device);
+                    currentInterface().device = value;
+                    Gd::bl->out.printDebug("Debug: device set to " + currentInterface().device);
+                }
+                else if(name == "seriallowlatency")
+                {
+                    _serialLowLatency = (BaseLib::HelperFunctions::toLower(value) == "true");
+                    Gd::bl->out.printDebug("Debug: serialLowLatency set to " + std::to_string(_serialLowLatency));
+                }
+                else if(name == "receivetimestamps")
+                {
+                    _receiveTimestamps = (BaseLib::HelperFunctions::toLower(value) == "true");
+                    Gd::bl->out.printDebug("Debug: receiveTimestamps set to " + std::to_string(_receiveTimestamps));
+                }
+                else if(name == "clocksyncinterval")
+                {
+                    _clockSyncInterval = BaseLib::Math::getNumber(value);
+                    if(_clockSyncInterval < 0) _clockSyncInterval = 0;
+                    Gd::bl->out.printDebug("Debug: clockSyncInterval set to " + std::to_string(_clockSyncInterval));
+                }
+                else if(name == "realtimeserial")
+                {
+                    _realTimeSerial = value;
+                    Gd::bl->out.printDebug("Debug: realTimeSerial set to " + _realTimeSerial);
+                }
+                else if(name == "realtimecc1101")
+                {
+                    _realTimeCc1101 = value;
+                    Gd::bl->out.printDebug("Debug: realTimeCc1101 set to " + _realTimeCc1101);
+                }
+                else if(name == "realtimerpc")
+                {
+                    _realTimeRpc = value;
+                    Gd::bl->out.printDebug("Debug: realTimeRpc set to " + _realTimeRpc);
+                }
+                else if(name == "realtimesignal")
+                {
+                    _realTimeSignal = value;
+                    Gd::bl->out.printDebug("Debug: realTimeSignal set to " + _realTimeSignal);
+                }
+                else if(name == "lockmemory")
+                {
+                    _lockMemory = (BaseLib::HelperFunctions::toLower(value) == "true");
+                    Gd::bl->out.printDebug("Debug: lockMemory set to " + std::to_string(_lockMemory));
+                }
+                else if(name == "threadstacksize")
+                {
+                    _threadStackSize = BaseLib::Math::getNumber(value);
+                    if(_threadStackSize < 0) _threadStackSize = 0;
+                    Gd::bl->out.printDebug("Debug: threadStackSize set to " + std::to_string(_threadStackSize));
+                }
+                else if(name == "capture")
+                {
+                    _capture = (BaseLib::HelperFunctions::toLower(value) == "true");
+                    Gd::bl->out.printDebug("Debug: capture set to " + std::to_string(_capture));
+                }
+                else if(name == "capturefile")
+                {
+                    _captureFile = value;
+                    Gd::bl->out.printDebug("Debug: captureFile set to " + _captureFile);
+                }
+                else if(name == "capturefilesize")
+                {
+                    _captureFileSize = BaseLib::Math::getNumber(value);
+                    if(_captureFileSize < 1) _captureFileSize = 1;
+                    Gd::bl->out.printDebug("Debug: captureFileSize set to " + std::to_string(_captureFileSize));
+                }
+                else if(name == "capturefiles")
+                {
+                    _captureFiles = BaseLib::Math::getNumber(value);
+                    if(_captureFiles < 1) _captureFiles = 1;
+                    Gd::bl->out.printDebug("Debug: captureFiles set to " + std::to_string(_captureFiles));
                 }
 				else if(name == "gpio1")
 				{
-					_gpio1 = BaseLib::Math::getNumber(value);
-					if(_gpio1 < 0) _gpio1 =  -1;
-					Gd::bl->out.printDebug("Debug: gpio1 set to " + std::to_string(_gpio1));
+					currentInterface().gpio1 = BaseLib::Math::getNumber(value);
+					if(currentInterface().gpio1 < 0) currentInterface().gpio1 = -1;
+					Gd::bl->out.printDebug("Debug: gpio1 set to " + std::to_string(currentInterface().gpio1));
 				}
 				else if(name == "gpio2")
 				{
-					_gpio2 = BaseLib::Math::getNumber(value);
-					if(_gpio2 < 0) _gpio2 =  -1;
-					Gd::bl->out.printDebug("Debug: gpio2 set to " + std::to_string(_gpio2));
+					currentInterface().gpio2 = BaseLib::Math::getNumber(value);
+					if(currentInterface().gpio2 < 0) currentInterface().gpio2 = -1;
+					Gd::bl->out.printDebug("Debug: gpio2 set to " + std::to_string(currentInterface().gpio2));
 				}
 				else if(name == "oscillatorfrequency")
 				{
-					_oscillatorFrequency = BaseLib::Math::getNumber(value);
-					if(_oscillatorFrequency < 0) _oscillatorFrequency = -1;
-					Gd::bl->out.printDebug("Debug: oscillatorFrequency set to " + std::to_string(_oscillatorFrequency));
+					currentInterface().oscillatorFrequency = BaseLib::Math::getNumber(value);
+					if(currentInterface().oscillatorFrequency < 0) currentInterface().oscillatorFrequency = -1;
+					Gd::bl->out.printDebug("Debug: oscillatorFrequency set to " + std::to_string(currentInterface().oscillatorFrequency));
 				}
+                else if(name == "dedupewindow")
+                {
+                    currentInterface().dedupeWindow = BaseLib::Math::getNumber(value);
+                    if(currentInterface().dedupeWindow < 0) currentInterface().dedupeWindow = 0;
+                    Gd::bl->out.printDebug("Debug: dedupeWindow set to " + std::to_string(currentInterface().dedupeWindow));
+                }
+                else if(name == "dedupehold")
+                {
+                    currentInterface().dedupeHold = BaseLib::Math::getNumber(value);
+                    if(currentInterface().dedupeHold < 0) currentInterface().dedupeHold = 0;
+                    Gd::bl->out.printDebug("Debug: dedupeHold set to " + std::to_string(currentInterface().dedupeHold));
+                }
+                else if(name == "ratelimit")
+                {
+                    currentInterface().rateLimit = BaseLib::Math::getNumber(value);
+                    if(currentInterface().rateLimit < 0) currentInterface().rateLimit = 0;
+                    Gd::bl->out.printDebug("Debug: rateLimit set to " + std::to_string(currentInterface().rateLimit));
+                }
+                else if(name == "ratelimitburst")
+                {
+                    currentInterface().rateLimitBurst = BaseLib::Math::getNumber(value);
+                    if(currentInterface().rateLimitBurst < 1) currentInterface().rateLimitBurst = 1;
+                    Gd::bl->out.printDebug("Debug: rateLimitBurst set to " + std::to_string(currentInterface().rateLimitBurst));
+                }
+                else if(name == "receivebudget")
+                {
+                    currentInterface().receiveBudget = BaseLib::Math::getNumber(value);
+                    if(currentInterface().receiveBudget < 0) currentInterface().receiveBudget = 0;
+                    Gd::bl->out.printDebug("Debug: receiveBudget set to " + std::to_string(currentInterface().receiveBudget));
+                }
 				else if(name == "interruptpin")
 				{
 					int32_t number = BaseLib::Math::getNumber(value);
 					if(number >= 0)
 					{
-						_interruptPin = number;
-						Gd::bl->out.printDebug("Debug: interruptPin set to " + std::to_string(_interruptPin));
+						currentInterface().interruptPin = number;
+						Gd::bl->out.printDebug("Debug: interruptPin set to " + std::to_string(currentInterface().interruptPin));
 					}
 				}
 				else
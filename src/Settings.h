@@ -33,6 +33,25 @@
 
 #include <homegear-base/BaseLib.h>
 
+/**
+ * Settings of one radio module. The family specific settings before the first "[interface]" section form the first
+ * interface, each "[interface]" section adds another one.
+ */
+struct InterfaceSettings
+{
+    std::string family;
+    std::string device;
+    int32_t gpio1 = -1;
+    int32_t gpio2 = -1;
+    int32_t oscillatorFrequency = -1;
+    int32_t interruptPin = -1;
+    int32_t dedupeWindow = 0;
+    int32_t dedupeHold = 0;
+    int32_t rateLimit = 0;
+    int32_t rateLimitBurst = 10;
+    int32_t receiveBudget = 0;
+};
+
 class Settings
 {
 public:
@@ -48,6 +67,8 @@ public:
 	std::string runAsGroup() { return _runAsGroup; }
 	int32_t debugLevel() { return _debugLevel; }
 	bool memoryDebugging() { return _memoryDebugging; }
+	bool asyncLogging() { return _asyncLogging; }
+	uint32_t watchdogTimeout() { return _watchdogTimeout; }
 	bool enableCoreDumps() { return _enableCoreDumps; };
     std::string waitForIp4OnInterface() { return _waitForIp4OnInterface; }
     std::string waitForIp6OnInterface() { return _waitForIp6OnInterface; }
@@ -57,6 +78,8 @@ public:
 	std::string dataPath() { return _dataPath; }
 	std::string lockFilePath() { return _lockFilePath; }
     std::string gpioPath() { return _gpioPath; }
+    std::string modulePath() { return _modulePath; }
+    bool eventLoop() { return _eventLoop; }
 	uint32_t secureMemorySize() { return _secureMemorySize; }
 	std::string caFile() { return _caFile; }
 	std::string certPath() { return _certPath; }
@@ -69,12 +92,22 @@ public:
     std::string upnpIpAddress() { return _upnpIpAddress; }
     std::string upnpUdn() { return _upnpUdn; }
 
-    std::string family() { return _family; }
-    std::string device() { return _device; }
-	int32_t gpio1() { return _gpio1; }
-    int32_t gpio2() { return _gpio2; }
-	int32_t oscillatorFrequency() { return _oscillatorFrequency; }
-	int32_t interruptPin() { return _interruptPin; }
+    int32_t metricsPort() { return _metricsPort; }
+
+    bool serialLowLatency() { return _serialLowLatency; }
+    bool receiveTimestamps() { return _receiveTimestamps; }
+    int32_t clockSyncInterval() { return _clockSyncInterval; }
+    std::string realTimeSerial() { return _realTimeSerial; }
+    std::string realTimeCc1101() { return _realTimeCc1101; }
+    std::string realTimeRpc() { return _realTimeRpc; }
+    std::string realTimeSignal() { return _realTimeSignal; }
+    bool lockMemory() { return _lockMemory; }
+    int32_t threadStackSize() { return _threadStackSize; }
+    bool capture() { return _capture; }
+    std::string captureFile() { return _captureFile.empty() ? _logFilePath + "capture.pcapng" : _captureFile; }
+    int32_t captureFileSize() { return _captureFileSize; }
+    int32_t captureFiles() { return _captureFiles; }
+    const std::vector<InterfaceSettings>& interfaces() { return _interfaces; }
 private:
 	std::string _executablePath;
 	std::string _path;
@@ -87,6 +120,8 @@ private:
 	std::string _runAsGroup;
 	int32_t _debugLevel = 3;
 	bool _memoryDebugging = false;
+	bool _asyncLogging = false;
+	uint32_t _watchdogTimeout = 60;
 	bool _enableCoreDumps = true;
     std::string _waitForIp4OnInterface;
     std::string _waitForIp6OnInterface;
@@ -96,6 +131,8 @@ private:
 	std::string _dataPath;
 	std::string _lockFilePath;
     std::string _gpioPath;
+    std::string _modulePath;
+    bool _eventLoop = false;
 	uint32_t _secureMemorySize = 65536;
 	std::string _caFile;
 	std::string _certPath;
@@ -108,13 +145,24 @@ private:
     std::string _upnpIpAddress;
     std::string _upnpUdn;
 
-	std::string _family;
-    std::string _device;
-	int32_t _gpio1 = -1;
-	int32_t _gpio2 = -1;
-	int32_t _oscillatorFrequency = -1;
-	int32_t _interruptPin = -1;
+    int32_t _metricsPort = 0;
+
+    bool _serialLowLatency = false;
+    bool _receiveTimestamps = false;
+    int32_t _clockSyncInterval = 0;
+    std::string _realTimeSerial;
+    std::string _realTimeCc1101 = "fifo:45";
+    std::string _realTimeRpc;
+    std::string _realTimeSignal;
+    bool _lockMemory = false;
+    int32_t _threadStackSize = 0;
+    bool _capture = false;
+    std::string _captureFile;
+    int32_t _captureFileSize = 10;
+    int32_t _captureFiles = 5;
+    std::vector<InterfaceSettings> _interfaces;
 
 	void reset();
+	InterfaceSettings& currentInterface();
 };
 #endif
@@ -0,0 +1,252 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "LoadTestClient.h"
+
+#include <iostream>
+#include <random>
+
+namespace {
+int64_t steadyTime() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+LoadTestClient::LoadTestClient(BaseLib::SharedObjects *bl, Options options) : _options(std::move(options)) {
+  _bl = bl;
+  _binaryRpc.reset(new BaseLib::Rpc::BinaryRpc(bl));
+  _rpcEncoder.reset(new BaseLib::Rpc::RpcEncoder(bl, true, true));
+  _rpcDecoder.reset(new BaseLib::Rpc::RpcDecoder(bl, false, false));
+  if (_options.concurrency == 0) _options.concurrency = 1;
+  if (_options.rate < 0) _options.rate = 0;
+}
+
+LoadTestClient::~LoadTestClient() {
+  _stop = true;
+  _ackQueueConditionVariable.notify_all();
+  if (_readThread.joinable()) _readThread.join();
+  if (_ackThread.joinable()) _ackThread.join();
+}
+
+bool LoadTestClient::run() {
+  try {
+    _socket.reset(new BaseLib::TcpSocket(_bl, _options.host, _options.port, !_options.caFile.empty(), _options.caFile, _options.verifyCertificate, _options.certFile, _options.keyFile));
+    _socket->setReadTimeout(100000);
+    _socket->setWriteTimeout(5000000);
+    _socket->open();
+  }
+  catch (const BaseLib::Exception &ex) {
+    std::cerr << "Error: Could not connect to " << _options.host << ":" << _options.port << ": " << ex.what() << std::endl;
+    return false;
+  }
+
+  _stop = false;
+  _connectionLost = false;
+  _readThread = std::thread(&LoadTestClient::readThread, this);
+  _ackThread = std::thread(&LoadTestClient::ackThread, this);
+
+  auto parameters = std::make_shared<BaseLib::Array>();
+  parameters->push_back(std::make_shared<BaseLib::Variable>(_options.familyId));
+  if (_options.packetIsString) parameters->push_back(std::make_shared<BaseLib::Variable>(std::string(_options.packet.begin(), _options.packet.end())));
+  else parameters->push_back(std::make_shared<BaseLib::Variable>(_options.packet));
+  std::vector<char> request;
+  _rpcEncoder->encodeRequest(_options.method, parameters, request);
+
+  int64_t interval = _options.rate > 0 ? (int64_t)(1000000.0 / _options.rate) : 0;
+  int64_t startTime = steadyTime();
+  int64_t endTime = startTime + (int64_t)_options.duration * 1000000;
+  int64_t nextRequestTime = startTime;
+  int64_t now = startTime;
+  while (!_stop && !_connectionLost && now < endTime) {
+    now = steadyTime();
+    if (interval == 0) {
+      //Passive mode: Only answer packetReceived, e. g. while the gateway replays a trace.
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      continue;
+    }
+    if (now < nextRequestTime) {
+      std::this_thread::sleep_for(std::chrono::microseconds(nextRequestTime - now));
+      continue;
+    }
+    //Don't try to catch up after a stall, that would measure a burst instead of the configured rate.
+    nextRequestTime = std::max(nextRequestTime + interval, now - 1000000);
+
+    {
+      std::lock_guard<std::mutex> resultsGuard(_resultsMutex);
+      checkTimeouts(now);
+      if (_pendingRequests.size() >= _options.concurrency) {
+        _results.throttled++;
+        continue;
+      }
+      PendingRequest pendingRequest;
+      pendingRequest.time = now;
+      _pendingRequests.push_back(pendingRequest);
+      _results.requestsSent++;
+    }
+    write(request);
+  }
+
+  //Wait for the responses of requests still in flight.
+  {
+    std::unique_lock<std::mutex> resultsLock(_resultsMutex);
+    _resultsConditionVariable.wait_for(resultsLock, std::chrono::milliseconds(_options.timeout), [&] { return _pendingRequests.empty() || _connectionLost; });
+    checkTimeouts(steadyTime());
+    for (auto &pendingRequest : _pendingRequests) {
+      if (!pendingRequest.timedOut) _results.timeouts++;
+    }
+    _pendingRequests.clear();
+    _results.duration = (double)(steadyTime() - startTime) / 1000000.0;
+  }
+
+  _stop = true;
+  _ackQueueConditionVariable.notify_all();
+  if (_readThread.joinable()) _readThread.join();
+  if (_ackThread.joinable()) _ackThread.join();
+  _socket->close();
+
+  return !_connectionLost;
+}
+
+LoadTestClient::Results LoadTestClient::results() {
+  std::lock_guard<std::mutex> resultsGuard(_resultsMutex);
+  return _results;
+}
+
+void LoadTestClient::write(const std::vector<char> &data) {
+  try {
+    std::lock_guard<std::mutex> writeGuard(_writeMutex);
+    _socket->proofwrite(data);
+  }
+  catch (const BaseLib::Exception &ex) {
+    std::cerr << "Error: Could not write to gateway: " << ex.what() << std::endl;
+    _connectionLost = true;
+    _resultsConditionVariable.notify_all();
+  }
+}
+
+void LoadTestClient::checkTimeouts(int64_t now) {
+  //Requests stay in the queue after timing out, because a late response still needs to be matched to them.
+  for (auto &pendingRequest : _pendingRequests) {
+    if (now - pendingRequest.time < (int64_t)_options.timeout * 1000) break;
+    if (pendingRequest.timedOut) continue;
+    pendingRequest.timedOut = true;
+    _results.timeouts++;
+  }
+}
+
+void LoadTestClient::processResponse(BaseLib::PVariable &response) {
+  int64_t now = steadyTime();
+  {
+    std::lock_guard<std::mutex> resultsGuard(_resultsMutex);
+    if (_pendingRequests.empty()) {
+      _results.unmatchedResponses++;
+      return;
+    }
+    _results.latencies.push_back(now - _pendingRequests.front().time);
+    _pendingRequests.pop_front();
+    _results.responsesReceived++;
+    if (response->errorStruct) _results.errorResponses++;
+  }
+  _resultsConditionVariable.notify_all();
+}
+
+void LoadTestClient::readThread() {
+  std::vector<char> buffer(4096);
+  std::mt19937 random(1);
+  std::uniform_int_distribution<int32_t> ackDelayDistribution(_options.ackDelayMin, std::max(_options.ackDelayMin, _options.ackDelayMax));
+  while (!_stop) {
+    int32_t bytesRead = 0;
+    try {
+      bytesRead = _socket->proofread(buffer.data(), buffer.size());
+    }
+    catch (const BaseLib::SocketTimeOutException &) {
+      continue;
+    }
+    catch (const BaseLib::Exception &ex) {
+      if (_stop) return;
+      std::cerr << "Error: Connection to gateway lost: " << ex.what() << std::endl;
+      _connectionLost = true;
+      _resultsConditionVariable.notify_all();
+      return;
+    }
+
+    try {
+      int32_t processedBytes = 0;
+      while (processedBytes < bytesRead) {
+        processedBytes += _binaryRpc->process(buffer.data() + processedBytes, bytesRead - processedBytes);
+        if (!_binaryRpc->isFinished()) continue;
+
+        if (_binaryRpc->getType() == BaseLib::Rpc::BinaryRpc::Type::request) {
+          std::string method;
+          _rpcDecoder->decodeRequest(_binaryRpc->getData(), method);
+          if (method == "packetReceived") {
+            std::lock_guard<std::mutex> resultsGuard(_resultsMutex);
+            _results.packetsReceived++;
+          }
+          {
+            std::lock_guard<std::mutex> ackQueueGuard(_ackQueueMutex);
+            _ackQueue.push_back(steadyTime() + (int64_t)ackDelayDistribution(random) * 1000);
+          }
+          _ackQueueConditionVariable.notify_one();
+        } else if (_binaryRpc->getType() == BaseLib::Rpc::BinaryRpc::Type::response) {
+          auto response = _rpcDecoder->decodeResponse(_binaryRpc->getData());
+          processResponse(response);
+        }
+        _binaryRpc->reset();
+      }
+    }
+    catch (const BaseLib::Rpc::BinaryRpcException &ex) {
+      _binaryRpc->reset();
+      std::cerr << "Error processing packet: " << ex.what() << std::endl;
+    }
+  }
+}
+
+void LoadTestClient::ackThread() {
+  std::vector<char> data;
+  BaseLib::PVariable response = std::make_shared<BaseLib::Variable>();
+  _rpcEncoder->encodeResponse(response, data);
+
+  while (!_stop) {
+    int64_t dueTime = 0;
+    {
+      std::unique_lock<std::mutex> ackQueueLock(_ackQueueMutex);
+      _ackQueueConditionVariable.wait_for(ackQueueLock, std::chrono::milliseconds(100), [&] { return !_ackQueue.empty() || _stop; });
+      if (_ackQueue.empty()) continue;
+      dueTime = _ackQueue.front();
+      _ackQueue.pop_front();
+    }
+
+    //Responses need to be sent in the order of the requests, so a long delay also delays all following responses.
+    int64_t now = steadyTime();
+    if (dueTime > now) std::this_thread::sleep_for(std::chrono::microseconds(dueTime - now));
+    write(data);
+  }
+}
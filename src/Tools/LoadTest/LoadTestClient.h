@@ -0,0 +1,144 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_LOADTESTCLIENT_H
+#define HOMEGEAR_GATEWAY_LOADTESTCLIENT_H
+
+#include <homegear-base/BaseLib.h>
+
+#include <deque>
+
+/**
+ * Connects to the gateway like Homegear does (binary RPC over TLS with client certificate), calls a method (usually
+ * sendPacket) at a fixed rate with a limited number of requests in flight and answers packetReceived after a
+ * configurable delay.
+ *
+ * Binary RPC responses carry no request ID. The gateway processes requests of a connection in order, so responses are
+ * matched to requests first in, first out.
+ */
+class LoadTestClient
+{
+public:
+    struct Options
+    {
+        std::string host = "127.0.0.1";
+        std::string port = "2017";
+        std::string caFile;
+        std::string certFile;
+        std::string keyFile;
+        bool verifyCertificate = true;
+
+        std::string method = "sendPacket";
+        int32_t familyId = 15;
+        std::vector<uint8_t> packet;
+        bool packetIsString = false;
+
+        /**
+         * Requests per second.
+         */
+        double rate = 100;
+        uint32_t concurrency = 1;
+        int32_t duration = 10;
+        int32_t timeout = 5000;
+
+        /**
+         * Delay in milliseconds before packetReceived is answered. A random value between minimum and maximum is used.
+         */
+        int32_t ackDelayMin = 0;
+        int32_t ackDelayMax = 0;
+    };
+
+    struct Results
+    {
+        double duration = 0;
+        uint64_t requestsSent = 0;
+        uint64_t responsesReceived = 0;
+        uint64_t errorResponses = 0;
+        uint64_t timeouts = 0;
+        uint64_t unmatchedResponses = 0;
+        uint64_t throttled = 0;
+        uint64_t packetsReceived = 0;
+
+        /**
+         * Round trip times in microseconds.
+         */
+        std::vector<int64_t> latencies;
+    };
+
+    LoadTestClient(BaseLib::SharedObjects* bl, Options options);
+    virtual ~LoadTestClient();
+
+    /**
+     * Runs the test for the configured duration.
+     *
+     * @return Returns false when the connection could not be established or was lost.
+     */
+    bool run();
+    void stop() { _stop = true; }
+
+    Results results();
+private:
+    struct PendingRequest
+    {
+        int64_t time = 0;
+        bool timedOut = false;
+    };
+
+    BaseLib::SharedObjects* _bl = nullptr;
+    Options _options;
+    std::unique_ptr<BaseLib::TcpSocket> _socket;
+    std::unique_ptr<BaseLib::Rpc::BinaryRpc> _binaryRpc;
+    std::unique_ptr<BaseLib::Rpc::RpcEncoder> _rpcEncoder;
+    std::unique_ptr<BaseLib::Rpc::RpcDecoder> _rpcDecoder;
+    std::atomic_bool _stop{false};
+    std::atomic_bool _connectionLost{false};
+
+    std::mutex _writeMutex;
+
+    std::mutex _resultsMutex;
+    std::condition_variable _resultsConditionVariable;
+    Results _results;
+    std::deque<PendingRequest> _pendingRequests;
+
+    std::mutex _ackQueueMutex;
+    std::condition_variable _ackQueueConditionVariable;
+    std::deque<int64_t> _ackQueue;
+
+    std::thread _readThread;
+    std::thread _ackThread;
+
+    void readThread();
+    void ackThread();
+    void processResponse(BaseLib::PVariable& response);
+    void checkTimeouts(int64_t now);
+    void write(const std::vector<char>& data);
+};
+
+#endif
@@ -0,0 +1,173 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "LoadTestClient.h"
+
+#include <algorithm>
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+
+/*
+ * Stand-in for Homegear to benchmark the gateway. Together with homegear-gateway-simulator this measures the whole
+ * pipeline without hardware, e. g.:
+ *
+ *   homegear-gateway-simulator --family enocean --link /tmp/enocean0
+ *   homegear-gateway-loadtest --ca ca.crt --cert client.crt --key client.key --rate 500 --concurrency 8 --duration 30
+ *
+ * With the EnOcean simulator every sendPacket is answered by the module with RET_OK, which the gateway forwards as
+ * packetReceived, so both directions are loaded.
+ *
+ * To benchmark the receive path with recorded traffic, let the gateway replay a capture file and run the client passively:
+ *
+ *   homegear-gateway --replay capture.pcapng --replayspeed 10
+ *   homegear-gateway-loadtest --ca ca.crt --cert client.crt --key client.key --rate 0 --duration 60
+ */
+
+namespace {
+LoadTestClient *client = nullptr;
+
+void signalHandler(int) {
+  if (client) client->stop();
+}
+
+void printHelp() {
+  std::cout << "Usage: homegear-gateway-loadtest [OPTIONS]" << std::endl << std::endl;
+  std::cout << "Connection:" << std::endl;
+  std::cout << "  --host HOST          Gateway host (default: 127.0.0.1)" << std::endl;
+  std::cout << "  --port PORT          Gateway port (default: 2017)" << std::endl;
+  std::cout << "  --ca FILE            CA certificate. Without it, TLS is disabled (unconfigured gateway)." << std::endl;
+  std::cout << "  --cert FILE          Client certificate" << std::endl;
+  std::cout << "  --key FILE           Client key" << std::endl;
+  std::cout << "  --noverify           Don't verify the gateway's certificate" << std::endl << std::endl;
+  std::cout << "Load:" << std::endl;
+  std::cout << "  --method NAME        Method to call (default: sendPacket)" << std::endl;
+  std::cout << "  --family ID          Family ID passed as first parameter (default: 15, EnOcean)" << std::endl;
+  std::cout << "  --packet HEX         Packet passed as second parameter (default: EnOcean 4BS telegram)" << std::endl;
+  std::cout << "  --string TEXT        Pass TEXT as string instead of a binary packet (CUL families)" << std::endl;
+  std::cout << "  --rate N             Requests per second. 0 only answers packetReceived (default: 100)" << std::endl;
+  std::cout << "  --concurrency N      Maximum number of requests in flight (default: 1)" << std::endl;
+  std::cout << "  --duration SECONDS   Test duration (default: 10)" << std::endl;
+  std::cout << "  --timeout MS         Time after which a request counts as timed out (default: 5000)" << std::endl;
+  std::cout << "  --ackdelay MIN[:MAX] Delay in ms before packetReceived is answered (default: 0)" << std::endl;
+  std::cout << "  -h, --help           Show this help" << std::endl;
+}
+
+int64_t percentile(const std::vector<int64_t> &sortedValues, double percent) {
+  if (sortedValues.empty()) return 0;
+  size_t index = (size_t)(percent / 100.0 * (double)(sortedValues.size() - 1) + 0.5);
+  return sortedValues.at(std::min(index, sortedValues.size() - 1));
+}
+
+void printResults(LoadTestClient::Results &results) {
+  std::sort(results.latencies.begin(), results.latencies.end());
+  double duration = results.duration > 0 ? results.duration : 1;
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "Duration:             " << results.duration << " s" << std::endl;
+  std::cout << "Requests sent:        " << results.requestsSent << " (" << (double)results.requestsSent / duration << "/s)" << std::endl;
+  std::cout << "Responses:            " << results.responsesReceived << " (" << (double)results.responsesReceived / duration << "/s)" << std::endl;
+  std::cout << "Error responses:      " << results.errorResponses << std::endl;
+  std::cout << "Timeouts:             " << results.timeouts << std::endl;
+  std::cout << "Unmatched responses:  " << results.unmatchedResponses << std::endl;
+  std::cout << "Throttled:            " << results.throttled << " (concurrency limit reached)" << std::endl;
+  std::cout << "packetReceived:       " << results.packetsReceived << " (" << (double)results.packetsReceived / duration << "/s)" << std::endl;
+  std::cout << "Latency (µs):         p50 " << percentile(results.latencies, 50) << ", p90 " << percentile(results.latencies, 90) << ", p99 " << percentile(results.latencies, 99) << ", p99.9 " << percentile(results.latencies, 99.9) << ", max " << (results.latencies.empty() ? 0 : results.latencies.back()) << std::endl;
+}
+}
+
+int main(int argc, char *argv[]) {
+  BaseLib::SharedObjects bl;
+  LoadTestClient::Options options;
+  options.packet = bl.hf.getUBinary("55000A0701EBA500000008FF8000010003FFFFFFFFFF0016");
+
+  try {
+    for (int32_t i = 1; i < argc; i++) {
+      std::string arg(argv[i]);
+      if (arg == "-h" || arg == "--help") {
+        printHelp();
+        return 0;
+      } else if (arg == "--noverify") {
+        options.verifyCertificate = false;
+        continue;
+      }
+      if (i + 1 >= argc) {
+        std::cerr << "Error: Missing value for " << arg << ". See --help." << std::endl;
+        return 1;
+      }
+      std::string value(argv[++i]);
+      if (arg == "--host") options.host = value;
+      else if (arg == "--port") options.port = value;
+      else if (arg == "--ca") options.caFile = value;
+      else if (arg == "--cert") options.certFile = value;
+      else if (arg == "--key") options.keyFile = value;
+      else if (arg == "--method") options.method = value;
+      else if (arg == "--family") options.familyId = std::stoi(value);
+      else if (arg == "--packet") {
+        options.packet = bl.hf.getUBinary(value);
+        options.packetIsString = false;
+      } else if (arg == "--string") {
+        options.packet = std::vector<uint8_t>(value.begin(), value.end());
+        options.packetIsString = true;
+      } else if (arg == "--rate") options.rate = std::stod(value);
+      else if (arg == "--concurrency") options.concurrency = (uint32_t)std::stoul(value);
+      else if (arg == "--duration") options.duration = std::stoi(value);
+      else if (arg == "--timeout") options.timeout = std::stoi(value);
+      else if (arg == "--ackdelay") {
+        auto delays = BaseLib::HelperFunctions::splitFirst(value, ':');
+        options.ackDelayMin = std::stoi(delays.first);
+        options.ackDelayMax = delays.second.empty() ? options.ackDelayMin : std::stoi(delays.second);
+      } else {
+        std::cerr << "Error: Unknown option " << arg << ". See --help." << std::endl;
+        return 1;
+      }
+    }
+  }
+  catch (const std::exception &ex) {
+    std::cerr << "Error: Invalid argument: " << ex.what() << std::endl;
+    return 1;
+  }
+
+  LoadTestClient loadTestClient(&bl, options);
+  client = &loadTestClient;
+
+  struct sigaction action{};
+  action.sa_handler = signalHandler;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  if (options.rate > 0) std::cout << "Calling " << options.method << " at " << options.rate << "/s with up to " << options.concurrency << " requests in flight for " << options.duration << " s..." << std::endl;
+  else std::cout << "Answering packetReceived for " << options.duration << " s..." << std::endl;
+  bool success = loadTestClient.run();
+  auto results = loadTestClient.results();
+  printResults(results);
+  client = nullptr;
+
+  return success && results.timeouts == 0 ? 0 : 2;
+}
@@ -0,0 +1,100 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "CulfwSimulator.h"
+
+CulfwSimulator::CulfwSimulator(Options options) : PtySimulator(std::move(options)) {
+}
+
+void CulfwSimulator::processData(const uint8_t *data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (data[i] == '\r') continue;
+    if (data[i] != '\n') {
+      _line.push_back((char)data[i]);
+      if (_line.size() > 1024) {
+        _stats.invalidFramesReceived++;
+        _line.clear();
+      }
+      continue;
+    }
+    if (!_line.empty()) processLine();
+    _line.clear();
+  }
+}
+
+void CulfwSimulator::processLine() {
+  _stats.framesReceived++;
+  if (_line == "V") {
+    std::string version = "V 1.67 CUL868\r\n";
+    sendResponse(std::vector<uint8_t>(version.begin(), version.end()));
+  } else if (_line.compare(0, 1, "X") == 0) {
+    _reporting = _line.size() > 1 && _line.compare(1, std::string::npos, "00") != 0;
+  } else if (_line == "Ar" || _line == "AR") {
+    _mode = 'A';
+  } else if (_line == "Zr") {
+    _mode = 'Z';
+  } else if ((_line.compare(0, 2, "As") == 0 || _line.compare(0, 2, "Zs") == 0) && _line.size() % 2 == 0) {
+    //Send command. culfw does not answer unless the duty cycle limit is reached.
+  } else {
+    _stats.invalidFramesReceived++;
+  }
+}
+
+std::vector<uint8_t> CulfwSimulator::createLine(char prefix, const std::vector<uint8_t> &packet) {
+  static const char hexDigits[] = "0123456789ABCDEF";
+  std::vector<uint8_t> line;
+  line.reserve(packet.size() * 2 + 5);
+  line.push_back((uint8_t)prefix);
+  for (auto byte : packet) {
+    line.push_back((uint8_t)hexDigits[byte >> 4]);
+    line.push_back((uint8_t)hexDigits[byte & 0x0F]);
+  }
+  //RSSI
+  uint8_t rssi = randomByte();
+  line.push_back((uint8_t)hexDigits[rssi >> 4]);
+  line.push_back((uint8_t)hexDigits[rssi & 0x0F]);
+  line.push_back('\r');
+  line.push_back('\n');
+  return line;
+}
+
+std::vector<uint8_t> CulfwSimulator::createTelegram(uint32_t device) {
+  uint32_t sender = 0x100000 + device;
+  std::vector<uint8_t> packet{0x00, _messageCounter++};
+  if (_mode == 'Z') {
+    //MAX!: flags, WallThermostatControl, sender, broadcast receiver, group, set point, measured temperature
+    packet.insert(packet.end(), {0x04, 0x42, (uint8_t)(sender >> 16), (uint8_t)((sender >> 8) & 0xFF), (uint8_t)(sender & 0xFF), 0x00, 0x00, 0x00, 0x00, (uint8_t)(30 + randomByte() % 20), (uint8_t)(randomByte() % 250)});
+  } else {
+    //HomeMatic: flags, INFO_LEVEL, sender, broadcast receiver, subtype, channel, level, status
+    packet.insert(packet.end(), {0x84, 0x10, (uint8_t)(sender >> 16), (uint8_t)((sender >> 8) & 0xFF), (uint8_t)(sender & 0xFF), 0x00, 0x00, 0x00, 0x06, 0x01, (uint8_t)(randomByte() % 201), 0x00});
+  }
+  packet[0] = (uint8_t)(packet.size() - 1);
+  return createLine(_mode == 'Z' ? 'Z' : 'A', packet);
+}
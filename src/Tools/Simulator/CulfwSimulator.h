@@ -0,0 +1,60 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_CULFWSIMULATOR_H
+#define HOMEGEAR_GATEWAY_CULFWSIMULATOR_H
+
+#include "PtySimulator.h"
+
+/**
+ * Emulates a CUL/COC running culfw. Telegrams are only reported after the gateway enabled reporting ("X21") and
+ * selected a receive mode. "Ar" selects HomeMatic (telegrams prefixed with "A"), "Zr" selects MAX! (prefixed with "Z").
+ * Send commands ("As", "Zs") are counted but not answered, like by culfw.
+ */
+class CulfwSimulator : public PtySimulator
+{
+public:
+    explicit CulfwSimulator(Options options);
+    ~CulfwSimulator() override = default;
+protected:
+    void processData(const uint8_t* data, size_t size) override;
+    std::vector<uint8_t> createTelegram(uint32_t device) override;
+    bool receiving() override { return _reporting && _mode != 0; }
+private:
+    std::string _line;
+    bool _reporting = false;
+    char _mode = 0;
+    uint8_t _messageCounter = 0;
+
+    void processLine();
+    std::vector<uint8_t> createLine(char prefix, const std::vector<uint8_t>& packet);
+};
+
+#endif
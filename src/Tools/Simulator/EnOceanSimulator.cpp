@@ -0,0 +1,132 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "EnOceanSimulator.h"
+
+namespace {
+const uint8_t RET_OK = 0x00;
+const uint8_t RET_NOT_SUPPORTED = 0x02;
+const uint8_t RET_WRONG_PARAM = 0x03;
+}
+
+EnOceanSimulator::EnOceanSimulator(Options options) : PtySimulator(std::move(options)) {
+  //CRC8 with polynomial 0x07 as used by ESP3.
+  for (int32_t i = 0; i < 256; i++) {
+    uint8_t crc = (uint8_t)i;
+    for (int32_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    _crc8Table[i] = crc;
+  }
+  _baseAddress |= (_random() & 0x7F) << 16;
+}
+
+uint8_t EnOceanSimulator::crc8(const std::vector<uint8_t> &data, size_t start, size_t end) {
+  uint8_t crc = 0;
+  for (size_t i = start; i < end; i++) {
+    crc = _crc8Table[crc ^ data[i]];
+  }
+  return crc;
+}
+
+std::vector<uint8_t> EnOceanSimulator::createPacket(uint8_t packetType, const std::vector<uint8_t> &data, const std::vector<uint8_t> &optionalData) {
+  std::vector<uint8_t> packet;
+  packet.reserve(7 + data.size() + optionalData.size());
+  packet.push_back(0x55);
+  packet.push_back((uint8_t)(data.size() >> 8));
+  packet.push_back((uint8_t)(data.size() & 0xFF));
+  packet.push_back((uint8_t)optionalData.size());
+  packet.push_back(packetType);
+  packet.push_back(crc8(packet, 1, 5));
+  packet.insert(packet.end(), data.begin(), data.end());
+  packet.insert(packet.end(), optionalData.begin(), optionalData.end());
+  packet.push_back(crc8(packet, 6, packet.size()));
+  return packet;
+}
+
+void EnOceanSimulator::processData(const uint8_t *data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (_packet.empty() && data[i] != 0x55) continue;
+    _packet.push_back(data[i]);
+
+    if (_packet.size() == 6 && crc8(_packet, 1, 5) != _packet[5]) {
+      _stats.invalidFramesReceived++;
+      _packet.clear();
+      continue;
+    }
+    if (_packet.size() < 6) continue;
+
+    size_t packetSize = 7 + ((_packet[1] << 8) | _packet[2]) + _packet[3];
+    if (_packet.size() < packetSize) continue;
+
+    if (crc8(_packet, 6, _packet.size() - 1) != _packet.back()) _stats.invalidFramesReceived++;
+    else processPacket();
+    _packet.clear();
+  }
+}
+
+void EnOceanSimulator::processPacket() {
+  _stats.framesReceived++;
+  uint8_t packetType = _packet[4];
+  size_t dataSize = (_packet[1] << 8) | _packet[2];
+
+  if (packetType == 0x01) {
+    //RADIO_ERP1, acknowledged like by a real module.
+    sendReturnCode(RET_OK);
+  } else if (packetType == 0x05 && dataSize > 0) {
+    uint8_t command = _packet[6];
+    if (command == 0x08) {
+      //CO_RD_IDBASE
+      sendResponse(createPacket(0x02, {RET_OK, (uint8_t)(_baseAddress >> 24), (uint8_t)((_baseAddress >> 16) & 0xFF), (uint8_t)((_baseAddress >> 8) & 0xFF), (uint8_t)(_baseAddress & 0xFF)}, {_remainingBaseAddressChanges}));
+    } else if (command == 0x07 && dataSize == 5) {
+      //CO_WR_IDBASE
+      uint32_t baseAddress = ((uint32_t)_packet[7] << 24) | ((uint32_t)_packet[8] << 16) | ((uint32_t)_packet[9] << 8) | _packet[10];
+      if ((baseAddress & 0xFF80007F) != 0xFF800000 || _remainingBaseAddressChanges == 0) {
+        sendReturnCode(RET_WRONG_PARAM);
+        return;
+      }
+      _baseAddress = baseAddress;
+      _remainingBaseAddressChanges--;
+      sendReturnCode(RET_OK);
+    } else sendReturnCode(RET_NOT_SUPPORTED);
+  } else sendReturnCode(RET_NOT_SUPPORTED);
+}
+
+void EnOceanSimulator::sendReturnCode(uint8_t returnCode) {
+  sendResponse(createPacket(0x02, {returnCode}, {}));
+}
+
+std::vector<uint8_t> EnOceanSimulator::createTelegram(uint32_t device) {
+  uint32_t senderId = 0x01800000 + device;
+  std::vector<uint8_t> data{0xA5, randomByte(), randomByte(), randomByte(), (uint8_t)(randomByte() | 0x08), (uint8_t)(senderId >> 24), (uint8_t)((senderId >> 16) & 0xFF), (uint8_t)((senderId >> 8) & 0xFF), (uint8_t)(senderId & 0xFF), 0x00};
+  //Sub telegram count, broadcast destination, dBm, security level
+  std::vector<uint8_t> optionalData{0x01, 0xFF, 0xFF, 0xFF, 0xFF, (uint8_t)(40 + _random() % 55), 0x00};
+  return createPacket(0x01, data, optionalData);
+}
@@ -0,0 +1,60 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_ENOCEANSIMULATOR_H
+#define HOMEGEAR_GATEWAY_ENOCEANSIMULATOR_H
+
+#include "PtySimulator.h"
+
+/**
+ * Emulates an ESP3 module (e. g. USB 300). Answers CO_RD_IDBASE and CO_WR_IDBASE and acknowledges radio telegrams sent
+ * by the gateway. Generated telegrams are 4BS (A5) telegrams.
+ */
+class EnOceanSimulator : public PtySimulator
+{
+public:
+    explicit EnOceanSimulator(Options options);
+    ~EnOceanSimulator() override = default;
+protected:
+    void processData(const uint8_t* data, size_t size) override;
+    std::vector<uint8_t> createTelegram(uint32_t device) override;
+private:
+    uint8_t _crc8Table[256];
+    std::vector<uint8_t> _packet;
+    uint32_t _baseAddress = 0xFF800000;
+    uint8_t _remainingBaseAddressChanges = 10;
+
+    uint8_t crc8(const std::vector<uint8_t>& data, size_t start, size_t end);
+    std::vector<uint8_t> createPacket(uint8_t packetType, const std::vector<uint8_t>& data, const std::vector<uint8_t>& optionalData);
+    void processPacket();
+    void sendReturnCode(uint8_t returnCode);
+};
+
+#endif
@@ -0,0 +1,214 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "PtySimulator.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+PtySimulator::PtySimulator(Options options) : _options(std::move(options)), _random(_options.seed) {
+  if (_options.devices == 0) _options.devices = 1;
+}
+
+PtySimulator::~PtySimulator() {
+  close();
+}
+
+bool PtySimulator::open() {
+  close();
+
+  _masterDescriptor = posix_openpt(O_RDWR | O_NOCTTY);
+  if (_masterDescriptor == -1 || grantpt(_masterDescriptor) == -1 || unlockpt(_masterDescriptor) == -1) {
+    std::cerr << "Error: Could not create pseudo-terminal: " << strerror(errno) << std::endl;
+    close();
+    return false;
+  }
+  fcntl(_masterDescriptor, F_SETFL, fcntl(_masterDescriptor, F_GETFL) | O_NONBLOCK);
+  fcntl(_masterDescriptor, F_SETFD, FD_CLOEXEC);
+
+  char slaveName[256];
+  if (ptsname_r(_masterDescriptor, slaveName, sizeof(slaveName)) != 0) {
+    std::cerr << "Error: Could not get name of pseudo-terminal slave: " << strerror(errno) << std::endl;
+    close();
+    return false;
+  }
+  _slaveName = slaveName;
+
+  //Keep the slave side open, so the master side does not return EIO while the gateway is not connected.
+  _slaveDescriptor = ::open(_slaveName.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (_slaveDescriptor == -1) {
+    std::cerr << "Error: Could not open " << _slaveName << ": " << strerror(errno) << std::endl;
+    close();
+    return false;
+  }
+  termios attributes{};
+  tcgetattr(_slaveDescriptor, &attributes);
+  cfmakeraw(&attributes);
+  tcsetattr(_slaveDescriptor, TCSANOW, &attributes);
+
+  if (!_options.link.empty()) {
+    struct stat linkStat{};
+    if (lstat(_options.link.c_str(), &linkStat) == 0) {
+      if (!S_ISLNK(linkStat.st_mode)) {
+        std::cerr << "Error: " << _options.link << " exists and is not a symbolic link." << std::endl;
+        close();
+        return false;
+      }
+      unlink(_options.link.c_str());
+    }
+    if (symlink(_slaveName.c_str(), _options.link.c_str()) == -1) {
+      std::cerr << "Error: Could not create link " << _options.link << ": " << strerror(errno) << std::endl;
+      close();
+      return false;
+    }
+  }
+
+  if (_options.rate > 0) {
+    _timerDescriptor = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (_timerDescriptor == -1) {
+      std::cerr << "Error: Could not create timer: " << strerror(errno) << std::endl;
+      close();
+      return false;
+    }
+    itimerspec timerSpec{};
+    timerSpec.it_value.tv_nsec = _timerInterval * 1000000;
+    timerSpec.it_interval.tv_nsec = _timerInterval * 1000000;
+    timerfd_settime(_timerDescriptor, 0, &timerSpec, nullptr);
+  }
+
+  return true;
+}
+
+void PtySimulator::close() {
+  if (_timerDescriptor != -1) ::close(_timerDescriptor);
+  if (_slaveDescriptor != -1) ::close(_slaveDescriptor);
+  if (_masterDescriptor != -1) ::close(_masterDescriptor);
+  _timerDescriptor = -1;
+  _slaveDescriptor = -1;
+  _masterDescriptor = -1;
+  if (!_options.link.empty() && !_slaveName.empty()) {
+    char target[256];
+    ssize_t size = readlink(_options.link.c_str(), target, sizeof(target) - 1);
+    if (size > 0 && _slaveName.compare(0, std::string::npos, target, size) == 0) unlink(_options.link.c_str());
+  }
+  _slaveName.clear();
+  _output.clear();
+}
+
+void PtySimulator::processInput() {
+  uint8_t buffer[4096];
+  while (true) {
+    ssize_t bytesRead = read(_masterDescriptor, buffer, sizeof(buffer));
+    if (bytesRead > 0) {
+      processData(buffer, bytesRead);
+      continue;
+    }
+    if (bytesRead == -1 && errno == EINTR) continue;
+    return;
+  }
+}
+
+void PtySimulator::processOutput() {
+  while (!_output.empty()) {
+    ssize_t bytesWritten = ::write(_masterDescriptor, _output.data(), _output.size());
+    if (bytesWritten == -1) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    _output.erase(_output.begin(), _output.begin() + bytesWritten);
+  }
+}
+
+void PtySimulator::processTimer() {
+  uint64_t expirations = 0;
+  if (read(_timerDescriptor, &expirations, sizeof(expirations)) != sizeof(expirations)) return;
+
+  if (!receiving()) {
+    _telegramsDue = 0;
+    return;
+  }
+
+  _telegramsDue += _options.devices * _options.rate * (double)(expirations * _timerInterval) / 1000.0;
+  uint64_t count = (uint64_t)_telegramsDue;
+  _telegramsDue -= count;
+
+  std::uniform_real_distribution<double> errorDistribution(0.0, 1.0);
+  for (uint64_t i = 0; i < count; i++) {
+    std::vector<uint8_t> telegram = createTelegram(_nextDevice);
+    _nextDevice = (_nextDevice + 1) % _options.devices;
+    if (_options.errorRate > 0 && errorDistribution(_random) < _options.errorRate) injectError(telegram);
+
+    if (_output.size() + telegram.size() > _maxOutputSize) {
+      //The gateway does not keep up. Count the telegram as lost like a real module would.
+      _stats.telegramsDropped++;
+      continue;
+    }
+    write(telegram);
+    _stats.telegramsSent++;
+  }
+}
+
+void PtySimulator::sendResponse(const std::vector<uint8_t> &data) {
+  write(data);
+  _stats.responsesSent++;
+}
+
+void PtySimulator::write(const std::vector<uint8_t> &data) {
+  _output.insert(_output.end(), data.begin(), data.end());
+  processOutput();
+}
+
+void PtySimulator::injectError(std::vector<uint8_t> &telegram) {
+  if (telegram.size() < 2) return;
+  _stats.errorsInjected++;
+  switch (_random() % 3) {
+    case 0: {
+      //Bit error, usually caught by the checksum.
+      size_t index = 1 + _random() % (telegram.size() - 1);
+      telegram[index] ^= (uint8_t)(1 << (_random() % 8));
+      break;
+    }
+    case 1:
+      //Truncated frame.
+      telegram.resize(1 + _random() % (telegram.size() - 1));
+      break;
+    default:
+      //Garbage in front of the frame.
+      telegram.insert(telegram.begin(), randomByte());
+      break;
+  }
+}
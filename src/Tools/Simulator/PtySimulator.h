@@ -0,0 +1,150 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_PTYSIMULATOR_H
+#define HOMEGEAR_GATEWAY_PTYSIMULATOR_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Base class of the device simulators. A simulator creates a pseudo-terminal pair and emulates the serial side of a
+ * radio module on the master side. The slave side is made available under a configurable path, which can be used as
+ * "device" in "gateway.conf".
+ *
+ * All simulators are driven by a single event loop in main.cpp, so none of the methods is thread safe.
+ */
+class PtySimulator
+{
+public:
+    struct Options
+    {
+        std::string family;
+        std::string link;
+
+        /**
+         * The number of virtual devices sending telegrams.
+         */
+        uint32_t devices = 1;
+
+        /**
+         * Telegrams per second per virtual device.
+         */
+        double rate = 0;
+
+        /**
+         * Probability (0 to 1) of a generated telegram being corrupted.
+         */
+        double errorRate = 0;
+
+        uint32_t seed = 1;
+    };
+
+    struct Stats
+    {
+        uint64_t framesReceived = 0;
+        uint64_t invalidFramesReceived = 0;
+        uint64_t responsesSent = 0;
+        uint64_t telegramsSent = 0;
+        uint64_t errorsInjected = 0;
+        uint64_t telegramsDropped = 0;
+    };
+
+    explicit PtySimulator(Options options);
+    virtual ~PtySimulator();
+
+    /**
+     * Creates the pseudo-terminal pair, the telegram timer and the link to the slave side.
+     *
+     * @return Returns false on error. The error is printed to stderr.
+     */
+    bool open();
+    void close();
+
+    const Options& options() { return _options; }
+    const Stats& stats() { return _stats; }
+    const std::string& slaveName() { return _slaveName; }
+    int32_t masterDescriptor() { return _masterDescriptor; }
+    int32_t timerDescriptor() { return _timerDescriptor; }
+
+    /**
+     * @return True when output is pending, so the master descriptor needs to be polled for EPOLLOUT.
+     */
+    bool outputPending() { return !_output.empty(); }
+
+    void processInput();
+    void processOutput();
+    void processTimer();
+protected:
+    Options _options;
+    Stats _stats;
+    std::mt19937 _random;
+
+    /**
+     * Called with everything read from the master side. Implementations need to handle frames split across calls.
+     */
+    virtual void processData(const uint8_t* data, size_t size) = 0;
+
+    /**
+     * Creates a telegram as sent by the module when the virtual device with the given index sends something.
+     */
+    virtual std::vector<uint8_t> createTelegram(uint32_t device) = 0;
+
+    /**
+     * @return False while the module would not pass received telegrams to the host, e. g. before it was initialized.
+     */
+    virtual bool receiving() { return true; }
+
+    /**
+     * Sends a response to a request of the gateway. Responses are never corrupted.
+     */
+    void sendResponse(const std::vector<uint8_t>& data);
+
+    uint8_t randomByte() { return (uint8_t)(_random() & 0xFF); }
+private:
+    static const size_t _maxOutputSize = 65536;
+    static const int32_t _timerInterval = 10;
+
+    int32_t _masterDescriptor = -1;
+    int32_t _slaveDescriptor = -1;
+    int32_t _timerDescriptor = -1;
+    std::string _slaveName;
+    std::vector<uint8_t> _output;
+
+    double _telegramsDue = 0;
+    uint32_t _nextDevice = 0;
+
+    void write(const std::vector<uint8_t>& data);
+    void injectError(std::vector<uint8_t>& telegram);
+};
+
+#endif
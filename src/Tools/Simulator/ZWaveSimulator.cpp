@@ -0,0 +1,127 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "ZWaveSimulator.h"
+
+namespace {
+const uint8_t SOF = 0x01;
+const uint8_t ACK = 0x06;
+const uint8_t NACK = 0x15;
+const uint8_t CAN = 0x18;
+
+const uint8_t REQUEST = 0x00;
+const uint8_t RESPONSE = 0x01;
+
+const uint8_t FUNC_APPLICATION_COMMAND_HANDLER = 0x04;
+const uint8_t FUNC_ZW_SEND_DATA = 0x13;
+const uint8_t FUNC_ZW_GET_VERSION = 0x15;
+const uint8_t FUNC_MEMORY_GET_ID = 0x20;
+}
+
+ZWaveSimulator::ZWaveSimulator(Options options) : PtySimulator(std::move(options)) {
+  _homeId = _random();
+}
+
+std::vector<uint8_t> ZWaveSimulator::createFrame(uint8_t type, uint8_t function, const std::vector<uint8_t> &payload) {
+  std::vector<uint8_t> frame;
+  frame.reserve(payload.size() + 5);
+  frame.push_back(SOF);
+  frame.push_back((uint8_t)(payload.size() + 3));
+  frame.push_back(type);
+  frame.push_back(function);
+  frame.insert(frame.end(), payload.begin(), payload.end());
+  uint8_t checksum = 0xFF;
+  for (size_t i = 1; i < frame.size(); i++) {
+    checksum ^= frame[i];
+  }
+  frame.push_back(checksum);
+  return frame;
+}
+
+void ZWaveSimulator::processData(const uint8_t *data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (_frame.empty()) {
+      if (data[i] == ACK || data[i] == NACK || data[i] == CAN) continue;
+      if (data[i] != SOF) {
+        _stats.invalidFramesReceived++;
+        continue;
+      }
+    }
+    _frame.push_back(data[i]);
+    if (_frame.size() < 2) continue;
+    if (_frame[1] < 3) {
+      _stats.invalidFramesReceived++;
+      _frame.clear();
+      continue;
+    }
+    if (_frame.size() < (size_t)_frame[1] + 2) continue;
+
+    uint8_t checksum = 0xFF;
+    for (size_t j = 1; j < _frame.size() - 1; j++) {
+      checksum ^= _frame[j];
+    }
+    if (checksum != _frame.back()) {
+      _stats.invalidFramesReceived++;
+      sendResponse({NACK});
+    } else processFrame();
+    _frame.clear();
+  }
+}
+
+void ZWaveSimulator::processFrame() {
+  _stats.framesReceived++;
+  sendResponse({ACK});
+  if (_frame[2] != REQUEST) return;
+
+  uint8_t function = _frame[3];
+  if (function == FUNC_ZW_GET_VERSION) {
+    std::string version = "Z-Wave 4.05";
+    std::vector<uint8_t> payload(version.begin(), version.end());
+    payload.push_back(0x00);
+    payload.push_back(0x01); //Library type "static controller"
+    sendResponse(createFrame(RESPONSE, function, payload));
+  } else if (function == FUNC_MEMORY_GET_ID) {
+    sendResponse(createFrame(RESPONSE, function, {(uint8_t)(_homeId >> 24), (uint8_t)((_homeId >> 16) & 0xFF), (uint8_t)((_homeId >> 8) & 0xFF), (uint8_t)(_homeId & 0xFF), 0x01}));
+  } else if (function == FUNC_ZW_SEND_DATA) {
+    //Transmission queued, followed by the callback reporting TRANSMIT_COMPLETE_OK. The callback ID is the last byte
+    //before the checksum.
+    sendResponse(createFrame(RESPONSE, function, {0x01}));
+    if (_frame.size() > 6) sendResponse(createFrame(REQUEST, function, {_frame[_frame.size() - 2], 0x00}));
+  } else {
+    sendResponse(createFrame(RESPONSE, function, {0x01}));
+  }
+}
+
+std::vector<uint8_t> ZWaveSimulator::createTelegram(uint32_t device) {
+  //Node IDs 2 to 232. With more virtual devices, node IDs are reused.
+  auto nodeId = (uint8_t)(2 + device % 231);
+  //Receive status, source node, command length, COMMAND_CLASS_BASIC, BASIC_REPORT, value
+  return createFrame(REQUEST, FUNC_APPLICATION_COMMAND_HANDLER, {0x00, nodeId, 0x03, 0x20, 0x03, (uint8_t)(randomByte() % 100)});
+}
@@ -0,0 +1,57 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HOMEGEAR_GATEWAY_ZWAVESIMULATOR_H
+#define HOMEGEAR_GATEWAY_ZWAVESIMULATOR_H
+
+#include "PtySimulator.h"
+
+/**
+ * Emulates a Z-Wave serial API controller. Every valid frame of the gateway is acknowledged (ACK), frames with a wrong
+ * checksum are answered with NACK. ZW_GET_VERSION, MEMORY_GET_ID and ZW_SEND_DATA get plausible responses, all other
+ * requests a generic success response. Generated telegrams are BASIC reports of the virtual nodes.
+ */
+class ZWaveSimulator : public PtySimulator
+{
+public:
+    explicit ZWaveSimulator(Options options);
+    ~ZWaveSimulator() override = default;
+protected:
+    void processData(const uint8_t* data, size_t size) override;
+    std::vector<uint8_t> createTelegram(uint32_t device) override;
+private:
+    std::vector<uint8_t> _frame;
+    uint32_t _homeId = 0;
+
+    std::vector<uint8_t> createFrame(uint8_t type, uint8_t function, const std::vector<uint8_t>& payload);
+    void processFrame();
+};
+
+#endif
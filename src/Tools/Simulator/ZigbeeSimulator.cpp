@@ -0,0 +1,133 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "ZigbeeSimulator.h"
+
+namespace {
+const uint8_t SOF = 0xFE;
+
+const uint8_t TYPE_MASK = 0xE0;
+const uint8_t SUBSYSTEM_MASK = 0x1F;
+const uint8_t AREQ = 0x40;
+const uint8_t SREQ = 0x20;
+const uint8_t SRSP = 0x60;
+
+const uint8_t SUBSYSTEM_SYS = 0x01;
+const uint8_t SUBSYSTEM_AF = 0x04;
+
+const uint8_t SYS_RESET_REQ = 0x00;
+const uint8_t SYS_PING = 0x01;
+const uint8_t SYS_VERSION = 0x02;
+const uint8_t SYS_RESET_IND = 0x80;
+const uint8_t AF_INCOMING_MSG = 0x81;
+
+//Transport revision, product, major, minor, maintenance release
+const std::vector<uint8_t> version{0x02, 0x01, 0x02, 0x07, 0x01};
+}
+
+ZigbeeSimulator::ZigbeeSimulator(Options options) : PtySimulator(std::move(options)) {
+}
+
+std::vector<uint8_t> ZigbeeSimulator::createFrame(uint8_t command0, uint8_t command1, const std::vector<uint8_t> &data) {
+  std::vector<uint8_t> frame;
+  frame.reserve(data.size() + 5);
+  frame.push_back(SOF);
+  frame.push_back((uint8_t)data.size());
+  frame.push_back(command0);
+  frame.push_back(command1);
+  frame.insert(frame.end(), data.begin(), data.end());
+  uint8_t fcs = 0;
+  for (size_t i = 1; i < frame.size(); i++) {
+    fcs ^= frame[i];
+  }
+  frame.push_back(fcs);
+  return frame;
+}
+
+void ZigbeeSimulator::processData(const uint8_t *data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (_frame.empty() && data[i] != SOF) {
+      _stats.invalidFramesReceived++;
+      continue;
+    }
+    _frame.push_back(data[i]);
+    if (_frame.size() < 2 || _frame.size() < (size_t)_frame[1] + 5) continue;
+
+    uint8_t fcs = 0;
+    for (size_t j = 1; j < _frame.size() - 1; j++) {
+      fcs ^= _frame[j];
+    }
+    if (fcs != _frame.back()) _stats.invalidFramesReceived++;
+    else processFrame();
+    _frame.clear();
+  }
+}
+
+void ZigbeeSimulator::processFrame() {
+  _stats.framesReceived++;
+  uint8_t type = _frame[2] & TYPE_MASK;
+  uint8_t subsystem = _frame[2] & SUBSYSTEM_MASK;
+  uint8_t command = _frame[3];
+
+  if (type == SREQ) {
+    uint8_t responseCommand0 = SRSP | subsystem;
+    if (subsystem == SUBSYSTEM_SYS && command == SYS_PING) sendResponse(createFrame(responseCommand0, command, {0x79, 0x01}));
+    else if (subsystem == SUBSYSTEM_SYS && command == SYS_VERSION) sendResponse(createFrame(responseCommand0, command, version));
+    else sendResponse(createFrame(responseCommand0, command, {0x00}));
+  } else if (type == AREQ && subsystem == SUBSYSTEM_SYS && command == SYS_RESET_REQ) {
+    std::vector<uint8_t> data{0x00}; //Reset reason "power up"
+    data.insert(data.end(), version.begin(), version.end());
+    sendResponse(createFrame(AREQ | SUBSYSTEM_SYS, SYS_RESET_IND, data));
+  }
+}
+
+std::vector<uint8_t> ZigbeeSimulator::createTelegram(uint32_t device) {
+  uint16_t sourceAddress = (uint16_t)(0x1000 + device);
+  uint32_t timestamp = _random();
+  uint8_t sequenceNumber = _sequenceNumber++;
+  //ZCL: frame control (server to client, disable default response), sequence number, REPORT_ATTRIBUTES, attribute
+  //0x0000 (OnOff), type boolean, value
+  std::vector<uint8_t> zcl{0x18, sequenceNumber, 0x0A, 0x00, 0x00, 0x10, (uint8_t)(randomByte() & 1)};
+  std::vector<uint8_t> data{
+      0x00, 0x00, //Group ID
+      0x06, 0x00, //Cluster ID (OnOff)
+      (uint8_t)(sourceAddress & 0xFF), (uint8_t)(sourceAddress >> 8),
+      0x01, //Source endpoint
+      0x01, //Destination endpoint
+      0x00, //Was broadcast
+      randomByte(), //Link quality
+      0x00, //Security use
+      (uint8_t)(timestamp & 0xFF), (uint8_t)((timestamp >> 8) & 0xFF), (uint8_t)((timestamp >> 16) & 0xFF), (uint8_t)(timestamp >> 24),
+      sequenceNumber,
+      (uint8_t)zcl.size()
+  };
+  data.insert(data.end(), zcl.begin(), zcl.end());
+  return createFrame(AREQ | SUBSYSTEM_AF, AF_INCOMING_MSG, data);
+}
@@ -0,0 +1,217 @@
+/* Copyright 2013-2019 Homegear GmbH
+ *
+ * Homegear is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * Homegear is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Homegear.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "CulfwSimulator.h"
+#include "EnOceanSimulator.h"
+#include "ZigbeeSimulator.h"
+#include "ZWaveSimulator.h"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <memory>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+/*
+ * Creates pseudo-terminals emulating the radio modules supported by the gateway, so the gateway can be run and load
+ * tested without hardware. Example:
+ *
+ *   homegear-gateway-simulator --family enocean --link /tmp/enocean0 --devices 1000 --rate 0.1 --errors 0.01
+ *
+ * and "device = /tmp/enocean0" in the EnOcean section of "gateway.conf". All telegrams are generated from the seed, so
+ * runs are reproducible.
+ */
+
+namespace {
+std::atomic_bool stopRequested{false};
+
+void signalHandler(int) {
+  stopRequested = true;
+}
+
+void printHelp() {
+  std::cout << "Usage: homegear-gateway-simulator [OPTIONS] --family FAMILY [FAMILY OPTIONS] [--family FAMILY [FAMILY OPTIONS]]..." << std::endl << std::endl;
+  std::cout << "Families:" << std::endl;
+  std::cout << "  enocean         ESP3 module" << std::endl;
+  std::cout << "  zwave           Z-Wave serial API controller" << std::endl;
+  std::cout << "  zigbee          Z-Stack ZNP coprocessor" << std::endl;
+  std::cout << "  culfw           CUL/COC (HomeMatic and MAX!)" << std::endl << std::endl;
+  std::cout << "Family options (apply to the preceding --family):" << std::endl;
+  std::cout << "  --link PATH     Symbolic link to the pseudo-terminal (default: /tmp/homegear-gateway-FAMILYINDEX)" << std::endl;
+  std::cout << "  --devices N     Number of virtual devices (default: 1)" << std::endl;
+  std::cout << "  --rate N        Telegrams per second per virtual device (default: 0)" << std::endl;
+  std::cout << "  --errors P      Probability of a telegram being corrupted, 0 to 1 (default: 0)" << std::endl;
+  std::cout << "  --seed N        Seed of the random number generator (default: 1)" << std::endl << std::endl;
+  std::cout << "Options:" << std::endl;
+  std::cout << "  --stats SECONDS Statistics interval, 0 disables statistics (default: 10)" << std::endl;
+  std::cout << "  -h, --help      Show this help" << std::endl;
+}
+
+std::unique_ptr<PtySimulator> createSimulator(const PtySimulator::Options &options) {
+  if (options.family == "enocean") return std::unique_ptr<PtySimulator>(new EnOceanSimulator(options));
+  if (options.family == "zwave") return std::unique_ptr<PtySimulator>(new ZWaveSimulator(options));
+  if (options.family == "zigbee") return std::unique_ptr<PtySimulator>(new ZigbeeSimulator(options));
+  if (options.family == "culfw") return std::unique_ptr<PtySimulator>(new CulfwSimulator(options));
+  return std::unique_ptr<PtySimulator>();
+}
+
+void printStats(const std::vector<std::unique_ptr<PtySimulator>> &simulators) {
+  for (auto &simulator : simulators) {
+    auto &stats = simulator->stats();
+    std::cout << simulator->options().family << " (" << simulator->options().link << "): telegrams sent " << stats.telegramsSent << ", dropped " << stats.telegramsDropped << ", errors injected " << stats.errorsInjected << ", frames received " << stats.framesReceived << ", invalid frames " << stats.invalidFramesReceived << ", responses " << stats.responsesSent << std::endl;
+  }
+}
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<PtySimulator::Options> optionsList;
+  int32_t statsInterval = 10;
+
+  try {
+    for (int32_t i = 1; i < argc; i++) {
+      std::string arg(argv[i]);
+      if (arg == "-h" || arg == "--help") {
+        printHelp();
+        return 0;
+      }
+      if (i + 1 >= argc) {
+        std::cerr << "Error: Missing value for " << arg << ". See --help." << std::endl;
+        return 1;
+      }
+      std::string value(argv[++i]);
+      if (arg == "--family") {
+        PtySimulator::Options options;
+        options.family = value;
+        options.link = "/tmp/homegear-gateway-" + value + std::to_string(optionsList.size());
+        options.seed = (uint32_t)optionsList.size() + 1;
+        optionsList.push_back(options);
+      } else if (arg == "--stats") {
+        statsInterval = std::stoi(value);
+      } else if (optionsList.empty()) {
+        std::cerr << "Error: " << arg << " needs to follow --family. See --help." << std::endl;
+        return 1;
+      } else if (arg == "--link") {
+        optionsList.back().link = value;
+      } else if (arg == "--devices") {
+        optionsList.back().devices = (uint32_t)std::stoul(value);
+      } else if (arg == "--rate") {
+        optionsList.back().rate = std::stod(value);
+      } else if (arg == "--errors") {
+        optionsList.back().errorRate = std::stod(value);
+      } else if (arg == "--seed") {
+        optionsList.back().seed = (uint32_t)std::stoul(value);
+      } else {
+        std::cerr << "Error: Unknown option " << arg << ". See --help." << std::endl;
+        return 1;
+      }
+    }
+  }
+  catch (const std::exception &ex) {
+    std::cerr << "Error: Invalid argument: " << ex.what() << std::endl;
+    return 1;
+  }
+
+  if (optionsList.empty()) {
+    printHelp();
+    return 1;
+  }
+
+  std::vector<std::unique_ptr<PtySimulator>> simulators;
+  for (auto &options : optionsList) {
+    auto simulator = createSimulator(options);
+    if (!simulator) {
+      std::cerr << "Error: Unknown family " << options.family << ". See --help." << std::endl;
+      return 1;
+    }
+    if (!simulator->open()) return 1;
+    std::cout << "Simulating " << options.family << " with " << options.devices << " devices on " << simulator->slaveName() << " (" << options.link << ")." << std::endl;
+    simulators.push_back(std::move(simulator));
+  }
+
+  struct sigaction action{};
+  action.sa_handler = signalHandler;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  int32_t epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+  if (epollDescriptor == -1) {
+    std::cerr << "Error: Could not create epoll descriptor." << std::endl;
+    return 1;
+  }
+
+  //Bit 0 of the event data distinguishes the timer from the pseudo-terminal, the remaining bits are the index.
+  std::vector<bool> pollingOutput(simulators.size(), false);
+  for (size_t i = 0; i < simulators.size(); i++) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = i << 1;
+    epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, simulators[i]->masterDescriptor(), &event);
+    if (simulators[i]->timerDescriptor() != -1) {
+      event.data.u64 = (i << 1) | 1;
+      epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, simulators[i]->timerDescriptor(), &event);
+    }
+  }
+
+  auto lastStats = std::chrono::steady_clock::now();
+  epoll_event events[64];
+  while (!stopRequested) {
+    int32_t eventCount = epoll_wait(epollDescriptor, events, 64, 1000);
+    for (int32_t i = 0; i < eventCount; i++) {
+      size_t index = events[i].data.u64 >> 1;
+      auto &simulator = simulators[index];
+      if (events[i].data.u64 & 1) simulator->processTimer();
+      else {
+        if (events[i].events & EPOLLOUT) simulator->processOutput();
+        if (events[i].events & EPOLLIN) simulator->processInput();
+      }
+
+      if (simulator->outputPending() != pollingOutput[index]) {
+        pollingOutput[index] = simulator->outputPending();
+        epoll_event event{};
+        event.events = EPOLLIN | (pollingOutput[index] ? (uint32_t)EPOLLOUT : 0u);
+        event.data.u64 = index << 1;
+        epoll_ctl(epollDescriptor, EPOLL_CTL_MOD, simulator->masterDescriptor(), &event);
+      }
+    }
+
+    if (statsInterval > 0 && std::chrono::steady_clock::now() - lastStats >= std::chrono::seconds(statsInterval)) {
+      lastStats = std::chrono::steady_clock::now();
+      printStats(simulators);
+    }
+  }
+
+  close(epollDescriptor);
+  printStats(simulators);
+  simulators.clear();
+  return 0;
+}
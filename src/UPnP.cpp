@@ -29,6 +29,7 @@
 
 #include "UPnP.h"
 #include "Gd.h"
+#include "IoBackend.h"
 #include "../config.h"
 
 #include <arpa/inet.h>
@@ -57,7 +58,8 @@ void UPnP::start() {
     stop();
 
     _stopServer = false;
-    Gd::bl->threadManager.start(_listenThread, true, &UPnP::listen, this);
+    if (Gd::eventLoop) registerWithEventLoop();
+    else Gd::bl->threadManager.start(_listenThread, true, &UPnP::listen, this);
   }
   catch (const std::exception &ex) {
     Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
@@ -68,6 +70,12 @@ void UPnP::stop() {
   try {
     if (_stopServer) return;
     _stopServer = true;
+    if (Gd::eventLoop) {
+      unregisterFromEventLoop();
+      sendByebye();
+      Gd::bl->fileDescriptorManager.shutdown(_serverSocketDescriptor);
+      return;
+    }
     Gd::bl->threadManager.join(_listenThread);
     sendByebye();
   }
@@ -101,10 +109,12 @@ void UPnP::listen() {
     int32_t bytesReceived = 0;
     struct sockaddr_in si_other{};
     socklen_t slen = sizeof(si_other);
-    fd_set readFileDescriptor;
-    timeval timeout{};
-    int32_t nfds = 0;
     BaseLib::Http http;
+    std::unique_ptr<IoBackend> ioBackend = IoBackend::create(Gd::bl.get());
+    if (!ioBackend) {
+      Gd::out.printError("Error in UPnP Server: Could not create I/O backend.");
+      return;
+    }
     while (!_stopServer) {
       try {
         if (!_serverSocketDescriptor || _serverSocketDescriptor->descriptor == -1) {
@@ -117,29 +127,15 @@ void UPnP::listen() {
           continue;
         }
 
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 100000;
-        FD_ZERO(&readFileDescriptor);
-        {
-          auto fileDescriptorGuard = Gd::bl->fileDescriptorManager.getLock();
-          fileDescriptorGuard.lock();
-          nfds = _serverSocketDescriptor->descriptor + 1;
-          if (nfds <= 0) {
-            fileDescriptorGuard.unlock();
-            Gd::out.printError("Error in UPnP Server: Socket closed (1).");
-            Gd::bl->fileDescriptorManager.shutdown(_serverSocketDescriptor);
-          }
-          FD_SET(_serverSocketDescriptor->descriptor, &readFileDescriptor);
-        }
-
-        bytesReceived = select(nfds, &readFileDescriptor, nullptr, nullptr, &timeout);
+        bytesReceived = ioBackend->poll(_serverSocketDescriptor, POLLIN, 100);
         if (bytesReceived == 0) {
           if (BaseLib::HelperFunctions::getTimeSeconds() - _lastAdvertisement >= 60) sendNotify();
           continue;
         }
-        if (bytesReceived != 1) {
-          Gd::out.printError("Error in UPnP Server: Socket closed (2).");
+        if (bytesReceived < 0 || !(ioBackend->polledEvents() & POLLIN)) {
+          Gd::out.printError("Error in UPnP Server: Socket closed.");
           Gd::bl->fileDescriptorManager.shutdown(_serverSocketDescriptor);
+          continue;
         }
 
         bytesReceived = recvfrom(_serverSocketDescriptor->descriptor, buffer, 1024, 0, (struct sockaddr *)&si_other, &slen);
@@ -159,6 +155,85 @@ void UPnP::listen() {
   Gd::bl->fileDescriptorManager.shutdown(_serverSocketDescriptor);
 }
 
+void UPnP::addEventLoopTimer(int32_t delay, int32_t interval, std::function<void()> callback) {
+  try {
+    auto timerId = std::make_shared<int32_t>(-1);
+    std::lock_guard<std::mutex> eventLoopTimersGuard(_eventLoopTimersMutex);
+    *timerId = Gd::eventLoop->addTimer(delay, interval, [this, timerId, interval, callback]() {
+      if (interval == 0) {
+        std::lock_guard<std::mutex> eventLoopTimersGuard(_eventLoopTimersMutex);
+        _eventLoopTimers.erase(*timerId);
+      }
+      callback();
+    });
+    if (*timerId != -1) _eventLoopTimers.insert(*timerId);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void UPnP::registerWithEventLoop() {
+  try {
+    if (_stopServer) return;
+    _serverSocketDescriptor = getSocketDescriptor();
+    if (!_serverSocketDescriptor || _serverSocketDescriptor->descriptor == -1) {
+      Gd::out.printWarning("Warning: Could not bind UPnP socket.");
+      addEventLoopTimer(5000, 0, [this]() { registerWithEventLoop(); });
+      return;
+    }
+
+    Gd::out.printInfo("Info: UPnP server started listening.");
+    sendNotify();
+    Gd::eventLoop->addDescriptor(_serverSocketDescriptor->descriptor, POLLIN, [this](int32_t fileDescriptor, uint32_t events) { processSocketEvent(events); });
+    addEventLoopTimer(60000, 60000, [this]() { sendNotify(); });
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void UPnP::unregisterFromEventLoop() {
+  try {
+    std::set<int32_t> eventLoopTimers;
+    {
+      std::lock_guard<std::mutex> eventLoopTimersGuard(_eventLoopTimersMutex);
+      eventLoopTimers.swap(_eventLoopTimers);
+    }
+    for (auto timerId : eventLoopTimers) {
+      Gd::eventLoop->removeTimer(timerId);
+    }
+    if (_serverSocketDescriptor) Gd::eventLoop->removeDescriptor(_serverSocketDescriptor->descriptor);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
+void UPnP::processSocketEvent(uint32_t events) {
+  try {
+    if (!(events & POLLIN)) {
+      Gd::out.printError("Error in UPnP Server: Socket closed.");
+      unregisterFromEventLoop();
+      Gd::bl->fileDescriptorManager.shutdown(_serverSocketDescriptor);
+      addEventLoopTimer(5000, 0, [this]() { registerWithEventLoop(); });
+      return;
+    }
+
+    char buffer[1024];
+    struct sockaddr_in si_other{};
+    socklen_t slen = sizeof(si_other);
+    int32_t bytesReceived = recvfrom(_serverSocketDescriptor->descriptor, buffer, 1024, 0, (struct sockaddr *)&si_other, &slen);
+    if (bytesReceived <= 0) return;
+    BaseLib::Http http;
+    http.process(buffer, bytesReceived, false);
+    if (http.isFinished()) processPacket(http);
+  }
+  catch (const std::exception &ex) {
+    Gd::out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+  }
+}
+
 void UPnP::processPacket(BaseLib::Http &http) {
   try {
     BaseLib::Http::Header &header = http.getHeader();
@@ -173,6 +248,16 @@ void UPnP::processPacket(BaseLib::Http &http) {
       if (!address.first.empty() && port > 0) {
         int32_t mx = 500;
         if (header.fields.find("mx") != header.fields.end()) mx = BaseLib::Math::getNumber(header.fields.at("mx"), false) * 1000;
+        if (Gd::eventLoop) {
+          //Don't block the event loop. Schedule the response instead.
+          int32_t delay = 20;
+          if (mx > 500) delay += BaseLib::HelperFunctions::getRandomNumber(0, mx - 500);
+          bool rootDeviceOnly = header.fields.at("st") == "upnp:rootdevice";
+          std::string ipAddress = address.first;
+          addEventLoopTimer(delay, 0, [this, ipAddress, port, rootDeviceOnly]() { sendOK(ipAddress, port, rootDeviceOnly); });
+          addEventLoopTimer(delay + 100, 0, [this]() { sendNotify(); });
+          return;
+        }
         std::this_thread::sleep_for(std::chrono::milliseconds(20));
         //Wait for 0 to mx seconds for load balancing
         if (mx > 500) {
@@ -193,9 +278,16 @@ void UPnP::processPacket(BaseLib::Http &http) {
 
 void UPnP::setPackets() {
   try {
+    //HG-FAMILY-ID contains the first family for compatibility. HG-FAMILY-IDS lists all families of multi-radio gateways.
+    std::string familyIds;
+    for (auto familyId : Gd::rpcServer->familyIds()) {
+      if (!familyIds.empty()) familyIds.push_back(',');
+      familyIds.append(std::to_string(familyId));
+    }
+
     std::string notifyPacketBase =
         "NOTIFY * HTTP/1.1\r\nHOST: 239.255.255.250:1900\r\nCACHE-CONTROL: max-age=1800\r\nSERVER: Homegear Gateway " + std::string(VERSION) + "\r\nLOCATION: " + "binrpcs://" + _address + ":" + std::to_string(Gd::settings.port())
-            + "/\r\nHG-FAMILY-ID: " + std::to_string(Gd::rpcServer->familyId()) + "\r\nHG-GATEWAY-CONFIGURED: " + (Gd::rpcServer->isUnconfigured() ? "0" : "1") + "\r\nHG-GATEWAY-PORT-UNCONFIGURED: " + std::to_string(Gd::settings.portUnconfigured())
+            + "/\r\nHG-FAMILY-ID: " + std::to_string(Gd::rpcServer->familyId()) + "\r\nHG-FAMILY-IDS: " + familyIds + "\r\nHG-GATEWAY-CONFIGURED: " + (Gd::rpcServer->isUnconfigured() ? "0" : "1") + "\r\nHG-GATEWAY-PORT-UNCONFIGURED: " + std::to_string(Gd::settings.portUnconfigured())
             + "\r\n";
     std::string alivePacketRoot = notifyPacketBase + "NT: upnp:rootdevice\r\nUSN: " + _st + "::upnp:rootdevice\r\nNTS: ssdp:alive\r\n\r\n";
     std::string alivePacketRootUUID = notifyPacketBase + "NT: " + _st + "\r\nUSN: " + _st + "\r\nNTS: ssdp:alive\r\n\r\n";
@@ -213,7 +305,7 @@ void UPnP::setPackets() {
 
     std::string okPacketBase =
         std::string("HTTP/1.1 200 OK\r\nCache-Control: max-age=1800\r\nLocation: ") + "binrpcs://" + _address + ":" + std::to_string(Gd::settings.port()) + "/\r\nServer: Homegear Gateway " + std::string(VERSION) + "\r\nHG-Family-ID: "
-            + std::to_string(Gd::rpcServer->familyId()) + "\r\nHG-Gateway-Configured: " + (Gd::rpcServer->isUnconfigured() ? "0" : "1") + "\r\nHG-Gateway-Port-Unconfigured: " + std::to_string(Gd::settings.portUnconfigured()) + "\r\n";
+            + std::to_string(Gd::rpcServer->familyId()) + "\r\nHG-Family-IDs: " + familyIds + "\r\nHG-Gateway-Configured: " + (Gd::rpcServer->isUnconfigured() ? "0" : "1") + "\r\nHG-Gateway-Port-Unconfigured: " + std::to_string(Gd::settings.portUnconfigured()) + "\r\n";
     std::string okPacketRoot = okPacketBase + "ST: upnp:rootdevice\r\nUSN: " + _st + "::upnp:rootdevice\r\n\r\n";
     std::string okPacketRootUUID = okPacketBase + "ST: " + _st + "\r\nUSN: " + _st + "\r\n\r\n";
     std::string okPacket = okPacketBase + "ST: urn:schemas-upnp-org:device:basic:1\r\nUSN: " + _st + "\r\n\r\n";
@@ -235,6 +327,7 @@ void UPnP::sendOK(std::string destinationIpAddress, int32_t destinationPort, boo
     addessInfo.sin_port = htons(destinationPort);
 
     if (Gd::bl->debugLevel >= 5) Gd::out.printDebug("Debug: Sending discovery response packets to " + destinationIpAddress + " on port " + std::to_string(destinationPort));
+    Metrics::add(Counter::upnpResponses, -1);
     if (sendto(_serverSocketDescriptor->descriptor, _packets.okRoot.data(), _packets.okRoot.size(), 0, (struct sockaddr *)&addessInfo, sizeof(addessInfo)) == -1) {
       Gd::out.printWarning("Warning: Error sending packet in UPnP server: " + std::string(strerror(errno)));
     }
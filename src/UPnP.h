@@ -63,9 +63,16 @@ private:
 	Packets _packets;
 	int32_t _lastAdvertisement = 0;
 
+	std::mutex _eventLoopTimersMutex;
+	std::set<int32_t> _eventLoopTimers;
+
 	void getAddress();
     std::shared_ptr<BaseLib::FileDescriptor> getSocketDescriptor();
 	void listen();
+	void addEventLoopTimer(int32_t delay, int32_t interval, std::function<void()> callback);
+	void registerWithEventLoop();
+	void unregisterFromEventLoop();
+	void processSocketEvent(uint32_t events);
 	void processPacket(BaseLib::Http& http);
 	void sendOK(std::string destinationIpAddress, int32_t destinationPort, bool rootDeviceOnly);
 	void sendNotify();
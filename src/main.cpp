@@ -29,8 +29,12 @@
 */
 
 #include "Gd.h"
+#include "LatencyTest.h"
+#include "RealTime.h"
+#include "Families/SerialLowLatency.h"
 
 #include <iostream>
+#include <cmath>
 
 #include <malloc.h>
 #include <sys/prctl.h> //For function prctl
@@ -52,6 +56,9 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 
 bool _startAsDaemon = false;
 bool _txTestMode = false;
+int32_t _latencyTestDuration = 0;
+std::string _replayFile;
+double _replaySpeed = 1;
 std::mutex _shuttingDownMutex;
 std::atomic_bool _startUpComplete;
 std::atomic_bool _shutdownQueued;
@@ -83,14 +90,22 @@ void terminateProgram(int signalNumber, bool force)
         Gd::out.printMessage("(Shutdown) => Stopping Homegear Gateway (Signal: " + std::to_string(signalNumber) + ")");
         Gd::bl->shuttingDown = true;
         _shuttingDownMutex.unlock();
+        Gd::flightRecorder.record(FlightRecorder::Event::state, -1, "Shutdown (signal " + std::to_string(signalNumber) + ")");
+        Gd::flightRecorder.stopWatchdog();
         _disposing = true;
         if(Gd::upnp)
         {
             Gd::out.printInfo("Stopping UPnP server...");
             Gd::upnp->stop();
         }
+        if(Gd::metricsServer) Gd::metricsServer->stop();
+        if(Gd::frameReplay) Gd::frameReplay->stop();
+        if(Gd::clockSync) Gd::clockSync->stop();
         Gd::rpcServer->stop();
         Gd::rpcServer.reset();
+        if(Gd::frameCapture) Gd::frameCapture->stop();
+        if(Gd::eventLoop) Gd::eventLoop->stop();
+        Gd::asyncLog.stop();
 
         Gd::out.printMessage("(Shutdown) => Shutdown complete.");
         fclose(stdout);
@@ -112,17 +127,15 @@ void terminateProgram(int signalNumber, bool force)
 
 void signalHandlerThread()
 {
+    RealTime::apply(RealTime::Subsystem::signal);
+
     sigset_t set{};
     int signalNumber = -1;
     sigemptyset(&set);
     sigaddset(&set, SIGHUP);
     sigaddset(&set, SIGTERM);
     sigaddset(&set, SIGINT);
-    sigaddset(&set, SIGABRT);
-    sigaddset(&set, SIGSEGV);
     sigaddset(&set, SIGQUIT);
-    sigaddset(&set, SIGILL);
-    sigaddset(&set, SIGFPE);
     sigaddset(&set, SIGALRM);
     sigaddset(&set, SIGUSR1);
     sigaddset(&set, SIGUSR2);
@@ -175,14 +188,10 @@ void signalHandlerThread()
             else if(signalNumber == SIGUSR1 && _stopMain) return;
             else
             {
+                //Fatal signals (SIGSEGV, SIGABRT, ...) are handled by FlightRecorder, which also generates the core dump.
                 if(!_disposing) Gd::out.printCritical("Critical: Signal " + std::to_string(signalNumber) + " received. Stopping Homegear Gateway...");
-                if(signalNumber != SIGABRT && signalNumber != SIGSEGV)
-                {
-                    terminateProgram(signalNumber, false);
-                    return;
-                }
-                signal(signalNumber, SIG_DFL); //Reset signal handler for the current signal to default
-                kill(getpid(), signalNumber); //Generate core dump
+                terminateProgram(signalNumber, false);
+                return;
             }
         }
         catch(const std::exception& ex)
@@ -301,6 +310,58 @@ void printHelp()
 	std::cout << "-d                  Run as daemon" << std::endl;
 	std::cout << "-p <pid path>       Specify path to process id file" << std::endl;
 	std::cout << "-v                  Print program version" << std::endl;
+	std::cout << "--dispatchbenchmark Measure the cost of resolving and dispatching RPC methods" << std::endl;
+	std::cout << "--latencytest [<s>] Measure the receive path jitter under synthetic CPU and IO load (default: 10 s per phase)" << std::endl;
+	std::cout << "--replay <file>     Replay the received frames of a capture file instead of opening the devices" << std::endl;
+	std::cout << "--replayspeed <n>   Replay speed factor. \"max\" replays as fast as possible (default: 1)" << std::endl;
+}
+
+void dispatchBenchmark()
+{
+    //Compares the former std::map<std::string, std::function> lookup with the compile-time method table.
+    const int32_t iterations = 1000000;
+    auto parameters = std::make_shared<BaseLib::Array>();
+    auto result = std::make_shared<BaseLib::Variable>();
+    std::function<BaseLib::PVariable(BaseLib::PArray&)> function = [&](BaseLib::PArray& parameters) { return result; };
+
+    std::vector<std::string> methodNames;
+    std::map<std::string, std::function<BaseLib::PVariable(BaseLib::PArray&)>> methodMap;
+    std::array<std::function<BaseLib::PVariable(BaseLib::PArray&)>, RpcMethods::size> methodTable;
+    for(auto& entry : RpcMethods::table)
+    {
+        methodNames.emplace_back(entry.first);
+        methodMap.emplace(std::string(entry.first), function);
+        methodTable[(size_t)entry.second] = function;
+    }
+
+    size_t calls = 0;
+    auto startTime = std::chrono::steady_clock::now();
+    for(int32_t i = 0; i < iterations; i++)
+    {
+        auto methodIterator = methodMap.find(methodNames[i % methodNames.size()]);
+        if(methodIterator != methodMap.end() && methodIterator->second(parameters)) calls++;
+    }
+    double mapTime = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() / iterations;
+
+    startTime = std::chrono::steady_clock::now();
+    for(int32_t i = 0; i < iterations; i++)
+    {
+        RpcMethod method = RpcMethods::getId(methodNames[i % methodNames.size()]);
+        if(method != RpcMethod::unknown && methodTable[(size_t)method](parameters)) calls++;
+    }
+    double tableTime = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() / iterations;
+
+    startTime = std::chrono::steady_clock::now();
+    for(int32_t i = 0; i < iterations; i++)
+    {
+        if(methodTable[i % RpcMethods::size](parameters)) calls++;
+    }
+    double idTime = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count() / iterations;
+
+    std::cout << "Dispatched " << calls << " calls (" << RpcMethods::size << " methods, " << iterations << " iterations per variant)." << std::endl;
+    std::cout << "std::map lookup by name:     " << mapTime << " ns/call" << std::endl;
+    std::cout << "Method table lookup by name: " << tableTime << " ns/call" << std::endl;
+    std::cout << "Dispatch by method ID:       " << idTime << " ns/call" << std::endl;
 }
 
 void startDaemon()
@@ -352,11 +413,7 @@ void startUp()
             sigaddset(&set, SIGHUP);
             sigaddset(&set, SIGTERM);
             sigaddset(&set, SIGINT);
-            sigaddset(&set, SIGABRT);
-            sigaddset(&set, SIGSEGV);
             sigaddset(&set, SIGQUIT);
-            sigaddset(&set, SIGILL);
-            sigaddset(&set, SIGFPE);
             sigaddset(&set, SIGALRM);
             sigaddset(&set, SIGUSR1);
             sigaddset(&set, SIGUSR2);
@@ -371,6 +428,8 @@ void startUp()
     	initGnuTls();
 
 		setLimits();
+		RealTime::init();
+		Gd::flightRecorder.init(Gd::settings.dataPath());
 
         Gd::bl->threadManager.start(_signalHandlerThread, true, &signalHandlerThread);
 
@@ -384,6 +443,7 @@ void startUp()
         }
 
         Gd::out.printMessage("Starting Homegear Gateway...");
+        if(Gd::settings.asyncLogging()) Gd::asyncLog.start(Gd::bl.get());
 
         if(Gd::runAsUser.empty()) Gd::runAsUser = Gd::settings.runAsUser();
         if(Gd::runAsGroup.empty()) Gd::runAsGroup = Gd::settings.runAsGroup();
@@ -407,13 +467,25 @@ void startUp()
             }
         }
 
+		//{{{ Lower latency timer of USB serial adapters (needs root)
+		if(getuid() == 0 && Gd::settings.serialLowLatency() && _replayFile.empty())
+		{
+			for(auto& interfaceSettings : Gd::settings.interfaces())
+			{
+				if(!interfaceSettings.device.empty()) SerialLowLatency::setLatencyTimer(interfaceSettings.device);
+			}
+		}
+		//}}}
+
 		//{{{ Export GPIOs
-		if(getuid() == 0 && (Gd::settings.gpio1() != -1 || Gd::settings.gpio2() != -1))
+		if(getuid() == 0 && _replayFile.empty())
 		{
 			std::vector<uint32_t> gpios;
-			gpios.reserve(2);
-			if(Gd::settings.gpio1() != -1) gpios.push_back(Gd::settings.gpio1());
-			if(Gd::settings.gpio2() != -1) gpios.push_back(Gd::settings.gpio2());
+			for(auto& interfaceSettings : Gd::settings.interfaces())
+			{
+				if(interfaceSettings.gpio1 != -1) gpios.push_back(interfaceSettings.gpio1);
+				if(interfaceSettings.gpio2 != -1) gpios.push_back(interfaceSettings.gpio2);
+			}
 			if(!gpios.empty())
 			{
 				BaseLib::LowLevel::Gpio gpio(Gd::bl.get(), Gd::settings.gpioPath());
@@ -581,6 +653,30 @@ void startUp()
             }
         }
 
+        if(Gd::settings.eventLoop())
+        {
+            Gd::eventLoop.reset(new EventLoop(Gd::bl.get()));
+            if(!Gd::eventLoop->init())
+            {
+                Gd::out.printError("Error: Could not initialize event loop. Falling back to dedicated threads.");
+                Gd::eventLoop.reset();
+            }
+        }
+
+        if(!_replayFile.empty())
+        {
+            //Must exist before the interfaces are created, so they don't open their devices.
+            Gd::frameReplay.reset(new FrameReplay(Gd::bl.get()));
+            if(!Gd::frameReplay->load(_replayFile))
+            {
+                Gd::out.printCritical("Critical: Could not load trace file " + _replayFile + ".");
+                exit(1);
+            }
+        }
+
+        Gd::frameCapture.reset(new FrameCapture(Gd::bl.get()));
+        if(Gd::settings.capture() && !Gd::frameReplay) Gd::frameCapture->start();
+
 		Gd::rpcServer.reset(new RpcServer(Gd::bl.get()));
 		if(!_shutdownQueued)
         {
@@ -591,7 +687,18 @@ void startUp()
             }
         }
 
+        Gd::clockSync.reset(new ClockSync(Gd::bl.get()));
+        if(!Gd::frameReplay) Gd::clockSync->start(Gd::settings.clockSyncInterval());
+
+        if(Gd::settings.metricsPort() > 0)
+        {
+            Gd::metricsServer.reset(new MetricsServer());
+            if(!Gd::metricsServer->start(Gd::settings.metricsPort())) Gd::metricsServer.reset();
+        }
+
         Gd::out.printMessage("Startup complete.");
+        Gd::flightRecorder.record(FlightRecorder::Event::state, -1, "Startup complete");
+        Gd::flightRecorder.startWatchdog(Gd::bl.get(), Gd::settings.watchdogTimeout());
 
 		if(Gd::settings.enableUpnp())
 		{
@@ -617,11 +724,25 @@ void startUp()
 			Gd::out.printError("Error: A core file exists in Homegear Gateway's working directory (\"" + Gd::settings.workingDirectory() + "core" + "\"). Please send this file to the Homegear team including information about your system (Linux distribution, CPU architecture), the Homegear Gateway version, the current log files and information what might've caused the error.");
 		}
 
+        if(Gd::frameReplay)
+        {
+            //Shut down when the trace was replayed. The results are written to the log.
+            Gd::frameReplay->start(_replaySpeed, []() { kill(getpid(), SIGTERM); });
+        }
+
         if(_txTestMode)
         {
             Gd::rpcServer->txTest();
         }
 
+        if(Gd::eventLoop)
+        {
+            RealTime::apply(RealTime::Subsystem::serial); //The event loop services the serial devices in this mode.
+            FlightRecorder::Watch watch("Event loop");
+            int32_t watchTimer = Gd::eventLoop->addTimer(1000, 1000, [&watch]() { watch.beat(); });
+            Gd::eventLoop->run();
+            Gd::eventLoop->removeTimer(watchTimer);
+        }
        	while(!_stopMain) std::this_thread::sleep_for(std::chrono::milliseconds(100));
 	}
 	catch(const std::exception& ex)
@@ -720,6 +841,66 @@ int main(int argc, char* argv[])
             else if(arg == "--txtest")
             {
                 _txTestMode = true;
+            }
+            else if(arg == "--replay")
+            {
+                if(i + 1 < argc)
+                {
+                    _replayFile = std::string(argv[i + 1]);
+                    if(!_replayFile.empty() && _replayFile.front() != '/') _replayFile = Gd::workingDirectory + '/' + _replayFile; //The working directory is changed on start up.
+                    i++;
+                }
+                else
+                {
+                    printHelp();
+                    exit(1);
+                }
+            }
+            else if(arg == "--replayspeed")
+            {
+                if(i + 1 < argc)
+                {
+                    std::string speed(argv[i + 1]);
+                    if(speed == "max") _replaySpeed = 0;
+                    else
+                    {
+                        //Reject anything that isn't a positive number. Otherwise a typo would silently mean "max".
+                        char* end = nullptr;
+                        errno = 0;
+                        _replaySpeed = std::strtod(speed.c_str(), &end);
+                        if(speed.empty() || errno != 0 || *end != 0 || !std::isfinite(_replaySpeed) || _replaySpeed <= 0)
+                        {
+                            std::cerr << "Invalid replay speed: " << speed << std::endl;
+                            printHelp();
+                            exit(1);
+                        }
+                    }
+                    i++;
+                }
+                else
+                {
+                    printHelp();
+                    exit(1);
+                }
+            }
+            else if(arg == "--dispatchbenchmark")
+            {
+                dispatchBenchmark();
+                exit(0);
+            }
+            else if(arg == "--latencytest")
+            {
+                _latencyTestDuration = 10;
+                if(i + 1 < argc && BaseLib::Math::isNumber(argv[i + 1]))
+                {
+                    _latencyTestDuration = BaseLib::Math::getNumber(argv[i + 1]);
+                    if(_latencyTestDuration <= 0)
+                    {
+                        printHelp();
+                        exit(1);
+                    }
+                    i++;
+                }
             }
     		else if(arg == "-v")
     		{
@@ -759,6 +940,15 @@ int main(int argc, char* argv[])
             exit(1);
 		}
 
+		if(_latencyTestDuration > 0)
+		{
+			//Uses the profiles from gateway.conf, but doesn't start the gateway.
+			RealTime::init();
+			LatencyTest latencyTest(Gd::bl.get());
+			latencyTest.run(_latencyTestDuration);
+			exit(0);
+		}
+
 		if(_startAsDaemon) startDaemon();
     	startUp();
 